@@ -164,7 +164,10 @@ HEADERS += src/qt/bitcoingui.h \
     src/qt/bitcoinaddressvalidator.h \
     src/qt/serveur.h \
     src/alert.h \
+    src/bloom.h \
     src/addrman.h \
+    src/addrindex.h \
+    src/spentindex.h \
     src/base58.h \
     src/bignum.h \
     src/checkpoints.h \
@@ -182,6 +185,9 @@ HEADERS += src/qt/bitcoingui.h \
     src/net.h \
     src/key.h \
     src/db.h \
+    src/download.h \
+    src/stratum.h \
+    src/eventserver.h \
     src/walletdb.h \
     src/script.h \
     src/init.h \
@@ -239,6 +245,8 @@ HEADERS += src/qt/bitcoingui.h \
     src/rca/sph_types.h \
     src/qt/macnotificationhandler.h \
     src/qt/blockbrowser.h \
+    src/qt/coincontrolmodel.h \
+    src/qt/modelworker.h \
     src/qt/trafficgraphwidget.h \
     src/qt/winshutdownmonitor.h \
     src/qt/splitthresholdfield.h
@@ -257,6 +265,7 @@ SOURCES += src/qt/bitcoin.cpp src/qt/bitcoingui.cpp \
     src/qt/bitcoinaddressvalidator.cpp \
     src/qt/chatwindow.cpp \
     src/alert.cpp \
+    src/bloom.cpp \
     src/version.cpp \
     src/sync.cpp \
     src/util.cpp \
@@ -269,7 +278,12 @@ SOURCES += src/qt/bitcoin.cpp src/qt/bitcoingui.cpp \
     src/irc.cpp \
     src/checkpoints.cpp \
     src/addrman.cpp \
+    src/addrindex.cpp \
+    src/spentindex.cpp \
     src/db.cpp \
+    src/download.cpp \
+    src/stratum.cpp \
+    src/eventserver.cpp \
     src/walletdb.cpp \
     src/qt/clientmodel.cpp \
     src/qt/guiutil.cpp \
@@ -307,6 +321,8 @@ SOURCES += src/qt/bitcoin.cpp src/qt/bitcoingui.cpp \
     src/qt/splashscreen.cpp \
     src/qt/rpcconsole.cpp \
     src/qt/blockbrowser.cpp \
+    src/qt/coincontrolmodel.cpp \
+    src/qt/modelworker.cpp \
     src/qt/trafficgraphwidget.cpp \
     src/qt/winshutdownmonitor.cpp \
     src/qt/splitthresholdfield.cpp \
@@ -0,0 +1,181 @@
+// Copyright (c) 2013 The DeOxyRibose developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/foreach.hpp>
+
+#include "addrindex.h"
+#include "db.h"
+#include "main.h"
+#include "ui_interface.h"
+
+using namespace std;
+
+bool fAddrIndex = false;
+
+bool CAddrIndexKey::Set(const CTxDestination& dest)
+{
+    if (const CKeyID* pkeyID = boost::get<CKeyID>(&dest))
+    {
+        nType = KEYID;
+        hash = *pkeyID;
+        return true;
+    }
+    if (const CScriptID* pscriptID = boost::get<CScriptID>(&dest))
+    {
+        nType = SCRIPTID;
+        hash = *pscriptID;
+        return true;
+    }
+    return false;
+}
+
+bool CAddrIndexKey::Set(const CScript& scriptPubKey)
+{
+    // Pay-to-pubkey outputs are indexed under the key's address
+    CTxDestination dest;
+    return ExtractDestination(scriptPubKey, dest) && Set(dest);
+}
+
+CTxDestination CAddrIndexKey::Get() const
+{
+    if (nType == KEYID)
+        return CKeyID(hash);
+    if (nType == SCRIPTID)
+        return CScriptID(hash);
+    return CNoDestination();
+}
+
+bool AddrIndexConnectBlock(CTxDB& txdb, const CBlock& block, const CBlockIndex* pindex)
+{
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+    {
+        uint256 hashTx = tx.GetHash();
+
+        if (!tx.IsCoinBase())
+        {
+            for (unsigned int i = 0; i < tx.vin.size(); i++)
+            {
+                CAddrIndexOut out;
+                if (!txdb.ReadAddrIndexOut(tx.vin[i].prevout, out))
+                    continue;
+                if (!txdb.WriteAddrIndexDelta(out.addr, CAddrIndexDelta(pindex->nHeight, hashTx, i, true, -out.nValue)) ||
+                    !txdb.EraseAddrIndexUnspent(tx.vin[i].prevout, out.addr))
+                    return error("AddrIndexConnectBlock() : failed to index input of %s", hashTx.ToString().c_str());
+            }
+        }
+
+        for (unsigned int i = 0; i < tx.vout.size(); i++)
+        {
+            CAddrIndexKey addr;
+            if (!addr.Set(tx.vout[i].scriptPubKey))
+                continue;
+            COutPoint outpoint(hashTx, i);
+            CAddrIndexOut out(addr, tx.vout[i].nValue, pindex->nHeight);
+            if (!txdb.WriteAddrIndexDelta(addr, CAddrIndexDelta(pindex->nHeight, hashTx, i, false, out.nValue)) ||
+                !txdb.WriteAddrIndexUnspent(outpoint, out) ||
+                !txdb.WriteAddrIndexOut(outpoint, out))
+                return error("AddrIndexConnectBlock() : failed to index output of %s", hashTx.ToString().c_str());
+        }
+    }
+    return txdb.WriteAddrIndexHeight(pindex->nHeight);
+}
+
+bool AddrIndexDisconnectBlock(CTxDB& txdb, const CBlock& block, const CBlockIndex* pindex)
+{
+    // Undo in reverse order, so outputs spent in the same block are removed last
+    for (int j = block.vtx.size() - 1; j >= 0; j--)
+    {
+        const CTransaction& tx = block.vtx[j];
+        uint256 hashTx = tx.GetHash();
+
+        for (unsigned int i = 0; i < tx.vout.size(); i++)
+        {
+            CAddrIndexKey addr;
+            if (!addr.Set(tx.vout[i].scriptPubKey))
+                continue;
+            COutPoint outpoint(hashTx, i);
+            if (!txdb.EraseAddrIndexDelta(addr, CAddrIndexDelta(pindex->nHeight, hashTx, i, false, 0)) ||
+                !txdb.EraseAddrIndexUnspent(outpoint, addr) ||
+                !txdb.EraseAddrIndexOut(outpoint))
+                return error("AddrIndexDisconnectBlock() : failed to remove output of %s", hashTx.ToString().c_str());
+        }
+
+        if (tx.IsCoinBase())
+            continue;
+        for (unsigned int i = 0; i < tx.vin.size(); i++)
+        {
+            CAddrIndexOut out;
+            if (!txdb.ReadAddrIndexOut(tx.vin[i].prevout, out))
+                continue;
+            if (!txdb.EraseAddrIndexDelta(out.addr, CAddrIndexDelta(pindex->nHeight, hashTx, i, true, 0)) ||
+                !txdb.WriteAddrIndexUnspent(tx.vin[i].prevout, out))
+                return error("AddrIndexDisconnectBlock() : failed to restore input of %s", hashTx.ToString().c_str());
+        }
+    }
+    return txdb.WriteAddrIndexHeight(pindex->nHeight - 1);
+}
+
+bool InitAddrIndex()
+{
+    fAddrIndex = GetBoolArg("-addrindex");
+
+    CTxDB txdb;
+    int nHeight = -1;
+    bool fHaveIndex = txdb.ReadAddrIndexHeight(nHeight);
+    if (!fAddrIndex)
+    {
+        // Blocks connected from now on aren't indexed, so what is there goes stale
+        if (fHaveIndex && !txdb.EraseAddrIndexHeight())
+            return error("InitAddrIndex() : failed to disable the address index");
+        return true;
+    }
+
+    if (!fHaveIndex || nHeight > nBestHeight)
+    {
+        printf("Wiping address index...\n");
+        if (!txdb.WipeAddrIndex())
+            return error("InitAddrIndex() : failed to wipe the address index");
+        nHeight = 0;        // the genesis coinbase is never connected
+    }
+    if (nHeight >= nBestHeight)
+        return true;
+
+    uiInterface.InitMessage(_("Building address index..."));
+    return BuildChainIndex(txdb, nHeight, AddrIndexConnectBlock, ADDRINDEX_BUILD_BATCH, "address index");
+}
+
+bool BuildChainIndex(CTxDB& txdb, int nHeight, IndexBlockFn fnIndexBlock, unsigned int nBatch, const char* pszName)
+{
+    printf("Building %s from height %d...\n", pszName, nHeight + 1);
+    int64 nStart = GetTimeMillis();
+
+    // Walk the best chain, a database transaction per batch of blocks
+    CBlockIndex* pindex = FindBlockByHeight(nHeight + 1);
+    while (pindex && !fRequestShutdown)
+    {
+        if (!txdb.TxnBegin())
+            return error("BuildChainIndex() : TxnBegin failed");
+        unsigned int nTx = 0;
+        while (pindex && nTx < nBatch)
+        {
+            CBlock block;
+            if (!block.ReadFromDisk(pindex) || !fnIndexBlock(txdb, block, pindex))
+            {
+                txdb.TxnAbort();
+                return error("BuildChainIndex() : failed to add block %d to the %s", pindex->nHeight, pszName);
+            }
+            nTx += block.vtx.size();
+            pindex = pindex->pnext;
+        }
+        if (!txdb.TxnCommit())
+            return error("BuildChainIndex() : TxnCommit failed");
+        if (pindex && pindex->nHeight / 10000 != nHeight / 10000)
+        {
+            nHeight = pindex->nHeight;
+            printf("%s built to height %d\n", pszName, nHeight - 1);
+        }
+    }
+    printf(" %s %15"PRI64d"ms\n", pszName, GetTimeMillis() - nStart);
+    return true;
+}
@@ -0,0 +1,123 @@
+// Copyright (c) 2013 The DeOxyRibose developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_ADDRINDEX_H
+#define BITCOIN_ADDRINDEX_H
+
+#include <vector>
+
+#include "serialize.h"
+#include "script.h"
+#include "uint256.h"
+
+class CBlock;
+class CBlockIndex;
+class CTxDB;
+
+/** Blocks are indexed in database transactions of about this many transactions while the index is built */
+static const unsigned int ADDRINDEX_BUILD_BATCH = 500;
+
+/** Whether the address index (-addrindex) is maintained */
+extern bool fAddrIndex;
+
+/** Address an output pays to: the hash of its key or of its P2SH script */
+class CAddrIndexKey
+{
+public:
+    enum
+    {
+        KEYID    = 1,
+        SCRIPTID = 2,
+    };
+
+    unsigned char nType;
+    uint160 hash;
+
+    CAddrIndexKey() : nType(0), hash(0) {}
+
+    bool Set(const CTxDestination& dest);
+    bool Set(const CScript& scriptPubKey);
+    CTxDestination Get() const;
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(nType);
+        READWRITE(hash);
+    )
+
+    friend bool operator<(const CAddrIndexKey& a, const CAddrIndexKey& b)
+    {
+        return a.nType < b.nType || (a.nType == b.nType && a.hash < b.hash);
+    }
+};
+
+/** Output credited to an address, looked up when it is spent */
+class CAddrIndexOut
+{
+public:
+    CAddrIndexKey addr;
+    int64 nValue;
+    int nHeight;
+
+    CAddrIndexOut() : nValue(0), nHeight(0) {}
+    CAddrIndexOut(const CAddrIndexKey& addrIn, int64 nValueIn, int nHeightIn) : addr(addrIn), nValue(nValueIn), nHeight(nHeightIn) {}
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(addr);
+        READWRITE(nValue);
+        READWRITE(nHeight);
+    )
+};
+
+/** One entry of an address' history: an output paying it, or an input spending such an output */
+class CAddrIndexDelta
+{
+public:
+    int nHeight;
+    uint256 txid;
+    unsigned int n;         // output index, or input index when fSpend
+    bool fSpend;
+    int64 nValue;           // negative when fSpend
+
+    CAddrIndexDelta() : nHeight(0), txid(0), n(0), fSpend(false), nValue(0) {}
+    CAddrIndexDelta(int nHeightIn, const uint256& txidIn, unsigned int nIn, bool fSpendIn, int64 nValueIn)
+        : nHeight(nHeightIn), txid(txidIn), n(nIn), fSpend(fSpendIn), nValue(nValueIn) {}
+};
+
+/** Unspent output of an address */
+class CAddrIndexUnspent
+{
+public:
+    uint256 txid;
+    unsigned int n;
+    int64 nValue;
+    int nHeight;
+
+    CAddrIndexUnspent() : txid(0), n(0), nValue(0), nHeight(0) {}
+};
+
+/** Index the outputs block pays and the indexed outputs it spends */
+bool AddrIndexConnectBlock(CTxDB& txdb, const CBlock& block, const CBlockIndex* pindex);
+
+/** Undo AddrIndexConnectBlock while block is disconnected */
+bool AddrIndexDisconnectBlock(CTxDB& txdb, const CBlock& block, const CBlockIndex* pindex);
+
+/** Indexes a block of the best chain while an index is built, see BuildChainIndex */
+typedef bool (*IndexBlockFn)(CTxDB& txdb, const CBlock& block, const CBlockIndex* pindex);
+
+/**
+ * Index the best chain from height nHeight + 1 on with fnIndexBlock, a database
+ * transaction per batch of about nBatch transactions.  Builds the address and
+ * spent indexes, pszName names the index in the log.
+ */
+bool BuildChainIndex(CTxDB& txdb, int nHeight, IndexBlockFn fnIndexBlock, unsigned int nBatch, const char* pszName);
+
+/**
+ * Bring the index up to the best chain at startup: build it when -addrindex
+ * was just turned on, resuming an interrupted build, or mark it stale when
+ * -addrindex was turned off.
+ */
+bool InitAddrIndex();
+
+#endif
@@ -130,6 +130,7 @@ string CRPCTable::help(string strCommand) const
 {
     string strRet;
     set<rpcfn_type> setDone;
+    set<rpcstreamfn_type> setStreamDone;
     for (map<string, const CRPCCommand*>::const_iterator mi = mapCommands.begin(); mi != mapCommands.end(); ++mi)
     {
         const CRPCCommand *pcmd = mi->second;
@@ -142,6 +143,14 @@ string CRPCTable::help(string strCommand) const
         try
         {
             Array params;
+            if (pcmd->streamActor)
+            {
+                std::ostringstream ss;
+                CJSONWriter writer(ss);
+                if (setStreamDone.insert(pcmd->streamActor).second)
+                    (*pcmd->streamActor)(params, true, writer);
+                continue;
+            }
             rpcfn_type pfn = pcmd->actor;
             if (setDone.insert(pfn).second)
                 (*pfn)(params, true);
@@ -199,78 +208,87 @@ Value stop(const Array& params, bool fHelp)
 
 
 static const CRPCCommand vRPCCommands[] =
-{ //  name                      function                 safemd  unlocked
-  //  ------------------------  -----------------------  ------  --------
-    { "help",                   &help,                   true,   true },
-    { "stop",                   &stop,                   true,   true },
-    { "getblockcount",          &getblockcount,          true,   false },
-    { "getconnectioncount",     &getconnectioncount,     true,   false },
-    { "getpeerinfo",            &getpeerinfo,            true,   false },
-    { "getdifficulty",          &getdifficulty,          true,   false },
-    { "getgenerate",            &getgenerate,            true,   false },
-    { "setgenerate",            &setgenerate,            true,   false },
-    { "gethashespersec",        &gethashespersec,        true,   false },
-	{ "getnettotals",           &getnettotals,           true,      true },
-    { "getinfo",                &getinfo,                true,   false },
-    { "getmininginfo",          &getmininginfo,          true,   false },
-    { "getnewaddress",          &getnewaddress,          true,   false },
-    { "getnewpubkey",           &getnewpubkey,           true,   false },
-    { "getaccountaddress",      &getaccountaddress,      true,   false },
-    { "setaccount",             &setaccount,             true,   false },
-    { "getaccount",             &getaccount,             false,  false },
-    { "getaddressesbyaccount",  &getaddressesbyaccount,  true,   false },
-    { "sendtoaddress",          &sendtoaddress,          false,  false },
-    { "getreceivedbyaddress",   &getreceivedbyaddress,   false,  false },
-    { "getreceivedbyaccount",   &getreceivedbyaccount,   false,  false },
-    { "listreceivedbyaddress",  &listreceivedbyaddress,  false,  false },
-    { "listreceivedbyaccount",  &listreceivedbyaccount,  false,  false },
-    { "backupwallet",           &backupwallet,           true,   false },
-    { "keypoolrefill",          &keypoolrefill,          true,   false },
-    { "walletpassphrase",       &walletpassphrase,       true,   false },
-    { "walletpassphrasechange", &walletpassphrasechange, false,  false },
-    { "walletlock",             &walletlock,             true,   false },
-    { "encryptwallet",          &encryptwallet,          false,  false },
-    { "validateaddress",        &validateaddress,        true,   false },
-    { "validatepubkey",         &validatepubkey,         true,   false },
-    { "getbalance",             &getbalance,             false,  false },
-    { "move",                   &movecmd,                false,  false },
-    { "sendfrom",               &sendfrom,               false,  false },
-    { "sendmany",               &sendmany,               false,  false },
-    { "addmultisigaddress",     &addmultisigaddress,     false,  false },
-    { "getrawmempool",          &getrawmempool,          true,   false },
-    { "getblock",               &getblock,               false,  false },
-    { "getblockbynumber",       &getblockbynumber,       false,  false },
-    { "getblockhash",           &getblockhash,           false,  false },
-    { "gettransaction",         &gettransaction,         false,  false },
-	{ "getstaketx",             &getstaketx,             false,  false },
-    { "listtransactions",       &listtransactions,       false,  false },
-    { "listaddressgroupings",   &listaddressgroupings,   false,  false },
-    { "signmessage",            &signmessage,            false,  false },
-    { "verifymessage",          &verifymessage,          false,  false },
-    { "getwork",                &getwork,                true,   false },
-    { "getworkex",              &getworkex,              true,   false },
-    { "listaccounts",           &listaccounts,           false,  false },
-    { "settxfee",               &settxfee,               false,  false },
-    { "getblocktemplate",       &getblocktemplate,       true,   false },
-    { "submitblock",            &submitblock,            false,  false },
-    { "listsinceblock",         &listsinceblock,         false,  false },
-    { "dumpprivkey",            &dumpprivkey,            false,  false },
-	{ "dumpwallet",             &dumpwallet,             true,   false },
-    { "importprivkey",          &importprivkey,          false,  false },
-	{ "importwallet",           &importwallet,           false,  false },
-    { "listunspent",            &listunspent,            false,  false },
-    { "getrawtransaction",      &getrawtransaction,      false,  false },
-    { "createrawtransaction",   &createrawtransaction,   false,  false },
-    { "decoderawtransaction",   &decoderawtransaction,   false,  false },
-    { "signrawtransaction",     &signrawtransaction,     false,  false },
-    { "sendrawtransaction",     &sendrawtransaction,     false,  false },
-    { "getcheckpoint",          &getcheckpoint,          true,   false },
-    { "reservebalance",         &reservebalance,         false,  true},
-    { "checkwallet",            &checkwallet,            false,  true},
-    { "repairwallet",           &repairwallet,           false,  true},
-    { "resendtx",               &resendtx,               false,  true},
-    { "makekeypair",            &makekeypair,            false,  true},
-    { "sendalert",              &sendalert,              false,  false},
+{ //  name                      function                 safemd  unlocked  parallel  streamed function
+  //  ------------------------  -----------------------  ------  --------  --------  -----------------
+    { "help",                   &help,                   true,   true,     false,    NULL },
+    { "stop",                   &stop,                   true,   true,     false,    NULL },
+    { "getblockcount",          &getblockcount,          true,   true,     true,     NULL },
+    { "getconnectioncount",     &getconnectioncount,     true,   false,    false,    NULL },
+    { "getpeerinfo",            &getpeerinfo,            true,   false,    false,    NULL },
+    { "getdifficulty",          &getdifficulty,          true,   false,    false,    NULL },
+    { "getgenerate",            &getgenerate,            true,   false,    false,    NULL },
+    { "setgenerate",            &setgenerate,            true,   false,    false,    NULL },
+    { "gethashespersec",        &gethashespersec,        true,   false,    false,    NULL },
+    { "getnettotals",           &getnettotals,           true,   true,     false,    NULL },
+    { "getinfo",                &getinfo,                true,   false,    false,    NULL },
+    { "getmininginfo",          &getmininginfo,          true,   false,    false,    NULL },
+    { "getnewaddress",          &getnewaddress,          true,   false,    false,    NULL },
+    { "getnewpubkey",           &getnewpubkey,           true,   false,    false,    NULL },
+    { "getaccountaddress",      &getaccountaddress,      true,   false,    false,    NULL },
+    { "setaccount",             &setaccount,             true,   false,    false,    NULL },
+    { "getaccount",             &getaccount,             false,  false,    false,    NULL },
+    { "getaddressesbyaccount",  &getaddressesbyaccount,  true,   false,    false,    NULL },
+    { "sendtoaddress",          &sendtoaddress,          false,  false,    false,    NULL },
+    { "getreceivedbyaddress",   &getreceivedbyaddress,   false,  false,    false,    NULL },
+    { "getreceivedbyaccount",   &getreceivedbyaccount,   false,  false,    false,    NULL },
+    { "listreceivedbyaddress",  &listreceivedbyaddress,  false,  false,    false,    NULL },
+    { "listreceivedbyaccount",  &listreceivedbyaccount,  false,  false,    false,    NULL },
+    { "backupwallet",           &backupwallet,           true,   false,    false,    NULL },
+    { "keypoolrefill",          &keypoolrefill,          true,   false,    false,    NULL },
+    { "walletpassphrase",       &walletpassphrase,       true,   false,    false,    NULL },
+    { "walletpassphrasechange", &walletpassphrasechange, false,  false,    false,    NULL },
+    { "walletlock",             &walletlock,             true,   false,    false,    NULL },
+    { "encryptwallet",          &encryptwallet,          false,  false,    false,    NULL },
+    { "validateaddress",        &validateaddress,        true,   true,     true,     NULL },
+    { "validatepubkey",         &validatepubkey,         true,   false,    false,    NULL },
+    { "getbalance",             &getbalance,             false,  false,    false,    NULL },
+    { "move",                   &movecmd,                false,  false,    false,    NULL },
+    { "sendfrom",               &sendfrom,               false,  false,    false,    NULL },
+    { "sendmany",               &sendmany,               false,  false,    false,    NULL },
+    { "addmultisigaddress",     &addmultisigaddress,     false,  false,    false,    NULL },
+    { "getrawmempool",          NULL,                    true,   true,     true,     &getrawmempool },
+    { "getmempoolinfo",         &getmempoolinfo,         true,   false,    false,    NULL },
+    { "prioritisetransaction",  &prioritisetransaction,  false,  false,    false,    NULL },
+    { "getblock",               NULL,                    false,  true,     true,     &getblock },
+    { "getblockbynumber",       NULL,                    false,  true,     true,     &getblockbynumber },
+    { "getblockhash",           &getblockhash,           false,  true,     true,     NULL },
+    { "getaddressbalance",      &getaddressbalance,      false,  false,    false,    NULL },
+    { "getaddresstxids",        &getaddresstxids,        false,  false,    false,    NULL },
+    { "getaddressutxos",        &getaddressutxos,        false,  false,    false,    NULL },
+    { "gettransaction",         &gettransaction,         false,  false,    false,    NULL },
+    { "getstaketx",             &getstaketx,             false,  false,    false,    NULL },
+    { "listtransactions",       NULL,                    false,  false,    false,    &listtransactions },
+    { "listaddressgroupings",   &listaddressgroupings,   false,  false,    false,    NULL },
+    { "signmessage",            &signmessage,            false,  false,    false,    NULL },
+    { "verifymessage",          &verifymessage,          false,  false,    false,    NULL },
+    { "getwork",                &getwork,                true,   false,    false,    NULL },
+    { "getworkex",              &getworkex,              true,   false,    false,    NULL },
+    { "listaccounts",           &listaccounts,           false,  false,    false,    NULL },
+    { "settxfee",               &settxfee,               false,  false,    false,    NULL },
+    { "getblocktemplate",       NULL,                    true,   true,     false,    &getblocktemplate },
+    { "submitblock",            &submitblock,            false,  false,    false,    NULL },
+    { "listsinceblock",         &listsinceblock,         false,  false,    false,    NULL },
+    { "dumpprivkey",            &dumpprivkey,            false,  false,    false,    NULL },
+    { "dumpwallet",             &dumpwallet,             true,   true,     false,    NULL },
+    { "importprivkey",          &importprivkey,          false,  false,    false,    NULL },
+    { "importwallet",           &importwallet,           false,  true,     false,    NULL },
+    { "importaddress",          &importaddress,          false,  true,     false,    NULL },
+    { "loadwallet",             &loadwallet,             false,  true,     false,    NULL },
+    { "unloadwallet",           &unloadwallet,           false,  true,     false,    NULL },
+    { "listwallets",            &listwallets,            true,   true,     false,    NULL },
+    { "listunspent",            NULL,                    false,  false,    false,    &listunspent },
+    { "getrawtransaction",      &getrawtransaction,      false,  true,     true,     NULL },
+    { "createrawtransaction",   &createrawtransaction,   false,  false,    false,    NULL },
+    { "decoderawtransaction",   &decoderawtransaction,   false,  true,     true,     NULL },
+    { "signrawtransaction",     &signrawtransaction,     false,  false,    false,    NULL },
+    { "sendrawtransaction",     &sendrawtransaction,     false,  false,    false,    NULL },
+    { "getcheckpoint",          &getcheckpoint,          true,   false,    false,    NULL },
+    { "reservebalance",         &reservebalance,         false,  true,     false,    NULL },
+    { "checkwallet",            &checkwallet,            false,  true,     false,    NULL },
+    { "repairwallet",           &repairwallet,           false,  true,     false,    NULL },
+    { "resendtx",               &resendtx,               false,  true,     false,    NULL },
+    { "makekeypair",            &makekeypair,            false,  true,     false,    NULL },
+    { "sendalert",              &sendalert,              false,  false,    false,    NULL },
 };
 
 CRPCTable::CRPCTable()
@@ -374,6 +392,84 @@ static string HTTPReply(int nStatus, const string& strMsg, bool keepalive)
         strMsg.c_str());
 }
 
+static string HTTPChunkedReplyHeader(bool keepalive)
+{
+    return strprintf(
+            "HTTP/1.1 200 OK\r\n"
+            "Date: %s\r\n"
+            "Connection: %s\r\n"
+            "Transfer-Encoding: chunked\r\n"
+            "Content-Type: application/json\r\n"
+            "Server: DeOxyRibose-json-rpc/%s\r\n"
+            "\r\n",
+        rfc1123Time().c_str(),
+        keepalive ? "keep-alive" : "close",
+        FormatFullVersion().c_str());
+}
+
+static const unsigned int RPC_CHUNK_SIZE = 64 * 1024;
+
+/**
+ * Sends what is written to it as the body of an HTTP/1.1 chunked reply.
+ * The header goes out together with the first chunk, so until a chunk's
+ * worth of output has accumulated the reply can still be replaced by an
+ * error reply.
+ */
+class CHTTPChunkedBuf : public std::streambuf
+{
+private:
+    std::ostream& stream;
+    string strHeader;
+    vector<char> vchBuffer;
+    bool fStarted;
+
+    bool SendChunk()
+    {
+        if (!fStarted)
+        {
+            stream << strHeader;
+            fStarted = true;
+        }
+        unsigned int nSize = pptr() - pbase();
+        if (nSize > 0)
+        {
+            stream << strprintf("%x\r\n", nSize);
+            stream.write(pbase(), nSize);
+            stream << "\r\n";
+        }
+        setp(&vchBuffer[0], &vchBuffer[0] + vchBuffer.size());
+        return stream.good();
+    }
+
+protected:
+    int_type overflow(int_type c)
+    {
+        if (!SendChunk())
+            return traits_type::eof();
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+public:
+    CHTTPChunkedBuf(std::ostream& streamIn, const string& strHeaderIn) : stream(streamIn), strHeader(strHeaderIn), vchBuffer(RPC_CHUNK_SIZE), fStarted(false)
+    {
+        setp(&vchBuffer[0], &vchBuffer[0] + vchBuffer.size());
+    }
+
+    bool Started() const { return fStarted; }
+
+    bool Finish()
+    {
+        SendChunk();
+        stream << "0\r\n\r\n" << std::flush;
+        return stream.good();
+    }
+};
+
 int ReadHTTPStatus(std::basic_istream<char>& stream, int &proto)
 {
     string str;
@@ -414,7 +510,37 @@ int ReadHTTPHeader(std::basic_istream<char>& stream, map<string, string>& mapHea
     return nLen;
 }
 
-int ReadHTTP(std::basic_istream<char>& stream, map<string, string>& mapHeadersRet, string& strMessageRet)
+static bool ReadHTTPChunked(std::basic_istream<char>& stream, string& strMessageRet)
+{
+    while (true)
+    {
+        string str;
+        std::getline(stream, str);
+        if (!stream.good())
+            return false;
+        long nChunk = strtol(str.c_str(), NULL, 16);
+        if (nChunk < 0 || strMessageRet.size() + nChunk > MAX_SIZE)
+            return false;
+        if (nChunk == 0)
+            break;
+        vector<char> vch(nChunk);
+        stream.read(&vch[0], nChunk);
+        strMessageRet.append(vch.begin(), vch.end());
+        std::getline(stream, str);
+    }
+
+    // Skip the trailer
+    while (true)
+    {
+        string str;
+        std::getline(stream, str);
+        if (!stream.good() || str.empty() || str == "\r")
+            break;
+    }
+    return true;
+}
+
+int ReadHTTP(std::basic_istream<char>& stream, map<string, string>& mapHeadersRet, string& strMessageRet, int* pnProtoRet = NULL)
 {
     mapHeadersRet.clear();
     strMessageRet = "";
@@ -422,6 +548,8 @@ int ReadHTTP(std::basic_istream<char>& stream, map<string, string>& mapHeadersRe
     // Read status
     int nProto = 0;
     int nStatus = ReadHTTPStatus(stream, nProto);
+    if (pnProtoRet)
+        *pnProtoRet = nProto;
 
     // Read header
     int nLen = ReadHTTPHeader(stream, mapHeadersRet);
@@ -429,7 +557,12 @@ int ReadHTTP(std::basic_istream<char>& stream, map<string, string>& mapHeadersRe
         return HTTP_INTERNAL_SERVER_ERROR;
 
     // Read message
-    if (nLen > 0)
+    if (boost::iequals(mapHeadersRet["transfer-encoding"], "chunked"))
+    {
+        if (!ReadHTTPChunked(stream, strMessageRet))
+            return HTTP_INTERNAL_SERVER_ERROR;
+    }
+    else if (nLen > 0)
     {
         vector<char> vch(nLen);
         stream.read(&vch[0], nLen);
@@ -507,6 +640,182 @@ void ErrorReply(std::ostream& stream, const Object& objError, const Value& id)
     stream << HTTPReply(nStatus, strReply, false) << std::flush;
 }
 
+void CJSONWriter::BeginValue()
+{
+    if (fAfterKey)
+        fAfterKey = false;
+    else if (!vEmpty.empty())
+    {
+        if (!vEmpty.back())
+            stream << ',';
+        vEmpty.back() = false;
+    }
+}
+
+void CJSONWriter::WriteString(const string& str)
+{
+    // Same escaping as json_spirit
+    string strOut;
+    strOut.reserve(str.size() + 2);
+    strOut += '"';
+    BOOST_FOREACH(char c, str)
+    {
+        switch (c)
+        {
+        case '"':  strOut += "\\\""; break;
+        case '\\': strOut += "\\\\"; break;
+        case '\b': strOut += "\\b"; break;
+        case '\f': strOut += "\\f"; break;
+        case '\n': strOut += "\\n"; break;
+        case '\r': strOut += "\\r"; break;
+        case '\t': strOut += "\\t"; break;
+        default:
+            {
+                unsigned char uc = (unsigned char)c;
+                if (iswprint(uc))
+                    strOut += c;
+                else
+                    strOut += strprintf("\\u%04X", (unsigned int)uc);
+            }
+        }
+    }
+    strOut += '"';
+    stream << strOut;
+}
+
+void CJSONWriter::BeginObject()
+{
+    BeginValue();
+    stream << '{';
+    vEmpty.push_back(true);
+}
+
+void CJSONWriter::EndObject()
+{
+    vEmpty.pop_back();
+    stream << '}';
+}
+
+void CJSONWriter::BeginArray()
+{
+    BeginValue();
+    stream << '[';
+    vEmpty.push_back(true);
+}
+
+void CJSONWriter::EndArray()
+{
+    vEmpty.pop_back();
+    stream << ']';
+}
+
+void CJSONWriter::Key(const string& strKey)
+{
+    BeginValue();
+    WriteString(strKey);
+    stream << ':';
+    fAfterKey = true;
+}
+
+void CJSONWriter::Write(const string& str)
+{
+    BeginValue();
+    WriteString(str);
+}
+
+void CJSONWriter::Write(const char* psz)
+{
+    Write(string(psz));
+}
+
+void CJSONWriter::Write(int n)
+{
+    Write((int64)n);
+}
+
+void CJSONWriter::Write(unsigned int n)
+{
+    Write((int64)n);
+}
+
+void CJSONWriter::Write(int64 n)
+{
+    BeginValue();
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%"PRI64d, n);
+    stream << buf;
+}
+
+void CJSONWriter::Write(uint64 n)
+{
+    BeginValue();
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%"PRI64u, n);
+    stream << buf;
+}
+
+void CJSONWriter::Write(double d)
+{
+    BeginValue();
+    stream << strprintf("%.8f", d);
+}
+
+void CJSONWriter::Write(bool f)
+{
+    BeginValue();
+    stream << (f ? "true" : "false");
+}
+
+void CJSONWriter::WriteNull()
+{
+    BeginValue();
+    stream << "null";
+}
+
+void CJSONWriter::WriteJSON(const string& strJSON)
+{
+    BeginValue();
+    stream << strJSON;
+}
+
+void CJSONWriter::Write(const Object& obj)
+{
+    BeginObject();
+    BOOST_FOREACH(const json_spirit::Pair& pair, obj)
+    {
+        Key(pair.name_);
+        Write(pair.value_);
+    }
+    EndObject();
+}
+
+void CJSONWriter::Write(const Array& arr)
+{
+    BeginArray();
+    BOOST_FOREACH(const Value& value, arr)
+        Write(value);
+    EndArray();
+}
+
+void CJSONWriter::Write(const Value& value)
+{
+    switch (value.type())
+    {
+    case obj_type:   Write(value.get_obj()); break;
+    case array_type: Write(value.get_array()); break;
+    case str_type:   Write(value.get_str()); break;
+    case bool_type:  Write(value.get_bool()); break;
+    case int_type:
+        if (value.is_uint64_t())
+            Write((uint64)value.get_uint64_t());
+        else
+            Write((int64)value.get_int64_t());
+        break;
+    case real_type:  Write(value.get_real()); break;
+    case null_type:  WriteNull(); break;
+    }
+}
+
 bool ClientAllowed(const boost::asio::ip::address& address)
 {
     // Make sure that IPv4-compatible and IPv4-mapped IPv6 addresses are treated as IPv4 addresses
@@ -897,37 +1206,109 @@ void JSONRequest::parse(const Value& valRequest)
         throw JSONRPCError(RPC_INVALID_REQUEST, "Params must be an array");
 }
 
-static Object JSONRPCExecOne(const Value& req)
+// Same reply object as JSONRPCReplyObj, written while the result is produced
+static void JSONRPCStreamReply(std::ostream& stream, const JSONRequest& jreq)
 {
-    Object rpc_result;
+    CJSONWriter writer(stream);
+    writer.BeginObject();
+    writer.Key("result");
+    tableRPC.execute(jreq.strMethod, jreq.params, writer);
+    writer.Pair("error", Value::null);
+    writer.Pair("id", jreq.id);
+    writer.EndObject();
+}
 
+static string JSONRPCExecOne(const Value& req)
+{
     JSONRequest jreq;
     try {
         jreq.parse(req);
 
-        Value result = tableRPC.execute(jreq.strMethod, jreq.params);
-        rpc_result = JSONRPCReplyObj(result, Value::null, jreq.id);
+        std::ostringstream ss;
+        JSONRPCStreamReply(ss, jreq);
+        return ss.str();
     }
     catch (Object& objError)
     {
-        rpc_result = JSONRPCReplyObj(Value::null, objError, jreq.id);
+        return write_string(Value(JSONRPCReplyObj(Value::null, objError, jreq.id)), false);
     }
     catch (std::exception& e)
     {
-        rpc_result = JSONRPCReplyObj(Value::null,
-                                     JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+        return write_string(Value(JSONRPCReplyObj(Value::null,
+                                     JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id)), false);
     }
+}
+
+static bool IsParallelRequest(const Value& req)
+{
+    if (req.type() != obj_type)
+        return false;
+    const Value& valMethod = find_value(req.get_obj(), "method");
+    if (valMethod.type() != str_type)
+        return false;
+    const CRPCCommand *pcmd = tableRPC[valMethod.get_str()];
+    return pcmd && pcmd->parallel;
+}
+
+// Entries [nNext, nEnd) of a batch, shared by the threads executing them
+struct CRPCBatchRun
+{
+    const Array& vReq;
+    vector<string>& vReply;
+    unsigned int nNext;
+    unsigned int nEnd;
+    CCriticalSection cs;
+
+    CRPCBatchRun(const Array& vReqIn, vector<string>& vReplyIn, unsigned int nBegin, unsigned int nEndIn) :
+        vReq(vReqIn), vReply(vReplyIn), nNext(nBegin), nEnd(nEndIn) { }
+};
 
-    return rpc_result;
+static void RPCBatchWorker(CRPCBatchRun* prun)
+{
+    while (true)
+    {
+        unsigned int nReq;
+        {
+            LOCK(prun->cs);
+            if (prun->nNext >= prun->nEnd)
+                return;
+            nReq = prun->nNext++;
+        }
+        prun->vReply[nReq] = JSONRPCExecOne(prun->vReq[nReq]);
+    }
 }
 
 static string JSONRPCExecBatch(const Array& vReq)
 {
-    Array ret;
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    int nThreads = std::max(1, std::min((int)GetArg("-rpcbatchthreads", 4), 16));
+
+    // Runs of read-only entries are spread over worker threads; any other
+    // entry waits for the run before it and executes on its own, so the
+    // batch still behaves as if executed in order
+    vector<string> vReply(vReq.size());
+    unsigned int reqIdx = 0;
+    while (reqIdx < vReq.size())
+    {
+        unsigned int nEnd = reqIdx;
+        while (nEnd < vReq.size() && IsParallelRequest(vReq[nEnd]))
+            nEnd++;
+        if (nEnd - reqIdx < 2 || nThreads < 2)
+        {
+            vReply[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+            reqIdx++;
+            continue;
+        }
+
+        CRPCBatchRun run(vReq, vReply, reqIdx, nEnd);
+        boost::thread_group threads;
+        for (int i = 1; i < std::min(nThreads, (int)(nEnd - reqIdx)); i++)
+            threads.create_thread(boost::bind(&RPCBatchWorker, &run));
+        RPCBatchWorker(&run);
+        threads.join_all();
+        reqIdx = nEnd;
+    }
 
-    return write_string(Value(ret), false) + "\n";
+    return "[" + boost::join(vReply, ",") + "]\n";
 }
 
 static CCriticalSection cs_THREAD_RPCHANDLER;
@@ -957,8 +1338,9 @@ void ThreadRPCServer3(void* parg)
         }
         map<string, string> mapHeaders;
         string strRequest;
+        int nProto = 0;
 
-        ReadHTTP(conn->stream(), mapHeaders, strRequest);
+        ReadHTTP(conn->stream(), mapHeaders, strRequest, &nProto);
 
         // Check authorization
         if (mapHeaders.count("authorization") == 0)
@@ -995,10 +1377,42 @@ void ThreadRPCServer3(void* parg)
             if (valRequest.type() == obj_type) {
                 jreq.parse(valRequest);
 
-                Value result = tableRPC.execute(jreq.strMethod, jreq.params);
-
-                // Send reply
-                strReply = JSONRPCReply(result, Value::null, jreq.id);
+                const CRPCCommand *pcmd = tableRPC[jreq.strMethod];
+                if (pcmd && pcmd->streamActor && nProto >= 1)
+                {
+                    // Send the result to HTTP/1.1 clients as it is produced
+                    CHTTPChunkedBuf buf(conn->stream(), HTTPChunkedReplyHeader(fRun));
+                    std::ostream out(&buf);
+                    try
+                    {
+                        JSONRPCStreamReply(out, jreq);
+                        out << "\n";
+                    }
+                    catch (...)
+                    {
+                        // Nothing went out yet, so the error can still be replied instead
+                        if (!buf.Started())
+                            throw;
+                        printf("ThreadRPCServer %s failed after the reply was started, closing connection\n", jreq.strMethod.c_str());
+                        break;
+                    }
+                    if (!buf.Finish())
+                        break;
+                    continue;
+                }
+                else if (pcmd && pcmd->streamActor)
+                {
+                    std::ostringstream ss;
+                    JSONRPCStreamReply(ss, jreq);
+                    strReply = ss.str() + "\n";
+                }
+                else
+                {
+                    Value result = tableRPC.execute(jreq.strMethod, jreq.params);
+
+                    // Send reply
+                    strReply = JSONRPCReply(result, Value::null, jreq.id);
+                }
 
             // array of requests
             } else if (valRequest.type() == array_type)
@@ -1027,7 +1441,7 @@ void ThreadRPCServer3(void* parg)
     }
 }
 
-json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_spirit::Array &params) const
+static const CRPCCommand* FindRPCCommand(const std::string &strMethod)
 {
     // Find method
     const CRPCCommand *pcmd = tableRPC[strMethod];
@@ -1040,6 +1454,25 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
         !pcmd->okSafeMode)
         throw JSONRPCError(RPC_FORBIDDEN_BY_SAFE_MODE, string("Safe mode: ") + strWarning);
 
+    return pcmd;
+}
+
+json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_spirit::Array &params) const
+{
+    const CRPCCommand *pcmd = FindRPCCommand(strMethod);
+
+    if (pcmd->streamActor)
+    {
+        // In-process callers get the streamed result parsed back
+        std::ostringstream ss;
+        CJSONWriter writer(ss);
+        execute(strMethod, params, writer);
+        Value result;
+        if (!read_string(ss.str(), result))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Internal error");
+        return result;
+    }
+
     try
     {
         // Execute
@@ -1060,6 +1493,39 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
     }
 }
 
+void CRPCTable::execute(const std::string &strMethod, const json_spirit::Array &params, CJSONWriter& writer) const
+{
+    const CRPCCommand *pcmd = FindRPCCommand(strMethod);
+
+    if (!pcmd->streamActor)
+    {
+        writer.Write(execute(strMethod, params));
+        return;
+    }
+
+    try
+    {
+        if (pcmd->unlocked)
+            pcmd->streamActor(params, false, writer);
+        else {
+            // The writer may be sending to a client socket. Render the result while
+            // holding the locks and hand it over only after releasing them, so a slow
+            // client can't hold up block processing and the wallet.
+            std::ostringstream ss;
+            {
+                LOCK2(cs_main, pwalletMain->cs_wallet);
+                CJSONWriter bufWriter(ss);
+                pcmd->streamActor(params, false, bufWriter);
+            }
+            writer.WriteJSON(ss.str());
+        }
+    }
+    catch (std::exception& e)
+    {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+}
+
 
 Object CallRPC(const string& strMethod, const Array& params)
 {
@@ -1164,6 +1630,14 @@ Array RPCConvertValues(const std::string &strMethod, const std::vector<std::stri
     if (strMethod == "getblockbynumber"       && n > 0) ConvertTo<boost::int64_t>(params[0]);
     if (strMethod == "getblockbynumber"       && n > 1) ConvertTo<bool>(params[1]);
     if (strMethod == "getblockhash"           && n > 0) ConvertTo<boost::int64_t>(params[0]);
+    if (strMethod == "getaddressbalance"      && n > 0 && params[0].get_str()[0] == '[') ConvertTo<Array>(params[0]);
+    if (strMethod == "getaddresstxids"        && n > 0 && params[0].get_str()[0] == '[') ConvertTo<Array>(params[0]);
+    if (strMethod == "getaddresstxids"        && n > 1) ConvertTo<boost::int64_t>(params[1]);
+    if (strMethod == "getaddresstxids"        && n > 2) ConvertTo<boost::int64_t>(params[2]);
+    if (strMethod == "getaddressutxos"        && n > 0 && params[0].get_str()[0] == '[') ConvertTo<Array>(params[0]);
+    if (strMethod == "prioritisetransaction"  && n > 1) ConvertTo<double>(params[1]);
+    if (strMethod == "loadwallet"             && n > 1) ConvertTo<bool>(params[1]);
+    if (strMethod == "importaddress"          && n > 3) ConvertTo<bool>(params[3]);
     if (strMethod == "move"                   && n > 2) ConvertTo<double>(params[2]);
     if (strMethod == "move"                   && n > 3) ConvertTo<boost::int64_t>(params[3]);
     if (strMethod == "sendfrom"               && n > 2) ConvertTo<double>(params[2]);
@@ -1185,6 +1659,7 @@ Array RPCConvertValues(const std::string &strMethod, const std::vector<std::stri
     if (strMethod == "listunspent"            && n > 1) ConvertTo<boost::int64_t>(params[1]);
     if (strMethod == "listunspent"            && n > 2) ConvertTo<Array>(params[2]);
     if (strMethod == "getrawtransaction"      && n > 1) ConvertTo<boost::int64_t>(params[1]);
+    if (strMethod == "decoderawtransaction"   && n > 1) ConvertTo<bool>(params[1]);
     if (strMethod == "createrawtransaction"   && n > 0) ConvertTo<Array>(params[0]);
     if (strMethod == "createrawtransaction"   && n > 1) ConvertTo<Object>(params[1]);
     if (strMethod == "signrawtransaction"     && n > 1) ConvertTo<Array>(params[1], true);
@@ -9,6 +9,8 @@
 #include <string>
 #include <list>
 #include <map>
+#include <ostream>
+#include <vector>
 
 class CBlockIndex;
 
@@ -88,8 +90,58 @@ void RPCTypeCheck(const json_spirit::Array& params,
 void RPCTypeCheck(const json_spirit::Object& o,
                   const std::map<std::string, json_spirit::Value_type>& typesExpected, bool fAllowNull=false);
 
+/**
+ * Writes JSON text straight to a stream, in the same compact format as
+ * json_spirit::write_string.  Lets large replies go out as they are produced
+ * instead of being built as a Value tree and rendered into one string first.
+ */
+class CJSONWriter
+{
+private:
+    std::ostream& stream;
+    std::vector<bool> vEmpty;   // per open object or array: nothing written into it yet
+    bool fAfterKey;
+
+    void BeginValue();
+    void WriteString(const std::string& str);
+
+public:
+    explicit CJSONWriter(std::ostream& streamIn) : stream(streamIn), fAfterKey(false) {}
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    void Key(const std::string& strKey);
+
+    void Write(const std::string& str);
+    void Write(const char* psz);
+    void Write(int n);
+    void Write(unsigned int n);
+    void Write(int64 n);
+    void Write(uint64 n);
+    void Write(double d);
+    void Write(bool f);
+    void WriteNull();
+    /** Write text that already is a single JSON value */
+    void WriteJSON(const std::string& strJSON);
+    void Write(const json_spirit::Value& value);
+    void Write(const json_spirit::Object& obj);
+    void Write(const json_spirit::Array& arr);
+
+    template<typename T>
+    void Pair(const std::string& strKey, const T& value)
+    {
+        Key(strKey);
+        Write(value);
+    }
+};
+
 typedef json_spirit::Value(*rpcfn_type)(const json_spirit::Array& params, bool fHelp);
+typedef void(*rpcstreamfn_type)(const json_spirit::Array& params, bool fHelp, CJSONWriter& writer);
 
+/** A row of the RPC command table.  Rows are aggregate-initialized and
+ * give every field, see vRPCCommands. */
 class CRPCCommand
 {
 public:
@@ -97,6 +149,8 @@ public:
     rpcfn_type actor;
     bool okSafeMode;
     bool unlocked;
+    bool parallel;                  // read-only and locks for itself, so batch entries may run it concurrently
+    rpcstreamfn_type streamActor;   // set instead of actor for commands that write their result as they go
 };
 
 /**
@@ -119,6 +173,13 @@ public:
      * @throws an exception (json_spirit::Value) when an error happens.
      */
     json_spirit::Value execute(const std::string &method, const json_spirit::Array &params) const;
+
+    /**
+     * Execute a method, writing its result to writer as it is produced.
+     * @throws an exception (json_spirit::Value) when an error happens, possibly
+     * after part of the result was written.
+     */
+    void execute(const std::string &method, const json_spirit::Array &params, CJSONWriter& writer) const;
 };
 
 extern const CRPCTable tableRPC;
@@ -141,6 +202,7 @@ extern json_spirit::Value dumpprivkey(const json_spirit::Array& params, bool fHe
 extern json_spirit::Value dumpwallet(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value importprivkey(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value importwallet(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value importaddress(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value sendalert(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value getnettotals(const json_spirit::Array& params, bool fHelp);
@@ -150,7 +212,7 @@ extern json_spirit::Value gethashespersec(const json_spirit::Array& params, bool
 extern json_spirit::Value getmininginfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getwork(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getworkex(const json_spirit::Array& params, bool fHelp);
-extern json_spirit::Value getblocktemplate(const json_spirit::Array& params, bool fHelp);
+extern void getblocktemplate(const json_spirit::Array& params, bool fHelp, CJSONWriter& writer);
 extern json_spirit::Value submitblock(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value getnewaddress(const json_spirit::Array& params, bool fHelp); // in rpcwallet.cpp
@@ -170,7 +232,7 @@ extern json_spirit::Value sendmany(const json_spirit::Array& params, bool fHelp)
 extern json_spirit::Value addmultisigaddress(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listreceivedbyaddress(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listreceivedbyaccount(const json_spirit::Array& params, bool fHelp);
-extern json_spirit::Value listtransactions(const json_spirit::Array& params, bool fHelp);
+extern void listtransactions(const json_spirit::Array& params, bool fHelp, CJSONWriter& writer);
 extern json_spirit::Value listaddressgroupings(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listaccounts(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listsinceblock(const json_spirit::Array& params, bool fHelp);
@@ -189,12 +251,15 @@ extern json_spirit::Value checkwallet(const json_spirit::Array& params, bool fHe
 extern json_spirit::Value repairwallet(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value resendtx(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value makekeypair(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value loadwallet(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value unloadwallet(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value listwallets(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value validatepubkey(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getnewpubkey(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getnetworkhashps(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value getrawtransaction(const json_spirit::Array& params, bool fHelp); // in rcprawtransaction.cpp
-extern json_spirit::Value listunspent(const json_spirit::Array& params, bool fHelp);
+extern void listunspent(const json_spirit::Array& params, bool fHelp, CJSONWriter& writer);
 extern json_spirit::Value createrawtransaction(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value decoderawtransaction(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value signrawtransaction(const json_spirit::Array& params, bool fHelp);
@@ -203,10 +268,15 @@ extern json_spirit::Value sendrawtransaction(const json_spirit::Array& params, b
 extern json_spirit::Value getblockcount(const json_spirit::Array& params, bool fHelp); // in rpcblockchain.cpp
 extern json_spirit::Value getdifficulty(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value settxfee(const json_spirit::Array& params, bool fHelp);
-extern json_spirit::Value getrawmempool(const json_spirit::Array& params, bool fHelp);
+extern void getrawmempool(const json_spirit::Array& params, bool fHelp, CJSONWriter& writer);
+extern json_spirit::Value getmempoolinfo(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value prioritisetransaction(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockhash(const json_spirit::Array& params, bool fHelp);
-extern json_spirit::Value getblock(const json_spirit::Array& params, bool fHelp);
-extern json_spirit::Value getblockbynumber(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddressbalance(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddresstxids(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddressutxos(const json_spirit::Array& params, bool fHelp);
+extern void getblock(const json_spirit::Array& params, bool fHelp, CJSONWriter& writer);
+extern void getblockbynumber(const json_spirit::Array& params, bool fHelp, CJSONWriter& writer);
 extern json_spirit::Value getcheckpoint(const json_spirit::Array& params, bool fHelp);
 
 #endif
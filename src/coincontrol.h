@@ -7,7 +7,7 @@ class CCoinControl
 public:
     CTxDestination destChange;
 
-    CCoinControl()
+    CCoinControl() : nGeneration(0)
     {
         SetNull();
     }
@@ -16,12 +16,18 @@ public:
     {
         destChange = CNoDestination();
         setSelected.clear();
+        nGeneration++;
     }
     
     bool HasSelected() const
     {
         return (setSelected.size() > 0);
     }
+
+    unsigned int CountSelected() const
+    {
+        return setSelected.size();
+    }
     
     bool IsSelected(const uint256& hash, unsigned int n) const
     {
@@ -32,16 +38,25 @@ public:
     void Select(COutPoint& output)
     {
         setSelected.insert(output);
+        nGeneration++;
     }
     
     void UnSelect(COutPoint& output)
     {
         setSelected.erase(output);
+        nGeneration++;
     }
     
     void UnSelectAll()
     {
         setSelected.clear();
+        nGeneration++;
+    }
+
+    /** Changes with every change of the selection, never 0 */
+    unsigned int GetGeneration() const
+    {
+        return nGeneration;
     }
 
     void ListSelected(std::vector<COutPoint>& vOutpoints)
@@ -51,6 +66,7 @@ public:
         
 private:
     std::set<COutPoint> setSelected;
+    unsigned int nGeneration;
 
 };
 
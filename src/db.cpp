@@ -9,6 +9,8 @@
 #include "util.h"
 #include "main.h"
 #include "kernel.h"
+#include "addrindex.h"
+#include "spentindex.h"
 #include <boost/version.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -592,6 +594,272 @@ bool CTxDB::WriteCheckpointPubKey(const string& strPubKey)
     return Write(string("strCheckpointPubKey"), strPubKey);
 }
 
+// Key of an address history entry.  The height is stored big endian so
+// that the entries of an address sort by height.
+class CAddrIndexDeltaKey
+{
+public:
+    CAddrIndexKey addr;
+    unsigned int nHeightBE;
+    uint256 txid;
+    unsigned int n;
+    bool fSpend;
+
+    CAddrIndexDeltaKey() : nHeightBE(0), txid(0), n(0), fSpend(false) {}
+    CAddrIndexDeltaKey(const CAddrIndexKey& addrIn, const CAddrIndexDelta& delta)
+        : addr(addrIn), nHeightBE(ByteReverse(delta.nHeight)), txid(delta.txid), n(delta.n), fSpend(delta.fSpend) {}
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(addr);
+        READWRITE(nHeightBE);
+        READWRITE(txid);
+        READWRITE(n);
+        READWRITE(fSpend);
+    )
+};
+
+bool CTxDB::ReadAddrIndexHeight(int& nHeight)
+{
+    return Read(string("addrIndexHeight"), nHeight);
+}
+
+bool CTxDB::WriteAddrIndexHeight(int nHeight)
+{
+    return Write(string("addrIndexHeight"), nHeight);
+}
+
+bool CTxDB::EraseAddrIndexHeight()
+{
+    return Erase(string("addrIndexHeight"));
+}
+
+bool CTxDB::EraseKeysWithPrefix(const string& strPrefix)
+{
+    while (true)
+    {
+        // Collect a round of keys with the cursor closed again before
+        // erasing them, so the cursor doesn't block the transaction
+        vector<CDataStream> vKeys;
+        Dbc* pcursor = GetCursor();
+        if (!pcursor)
+            return false;
+        unsigned int fFlags = DB_SET_RANGE;
+        while (vKeys.size() < 10000)
+        {
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            if (fFlags == DB_SET_RANGE)
+                ssKey << strPrefix;
+            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            int ret = ReadAtCursor(pcursor, ssKey, ssValue, fFlags);
+            fFlags = DB_NEXT;
+            if (ret == DB_NOTFOUND)
+                break;
+            else if (ret != 0)
+            {
+                pcursor->close();
+                return false;
+            }
+
+            CDataStream ssKeyCopy(ssKey);
+            string strType;
+            ssKey >> strType;
+            if (strType != strPrefix)
+                break;
+            vKeys.push_back(ssKeyCopy);
+        }
+        pcursor->close();
+
+        if (vKeys.empty())
+            return true;
+        if (!TxnBegin())
+            return false;
+        BOOST_FOREACH(const CDataStream& ssKey, vKeys)
+        {
+            if (!Erase(ssKey))
+            {
+                TxnAbort();
+                return false;
+            }
+        }
+        if (!TxnCommit())
+            return false;
+    }
+}
+
+bool CTxDB::WipeAddrIndex()
+{
+    return EraseKeysWithPrefix("addrtx") && EraseKeysWithPrefix("addrutxo") && EraseKeysWithPrefix("addrout");
+}
+
+bool CTxDB::ReadSpentIndexHeight(int& nHeight)
+{
+    return Read(string("spentIndexHeight"), nHeight);
+}
+
+bool CTxDB::WriteSpentIndexHeight(int nHeight)
+{
+    return Write(string("spentIndexHeight"), nHeight);
+}
+
+bool CTxDB::EraseSpentIndexHeight()
+{
+    return Erase(string("spentIndexHeight"));
+}
+
+bool CTxDB::WipeSpentIndex()
+{
+    return EraseKeysWithPrefix("spent");
+}
+
+bool CTxDB::ReadSpentIndex(const COutPoint& outpoint, CSpentIndexValue& spent)
+{
+    return Read(make_pair(string("spent"), outpoint), spent);
+}
+
+bool CTxDB::WriteSpentIndex(const COutPoint& outpoint, const CSpentIndexValue& spent)
+{
+    return Write(make_pair(string("spent"), outpoint), spent);
+}
+
+bool CTxDB::EraseSpentIndex(const COutPoint& outpoint)
+{
+    return Erase(make_pair(string("spent"), outpoint));
+}
+
+bool CTxDB::ReadAddrIndexOut(const COutPoint& outpoint, CAddrIndexOut& out)
+{
+    return Read(make_pair(string("addrout"), outpoint), out);
+}
+
+bool CTxDB::WriteAddrIndexOut(const COutPoint& outpoint, const CAddrIndexOut& out)
+{
+    return Write(make_pair(string("addrout"), outpoint), out);
+}
+
+bool CTxDB::EraseAddrIndexOut(const COutPoint& outpoint)
+{
+    return Erase(make_pair(string("addrout"), outpoint));
+}
+
+bool CTxDB::WriteAddrIndexUnspent(const COutPoint& outpoint, const CAddrIndexOut& out)
+{
+    return Write(make_pair(string("addrutxo"), make_pair(out.addr, outpoint)), make_pair(out.nValue, out.nHeight));
+}
+
+bool CTxDB::EraseAddrIndexUnspent(const COutPoint& outpoint, const CAddrIndexKey& addr)
+{
+    return Erase(make_pair(string("addrutxo"), make_pair(addr, outpoint)));
+}
+
+bool CTxDB::WriteAddrIndexDelta(const CAddrIndexKey& addr, const CAddrIndexDelta& delta)
+{
+    return Write(make_pair(string("addrtx"), CAddrIndexDeltaKey(addr, delta)), delta.nValue);
+}
+
+bool CTxDB::EraseAddrIndexDelta(const CAddrIndexKey& addr, const CAddrIndexDelta& delta)
+{
+    return Erase(make_pair(string("addrtx"), CAddrIndexDeltaKey(addr, delta)));
+}
+
+bool CTxDB::ReadAddrIndexDeltas(const CAddrIndexKey& addr, int nStartHeight, int nEndHeight, vector<CAddrIndexDelta>& vDelta)
+{
+    Dbc* pcursor = GetCursor();
+    if (!pcursor)
+        return false;
+
+    CAddrIndexDeltaKey keyStart;
+    keyStart.addr = addr;
+    keyStart.nHeightBE = ByteReverse((unsigned int)max(nStartHeight, 0));
+
+    unsigned int fFlags = DB_SET_RANGE;
+    while (true)
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        if (fFlags == DB_SET_RANGE)
+            ssKey << make_pair(string("addrtx"), keyStart);
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        int ret = ReadAtCursor(pcursor, ssKey, ssValue, fFlags);
+        fFlags = DB_NEXT;
+        if (ret == DB_NOTFOUND)
+            break;
+        else if (ret != 0)
+        {
+            pcursor->close();
+            return false;
+        }
+
+        try {
+            string strType;
+            CAddrIndexDeltaKey key;
+            ssKey >> strType;
+            if (strType != "addrtx")
+                break;
+            ssKey >> key;
+            int nHeight = ByteReverse(key.nHeightBE);
+            if (key.addr.nType != addr.nType || key.addr.hash != addr.hash || (nEndHeight >= 0 && nHeight > nEndHeight))
+                break;
+            int64 nValue;
+            ssValue >> nValue;
+            vDelta.push_back(CAddrIndexDelta(nHeight, key.txid, key.n, key.fSpend, nValue));
+        }
+        catch (std::exception &e) {
+            pcursor->close();
+            return error("%s() : deserialize error", __PRETTY_FUNCTION__);
+        }
+    }
+    pcursor->close();
+    return true;
+}
+
+bool CTxDB::ReadAddrIndexUnspent(const CAddrIndexKey& addr, vector<CAddrIndexUnspent>& vUnspent)
+{
+    Dbc* pcursor = GetCursor();
+    if (!pcursor)
+        return false;
+
+    unsigned int fFlags = DB_SET_RANGE;
+    while (true)
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        if (fFlags == DB_SET_RANGE)
+            ssKey << make_pair(string("addrutxo"), make_pair(addr, COutPoint(0, 0)));
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        int ret = ReadAtCursor(pcursor, ssKey, ssValue, fFlags);
+        fFlags = DB_NEXT;
+        if (ret == DB_NOTFOUND)
+            break;
+        else if (ret != 0)
+        {
+            pcursor->close();
+            return false;
+        }
+
+        try {
+            string strType;
+            CAddrIndexKey addrKey;
+            COutPoint outpoint;
+            ssKey >> strType;
+            if (strType != "addrutxo")
+                break;
+            ssKey >> addrKey >> outpoint;
+            if (addrKey.nType != addr.nType || addrKey.hash != addr.hash)
+                break;
+            CAddrIndexUnspent unspent;
+            unspent.txid = outpoint.hash;
+            unspent.n = outpoint.n;
+            ssValue >> unspent.nValue >> unspent.nHeight;
+            vUnspent.push_back(unspent);
+        }
+        catch (std::exception &e) {
+            pcursor->close();
+            return error("%s() : deserialize error", __PRETTY_FUNCTION__);
+        }
+    }
+    pcursor->close();
+    return true;
+}
+
 CBlockIndex static * InsertBlockIndex(uint256 hash)
 {
     if (hash == 0)
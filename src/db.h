@@ -14,13 +14,19 @@
 #include <db_cxx.h>
 
 class CAddress;
+class CAddrIndexDelta;
+class CAddrIndexKey;
+class CAddrIndexOut;
+class CAddrIndexUnspent;
 class CAddrMan;
 class CBlockLocator;
 class CDiskBlockIndex;
 class CDiskTxPos;
 class CMasterKey;
+class CSpentIndexValue;
 class COutPoint;
 class CTxIndex;
+class CImportedKey;
 class CWallet;
 class CWalletTx;
 
@@ -30,6 +36,7 @@ void ThreadFlushWalletDB(void* parg);
 bool BackupWallet(const CWallet& wallet, const std::string& strDest);
 bool DumpWallet(CWallet* pwallet, const std::string& strDest);
 bool ImportWallet(CWallet* pwallet, const std::string& strLocation);
+bool ParseDumpLine(const std::string& line, CImportedKey& imported);
 
 class CDBEnv
 {
@@ -345,9 +352,30 @@ public:
     bool WriteSyncCheckpoint(uint256 hashCheckpoint);
     bool ReadCheckpointPubKey(std::string& strPubKey);
     bool WriteCheckpointPubKey(const std::string& strPubKey);
+    bool ReadAddrIndexHeight(int& nHeight);
+    bool WriteAddrIndexHeight(int nHeight);
+    bool EraseAddrIndexHeight();
+    bool WipeAddrIndex();
+    bool ReadAddrIndexOut(const COutPoint& outpoint, CAddrIndexOut& out);
+    bool WriteAddrIndexOut(const COutPoint& outpoint, const CAddrIndexOut& out);
+    bool EraseAddrIndexOut(const COutPoint& outpoint);
+    bool WriteAddrIndexUnspent(const COutPoint& outpoint, const CAddrIndexOut& out);
+    bool EraseAddrIndexUnspent(const COutPoint& outpoint, const CAddrIndexKey& addr);
+    bool WriteAddrIndexDelta(const CAddrIndexKey& addr, const CAddrIndexDelta& delta);
+    bool EraseAddrIndexDelta(const CAddrIndexKey& addr, const CAddrIndexDelta& delta);
+    bool ReadAddrIndexDeltas(const CAddrIndexKey& addr, int nStartHeight, int nEndHeight, std::vector<CAddrIndexDelta>& vDelta);
+    bool ReadAddrIndexUnspent(const CAddrIndexKey& addr, std::vector<CAddrIndexUnspent>& vUnspent);
+    bool ReadSpentIndexHeight(int& nHeight);
+    bool WriteSpentIndexHeight(int nHeight);
+    bool EraseSpentIndexHeight();
+    bool WipeSpentIndex();
+    bool ReadSpentIndex(const COutPoint& outpoint, CSpentIndexValue& spent);
+    bool WriteSpentIndex(const COutPoint& outpoint, const CSpentIndexValue& spent);
+    bool EraseSpentIndex(const COutPoint& outpoint);
     bool LoadBlockIndex();
 private:
     bool LoadBlockIndexGuts();
+    bool EraseKeysWithPrefix(const std::string& strPrefix);
 };
 
 
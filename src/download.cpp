@@ -0,0 +1,291 @@
+// Copyright (c) 2013 The DeOxyRibose developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/foreach.hpp>
+
+#include "download.h"
+#include "net.h"
+
+using namespace std;
+
+int CDownloadScheduler::MaxInFlight(const CPeer& peer) const
+{
+    if (peer.nAvgItemSize == 0 || peer.nBytesPerSecond == 0)
+        return DOWNLOAD_MIN_IN_FLIGHT;
+
+    // Enough to keep the link busy for twice the peer's response time
+    int64 nMax = 2 * peer.nBytesPerSecond * peer.nAvgResponse / 1000000 / peer.nAvgItemSize;
+    return (int)max((int64)DOWNLOAD_MIN_IN_FLIGHT, min((int64)DOWNLOAD_MAX_IN_FLIGHT, nMax));
+}
+
+NodeId CDownloadScheduler::SelectPeer(const CItem& item) const
+{
+    // Fastest announcer with room to spare, else the fastest one
+    NodeId nodeBest = -1;
+    int64 nBest = 0;
+    bool fBestHasRoom = false;
+    BOOST_FOREACH(NodeId node, item.setAnnouncers)
+    {
+        map<NodeId, CPeer>::const_iterator pit = mapPeers.find(node);
+        if (pit == mapPeers.end())
+            continue;
+        const CPeer& peer = (*pit).second;
+        bool fHasRoom = (int)peer.setInFlight.size() < MaxInFlight(peer);
+        if (nodeBest == -1 || (fHasRoom && !fBestHasRoom) ||
+            (fHasRoom == fBestHasRoom && peer.nAvgResponse < nBest))
+        {
+            nodeBest = node;
+            nBest = peer.nAvgResponse;
+            fBestHasRoom = fHasRoom;
+        }
+    }
+    return nodeBest;
+}
+
+void CDownloadScheduler::Stalled(const CInv& inv, CItem& item, int64 nNow)
+{
+    map<NodeId, CPeer>::iterator pit = mapPeers.find(item.nodeInFlight);
+    if (pit != mapPeers.end())
+    {
+        CPeer& peer = (*pit).second;
+        peer.setInFlight.erase(inv);
+        peer.nTimeouts++;
+        peer.nAvgResponse = min(max(peer.nAvgResponse * 2, nNow - item.nRequestTime), (int64)DOWNLOAD_BLOCK_TIMEOUT);
+    }
+    if (fDebugNet)
+        printf("download of %s from peer=%d timed out\n", inv.ToString().c_str(), item.nodeInFlight);
+
+    // Don't ask the same peer again
+    item.setAnnouncers.erase(item.nodeInFlight);
+    item.nodeInFlight = -1;
+    item.nPreferredUntil = 0;
+}
+
+void CDownloadScheduler::EraseItem(map<CInv, CItem>::iterator mi)
+{
+    // Entries left in the announcers' pending queues are dropped lazily
+    const CItem& item = (*mi).second;
+    if (item.nodeInFlight != -1)
+    {
+        map<NodeId, CPeer>::iterator pit = mapPeers.find(item.nodeInFlight);
+        if (pit != mapPeers.end())
+            (*pit).second.setInFlight.erase((*mi).first);
+    }
+    mapItems.erase(mi);
+}
+
+void CDownloadScheduler::Announce(NodeId node, const CInv& inv, int64 nNow)
+{
+    LOCK(cs);
+    CPeer& peer = mapPeers[node];
+    if (peer.mapPending.size() >= MAX_PEER_ANNOUNCEMENTS)
+        return;
+
+    CItem& item = mapItems[inv];
+    if (item.nodeInFlight == node)
+        return;
+    item.setAnnouncers.insert(node);
+    peer.mapPending.insert(make_pair(nNow, inv));
+    if (fDebugNet)
+        printf("askfor %s from peer=%d\n", inv.ToString().c_str(), node);
+}
+
+void CDownloadScheduler::GetRequests(NodeId node, int64 nNow, vector<CInv>& vRequest)
+{
+    LOCK(cs);
+    map<NodeId, CPeer>::iterator pit = mapPeers.find(node);
+    if (pit == mapPeers.end())
+        return;
+    CPeer& peer = (*pit).second;
+
+    // Take back what this peer failed to deliver in time
+    vector<CInv> vStalled;
+    BOOST_FOREACH(const CInv& inv, peer.setInFlight)
+    {
+        map<CInv, CItem>::iterator mi = mapItems.find(inv);
+        if (mi != mapItems.end() && (*mi).second.nTimeout < nNow)
+            vStalled.push_back(inv);
+    }
+    BOOST_FOREACH(const CInv& inv, vStalled)
+    {
+        map<CInv, CItem>::iterator mi = mapItems.find(inv);
+        Stalled(inv, (*mi).second, nNow);
+        if ((*mi).second.setAnnouncers.empty())
+            EraseItem(mi);
+    }
+
+    int nMaxInFlight = MaxInFlight(peer);
+    vector<pair<int64, CInv> > vLater;
+    while (!peer.mapPending.empty() && (*peer.mapPending.begin()).first <= nNow &&
+           (int)peer.setInFlight.size() < nMaxInFlight)
+    {
+        CInv inv = (*peer.mapPending.begin()).second;
+        peer.mapPending.erase(peer.mapPending.begin());
+
+        map<CInv, CItem>::iterator mi = mapItems.find(inv);
+        if (mi == mapItems.end())
+            continue;
+        CItem& item = (*mi).second;
+        if (item.nodeInFlight == node || !item.setAnnouncers.count(node))
+            continue;
+
+        // Delivered and being validated: Rejected hands it out again, the
+        // entry is only kept so a disconnect still finds the item
+        if (item.fReceived)
+        {
+            vLater.push_back(make_pair(nNow + DOWNLOAD_PREFERRED_WAIT, inv));
+            continue;
+        }
+
+        // Outstanding at another peer: look again when that request expires
+        if (item.nodeInFlight != -1)
+        {
+            if (nNow <= item.nTimeout)
+            {
+                vLater.push_back(make_pair(item.nTimeout + 1, inv));
+                continue;
+            }
+            Stalled(inv, item, nNow);
+        }
+
+        // Leave it to the preferred peer for a little while
+        if (item.nPreferredUntil == 0)
+        {
+            item.nodePreferred = SelectPeer(item);
+            item.nPreferredUntil = nNow + DOWNLOAD_PREFERRED_WAIT;
+        }
+        if (item.nodePreferred != node && nNow < item.nPreferredUntil)
+        {
+            vLater.push_back(make_pair(item.nPreferredUntil, inv));
+            continue;
+        }
+
+        item.nodeInFlight = node;
+        item.nRequestTime = nNow;
+        item.nTimeout = nNow + (inv.type == MSG_BLOCK ? DOWNLOAD_BLOCK_TIMEOUT : DOWNLOAD_TX_TIMEOUT) + 4 * peer.nAvgResponse;
+        peer.setInFlight.insert(inv);
+        vRequest.push_back(inv);
+    }
+    peer.mapPending.insert(vLater.begin(), vLater.end());
+}
+
+void CDownloadScheduler::Received(NodeId node, const CInv& inv, unsigned int nBytes, int64 nNow)
+{
+    LOCK(cs);
+    map<CInv, CItem>::iterator mi = mapItems.find(inv);
+    if (mi == mapItems.end())
+        return;
+
+    CItem& item = (*mi).second;
+    map<NodeId, CPeer>::iterator pit = mapPeers.find(node);
+    if (item.nodeInFlight == node && pit != mapPeers.end())
+    {
+        CPeer& peer = (*pit).second;
+        peer.setInFlight.erase(inv);
+        int64 nResponse = max(nNow - item.nRequestTime, (int64)1000);
+        peer.nAvgResponse = (peer.nAvgResponse * 7 + nResponse) / 8;
+        peer.nAvgItemSize = peer.nAvgItemSize ? (peer.nAvgItemSize * 7 + nBytes) / 8 : nBytes;
+
+        // Delivered bandwidth, sampled about once a second
+        if (peer.nRateStart == 0)
+            peer.nRateStart = item.nRequestTime;
+        peer.nRateBytes += nBytes;
+        if (nNow - peer.nRateStart >= 1000000)
+        {
+            int64 nRate = peer.nRateBytes * 1000000 / (nNow - peer.nRateStart);
+            peer.nBytesPerSecond = peer.nBytesPerSecond ? (peer.nBytesPerSecond * 3 + nRate) / 4 : nRate;
+            peer.nRateStart = nNow;
+            peer.nRateBytes = 0;
+        }
+    }
+    if (item.nodeInFlight == node)
+        item.nodeInFlight = -1;
+
+    // Whatever node sent is what it has; should it be rejected, asking node
+    // again is no use
+    item.setAnnouncers.erase(node);
+    item.fReceived = true;
+}
+
+void CDownloadScheduler::Rejected(const CInv& inv)
+{
+    LOCK(cs);
+    map<CInv, CItem>::iterator mi = mapItems.find(inv);
+    if (mi == mapItems.end())
+        return;
+    CItem& item = (*mi).second;
+    item.fReceived = false;
+
+    // Still requested from another peer, which may send a good copy
+    if (item.nodeInFlight != -1)
+        return;
+    if (item.setAnnouncers.empty())
+    {
+        mapItems.erase(mi);
+        return;
+    }
+    item.nPreferredUntil = 0;
+    BOOST_FOREACH(NodeId nodeOther, item.setAnnouncers)
+        mapPeers[nodeOther].mapPending.insert(make_pair(0, inv));
+}
+
+void CDownloadScheduler::Forget(const CInv& inv)
+{
+    LOCK(cs);
+    map<CInv, CItem>::iterator mi = mapItems.find(inv);
+    if (mi != mapItems.end())
+        EraseItem(mi);
+}
+
+void CDownloadScheduler::PeerDisconnected(NodeId node)
+{
+    LOCK(cs);
+    map<NodeId, CPeer>::iterator pit = mapPeers.find(node);
+    if (pit == mapPeers.end())
+        return;
+    CPeer& peer = (*pit).second;
+
+    // Outstanding requests go to the remaining announcers right away
+    BOOST_FOREACH(const CInv& inv, peer.setInFlight)
+    {
+        map<CInv, CItem>::iterator mi = mapItems.find(inv);
+        if (mi == mapItems.end())
+            continue;
+        CItem& item = (*mi).second;
+        item.setAnnouncers.erase(node);
+        item.nodeInFlight = -1;
+        item.nPreferredUntil = 0;
+        if (item.setAnnouncers.empty())
+        {
+            mapItems.erase(mi);
+            continue;
+        }
+        BOOST_FOREACH(NodeId nodeOther, item.setAnnouncers)
+            mapPeers[nodeOther].mapPending.insert(make_pair(0, inv));
+    }
+
+    for (multimap<int64, CInv>::iterator it = peer.mapPending.begin(); it != peer.mapPending.end(); ++it)
+    {
+        map<CInv, CItem>::iterator mi = mapItems.find((*it).second);
+        if (mi == mapItems.end())
+            continue;
+        CItem& item = (*mi).second;
+        item.setAnnouncers.erase(node);
+        if (item.setAnnouncers.empty() && item.nodeInFlight == -1)
+            mapItems.erase(mi);
+    }
+
+    mapPeers.erase(pit);
+}
+
+bool CDownloadScheduler::GetPeerStats(NodeId node, int& nInFlight, int64& nAvgResponse) const
+{
+    LOCK(cs);
+    map<NodeId, CPeer>::const_iterator pit = mapPeers.find(node);
+    if (pit == mapPeers.end())
+        return false;
+    nInFlight = (*pit).second.setInFlight.size();
+    nAvgResponse = (*pit).second.nAvgResponse;
+    return true;
+}
@@ -0,0 +1,110 @@
+// Copyright (c) 2013 The DeOxyRibose developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_DOWNLOAD_H
+#define BITCOIN_DOWNLOAD_H
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "protocol.h"
+#include "sync.h"
+#include "util.h"
+
+/** Process-unique identifier of a peer connection, never reused */
+typedef int NodeId;
+
+/** How long other announcers hold back so the preferred peer can pick an item up (microseconds) */
+static const int64 DOWNLOAD_PREFERRED_WAIT = 2 * 1000000;
+/** Time a peer gets to deliver a requested item, on top of four times its average response time */
+static const int64 DOWNLOAD_TX_TIMEOUT = 30 * 1000000;
+static const int64 DOWNLOAD_BLOCK_TIMEOUT = 60 * 1000000;
+/** Response time assumed for peers we have not heard back from yet */
+static const int64 DOWNLOAD_DEFAULT_RESPONSE = 2 * 1000000;
+/** Bounds on the number of requests outstanding at one peer */
+static const int DOWNLOAD_MIN_IN_FLIGHT = 16;
+static const int DOWNLOAD_MAX_IN_FLIGHT = 512;
+/** Announcements remembered per peer before further ones are ignored */
+static const unsigned int MAX_PEER_ANNOUNCEMENTS = 50000;
+
+/**
+ * Schedules getdata requests for announced transactions and blocks across
+ * all peers.
+ *
+ * Every item is requested from one peer at a time: of the peers that
+ * announced it, the one answering fastest that still has room.  Requests
+ * not answered in time are taken back and handed to the next announcer, as
+ * is everything a peer had outstanding when it disconnects.  A delivered
+ * item is held until it is accepted (Forget) or rejected (Rejected), in
+ * which case the remaining announcers are asked for it.  How many
+ * requests a peer may have outstanding follows the bandwidth it delivered
+ * over its response time.
+ *
+ * All times are in microseconds.
+ */
+class CDownloadScheduler
+{
+private:
+    struct CItem
+    {
+        std::set<NodeId> setAnnouncers;
+        NodeId nodeInFlight;        // -1 while not requested from anyone
+        int64 nRequestTime;
+        int64 nTimeout;
+        NodeId nodePreferred;
+        int64 nPreferredUntil;      // 0 until a preferred peer was chosen
+        bool fReceived;             // delivered, not yet accepted or rejected
+
+        CItem() : nodeInFlight(-1), nRequestTime(0), nTimeout(0), nodePreferred(-1), nPreferredUntil(0), fReceived(false) {}
+    };
+
+    struct CPeer
+    {
+        // announced items, keyed by the earliest time to look at them again
+        std::multimap<int64, CInv> mapPending;
+        std::set<CInv> setInFlight;
+        int64 nAvgResponse;
+        int64 nAvgItemSize;
+        int64 nBytesPerSecond;
+        int64 nRateStart;
+        int64 nRateBytes;
+        int nTimeouts;
+
+        CPeer() : nAvgResponse(DOWNLOAD_DEFAULT_RESPONSE), nAvgItemSize(0), nBytesPerSecond(0),
+                  nRateStart(0), nRateBytes(0), nTimeouts(0) {}
+    };
+
+    mutable CCriticalSection cs;
+    std::map<CInv, CItem> mapItems;
+    std::map<NodeId, CPeer> mapPeers;
+
+    int MaxInFlight(const CPeer& peer) const;
+    NodeId SelectPeer(const CItem& item) const;
+    void Stalled(const CInv& inv, CItem& item, int64 nNow);
+    void EraseItem(std::map<CInv, CItem>::iterator mi);
+
+public:
+    // Peer node has inv; it becomes a candidate to fetch it from
+    void Announce(NodeId node, const CInv& inv, int64 nNow);
+
+    // Items to request from node now, marked as in flight there
+    void GetRequests(NodeId node, int64 nNow, std::vector<CInv>& vRequest);
+
+    // inv arrived from node, requested or not; node is done with it, the
+    // others wait for Forget or Rejected
+    void Received(NodeId node, const CInv& inv, unsigned int nBytes, int64 nNow);
+
+    // What arrived for inv was not accepted: fetch it from the other announcers
+    void Rejected(const CInv& inv);
+
+    // Stop scheduling inv, e.g. because it was accepted or we already have it
+    void Forget(const CInv& inv);
+
+    // Hand everything node had outstanding to the other announcers
+    void PeerDisconnected(NodeId node);
+
+    bool GetPeerStats(NodeId node, int& nInFlight, int64& nAvgResponse) const;
+};
+
+#endif
@@ -0,0 +1,349 @@
+// Copyright (c) 2013 The DeOxyRibose developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <deque>
+
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include "eventserver.h"
+#include "main.h"
+#include "net.h"
+
+using namespace std;
+
+/** Longest line a subscriber may send */
+static const unsigned int MAX_EVENT_LINE = 1024;
+/** Subscribers served at once */
+static const unsigned int MAX_EVENT_CONNECTIONS = 64;
+
+static const char* const pszEventTopics[] = { "hashblock", "rawblock", "hashtx", "rawtx", "wallettx" };
+
+class CEventSubscriber
+{
+public:
+    SOCKET hSocket;
+    CAddress addr;
+    string strRecv;
+    set<string> setTopics;
+    deque<vector<char> > vSendQueue;
+    unsigned int nSendOffset;       // bytes of the first queued frame already sent
+    size_t nQueued;                 // bytes in vSendQueue
+    unsigned int nDropped;
+    bool fDisconnect;
+
+    CEventSubscriber(SOCKET hSocketIn, const CAddress& addrIn)
+        : hSocket(hSocketIn), addr(addrIn), nSendOffset(0), nQueued(0), nDropped(0), fDisconnect(false) {}
+
+    // Send queued frames until the socket would block
+    void Send()
+    {
+        while (!vSendQueue.empty())
+        {
+            const vector<char>& vchFrame = vSendQueue.front();
+            size_t nSent;
+            if (!SendNonBlocking(hSocket, &vchFrame[nSendOffset], vchFrame.size() - nSendOffset, nSent))
+                fDisconnect = true;
+            if (nSent == 0)
+                return;
+            nSendOffset += nSent;
+            if (nSendOffset < vchFrame.size())
+                return;
+            nQueued -= vchFrame.size();
+            nSendOffset = 0;
+            vSendQueue.pop_front();
+        }
+    }
+};
+
+class CEventServer
+{
+private:
+    SOCKET hListenSocket;
+    list<CEventSubscriber*> lSubscribers;
+    map<string, unsigned int> mapSequence;
+    size_t nMaxQueue;
+
+    bool Listen();
+    void AcceptConnection();
+    void ProcessLine(CEventSubscriber* psub, const string& strLine);
+
+public:
+    CEventServer() : hListenSocket(INVALID_SOCKET), nMaxQueue(GetArg("-eventqueue", DEFAULT_EVENT_QUEUE) * 1024) {}
+    ~CEventServer();
+
+    bool Subscribed(const string& strTopic) const;
+    void Publish(const string& strTopic, const void* pdata, unsigned int nSize);
+    void Run();
+};
+
+// Guards the server's subscribers, which are published to from whatever
+// thread the event happens on
+static CCriticalSection cs_eventserver;
+static CEventServer* peventserver = NULL;
+
+CEventServer::~CEventServer()
+{
+    BOOST_FOREACH(CEventSubscriber* psub, lSubscribers)
+    {
+        closesocket(psub->hSocket);
+        delete psub;
+    }
+    if (hListenSocket != INVALID_SOCKET)
+        closesocket(hListenSocket);
+}
+
+bool CEventServer::Listen()
+{
+    // Subscribers are local processes only
+    struct in_addr inaddr;
+    inaddr.s_addr = htonl(INADDR_LOOPBACK);
+    CService addrBind(inaddr, GetArg("-eventport", DEFAULT_EVENT_PORT));
+    return ListenLineServer(addrBind, hListenSocket, "Event server");
+}
+
+void CEventServer::AcceptConnection()
+{
+    CAddress addr;
+    SOCKET hSocket = AcceptLineClient(hListenSocket, addr, "Event server");
+    if (hSocket == INVALID_SOCKET)
+        return;
+    if (lSubscribers.size() >= MAX_EVENT_CONNECTIONS)
+    {
+        printf("Event server: connection from %s refused\n", addr.ToString().c_str());
+        closesocket(hSocket);
+        return;
+    }
+
+    if (fDebug)
+        printf("Event server: subscriber connected from %s\n", addr.ToString().c_str());
+    lSubscribers.push_back(new CEventSubscriber(hSocket, addr));
+}
+
+void CEventServer::ProcessLine(CEventSubscriber* psub, const string& strLine)
+{
+    vector<string> vWords;
+    boost::split(vWords, strLine, boost::is_any_of(" \t"), boost::token_compress_on);
+
+    bool fKnown = false;
+    if (vWords.size() == 2)
+    {
+        BOOST_FOREACH(const char* pszTopic, pszEventTopics)
+        {
+            if (vWords[1] == pszTopic)
+            {
+                fKnown = true;
+                break;
+            }
+        }
+    }
+    if (!fKnown || (vWords[0] != "subscribe" && vWords[0] != "unsubscribe"))
+    {
+        printf("Event server: bad request from %s\n", psub->addr.ToString().c_str());
+        psub->fDisconnect = true;
+        return;
+    }
+
+    if (vWords[0] == "subscribe")
+        psub->setTopics.insert(vWords[1]);
+    else
+        psub->setTopics.erase(vWords[1]);
+}
+
+bool CEventServer::Subscribed(const string& strTopic) const
+{
+    BOOST_FOREACH(const CEventSubscriber* psub, lSubscribers)
+        if (!psub->fDisconnect && psub->setTopics.count(strTopic))
+            return true;
+    return false;
+}
+
+void MakeEventFrame(const string& strTopic, unsigned int nSequence, const void* pdata, unsigned int nSize, vector<char>& vchFrame)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << (unsigned int)0 << strTopic << nSequence;
+    ss.write((const char*)pdata, nSize);
+    unsigned int nFrameSize = ss.size() - sizeof(unsigned int);
+    memcpy(&ss[0], &nFrameSize, sizeof(nFrameSize));
+    vchFrame.assign(ss.begin(), ss.end());
+}
+
+void CEventServer::Publish(const string& strTopic, const void* pdata, unsigned int nSize)
+{
+    vector<char> vchFrame;
+    MakeEventFrame(strTopic, mapSequence[strTopic]++, pdata, nSize, vchFrame);
+
+    BOOST_FOREACH(CEventSubscriber* psub, lSubscribers)
+    {
+        if (psub->fDisconnect || !psub->setTopics.count(strTopic))
+            continue;
+        if (psub->nQueued + vchFrame.size() > nMaxQueue)
+        {
+            psub->nDropped++;
+            continue;
+        }
+
+        // Pushed out right away when nothing is waiting, the server thread
+        // only sends what the socket didn't take
+        bool fWasEmpty = psub->vSendQueue.empty();
+        psub->vSendQueue.push_back(vchFrame);
+        psub->nQueued += vchFrame.size();
+        if (fWasEmpty)
+            psub->Send();
+    }
+}
+
+void CEventServer::Run()
+{
+    if (!Listen())
+        return;
+
+    while (!fShutdown)
+    {
+        struct timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 100000;
+
+        fd_set fdsetRecv;
+        fd_set fdsetSend;
+        FD_ZERO(&fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        SOCKET hSocketMax = hListenSocket;
+        FD_SET(hListenSocket, &fdsetRecv);
+        {
+            LOCK(cs_eventserver);
+            BOOST_FOREACH(CEventSubscriber* psub, lSubscribers)
+            {
+                FD_SET(psub->hSocket, &fdsetRecv);
+                if (!psub->vSendQueue.empty())
+                    FD_SET(psub->hSocket, &fdsetSend);
+                hSocketMax = max(hSocketMax, psub->hSocket);
+            }
+        }
+
+        if (select(hSocketMax + 1, &fdsetRecv, &fdsetSend, NULL, &timeout) == SOCKET_ERROR)
+        {
+            printf("Event server: select failed: %d\n", WSAGetLastError());
+            Sleep(100);
+            continue;
+        }
+
+        LOCK(cs_eventserver);
+        if (FD_ISSET(hListenSocket, &fdsetRecv))
+            AcceptConnection();
+
+        BOOST_FOREACH(CEventSubscriber* psub, lSubscribers)
+        {
+            if (FD_ISSET(psub->hSocket, &fdsetRecv))
+            {
+                vector<string> vLines;
+                bool fOpen = RecvLines(psub->hSocket, psub->strRecv, vLines, MAX_EVENT_LINE);
+                BOOST_FOREACH(const string& strLine, vLines)
+                {
+                    if (psub->fDisconnect)
+                        break;
+                    ProcessLine(psub, strLine);
+                }
+                if (!fOpen)
+                    psub->fDisconnect = true;
+            }
+
+            if (!psub->fDisconnect && FD_ISSET(psub->hSocket, &fdsetSend))
+                psub->Send();
+        }
+
+        for (list<CEventSubscriber*>::iterator it = lSubscribers.begin(); it != lSubscribers.end(); )
+        {
+            CEventSubscriber* psub = *it;
+            if (!psub->fDisconnect)
+            {
+                ++it;
+                continue;
+            }
+            if (fDebug || psub->nDropped)
+                printf("Event server: subscriber %s disconnected, %u events dropped\n",
+                       psub->addr.ToString().c_str(), psub->nDropped);
+            closesocket(psub->hSocket);
+            delete psub;
+            it = lSubscribers.erase(it);
+        }
+    }
+}
+
+// Whether anyone listens to strTopic, so events aren't serialized for nobody
+static bool EventSubscribed(const string& strTopic)
+{
+    LOCK(cs_eventserver);
+    return peventserver && peventserver->Subscribed(strTopic);
+}
+
+static void PublishEvent(const string& strTopic, const void* pdata, unsigned int nSize)
+{
+    LOCK(cs_eventserver);
+    if (peventserver)
+        peventserver->Publish(strTopic, pdata, nSize);
+}
+
+void PublishBlockEvents(const CBlock& block, const uint256& hashBlock)
+{
+    if (EventSubscribed("hashblock"))
+        PublishEvent("hashblock", hashBlock.begin(), hashBlock.size());
+    if (EventSubscribed("rawblock"))
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+        PublishEvent("rawblock", &ss[0], ss.size());
+    }
+}
+
+void PublishTransactionEvents(const CTransaction& tx)
+{
+    if (EventSubscribed("hashtx"))
+    {
+        uint256 hashTx = tx.GetHash();
+        PublishEvent("hashtx", hashTx.begin(), hashTx.size());
+    }
+    if (EventSubscribed("rawtx"))
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << tx;
+        PublishEvent("rawtx", &ss[0], ss.size());
+    }
+}
+
+void PublishWalletTransactionEvent(const uint256& hashTx)
+{
+    if (EventSubscribed("wallettx"))
+        PublishEvent("wallettx", hashTx.begin(), hashTx.size());
+}
+
+void ThreadEventServer(void* parg)
+{
+    // Make this thread recognisable as the event server thread
+    RenameThread("bitcoin-events");
+
+    vnThreadsRunning[THREAD_EVENTSERVER]++;
+    CEventServer* pserver = NULL;
+    try
+    {
+        pserver = new CEventServer();
+        {
+            LOCK(cs_eventserver);
+            peventserver = pserver;
+        }
+        pserver->Run();
+    }
+    catch (std::exception& e) {
+        PrintException(&e, "ThreadEventServer()");
+    } catch (...) {
+        PrintException(NULL, "ThreadEventServer()");
+    }
+    {
+        LOCK(cs_eventserver);
+        peventserver = NULL;
+    }
+    delete pserver;
+    vnThreadsRunning[THREAD_EVENTSERVER]--;
+    printf("ThreadEventServer exited\n");
+}
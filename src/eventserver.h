@@ -0,0 +1,56 @@
+// Copyright (c) 2013 The DeOxyRibose developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_EVENTSERVER_H
+#define BITCOIN_EVENTSERVER_H
+
+#include <string>
+#include <vector>
+
+#include "uint256.h"
+
+class CBlock;
+class CTransaction;
+
+/** Port the event server listens on unless -eventport says otherwise */
+static const unsigned short DEFAULT_EVENT_PORT = 28332;
+/** Kilobytes of events queued for a subscriber before further ones are dropped, unless -eventqueue says otherwise */
+static const unsigned int DEFAULT_EVENT_QUEUE = 16384;
+
+/**
+ * Event server (-eventserver): publishes what happens to the chain and the
+ * wallet to local subscribers on -eventport, instead of a process per event
+ * as with -blocknotify and -walletnotify.
+ *
+ * A subscriber sends lines "subscribe <topic>" or "unsubscribe <topic>",
+ * topics being
+ *   hashblock  hash of the new best block
+ *   rawblock   the new best block, serialized
+ *   hashtx     hash of a transaction accepted to the memory pool or connected in a block
+ *   rawtx      such a transaction, serialized
+ *   wallettx   hash of a wallet transaction that was added or changed
+ *
+ * and receives every event of those topics as a frame of
+ *   uint32     size of the rest of the frame
+ *   string     topic, with compact size prefix
+ *   uint32     sequence number, counting the events published on the topic
+ *   bytes      hashes as 32 bytes in serialization order, blocks and transactions serialized
+ * all numbers little endian.  Events that would put a subscriber more than
+ * -eventqueue kilobytes behind are dropped for it, which shows as a gap in
+ * the sequence numbers.
+ */
+
+/** Build the frame of an event as described above */
+void MakeEventFrame(const std::string& strTopic, unsigned int nSequence, const void* pdata, unsigned int nSize, std::vector<char>& vchFrame);
+
+/** Publish a block that became the best block */
+void PublishBlockEvents(const CBlock& block, const uint256& hashBlock);
+/** Publish a transaction accepted to the memory pool or connected in a block */
+void PublishTransactionEvents(const CTransaction& tx);
+/** Publish a wallet transaction that was added or updated */
+void PublishWalletTransactionEvent(const uint256& hashTx);
+
+/** Serve event subscribers on -eventport until shutdown */
+void ThreadEventServer(void* parg);
+
+#endif
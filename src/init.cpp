@@ -10,6 +10,10 @@
 #include "util.h"
 #include "ui_interface.h"
 #include "checkpoints.h"
+#include "stratum.h"
+#include "eventserver.h"
+#include "addrindex.h"
+#include "spentindex.h"
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/filesystem/convenience.hpp>
@@ -75,6 +79,7 @@ void Shutdown(void* parg)
     {
         fShutdown = true;
         nTransactionsUpdated++;
+        UnloadAdditionalWallets();
         bitdb.Flush(false);
         StopNode();
         bitdb.Flush(true);
@@ -229,6 +234,22 @@ std::string HelpMessage()
         "  -datadir=<dir>         " + _("Specify data directory") + "\n" +
         "  -dbcache=<n>           " + _("Set database cache size in megabytes (default: 25)") + "\n" +
         "  -dblogsize=<n>         " + _("Set database disk log size in megabytes (default: 100)") + "\n" +
+        "  -maxmempool=<n>        " + _("Keep the transaction memory pool below <n> megabytes (default: 300)") + "\n" +
+        "  -persistmempool        " + _("Save the memory pool on shutdown and reload it on startup (default: 1)") + "\n" +
+        "  -feefilter             " + _("Tell peers the lowest fee rate the memory pool accepts, so they skip cheaper announcements (default: 1)") + "\n" +
+        "  -txvalidationthreads=<n> " + _("Number of threads verifying incoming transactions outside the main lock, 0 to verify in place (default: 2)") + "\n" +
+        "  -maxuploadtarget=<n>   " + _("Try to keep outbound traffic under <n> megabytes per 24h, 0 for no limit (default: 0)") + "\n" +
+        "  -whitelist=<ip>        " + _("Exempt peers connecting from the given IP address from the upload target") + "\n" +
+        "  -rpcbatchthreads=<n>   " + _("Number of threads executing the read-only calls of a JSON-RPC batch in parallel (default: 4)") + "\n" +
+        "  -stratum               " + _("Serve stratum miners from a built-in server (default: 0)") + "\n" +
+        "  -stratumport=<port>    " + _("Listen for stratum miners on <port> (default: 3333)") + "\n" +
+        "  -stratumallowip=<ip>   " + _("Allow stratum miners from the given IP address, otherwise only from this computer") + "\n" +
+        "  -stratumdifficulty=<n> " + _("Share difficulty for miners that don't ask for one (default: 1)") + "\n" +
+        "  -eventserver           " + _("Publish new blocks and transactions to subscribers on this computer (default: 0)") + "\n" +
+        "  -eventport=<port>      " + _("Listen for event subscribers on <port> (default: 28332)") + "\n" +
+        "  -eventqueue=<n>        " + _("Drop events for a subscriber more than <n> kilobytes behind (default: 16384)") + "\n" +
+        "  -addrindex             " + _("Maintain an index of the outputs paying and spending every address, for the getaddress* calls (default: 0)") + "\n" +
+        "  -spentindex            " + _("Maintain an index of where every output was spent, for verbose transaction decoding (default: 0)") + "\n" +
         "  -timeout=<n>           " + _("Specify connection timeout in milliseconds (default: 5000)") + "\n" +
         "  -proxy=<ip:port>       " + _("Connect through socks proxy") + "\n" +
         "  -socks=<n>             " + _("Select the version of socks proxy to use (4-5, default: 5)") + "\n" +
@@ -658,6 +679,19 @@ bool AppInit2()
         }
     }
 
+    if (mapArgs.count("-whitelist"))
+    {
+        BOOST_FOREACH(string strAddr, mapMultiArgs["-whitelist"]) {
+            std::vector<CNetAddr> vAddr;
+            if (!LookupHostNumeric(strAddr.c_str(), vAddr) || !vAddr[0].IsValid())
+                return InitError(strprintf(_("Invalid -whitelist address: '%s'"), strAddr.c_str()));
+            CNode::AddWhitelisted(vAddr[0]);
+        }
+    }
+
+    if (mapArgs.count("-maxuploadtarget"))
+        CNode::SetMaxOutboundTarget((uint64)GetArg("-maxuploadtarget", 0) * 1024 * 1024);
+
     if (mapArgs.count("-reservebalance")) // reserve balance amount
     {
         int64 nReserveBalance = 0;
@@ -714,6 +748,16 @@ bool AppInit2()
     }
     printf(" block index %15"PRI64d"ms\n", GetTimeMillis() - nStart);
 
+    if (!InitAddrIndex())
+        return InitError(_("Error building the address index"));
+    if (!InitSpentIndex())
+        return InitError(_("Error building the spent index"));
+    if (fRequestShutdown)
+    {
+        printf("Shutdown requested. Exiting.\n");
+        return false;
+    }
+
     if (GetBoolArg("-printblockindex") || GetBoolArg("-printblocktree"))
     {
         PrintBlockTree();
@@ -887,6 +931,12 @@ bool AppInit2()
     if (fServer)
         NewThread(ThreadRPCServer, NULL);
 
+    if (GetBoolArg("-stratum"))
+        NewThread(ThreadStratumServer, NULL);
+
+    if (GetBoolArg("-eventserver"))
+        NewThread(ThreadEventServer, NULL);
+
     // ********************************************************* Step 12: finished
 
     uiInterface.InitMessage(_("Done loading"));
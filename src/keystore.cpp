@@ -19,19 +19,23 @@ bool CBasicKeyStore::AddKey(const CKey& key)
 {
     bool fCompressed = false;
     CSecret secret = key.GetSecret(fCompressed);
+    CKeyID keyID = key.GetPubKey().GetID();
     {
         LOCK(cs_KeyStore);
-        mapKeys[key.GetPubKey().GetID()] = make_pair(secret, fCompressed);
+        mapKeys[keyID] = make_pair(secret, fCompressed);
     }
+    AddedToKeyStore(keyID);
     return true;
 }
 
 bool CBasicKeyStore::AddCScript(const CScript& redeemScript)
 {
+    CScriptID scriptID = redeemScript.GetID();
     {
         LOCK(cs_KeyStore);
-        mapScripts[redeemScript.GetID()] = redeemScript;
+        mapScripts[scriptID] = redeemScript;
     }
+    AddedToKeyStore(scriptID);
     return true;
 }
 
@@ -46,6 +50,28 @@ bool CBasicKeyStore::HaveCScript(const CScriptID& hash) const
 }
 
 
+bool CBasicKeyStore::AddWatchOnly(const CScript& script)
+{
+    {
+        LOCK(cs_KeyStore);
+        mapWatchOnly[Hash160(script)] = script;
+    }
+    std::vector<uint160> vHashes;
+    ExtractLookupHashes(script, vHashes);
+    BOOST_FOREACH(const uint160& hash, vHashes)
+        AddedToKeyStore(hash);
+    return true;
+}
+
+bool CBasicKeyStore::HaveWatchOnly(const CScript& script) const
+{
+    LOCK(cs_KeyStore);
+    // Most key stores watch nothing; don't hash every script asked about
+    if (mapWatchOnly.empty())
+        return false;
+    return mapWatchOnly.count(Hash160(script)) > 0;
+}
+
 bool CBasicKeyStore::GetCScript(const CScriptID &hash, CScript& redeemScriptOut) const
 {
     {
@@ -81,6 +107,7 @@ bool CCryptoKeyStore::Lock()
     {
         LOCK(cs_KeyStore);
         vMasterKey.clear();
+        mapKeyCache.clear();
     }
 
     NotifyStatusChanged(this);
@@ -112,6 +139,7 @@ bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn)
             return false;
         }
         vMasterKey = vMasterKeyIn;
+        mapKeyCache.clear();
     }
     NotifyStatusChanged(this);
     return true;
@@ -149,6 +177,7 @@ bool CCryptoKeyStore::AddCryptedKey(const CPubKey &vchPubKey, const std::vector<
 
         mapCryptedKeys[vchPubKey.GetID()] = make_pair(vchPubKey, vchCryptedSecret);
     }
+    AddedToKeyStore(vchPubKey.GetID());
     return true;
 }
 
@@ -159,6 +188,13 @@ bool CCryptoKeyStore::GetKey(const CKeyID &address, CKey& keyOut) const
         if (!IsCrypted())
             return CBasicKeyStore::GetKey(address, keyOut);
 
+        KeyCacheMap::const_iterator ci = mapKeyCache.find(address);
+        if (ci != mapKeyCache.end())
+        {
+            keyOut = (*ci).second;
+            return true;
+        }
+
         CryptedKeyMap::const_iterator mi = mapCryptedKeys.find(address);
         if (mi != mapCryptedKeys.end())
         {
@@ -171,6 +207,10 @@ bool CCryptoKeyStore::GetKey(const CKeyID &address, CKey& keyOut) const
                 return false;
             keyOut.SetPubKey(vchPubKey);
             keyOut.SetSecret(vchSecret);
+
+            if (mapKeyCache.size() >= MAX_KEY_CACHE_SIZE)
+                mapKeyCache.erase(mapKeyCache.begin());
+            mapKeyCache.insert(std::make_pair(address, keyOut));
             return true;
         }
     }
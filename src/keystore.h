@@ -34,6 +34,10 @@ public:
     virtual bool HaveCScript(const CScriptID &hash) const =0;
     virtual bool GetCScript(const CScriptID &hash, CScript& redeemScriptOut) const =0;
 
+    // Scripts treated as ours without a key to spend them
+    virtual bool AddWatchOnly(const CScript& script) =0;
+    virtual bool HaveWatchOnly(const CScript& script) const =0;
+
     virtual bool GetSecret(const CKeyID &address, CSecret& vchSecret, bool &fCompressed) const
     {
         CKey key;
@@ -42,10 +46,16 @@ public:
         vchSecret = key.GetSecret(fCompressed);
         return true;
     }
+
+protected:
+    // Called after a key, redeem script or watch-only script was added, with
+    // the hash outputs paying it are looked up by (see ExtractLookupHashes)
+    virtual void AddedToKeyStore(const uint160& hash) {}
 };
 
 typedef std::map<CKeyID, std::pair<CSecret, bool> > KeyMap;
 typedef std::map<CScriptID, CScript > ScriptMap;
+typedef std::map<uint160, CScript > WatchOnlyMap;
 
 /** Basic key store, that keeps keys in an address->secret map */
 class CBasicKeyStore : public CKeyStore
@@ -53,6 +63,7 @@ class CBasicKeyStore : public CKeyStore
 protected:
     KeyMap mapKeys;
     ScriptMap mapScripts;
+    WatchOnlyMap mapWatchOnly;
 
 public:
     bool AddKey(const CKey& key);
@@ -95,9 +106,17 @@ public:
     virtual bool AddCScript(const CScript& redeemScript);
     virtual bool HaveCScript(const CScriptID &hash) const;
     virtual bool GetCScript(const CScriptID &hash, CScript& redeemScriptOut) const;
+    virtual bool AddWatchOnly(const CScript& script);
+    virtual bool HaveWatchOnly(const CScript& script) const;
 };
 
 typedef std::map<CKeyID, std::pair<CPubKey, std::vector<unsigned char> > > CryptedKeyMap;
+// Decrypted keys ready to sign with.  The secrets live in OpenSSL's EC_KEY
+// whatever allocator the map uses, so it is a plain map emptied by Lock().
+typedef std::map<CKeyID, CKey> KeyCacheMap;
+
+/** Number of decrypted keys an unlocked wallet keeps around */
+static const unsigned int MAX_KEY_CACHE_SIZE = 1000;
 
 /** Keystore which keeps the private keys encrypted.
  * It derives from the basic key store, which is used if no encryption is active.
@@ -109,6 +128,10 @@ private:
 
     CKeyingMaterial vMasterKey;
 
+    // Keys decrypted since the last unlock, so signing does not pay for the
+    // AES decryption and public key derivation every time.  Emptied by Lock().
+    mutable KeyCacheMap mapKeyCache;
+
     // if fUseCrypto is true, mapKeys must be empty
     // if fUseCrypto is false, vMasterKey must be empty
     bool fUseCrypto;
@@ -121,6 +144,17 @@ protected:
 
     bool Unlock(const CKeyingMaterial& vMasterKeyIn);
 
+    // Copy of the master key, for encrypting secrets without holding
+    // cs_KeyStore; false while locked
+    bool GetMasterKey(CKeyingMaterial& vMasterKeyOut) const
+    {
+        LOCK(cs_KeyStore);
+        if (vMasterKey.empty())
+            return false;
+        vMasterKeyOut = vMasterKey;
+        return true;
+    }
+
 public:
     CCryptoKeyStore() : fUseCrypto(false)
     {
@@ -145,6 +179,13 @@ public:
 
     bool Lock();
 
+    /** Number of decrypted keys kept for signing */
+    unsigned int GetKeyCacheSize() const
+    {
+        LOCK(cs_KeyStore);
+        return mapKeyCache.size();
+    }
+
     virtual bool AddCryptedKey(const CPubKey &vchPubKey, const std::vector<unsigned char> &vchCryptedSecret);
     bool AddKey(const CKey& key);
     bool HaveKey(const CKeyID &address) const
@@ -3,14 +3,17 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addrindex.h"
 #include "alert.h"
 #include "checkpoints.h"
 #include "db.h"
+#include "eventserver.h"
 #include "net.h"
 #include "init.h" 
 #include "ui_interface.h"
 #include "kernel.h"
 #include "scrypt_mine.h"
+#include "spentindex.h"
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -28,6 +31,11 @@ using namespace boost;
 
 CCriticalSection cs_setpwalletRegistered;
 set<CWallet*> setpwalletRegistered; 
+// Which registered wallets have a key or script an output may pay, or have
+// a transaction, so a transaction is matched against all wallets at once.
+// Guarded by cs_setpwalletRegistered.
+static map<uint160, set<CWallet*> > mapWalletLookup;
+static map<uint256, set<CWallet*> > mapWalletTxLookup;
 
 CCriticalSection cs_main;
 
@@ -59,6 +67,11 @@ uint256 hashBestChain = 0;
 CBlockIndex* pindexBest = NULL;
 int64 nTimeBestReceived = 0;
 
+// Copy of hashBestChain for threads waiting on a new block without cs_main
+static CWaitableCriticalSection csBestBlock;
+static boost::condition_variable cvBlockChange;
+static uint256 hashBestBlockNotified = 0;
+
 CMedianFilter<int> cPeerBlockCounts(5, 0); // Amount of blocks that other nodes claim to have
 
 map<uint256, CBlock*> mapOrphanBlocks;
@@ -66,8 +79,8 @@ multimap<uint256, CBlock*> mapOrphanBlocksByPrev;
 set<pair<COutPoint, unsigned int> > setStakeSeenOrphan;
 map<uint256, uint256> mapProofOfStake;
 
-map<uint256, CDataStream*> mapOrphanTransactions;
-map<uint256, map<uint256, CDataStream*> > mapOrphanTransactionsByPrev;
+map<uint256, COrphanTx> mapOrphanTransactions;
+map<COutPoint, set<uint256> > mapOrphanTransactionsByPrev;
 
 // Constant stuff for coinbase transactions we create:
 CScript COINBASE_FLAGS;
@@ -96,6 +109,33 @@ void RegisterWallet(CWallet* pwalletIn)
         LOCK(cs_setpwalletRegistered);
         setpwalletRegistered.insert(pwalletIn);
     }
+
+    // Keys added from here on are entered by the wallet itself, entering
+    // them twice does no harm
+    set<uint160> setHashes;
+    vector<uint256> vTxHashes;
+    pwalletIn->GetLookupHashes(setHashes, vTxHashes);
+    {
+        LOCK(cs_setpwalletRegistered);
+        BOOST_FOREACH(const uint160& hash, setHashes)
+            mapWalletLookup[hash].insert(pwalletIn);
+        BOOST_FOREACH(const uint256& hashTx, vTxHashes)
+            mapWalletTxLookup[hashTx].insert(pwalletIn);
+    }
+}
+
+template<typename K>
+void static EraseWalletLookups(map<K, set<CWallet*> >& mapLookup, CWallet* pwallet)
+{
+    typename map<K, set<CWallet*> >::iterator mi = mapLookup.begin();
+    while (mi != mapLookup.end())
+    {
+        (*mi).second.erase(pwallet);
+        if ((*mi).second.empty())
+            mapLookup.erase(mi++);
+        else
+            mi++;
+    }
 }
 
 void UnregisterWallet(CWallet* pwalletIn)
@@ -103,13 +143,74 @@ void UnregisterWallet(CWallet* pwalletIn)
     {
         LOCK(cs_setpwalletRegistered);
         setpwalletRegistered.erase(pwalletIn);
+        EraseWalletLookups(mapWalletLookup, pwalletIn);
+        EraseWalletLookups(mapWalletTxLookup, pwalletIn);
+    }
+}
+
+void AddWalletLookup(CWallet* pwallet, const uint160& hash)
+{
+    LOCK(cs_setpwalletRegistered);
+    if (setpwalletRegistered.count(pwallet))
+        mapWalletLookup[hash].insert(pwallet);
+}
+
+void AddWalletTxLookup(CWallet* pwallet, const uint256& hashTx)
+{
+    LOCK(cs_setpwalletRegistered);
+    if (setpwalletRegistered.count(pwallet))
+        mapWalletTxLookup[hashTx].insert(pwallet);
+}
+
+void EraseWalletTxLookup(CWallet* pwallet, const uint256& hashTx)
+{
+    LOCK(cs_setpwalletRegistered);
+    map<uint256, set<CWallet*> >::iterator mi = mapWalletTxLookup.find(hashTx);
+    if (mi == mapWalletTxLookup.end())
+        return;
+    (*mi).second.erase(pwallet);
+    if ((*mi).second.empty())
+        mapWalletTxLookup.erase(mi);
+}
+
+// find the wallets that may be involved with the passed transaction: those
+// having it or a transaction it spends, or a key or script an output pays.
+// With fInputsOnly only those it may spend from.
+void static GetInvolvedWallets(const CTransaction& tx, set<CWallet*>& setWallets, bool fInputsOnly = false)
+{
+    vector<uint160> vHashes;
+    if (!fInputsOnly)
+    {
+        BOOST_FOREACH(const CTxOut& txout, tx.vout)
+            ExtractLookupHashes(txout.scriptPubKey, vHashes);
+    }
+
+    LOCK(cs_setpwalletRegistered);
+    map<uint256, set<CWallet*> >::const_iterator mi;
+    if (!fInputsOnly && (mi = mapWalletTxLookup.find(tx.GetHash())) != mapWalletTxLookup.end())
+        setWallets.insert((*mi).second.begin(), (*mi).second.end());
+    if (!tx.IsCoinBase())
+    {
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        {
+            if ((mi = mapWalletTxLookup.find(txin.prevout.hash)) != mapWalletTxLookup.end())
+                setWallets.insert((*mi).second.begin(), (*mi).second.end());
+        }
+    }
+    BOOST_FOREACH(const uint160& hash, vHashes)
+    {
+        map<uint160, set<CWallet*> >::const_iterator mil = mapWalletLookup.find(hash);
+        if (mil != mapWalletLookup.end())
+            setWallets.insert((*mil).second.begin(), (*mil).second.end());
     }
 }
 
 // check whether the passed transaction is from us
 bool static IsFromMe(CTransaction& tx)
 {
-    BOOST_FOREACH(CWallet* pwallet, setpwalletRegistered)
+    set<CWallet*> setWallets;
+    GetInvolvedWallets(tx, setWallets, true);
+    BOOST_FOREACH(CWallet* pwallet, setWallets)
         if (pwallet->IsFromMe(tx))
             return true;
     return false;
@@ -139,14 +240,22 @@ void SyncWithWallets(const CTransaction& tx, const CBlock* pblock, bool fUpdate,
         // wallets need to refund inputs when disconnecting coinstake
         if (tx.IsCoinStake())
         {
-            BOOST_FOREACH(CWallet* pwallet, setpwalletRegistered)
+            set<CWallet*> setWallets;
+            GetInvolvedWallets(tx, setWallets, true);
+            BOOST_FOREACH(CWallet* pwallet, setWallets)
                 if (pwallet->IsFromMe(tx))
                     pwallet->DisableTransaction(tx);
         }
         return;
     }
 
-    BOOST_FOREACH(CWallet* pwallet, setpwalletRegistered)
+    PublishTransactionEvents(tx);
+
+    // Wallets not involved would neither add the transaction nor have
+    // outputs it spends, no need to ask them
+    set<CWallet*> setWallets;
+    GetInvolvedWallets(tx, setWallets);
+    BOOST_FOREACH(CWallet* pwallet, setWallets)
         pwallet->AddToWalletIfInvolvingMe(tx, pblock, fUpdate);
 }
 
@@ -185,6 +294,37 @@ void ResendWalletTransactions()
         pwallet->ResendWalletTransactions();
 }
 
+// Wallet rebroadcast runs on its own timer instead of from SendMessages, so
+// waiting for cs_main here never holds up the network thread
+void ThreadResendWalletTransactions(void* parg)
+{
+    // Make this thread recognisable as the wallet rebroadcast thread
+    RenameThread("bitcoin-wltresend");
+
+    vnThreadsRunning[THREAD_RESENDWALLET]++;
+    try
+    {
+        while (!fShutdown)
+        {
+            // CWallet::ResendWalletTransactions keeps its own randomised
+            // schedule, this only polls it
+            {
+                LOCK(cs_main);
+                ResendWalletTransactions();
+            }
+            for (int i = 0; i < 10 && !fShutdown; i++)
+                Sleep(1000);
+        }
+    }
+    catch (std::exception& e) {
+        PrintException(&e, "ThreadResendWalletTransactions()");
+    } catch (...) {
+        PrintException(NULL, "ThreadResendWalletTransactions()");
+    }
+    vnThreadsRunning[THREAD_RESENDWALLET]--;
+    printf("ThreadResendWalletTransactions exited\n");
+}
+
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -192,16 +332,17 @@ void ResendWalletTransactions()
 // mapOrphanTransactions
 //
 
-bool AddOrphanTx(const CDataStream& vMsg)
+// Orphans in insertion order of their slot, for O(1) random eviction
+static vector<uint256> vOrphanList;
+static map<NodeId, unsigned int> mapOrphanCountByPeer;
+static int64 nNextOrphanSweep = 0;
+
+bool AddOrphanTx(const CTransaction& tx, NodeId peer)
 {
-    CTransaction tx;
-    CDataStream(vMsg) >> tx;
     uint256 hash = tx.GetHash();
     if (mapOrphanTransactions.count(hash))
         return false;
 
-    CDataStream* pvMsg = new CDataStream(vMsg);
-
     // Ignore big transactions, to avoid a
     // send-big-orphans memory exhaustion attack. If a peer has a legitimate
     // large transaction with a missing parent then we assume
@@ -209,16 +350,30 @@ bool AddOrphanTx(const CDataStream& vMsg)
     // have been mined or received.
     // 10,000 orphans, each of which is at most 5,000 bytes big is
     // at most 500 megabytes of orphans:
-    if (pvMsg->size() > 5000)
+    unsigned int nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    if (nSize > 5000)
     {
-        printf("ignoring large orphan tx (size: %"PRIszu", hash: %s)\n", pvMsg->size(), hash.ToString().substr(0,10).c_str());
-        delete pvMsg;
+        printf("ignoring large orphan tx (size: %u, hash: %s)\n", nSize, hash.ToString().substr(0,10).c_str());
         return false;
     }
 
-    mapOrphanTransactions[hash] = pvMsg;
+    // One peer must not be able to crowd everybody else out of the pool
+    map<NodeId, unsigned int>::iterator itPeer = mapOrphanCountByPeer.find(peer);
+    if (itPeer != mapOrphanCountByPeer.end() && (*itPeer).second >= MAX_ORPHAN_TRANSACTIONS_PER_PEER)
+    {
+        printf("ignoring orphan tx %s, peer=%d is over its orphan limit\n", hash.ToString().substr(0,10).c_str(), peer);
+        return false;
+    }
+
+    COrphanTx& orphan = mapOrphanTransactions[hash];
+    orphan.tx = tx;
+    orphan.fromPeer = peer;
+    orphan.nTimeExpire = GetTime() + ORPHAN_TX_EXPIRE_TIME;
+    orphan.nListPos = vOrphanList.size();
+    vOrphanList.push_back(hash);
     BOOST_FOREACH(const CTxIn& txin, tx.vin)
-        mapOrphanTransactionsByPrev[txin.prevout.hash].insert(make_pair(hash, pvMsg));
+        mapOrphanTransactionsByPrev[txin.prevout].insert(hash);
+    mapOrphanCountByPeer[peer]++;
 
     printf("stored orphan tx %s (mapsz %"PRIszu")\n", hash.ToString().substr(0,10).c_str(),
         mapOrphanTransactions.size());
@@ -227,37 +382,124 @@ bool AddOrphanTx(const CDataStream& vMsg)
 
 void static EraseOrphanTx(uint256 hash)
 {
-    if (!mapOrphanTransactions.count(hash))
+    map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
+    if (it == mapOrphanTransactions.end())
         return;
-    const CDataStream* pvMsg = mapOrphanTransactions[hash];
-    CTransaction tx;
-    CDataStream(*pvMsg) >> tx;
-    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    const COrphanTx& orphan = (*it).second;
+    BOOST_FOREACH(const CTxIn& txin, orphan.tx.vin)
     {
-        mapOrphanTransactionsByPrev[txin.prevout.hash].erase(hash);
-        if (mapOrphanTransactionsByPrev[txin.prevout.hash].empty())
-            mapOrphanTransactionsByPrev.erase(txin.prevout.hash);
+        map<COutPoint, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
+        if (itPrev == mapOrphanTransactionsByPrev.end())
+            continue;
+        (*itPrev).second.erase(hash);
+        if ((*itPrev).second.empty())
+            mapOrphanTransactionsByPrev.erase(itPrev);
     }
-    delete pvMsg;
-    mapOrphanTransactions.erase(hash);
+
+    // Fill the hole in vOrphanList with its last element
+    const uint256& hashLast = vOrphanList.back();
+    mapOrphanTransactions[hashLast].nListPos = orphan.nListPos;
+    vOrphanList[orphan.nListPos] = hashLast;
+    vOrphanList.pop_back();
+
+    map<NodeId, unsigned int>::iterator itPeer = mapOrphanCountByPeer.find(orphan.fromPeer);
+    if (itPeer != mapOrphanCountByPeer.end() && --(*itPeer).second == 0)
+        mapOrphanCountByPeer.erase(itPeer);
+
+    mapOrphanTransactions.erase(it);
 }
 
 unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
 {
+    // Drop orphans whose parents never showed up
+    int64 nNow = GetTime();
+    if (nNextOrphanSweep <= nNow)
+    {
+        vector<uint256> vExpired;
+        for (map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.begin(); it != mapOrphanTransactions.end(); ++it)
+            if ((*it).second.nTimeExpire <= nNow)
+                vExpired.push_back((*it).first);
+        BOOST_FOREACH(const uint256& hash, vExpired)
+            EraseOrphanTx(hash);
+        nNextOrphanSweep = nNow + ORPHAN_TX_EXPIRE_INTERVAL;
+        if (!vExpired.empty())
+            printf("LimitOrphanTxSize() : removed %"PRIszu" expired orphan tx\n", vExpired.size());
+    }
+
     unsigned int nEvicted = 0;
     while (mapOrphanTransactions.size() > nMaxOrphans)
     {
         // Evict a random orphan:
-        uint256 randomhash = GetRandHash();
-        map<uint256, CDataStream*>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end())
-            it = mapOrphanTransactions.begin();
-        EraseOrphanTx(it->first);
+        EraseOrphanTx(vOrphanList[GetRand(vOrphanList.size())]);
         ++nEvicted;
     }
     return nEvicted;
 }
 
+// Retry the orphans that spend outputs of the transactions in vWorkQueue
+// (txid, number of outputs), which were just accepted to the memory pool or
+// connected in a block.  Orphans accepted here are queued in turn, so a whole
+// chain of them resolves in one pass.  Must be called with cs_main held.
+void static ProcessOrphansFor(CTxDB& txdb, vector<pair<uint256, unsigned int> >& vWorkQueue)
+{
+    for (unsigned int i = 0; i < vWorkQueue.size(); i++)
+    {
+        // Gather first: accepting or erasing orphans changes the index
+        set<uint256> setCandidates;
+        for (unsigned int n = 0; n < vWorkQueue[i].second; n++)
+        {
+            map<COutPoint, set<uint256> >::const_iterator itPrev = mapOrphanTransactionsByPrev.find(COutPoint(vWorkQueue[i].first, n));
+            if (itPrev != mapOrphanTransactionsByPrev.end())
+                setCandidates.insert((*itPrev).second.begin(), (*itPrev).second.end());
+        }
+
+        BOOST_FOREACH(const uint256& hashOrphan, setCandidates)
+        {
+            map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hashOrphan);
+            if (it == mapOrphanTransactions.end())
+                continue;
+            CTransaction tx = (*it).second.tx;
+            CInv inv(MSG_TX, hashOrphan);
+            bool fMissingInputs = false;
+
+            if (tx.AcceptToMemoryPool(txdb, true, &fMissingInputs))
+            {
+                printf("   accepted orphan tx %s\n", hashOrphan.ToString().substr(0,10).c_str());
+                SyncWithWallets(tx, NULL, true);
+                RelayMessage(inv, tx);
+                vWorkQueue.push_back(make_pair(hashOrphan, (unsigned int)tx.vout.size()));
+                EraseOrphanTx(hashOrphan);
+            }
+            else if (!fMissingInputs)
+            {
+                // invalid orphan
+                EraseOrphanTx(hashOrphan);
+                printf("   removed invalid orphan tx %s\n", hashOrphan.ToString().substr(0,10).c_str());
+            }
+        }
+    }
+}
+
+// A new best block may confirm the parents orphans were waiting for; it also
+// makes orphans it contains itself redundant
+void static ProcessOrphansForBlock(const CBlock& block)
+{
+    if (mapOrphanTransactions.empty())
+        return;
+
+    vector<pair<uint256, unsigned int> > vWorkQueue;
+    vWorkQueue.reserve(block.vtx.size());
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+    {
+        uint256 hash = tx.GetHash();
+        EraseOrphanTx(hash);
+        vWorkQueue.push_back(make_pair(hash, (unsigned int)tx.vout.size()));
+    }
+
+    CTxDB txdb("r");
+    ProcessOrphansFor(txdb, vWorkQueue);
+}
+
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -538,8 +780,40 @@ int64 CTransaction::GetMinFee(unsigned int nBlockSize, bool fAllowFree,
 }
 
 
+uint64 GetMaxMempoolSize()
+{
+    return (uint64)GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+}
+
+// Approximate heap cost of one allocation of nAlloc bytes (glibc-style:
+// one word of header, rounded up to 16 bytes)
+static inline unsigned int MallocUsage(unsigned int nAlloc)
+{
+    if (nAlloc == 0)
+        return 0;
+    return ((nAlloc + sizeof(void*) + 15) >> 4) << 4;
+}
+
+// Estimated memory held by the pool for one transaction: its vectors and
+// scripts plus the tree nodes in mapTx, mapInfo, setEvictionOrder and mapNextTx
+static unsigned int GetMemPoolEntryUsage(const CTransaction& tx)
+{
+    static const unsigned int nNodeOverhead = 4 * sizeof(void*);
+    unsigned int nUsage = MallocUsage(tx.vin.capacity() * sizeof(CTxIn)) +
+                          MallocUsage(tx.vout.capacity() * sizeof(CTxOut));
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        nUsage += MallocUsage(txin.scriptSig.capacity());
+    BOOST_FOREACH(const CTxOut& txout, tx.vout)
+        nUsage += MallocUsage(txout.scriptPubKey.capacity());
+    nUsage += MallocUsage(nNodeOverhead + sizeof(uint256) + sizeof(CTransaction));
+    nUsage += MallocUsage(nNodeOverhead + sizeof(uint256) + sizeof(CTxMemPoolEntry));
+    nUsage += MallocUsage(nNodeOverhead + sizeof(std::pair<double, uint256>));
+    nUsage += tx.vin.size() * MallocUsage(nNodeOverhead + sizeof(COutPoint) + sizeof(CInPoint));
+    return nUsage;
+}
+
 bool CTxMemPool::accept(CTxDB& txdb, CTransaction &tx, bool fCheckInputs,
-                        bool* pfMissingInputs)
+                        bool* pfMissingInputs, bool fScriptChecks)
 {
     if (pfMissingInputs)
         *pfMissingInputs = false;
@@ -598,6 +872,11 @@ bool CTxMemPool::accept(CTxDB& txdb, CTransaction &tx, bool fCheckInputs,
         }
     }
 
+    // Fee is only known when inputs are checked; unchecked entries (e.g.
+    // resurrected by a reorg) count as paying nothing for eviction purposes.
+    // Any prioritisetransaction delta is credited either way.
+    int64 nFees = 0;
+    ApplyDeltas(hash, nFees);
     if (fCheckInputs)
     {
         MapPrevTx mapInputs;
@@ -620,7 +899,7 @@ bool CTxMemPool::accept(CTxDB& txdb, CTransaction &tx, bool fCheckInputs,
         // you should add code here to check that the transaction does a
         // reasonable number of ECDSA signature verifications.
 
-        int64 nFees = tx.GetValueIn(mapInputs)-tx.GetValueOut();
+        nFees += tx.GetValueIn(mapInputs)-tx.GetValueOut();
         unsigned int nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
 
         // Don't accept it if it can't get into a block
@@ -630,6 +909,14 @@ bool CTxMemPool::accept(CTxDB& txdb, CTransaction &tx, bool fCheckInputs,
                          hash.ToString().c_str(),
                          nFees, txMinFee);
 
+        // Once the pool has had to evict, require at least the fee rate of
+        // what was thrown out so the same spam does not churn straight back in
+        int64 nMempoolMinFee = GetMinFee(GetMaxMempoolSize()) * nSize / 1000;
+        if (nFees < nMempoolMinFee)
+            return error("CTxMemPool::accept() : mempool min fee not met %s, %"PRI64d" < %"PRI64d,
+                         hash.ToString().c_str(),
+                         nFees, nMempoolMinFee);
+
         // Continuously rate-limit free transactions
         // This mitigates 'penny-flooding' -- sending thousands of free transactions just to
         // be annoying or make others' transactions take longer to confirm.
@@ -657,7 +944,7 @@ bool CTxMemPool::accept(CTxDB& txdb, CTransaction &tx, bool fCheckInputs,
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!tx.ConnectInputs(txdb, mapInputs, mapUnused, CDiskTxPos(1,1,1), pindexBest, false, false))
+        if (!tx.ConnectInputs(txdb, mapInputs, mapUnused, CDiskTxPos(1,1,1), pindexBest, false, false, true, fScriptChecks))
         {
             return error("CTxMemPool::accept() : ConnectInputs failed %s", hash.ToString().substr(0,10).c_str());
         }
@@ -671,7 +958,12 @@ bool CTxMemPool::accept(CTxDB& txdb, CTransaction &tx, bool fCheckInputs,
             printf("CTxMemPool::accept() : replacing tx %s with new version\n", ptxOld->GetHash().ToString().c_str());
             remove(*ptxOld);
         }
-        addUnchecked(hash, tx);
+        addUnchecked(hash, tx, nFees);
+
+        // Make room if the pool grew past its limit; the new transaction
+        // may itself belong to the cheapest package
+        if (TrimToSize(GetMaxMempoolSize()) > 0 && !exists(hash))
+            return error("CTxMemPool::accept() : mempool full, %s not accepted", hash.ToString().substr(0,10).c_str());
     }
 
     ///// are we sure this is ok when loading transactions or restoring block txes
@@ -679,9 +971,9 @@ bool CTxMemPool::accept(CTxDB& txdb, CTransaction &tx, bool fCheckInputs,
     if (ptxOld)
         EraseFromWallets(ptxOld->GetHash());
 
-    printf("CTxMemPool::accept() : accepted %s (poolsz %"PRIszu")\n",
+    printf("CTxMemPool::accept() : accepted %s (poolsz %"PRIszu", %"PRI64u" bytes)\n",
            hash.ToString().substr(0,10).c_str(),
-           mapTx.size());
+           mapTx.size(), DynamicMemoryUsage());
     return true;
 }
 
@@ -690,28 +982,138 @@ bool CTransaction::AcceptToMemoryPool(CTxDB& txdb, bool fCheckInputs, bool* pfMi
     return mempool.accept(txdb, *this, fCheckInputs, pfMissingInputs);
 }
 
-bool CTxMemPool::addUnchecked(const uint256& hash, CTransaction &tx)
+bool CTxMemPool::addUnchecked(const uint256& hash, CTransaction &tx, int64 nFee)
 {
     // Add to memory pool without checking anything.  Don't call this directly,
     // call CTxMemPool::accept to properly check the transaction first.
     {
+        LOCK(cs);
+        if (mapTx.count(hash))
+            return true;
         mapTx[hash] = tx;
         for (unsigned int i = 0; i < tx.vin.size(); i++)
             mapNextTx[tx.vin[i].prevout] = CInPoint(&mapTx[hash], i);
+
+        CTxMemPoolEntry entry(nFee, ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION),
+                              GetMemPoolEntryUsage(mapTx[hash]), GetTime());
+
+        // After a reorg, spends of this transaction may already be waiting in the pool
+        set<uint256> setDescendants;
+        CalculateDescendants(hash, setDescendants);
+        BOOST_FOREACH(const uint256& hashDescendant, setDescendants)
+        {
+            if (hashDescendant == hash)
+                continue;
+            const CTxMemPoolEntry& entryDescendant = mapInfo[hashDescendant];
+            entry.nFeesWithDescendants += entryDescendant.nFee;
+            entry.nSizeWithDescendants += entryDescendant.nTxSize;
+        }
+
+        set<uint256> setAncestors;
+        CalculateAncestors(tx, setAncestors);
+        BOOST_FOREACH(const uint256& hashAncestor, setAncestors)
+            UpdateDescendantState(hashAncestor, entry.nFeesWithDescendants, entry.nSizeWithDescendants);
+
+        mapInfo[hash] = entry;
+        setEvictionOrder.insert(make_pair(entry.GetEvictionScore(), hash));
+        nTotalUsage += entry.nUsageSize;
+        nTotalTxSize += entry.nTxSize;
         nTransactionsUpdated++;
     }
     return true;
 }
 
+void CTxMemPool::UpdateDescendantState(const uint256& hash, int64 nFeeDelta, int64 nSizeDelta)
+{
+    map<uint256, CTxMemPoolEntry>::iterator mi = mapInfo.find(hash);
+    if (mi == mapInfo.end())
+        return;
+    CTxMemPoolEntry& entry = (*mi).second;
+    setEvictionOrder.erase(make_pair(entry.GetEvictionScore(), hash));
+    entry.nFeesWithDescendants += nFeeDelta;
+    entry.nSizeWithDescendants += nSizeDelta;
+    setEvictionOrder.insert(make_pair(entry.GetEvictionScore(), hash));
+}
+
+void CTxMemPool::CalculateAncestors(const CTransaction& tx, set<uint256>& setAncestors) const
+{
+    vector<const CTransaction*> vWork(1, &tx);
+    while (!vWork.empty())
+    {
+        const CTransaction* ptx = vWork.back();
+        vWork.pop_back();
+        BOOST_FOREACH(const CTxIn& txin, ptx->vin)
+        {
+            map<uint256, CTransaction>::const_iterator mi = mapTx.find(txin.prevout.hash);
+            if (mi != mapTx.end() && setAncestors.insert((*mi).first).second)
+                vWork.push_back(&(*mi).second);
+        }
+    }
+}
+
+void CTxMemPool::CalculateDescendants(const uint256& hash, set<uint256>& setDescendants) const
+{
+    vector<uint256> vWork(1, hash);
+    setDescendants.insert(hash);
+    while (!vWork.empty())
+    {
+        uint256 hashTx = vWork.back();
+        vWork.pop_back();
+        // mapNextTx is ordered by outpoint, so all spends of hashTx are adjacent
+        for (map<COutPoint, CInPoint>::const_iterator mi = mapNextTx.lower_bound(COutPoint(hashTx, 0));
+             mi != mapNextTx.end() && (*mi).first.hash == hashTx; ++mi)
+        {
+            uint256 hashChild = (*mi).second.ptx->GetHash();
+            if (setDescendants.insert(hashChild).second)
+                vWork.push_back(hashChild);
+        }
+    }
+}
 
 bool CTxMemPool::remove(CTransaction &tx)
+{
+    list<CTransaction> removed;
+    return remove(tx, removed, false);
+}
+
+bool CTxMemPool::remove(const CTransaction &tx, list<CTransaction>& removed, bool fRecursive)
 {
     // Remove transaction from memory pool
     {
         LOCK(cs);
         uint256 hash = tx.GetHash();
+        if (fRecursive)
+        {
+            // Spends go first so ancestor bookkeeping is unwound leaf to root
+            for (unsigned int i = 0; i < tx.vout.size(); i++)
+            {
+                map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
+                if (it == mapNextTx.end())
+                    continue;
+                CTransaction txChild = *(*it).second.ptx;
+                remove(txChild, removed, true);
+            }
+        }
         if (mapTx.count(hash))
         {
+            set<uint256> setAncestors;
+            CalculateAncestors(tx, setAncestors);
+
+            map<uint256, CTxMemPoolEntry>::iterator mi = mapInfo.find(hash);
+            if (mi != mapInfo.end())
+            {
+                const CTxMemPoolEntry& entry = (*mi).second;
+                BOOST_FOREACH(const uint256& hashAncestor, setAncestors)
+                    UpdateDescendantState(hashAncestor, -entry.nFee, -(int64)entry.nTxSize);
+                setEvictionOrder.erase(make_pair(entry.GetEvictionScore(), hash));
+                nTotalUsage -= entry.nUsageSize;
+                nTotalTxSize -= entry.nTxSize;
+                mapInfo.erase(mi);
+            }
+
+            // tx may refer to the pool's own copy, so it must not be used
+            // after mapTx.erase()
+            removed.push_back(tx);
             BOOST_FOREACH(const CTxIn& txin, tx.vin)
                 mapNextTx.erase(txin.prevout);
             mapTx.erase(hash);
@@ -721,11 +1123,90 @@ bool CTxMemPool::remove(CTransaction &tx)
     return true;
 }
 
+void CTxMemPool::removeForBlock(const vector<CTransaction>& vtx)
+{
+    LOCK(cs);
+    BOOST_FOREACH(const CTransaction& tx, vtx)
+    {
+        list<CTransaction> removed;
+        remove(tx, removed, false);
+        mapDeltas.erase(tx.GetHash());
+    }
+    // Let the rolling minimum fee start decaying again
+    nLastRollingFeeUpdate = GetTime();
+    fBlockSinceLastRollingFeeBump = true;
+}
+
+void CTxMemPool::TrackPackageRemoved(double dFeeRate)
+{
+    if (dFeeRate > dRollingMinimumFeeRate)
+    {
+        dRollingMinimumFeeRate = dFeeRate;
+        fBlockSinceLastRollingFeeBump = false;
+    }
+}
+
+unsigned int CTxMemPool::TrimToSize(uint64 nSizeLimit)
+{
+    LOCK(cs);
+    unsigned int nRemoved = 0;
+    while (!setEvictionOrder.empty() && nTotalUsage > nSizeLimit)
+    {
+        uint256 hash = (*setEvictionOrder.begin()).second;
+        const CTxMemPoolEntry& entry = mapInfo[hash];
+
+        // New transactions must beat the evicted package by the relay fee
+        double dRemovedRate = (double)entry.nFeesWithDescendants * 1000 / max(entry.nSizeWithDescendants, (uint64)1);
+        TrackPackageRemoved(dRemovedRate + MIN_RELAY_TX_FEE);
+
+        CTransaction tx = mapTx[hash];
+        list<CTransaction> removed;
+        remove(tx, removed, true);
+        nRemoved += removed.size();
+    }
+    if (nRemoved > 0)
+        printf("CTxMemPool::TrimToSize() : evicted %u tx, usage %"PRI64u" bytes, min fee rate %s\n",
+               nRemoved, nTotalUsage, FormatMoney((int64)dRollingMinimumFeeRate).c_str());
+    return nRemoved;
+}
+
+int64 CTxMemPool::GetMinFee(uint64 nSizeLimit) const
+{
+    LOCK(cs);
+    if (!fBlockSinceLastRollingFeeBump || dRollingMinimumFeeRate == 0)
+        return (int64)dRollingMinimumFeeRate;
+
+    int64 nNow = GetTime();
+    if (nNow > nLastRollingFeeUpdate + 10)
+    {
+        // Decay faster while the pool is well below its limit
+        double dHalfLife = ROLLING_FEE_HALFLIFE;
+        if (nTotalUsage < nSizeLimit / 4)
+            dHalfLife /= 4;
+        else if (nTotalUsage < nSizeLimit / 2)
+            dHalfLife /= 2;
+
+        dRollingMinimumFeeRate = dRollingMinimumFeeRate / pow(2.0, (nNow - nLastRollingFeeUpdate) / dHalfLife);
+        nLastRollingFeeUpdate = nNow;
+
+        if (dRollingMinimumFeeRate < MIN_RELAY_TX_FEE / 2)
+        {
+            dRollingMinimumFeeRate = 0;
+            return 0;
+        }
+    }
+    return max((int64)dRollingMinimumFeeRate, MIN_RELAY_TX_FEE);
+}
+
 void CTxMemPool::clear()
 {
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    mapInfo.clear();
+    setEvictionOrder.clear();
+    nTotalUsage = 0;
+    nTotalTxSize = 0;
     ++nTransactionsUpdated;
 }
 
@@ -739,6 +1220,254 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
         vtxid.push_back((*mi).first);
 }
 
+void CTxMemPool::PrioritiseTransaction(const uint256& hash, int64 nFeeDelta)
+{
+    LOCK(cs);
+    int64& nDelta = mapDeltas[hash];
+    nDelta += nFeeDelta;
+    if (nDelta == 0)
+        mapDeltas.erase(hash);
+
+    map<uint256, CTxMemPoolEntry>::iterator mi = mapInfo.find(hash);
+    if (mi == mapInfo.end())
+        return;
+
+    // Re-score the entry and every package it belongs to
+    CTxMemPoolEntry& entry = (*mi).second;
+    setEvictionOrder.erase(make_pair(entry.GetEvictionScore(), hash));
+    entry.nFee += nFeeDelta;
+    entry.nFeesWithDescendants += nFeeDelta;
+    setEvictionOrder.insert(make_pair(entry.GetEvictionScore(), hash));
+
+    set<uint256> setAncestors;
+    CalculateAncestors(mapTx[hash], setAncestors);
+    BOOST_FOREACH(const uint256& hashAncestor, setAncestors)
+        UpdateDescendantState(hashAncestor, nFeeDelta, 0);
+    nTransactionsUpdated++;
+}
+
+void CTxMemPool::ApplyDeltas(const uint256& hash, int64& nFee) const
+{
+    LOCK(cs);
+    map<uint256, int64>::const_iterator mi = mapDeltas.find(hash);
+    if (mi != mapDeltas.end())
+        nFee += (*mi).second;
+}
+
+// Set once mempool.dat has been read completely; until then a shutdown must
+// not overwrite it with the partially reloaded pool
+static bool fMempoolLoaded = false;
+
+bool DumpMempool()
+{
+    if (!fMempoolLoaded)
+        return error("DumpMempool() : mempool.dat not fully loaded yet, keeping it");
+
+    int64 nStart = GetTimeMillis();
+
+    // Snapshot the pool in dependency order, parents ahead of their spends,
+    // so the loader never sees a child before the input it depends on
+    vector<pair<unsigned int, uint256> > vOrder;
+    CDataStream ssMempool(SER_DISK, CLIENT_VERSION);
+    ssMempool << FLATDATA(pchMessageStart);
+    ssMempool << MEMPOOL_DUMP_VERSION;
+    {
+        LOCK(mempool.cs);
+        vOrder.reserve(mempool.mapTx.size());
+        for (map<uint256, CTransaction>::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
+        {
+            set<uint256> setAncestors;
+            mempool.CalculateAncestors((*mi).second, setAncestors);
+            vOrder.push_back(make_pair(setAncestors.size(), (*mi).first));
+        }
+        sort(vOrder.begin(), vOrder.end());
+
+        ssMempool << (uint64)vOrder.size();
+        BOOST_FOREACH(const PAIRTYPE(unsigned int, uint256)& item, vOrder)
+        {
+            int64 nFeeDelta = 0;
+            mempool.ApplyDeltas(item.second, nFeeDelta);
+            ssMempool << mempool.mapTx[item.second];
+            ssMempool << mempool.mapInfo[item.second].nTime;
+            ssMempool << nFeeDelta;
+        }
+
+        // Deltas for transactions we have not seen yet are kept too
+        map<uint256, int64> mapDeltas;
+        for (map<uint256, int64>::iterator mi = mempool.mapDeltas.begin(); mi != mempool.mapDeltas.end(); ++mi)
+            if (!mempool.mapTx.count((*mi).first))
+                mapDeltas.insert(*mi);
+        ssMempool << mapDeltas;
+    }
+    uint256 hash = Hash(ssMempool.begin(), ssMempool.end());
+    ssMempool << hash;
+
+    // Write to a temporary file and move it into place, as CAddrDB does
+    unsigned short randv = 0;
+    RAND_bytes((unsigned char *)&randv, sizeof(randv));
+    boost::filesystem::path pathTmp = GetDataDir() / strprintf("mempool.dat.%04x", randv);
+    FILE *file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!fileout)
+        return error("DumpMempool() : open failed");
+    try {
+        fileout << ssMempool;
+    }
+    catch (std::exception &e) {
+        return error("DumpMempool() : I/O error");
+    }
+    FileCommit(fileout);
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, GetDataDir() / "mempool.dat"))
+        return error("DumpMempool() : Rename-into-place failed");
+
+    printf("Dumped %"PRIszu" transactions to mempool.dat  %"PRI64d"ms\n",
+           vOrder.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+static bool ReadMempool(CDataStream& ssMempool)
+{
+    boost::filesystem::path pathMempool = GetDataDir() / "mempool.dat";
+    FILE *file = fopen(pathMempool.string().c_str(), "rb");
+    CAutoFile filein = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!filein)
+        return false;
+
+    int nDataSize = GetFilesize(filein) - sizeof(uint256);
+    if (nDataSize < 0)
+        nDataSize = 0;
+    vector<unsigned char> vchData(nDataSize);
+    uint256 hashIn;
+    try {
+        if (nDataSize > 0)
+            filein.read((char *)&vchData[0], nDataSize);
+        filein >> hashIn;
+    }
+    catch (std::exception &e) {
+        return error("ReadMempool() : I/O error or stream data corrupted");
+    }
+    filein.fclose();
+
+    ssMempool = CDataStream(vchData, SER_DISK, CLIENT_VERSION);
+    if (Hash(ssMempool.begin(), ssMempool.end()) != hashIn)
+        return error("ReadMempool() : checksum mismatch; data corrupted");
+
+    unsigned char pchMsgTmp[4];
+    int nVersion = 0;
+    try {
+        ssMempool >> FLATDATA(pchMsgTmp);
+        ssMempool >> nVersion;
+    }
+    catch (std::exception &e) {
+        return error("ReadMempool() : I/O error or stream data corrupted");
+    }
+    if (memcmp(pchMsgTmp, pchMessageStart, sizeof(pchMsgTmp)))
+        return error("ReadMempool() : invalid network magic number");
+    if (nVersion != MEMPOOL_DUMP_VERSION)
+        return error("ReadMempool() : unknown version %d", nVersion);
+    return true;
+}
+
+static void LoadMempool()
+{
+    int64 nStart = GetTimeMillis();
+    CDataStream ssMempool(SER_DISK, CLIENT_VERSION);
+    if (!ReadMempool(ssMempool))
+    {
+        printf("Invalid or missing mempool.dat; starting with an empty pool\n");
+        fMempoolLoaded = true;
+        return;
+    }
+
+    // Re-accept in batches: one cs_main hold and one txdb handle covers
+    // many transactions, but the lock is given back once the batch budget
+    // is spent so block processing and RPC are not starved during startup
+    static const unsigned int nBatchSize = 100;
+    static const int64 nBatchTimeBudget = 100; // milliseconds
+
+    int64 nNow = GetTime();
+    unsigned int nAccepted = 0, nFailed = 0, nExpired = 0;
+    try {
+        uint64 nCount = 0;
+        ssMempool >> nCount;
+        while (nCount > 0 && !fShutdown)
+        {
+            int64 nBatchStart = GetTimeMillis();
+            {
+                LOCK(cs_main);
+                CTxDB txdb("r");
+                for (unsigned int i = 0; i < nBatchSize && nCount > 0; i++, nCount--)
+                {
+                    CTransaction tx;
+                    int64 nTime, nFeeDelta;
+                    ssMempool >> tx >> nTime >> nFeeDelta;
+
+                    if (nTime + MEMPOOL_DUMP_MAX_AGE < nNow)
+                    {
+                        nExpired++;
+                        continue;
+                    }
+                    uint256 hash = tx.GetHash();
+                    if (nFeeDelta != 0)
+                        mempool.PrioritiseTransaction(hash, nFeeDelta);
+                    if (tx.AcceptToMemoryPool(txdb, true))
+                    {
+                        // Keep the original entry time rather than the reload time
+                        LOCK(mempool.cs);
+                        if (mempool.mapInfo.count(hash))
+                            mempool.mapInfo[hash].nTime = nTime;
+                        nAccepted++;
+                    }
+                    else
+                        nFailed++;
+
+                    if (GetTimeMillis() - nBatchStart > nBatchTimeBudget)
+                    {
+                        nCount--;
+                        break;
+                    }
+                }
+            }
+            Sleep(1);
+        }
+        if (fShutdown)
+            return;
+
+        map<uint256, int64> mapDeltas;
+        ssMempool >> mapDeltas;
+        for (map<uint256, int64>::iterator mi = mapDeltas.begin(); mi != mapDeltas.end(); ++mi)
+            mempool.PrioritiseTransaction((*mi).first, (*mi).second);
+    }
+    catch (std::exception &e) {
+        printf("LoadMempool() : I/O error or stream data corrupted\n");
+    }
+    fMempoolLoaded = true;
+
+    printf("Loaded %u transactions from mempool.dat (%u failed, %u expired)  %"PRI64d"ms\n",
+           nAccepted, nFailed, nExpired, GetTimeMillis() - nStart);
+}
+
+void ThreadLoadMempool(void* parg)
+{
+    // Make this thread recognisable as the mempool loading thread
+    RenameThread("bitcoin-loadmemp");
+
+    vnThreadsRunning[THREAD_LOADMEMPOOL]++;
+    try
+    {
+        LoadMempool();
+    }
+    catch (std::exception& e) {
+        PrintException(&e, "ThreadLoadMempool()");
+    } catch (...) {
+        PrintException(NULL, "ThreadLoadMempool()");
+    }
+    vnThreadsRunning[THREAD_LOADMEMPOOL]--;
+    printf("ThreadLoadMempool exited\n");
+}
+
 
 
 
@@ -874,6 +1603,17 @@ bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock)
 // CBlock and CBlockIndex
 //
 
+bool WaitForBlockChange(const uint256& hashWatched, int64 nMilliseconds)
+{
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(nMilliseconds);
+    boost::unique_lock<CWaitableCriticalSection> lock(csBestBlock);
+    // Nothing notified yet means the chain has not moved since startup
+    while (hashBestBlockNotified == 0 || hashBestBlockNotified == hashWatched)
+        if (!cvBlockChange.timed_wait(lock, deadline))
+            return hashBestBlockNotified != 0 && hashBestBlockNotified != hashWatched;
+    return true;
+}
+
 static CBlockIndex* pblockindexFBBHLast;
 CBlockIndex* FindBlockByHeight(int nHeight)
 {
@@ -1278,7 +2018,7 @@ bool CTransaction::DisconnectInputs(CTxDB& txdb)
 
 
 bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTestPool,
-                               bool fBlock, bool fMiner, MapPrevTx& inputsRet, bool& fInvalid)
+                               bool fBlock, bool fMiner, MapPrevTx& inputsRet, bool& fInvalid, bool fQuiet)
 {
     // FetchInputs can return false either because we just haven't seen some inputs
     // (in which case the transaction should be stored as an orphan)
@@ -1309,7 +2049,7 @@ bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTes
             fFound = txdb.ReadTxIndex(prevout.hash, txindex);
         }
         if (!fFound && (fBlock || fMiner))
-            return fMiner ? false : error("FetchInputs() : %s prev tx %s index entry not found", GetHash().ToString().substr(0,10).c_str(),  prevout.hash.ToString().substr(0,10).c_str());
+            return (fMiner || fQuiet) ? false : error("FetchInputs() : %s prev tx %s index entry not found", GetHash().ToString().substr(0,10).c_str(),  prevout.hash.ToString().substr(0,10).c_str());
 
         // Read txPrev
         CTransaction& txPrev = inputsRet[prevout.hash].second;
@@ -1319,7 +2059,7 @@ bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTes
             {
                 LOCK(mempool.cs);
                 if (!mempool.exists(prevout.hash))
-                    return error("FetchInputs() : %s mempool Tx prev not found %s", GetHash().ToString().substr(0,10).c_str(),  prevout.hash.ToString().substr(0,10).c_str());
+                    return fQuiet ? false : error("FetchInputs() : %s mempool Tx prev not found %s", GetHash().ToString().substr(0,10).c_str(),  prevout.hash.ToString().substr(0,10).c_str());
                 txPrev = mempool.lookup(prevout.hash);
             }
             if (!fFound)
@@ -1329,7 +2069,7 @@ bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTes
         {
             // Get prev tx from disk
             if (!txPrev.ReadFromDisk(txindex.pos))
-                return error("FetchInputs() : %s ReadFromDisk prev tx %s failed", GetHash().ToString().substr(0,10).c_str(),  prevout.hash.ToString().substr(0,10).c_str());
+                return fQuiet ? false : error("FetchInputs() : %s ReadFromDisk prev tx %s failed", GetHash().ToString().substr(0,10).c_str(),  prevout.hash.ToString().substr(0,10).c_str());
         }
     }
 
@@ -1345,6 +2085,8 @@ bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTes
             // Revisit this if/when transaction replacement is implemented and allows
             // adding inputs:
             fInvalid = true;
+            if (fQuiet)
+                return DoS(100, false);
             return DoS(100, error("FetchInputs() : %s prevout.n out of range %d %"PRIszu" %"PRIszu" prev tx %s\n%s", GetHash().ToString().substr(0,10).c_str(), prevout.n, txPrev.vout.size(), txindex.vSpent.size(), prevout.hash.ToString().substr(0,10).c_str(), txPrev.ToString().c_str()));
         }
     }
@@ -1400,7 +2142,8 @@ unsigned int CTransaction::GetP2SHSigOpCount(const MapPrevTx& inputs) const
 
 bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
                                  map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-                                 const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, bool fStrictPayToScriptHash)
+                                 const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, bool fStrictPayToScriptHash,
+                                 bool fScriptChecks)
 {
     // Take over previous transactions' spent pointers
     // fBlock is true when this is called from AcceptBlock when a new best-block is added to the blockchain
@@ -1455,7 +2198,7 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
             // Skip ECDSA signature verification when connecting blocks (fBlock=true)
             // before the last blockchain checkpoint. This is safe because block merkle hashes are
             // still computed and checked, and any change will be caught at the next checkpoint.
-            if (!(fBlock && (nBestHeight < Checkpoints::GetTotalBlocksEstimate())))
+            if (fScriptChecks && !(fBlock && (nBestHeight < Checkpoints::GetTotalBlocksEstimate())))
             {
                 // Verify signature
                 if (!VerifySignature(txPrev, *this, i, fStrictPayToScriptHash, 0))
@@ -1561,6 +2304,11 @@ bool CTransaction::ClientConnectInputs()
 
 bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
 {
+    if (fAddrIndex && !AddrIndexDisconnectBlock(txdb, *this, pindex))
+        return error("DisconnectBlock() : AddrIndexDisconnectBlock failed");
+    if (fSpentIndex && !SpentIndexDisconnectBlock(txdb, *this, pindex))
+        return error("DisconnectBlock() : SpentIndexDisconnectBlock failed");
+
     // Disconnect in reverse order
     for (int i = vtx.size()-1; i >= 0; i--)
         if (!vtx[i].DisconnectInputs(txdb))
@@ -1667,6 +2415,9 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
 
             if (!tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, fStrictPayToScriptHash))
                 return false;
+
+            if (fSpentIndex && !fJustCheck && !SpentIndexConnectInputs(txdb, tx, mapInputs, pindex->nHeight))
+                return error("ConnectBlock() : SpentIndexConnectInputs failed");
         }
 
         mapQueuedChanges[hashTx] = CTxIndex(posThisTx, tx.vout.size());
@@ -1693,6 +2444,11 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
             return error("ConnectBlock() : UpdateTxIndex failed");
     }
 
+    if (fAddrIndex && !AddrIndexConnectBlock(txdb, *this, pindex))
+        return error("ConnectBlock() : AddrIndexConnectBlock failed");
+    if (fSpentIndex && !SpentIndexConnectBlock(txdb, pindex))
+        return error("ConnectBlock() : SpentIndexConnectBlock failed");
+
 	uint256 prevHash = 0;
 	if(pindex->pprev)
 	{
@@ -1808,8 +2564,7 @@ bool static Reorganize(CTxDB& txdb, CBlockIndex* pindexNew)
         tx.AcceptToMemoryPool(txdb, false);
 
     // Delete redundant memory transactions that are in the connected branch
-    BOOST_FOREACH(CTransaction& tx, vDelete)
-        mempool.remove(tx);
+    mempool.removeForBlock(vDelete);
 
     printf("REORGANIZE: done\n");
 
@@ -1836,8 +2591,7 @@ bool CBlock::SetBestChainInner(CTxDB& txdb, CBlockIndex *pindexNew)
     pindexNew->pprev->pnext = pindexNew;
 
     // Delete redundant memory transactions
-    BOOST_FOREACH(CTransaction& tx, vtx)
-        mempool.remove(tx);
+    mempool.removeForBlock(vtx);
 
     return true;
 }
@@ -1924,12 +2678,20 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
     bnBestChainTrust = pindexNew->bnChainTrust;
     nTimeBestReceived = GetTime();
     nTransactionsUpdated++;
+    {
+        boost::lock_guard<CWaitableCriticalSection> lock(csBestBlock);
+        hashBestBlockNotified = hash;
+    }
+    cvBlockChange.notify_all();
     printf("SetBestChain: new best=%s  height=%d  trust=%s  date=%s\n",
       hashBestChain.ToString().c_str(), nBestHeight, bnBestChainTrust.ToString().c_str(),
       DateTimeStrFormat("%x %H:%M:%S", pindexBest->GetBlockTime()).c_str());
 
 	printf("Stake checkpoint: %x\n", pindexBest->nStakeModifierChecksum);
 
+    // Orphan transactions may have been waiting for this block
+    ProcessOrphansForBlock(*this);
+
     // Check the version of the last 100 blocks to see if we need to upgrade:
     if (!fIsInitialDownload)
     {
@@ -1948,6 +2710,8 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
             strMiscWarning = _("Warning: This version is obsolete, upgrade required!");
     }
 
+    PublishBlockEvents(*this, hashBestChain);
+
     std::string strCmd = GetArg("-blocknotify", "");
 
     if (!fIsInitialDownload && !strCmd.empty())
@@ -2888,93 +3652,427 @@ string GetWarnings(string strFor)
         strStatusBar = strMintWarning;
     }
 
-    // Misc warnings like out of disk space and clock is wrong
-    if (strMiscWarning != "")
+    // Misc warnings like out of disk space and clock is wrong
+    if (strMiscWarning != "")
+    {
+        nPriority = 1000;
+        strStatusBar = strMiscWarning;
+    }
+
+    // Should not enter safe mode for longer invalid chain 
+    // If sync-checkpoint is too old do not enter safe mode 
+    // Display warning only in the STRICT mode 
+//    if (CheckpointsMode == Checkpoints::STRICT && Checkpoints::IsSyncCheckpointTooOld(60 * 60 * 24 * 10) && !fTestNet && !IsInitialBlockDownload()) 
+//    { 
+//        nPriority = 100; 
+//        strStatusBar = _("WARNING: Checkpoint is too old. Wait for block chain to download, or notify developers."); 
+//    } 
+
+    // if detected invalid checkpoint enter safe mode
+    if (Checkpoints::hashInvalidCheckpoint != 0)
+    {
+        nPriority = 3000;
+        strStatusBar = strRPC = _("WARNING: Invalid checkpoint found! Displayed transactions may not be correct! You may need to upgrade, or notify developers.");
+    }
+
+    // Alerts
+    {
+        LOCK(cs_mapAlerts);
+        BOOST_FOREACH(PAIRTYPE(const uint256, CAlert)& item, mapAlerts)
+        {
+            const CAlert& alert = item.second;
+            if (alert.AppliesToMe() && alert.nPriority > nPriority)
+            {
+                nPriority = alert.nPriority;
+                strStatusBar = alert.strStatusBar;
+                if (nPriority > 1000)
+                    strRPC = strStatusBar;  // safe mode for high alert
+            }
+        }
+    }
+
+    if (strFor == "statusbar")
+        return strStatusBar;
+    else if (strFor == "rpc")
+        return strRPC;
+    assert(!"GetWarnings() : invalid parameter");
+    return "error";
+}
+
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Messages
+//
+
+
+bool static IsTxAdmissionQueued(const uint256& hash);
+
+bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
+{
+    switch (inv.type)
+    {
+    case MSG_TX:
+        {
+        bool txInMap = false;
+            {
+            LOCK(mempool.cs);
+            txInMap = (mempool.exists(inv.hash));
+            }
+        return txInMap ||
+               mapOrphanTransactions.count(inv.hash) ||
+               IsTxAdmissionQueued(inv.hash) ||
+               txdb.ContainsTx(inv.hash);
+        }
+
+    case MSG_BLOCK:
+        return mapBlockIndex.count(inv.hash) ||
+               mapOrphanBlocks.count(inv.hash);
+    }
+    // Don't know what it is, just say we already got one
+    return true;
+}
+
+
+
+
+// The message start string is designed to be unlikely to occur in normal data.
+// The characters are rarely used upper ASCII, not valid as UTF-8, and produce
+// a large 4-byte int at any alignment.
+unsigned char pchMessageStart[4] = { 0xdb, 0xad, 0xbd, 0xda };
+
+// Answer queued getdata requests for as long as the peer's send queue has
+// room; the rest waits until it drains.  Must be called with cs_main held.
+void static ProcessGetData(CNode* pfrom)
+{
+    deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
+    while (it != pfrom->vRecvGetData.end())
+    {
+        // Don't bother if send buffer is too full to respond anyway
+        if (pfrom->nSendSize >= SendBufferSize())
+            break;
+        if (fShutdown)
+            return;
+
+        const CInv& inv = *it;
+        it++;
+
+        if (inv.type == MSG_BLOCK)
+        {
+            // Send block from disk
+            map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(inv.hash);
+				pfrom->nBlocksRequested++;
+            if (mi != mapBlockIndex.end())
+            {
+                // Once the upload budget runs low, keep what is left for
+                // relaying new blocks rather than feeding a long sync
+                if (!pfrom->fWhitelisted && CNode::OutboundTargetReached(true) &&
+                    (*mi).second->GetBlockTime() < pindexBest->GetBlockTime() - HISTORICAL_BLOCK_AGE)
+                {
+                    printf("historical block serving limit reached, disconnect peer=%d\n", pfrom->id);
+                    pfrom->fDisconnect = true;
+                    break;
+                }
+
+                CBlock block;
+                block.ReadFromDisk((*mi).second);
+                pfrom->PushMessage("block", block);
+
+                // Trigger them to send a getblocks request for the next batch of inventory
+                if (inv.hash == pfrom->hashContinue)
+                {
+                    // Default behavior of PoS coins is to send last PoW block here which client receives as an orphan. 
+                    // To increase download speed, further block (index HIGH_BLOCK_INDEX) is sent.
+                    // If server does not have it yet, then proceeds with default behavior.
+                    vector<CInv> vInv;
+    			if (nBestHeight > HIGH_BLOCK_INDEX) { 
+		        	    vInv.push_back(CInv(MSG_BLOCK, hashHighBlock)); 
+			         } else { 
+                    vInv.push_back(CInv(MSG_BLOCK, GetLastBlockIndex(pindexBest, false)->GetBlockHash())); 
+			         } 
+                    pfrom->PushMessage("inv", vInv);
+                    pfrom->hashContinue = 0;
+                }
+            }
+        }
+        else if (inv.IsKnownType())
+        {
+            // Send the shared message from relay memory
+            CMessageRef msg;
+            {
+                LOCK(cs_mapRelay);
+                map<CInv, CMessageRef>::iterator mi = mapRelay.find(inv);
+                if (mi != mapRelay.end())
+                    msg = (*mi).second;
+            }
+            if (!msg && inv.type == MSG_TX) {
+                // Expired from relay memory but still in the pool: frame
+                // it once and put it back, so the next peer asking for
+                // it shares this copy
+                CTransaction tx;
+                bool fInPool = false;
+                {
+                    LOCK(mempool.cs);
+                    if (mempool.exists(inv.hash)) {
+                        tx = mempool.lookup(inv.hash);
+                        fInPool = true;
+                    }
+                }
+                if (fInPool) {
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    ss.reserve(1000);
+                    ss << tx;
+                    msg = MakeMessage("tx", ss);
+                    LOCK(cs_mapRelay);
+                    if (mapRelay.insert(make_pair(inv, msg)).second)
+                        vRelayExpiration.push_back(make_pair(GetTime() + 15 * 60, inv));
+                }
+            }
+            if (msg)
+                pfrom->PushMessage(msg);
+        }
+
+        // Track requests for our stuff
+        Inventory(inv.hash);
+    }
+    pfrom->vRecvGetData.erase(pfrom->vRecvGetData.begin(), it);
+}
+
+// Final, serialized stage of admitting a transaction received from pfrom:
+// conflict checks, insertion, relay and resolution of orphans waiting on it.
+// fScriptChecks is false when a validation thread already verified the
+// signatures.  Must be called with cs_main held.
+void static AcceptTransactionFromPeer(CNode* pfrom, CTransaction& tx, const CDataStream& vMsg, bool fScriptChecks)
+{
+    CTxDB txdb("r");
+
+    CInv inv(MSG_TX, tx.GetHash());
+
+    bool fMissingInputs = false;
+    if (mempool.accept(txdb, tx, true, &fMissingInputs, fScriptChecks))
+    {
+        downloads.Forget(inv);
+        SyncWithWallets(tx, NULL, true);
+        RelayMessage(inv, vMsg);
+        EraseOrphanTx(inv.hash);
+
+        // Process any orphan transactions that depended on this one
+        vector<pair<uint256, unsigned int> > vWorkQueue;
+        vWorkQueue.push_back(make_pair(inv.hash, (unsigned int)tx.vout.size()));
+        ProcessOrphansFor(txdb, vWorkQueue);
+    }
+    else if (fMissingInputs && AddOrphanTx(tx, pfrom->id))
+    {
+        downloads.Forget(inv);
+
+        // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
+        unsigned int nEvicted = LimitOrphanTxSize(MAX_ORPHAN_TRANSACTIONS);
+        if (nEvicted > 0)
+            printf("mapOrphan overflow, removed %u tx\n", nEvicted);
+    }
+    else
+        downloads.Rejected(inv);
+    if (tx.nDoS) pfrom->Misbehaving(tx.nDoS);
+}
+
+// Transactions waiting for a validation thread.  Each job holds a reference
+// on the node it came from so the node outlives the job.
+struct CTxAdmissionJob
+{
+    CNode* pfrom;
+    CTransaction tx;
+    CDataStream vMsg;
+
+    CTxAdmissionJob(CNode* pfromIn, const CTransaction& txIn, const CDataStream& vMsgIn) :
+        pfrom(pfromIn), tx(txIn), vMsg(vMsgIn) { }
+};
+
+static const unsigned int MAX_TX_ADMISSION_QUEUE = 5000;
+static CCriticalSection cs_txAdmission;
+static std::deque<CTxAdmissionJob> vTxAdmissionQueue;
+// Hashes of the queued jobs and of those a validation thread is working on,
+// so AlreadyHave doesn't request them again meanwhile
+static std::set<uint256> setTxAdmissionQueued;
+static CSemaphore* semTxAdmission = NULL;
+static int nTxValidationThreads = 0;
+
+// Context-free part of admission, run on a validation thread without
+// cs_main: structural checks, then a lock-free fetch of the inputs and the
+// ECDSA checks against them.  A previous output is immutable for a given
+// txid, so a positive result stays valid whatever the chain does meanwhile;
+// spentness is re-checked in the serialized stage.  Returns false if
+// anything is missing or wrong, in which case the serialized stage repeats
+// the full checks and reports the failure.
+bool static PreVerifyTransaction(const CTransaction& txIn)
+{
+    CTransaction tx(txIn);
+    if (!tx.CheckTransaction() || tx.IsCoinBase() || tx.IsCoinStake())
+        return false;
+    if (!fTestNet && !tx.IsStandard())
+        return false;
+
+    CTxDB txdb("r");
+    MapPrevTx mapInputs;
+    map<uint256, CTxIndex> mapUnused;
+    bool fInvalid = false;
+    // Orphans are common here and reported by the serialized stage
+    if (!tx.FetchInputs(txdb, mapUnused, false, false, mapInputs, fInvalid, true))
+        return false;
+    if (!fTestNet && !tx.AreInputsStandard(mapInputs))
+        return false;
+
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
     {
-        nPriority = 1000;
-        strStatusBar = strMiscWarning;
+        const CTransaction& txPrev = mapInputs[tx.vin[i].prevout.hash].second;
+        if (!VerifySignature(txPrev, tx, i, true, 0))
+            return false;
     }
+    return true;
+}
 
-    // Should not enter safe mode for longer invalid chain 
-    // If sync-checkpoint is too old do not enter safe mode 
-    // Display warning only in the STRICT mode 
-//    if (CheckpointsMode == Checkpoints::STRICT && Checkpoints::IsSyncCheckpointTooOld(60 * 60 * 24 * 10) && !fTestNet && !IsInitialBlockDownload()) 
-//    { 
-//        nPriority = 100; 
-//        strStatusBar = _("WARNING: Checkpoint is too old. Wait for block chain to download, or notify developers."); 
-//    } 
-
-    // if detected invalid checkpoint enter safe mode
-    if (Checkpoints::hashInvalidCheckpoint != 0)
+void QueueTransactionForAdmission(CNode* pfrom, const CTransaction& tx, const CDataStream& vMsg)
+{
+    if (nTxValidationThreads <= 0)
     {
-        nPriority = 3000;
-        strStatusBar = strRPC = _("WARNING: Invalid checkpoint found! Displayed transactions may not be correct! You may need to upgrade, or notify developers.");
+        LOCK(cs_main);
+        CTransaction txCopy(tx);
+        AcceptTransactionFromPeer(pfrom, txCopy, vMsg, true);
+        return;
     }
 
-    // Alerts
     {
-        LOCK(cs_mapAlerts);
-        BOOST_FOREACH(PAIRTYPE(const uint256, CAlert)& item, mapAlerts)
+        LOCK(cs_txAdmission);
+        // The peer will announce it again if it matters; better than
+        // letting a flood grow the queue without bound
+        if (vTxAdmissionQueue.size() >= MAX_TX_ADMISSION_QUEUE)
         {
-            const CAlert& alert = item.second;
-            if (alert.AppliesToMe() && alert.nPriority > nPriority)
-            {
-                nPriority = alert.nPriority;
-                strStatusBar = alert.strStatusBar;
-                if (nPriority > 1000)
-                    strRPC = strStatusBar;  // safe mode for high alert
-            }
+            if (fDebug)
+                printf("QueueTransactionForAdmission() : queue full, dropping %s\n", tx.GetHash().ToString().substr(0,10).c_str());
+            downloads.Rejected(CInv(MSG_TX, tx.GetHash()));
+            return;
+        }
+        // Same transaction from another peer, the first copy decides
+        if (!setTxAdmissionQueued.insert(tx.GetHash()).second)
+            return;
+        {
+            LOCK(cs_vNodes);
+            pfrom->AddRef();
         }
+        vTxAdmissionQueue.push_back(CTxAdmissionJob(pfrom, tx, vMsg));
     }
+    semTxAdmission->post();
+}
 
-    if (strFor == "statusbar")
-        return strStatusBar;
-    else if (strFor == "rpc")
-        return strRPC;
-    assert(!"GetWarnings() : invalid parameter");
-    return "error";
+bool static IsTxAdmissionQueued(const uint256& hash)
+{
+    LOCK(cs_txAdmission);
+    return setTxAdmissionQueued.count(hash) > 0;
 }
 
+// fDisconnect is set by the network threads; read it the way the socket
+// handler does, under cs_vNodes
+bool static NodeDisconnecting(CNode* pnode)
+{
+    LOCK(cs_vNodes);
+    return pnode->fDisconnect;
+}
 
+void static ThreadTxValidation2()
+{
+    while (true)
+    {
+        semTxAdmission->wait();
+        if (fShutdown)
+            break;
 
+        CNode* pfrom = NULL;
+        CTransaction tx;
+        CDataStream vMsg(SER_NETWORK, PROTOCOL_VERSION);
+        {
+            LOCK(cs_txAdmission);
+            if (vTxAdmissionQueue.empty())
+                continue;
+            CTxAdmissionJob& job = vTxAdmissionQueue.front();
+            pfrom = job.pfrom;
+            tx = job.tx;
+            vMsg = job.vMsg;
+            vTxAdmissionQueue.pop_front();
+        }
 
-//////////////////////////////////////////////////////////////////////////////
-//
-// Messages
-//
+        bool fScriptsVerified = false;
+        if (!NodeDisconnecting(pfrom))
+            fScriptsVerified = PreVerifyTransaction(tx);
 
+        if (!NodeDisconnecting(pfrom))
+        {
+            LOCK(cs_main);
+            AcceptTransactionFromPeer(pfrom, tx, vMsg, !fScriptsVerified);
+        }
+        else
+            downloads.Rejected(CInv(MSG_TX, tx.GetHash()));
 
-bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
-{
-    switch (inv.type)
-    {
-    case MSG_TX:
         {
-        bool txInMap = false;
-            {
-            LOCK(mempool.cs);
-            txInMap = (mempool.exists(inv.hash));
-            }
-        return txInMap ||
-               mapOrphanTransactions.count(inv.hash) ||
-               txdb.ContainsTx(inv.hash);
+            LOCK(cs_txAdmission);
+            setTxAdmissionQueued.erase(tx.GetHash());
+        }
+        {
+            LOCK(cs_vNodes);
+            pfrom->Release();
         }
+    }
+}
 
-    case MSG_BLOCK:
-        return mapBlockIndex.count(inv.hash) ||
-               mapOrphanBlocks.count(inv.hash);
+void static ThreadTxValidation(void* parg)
+{
+    // Make this thread recognisable as a transaction validation thread
+    RenameThread("bitcoin-txval");
+
+    vnThreadsRunning[THREAD_TXVALIDATION]++;
+    try
+    {
+        ThreadTxValidation2();
     }
-    // Don't know what it is, just say we already got one
-    return true;
+    catch (std::exception& e) {
+        PrintException(&e, "ThreadTxValidation()");
+    } catch (...) {
+        PrintException(NULL, "ThreadTxValidation()");
+    }
+    vnThreadsRunning[THREAD_TXVALIDATION]--;
+    printf("ThreadTxValidation exited\n");
 }
 
+void StartTxValidationThreads()
+{
+    nTxValidationThreads = std::max(0, std::min((int)GetArg("-txvalidationthreads", 2), 16));
+    if (nTxValidationThreads == 0)
+        return;
 
+    semTxAdmission = new CSemaphore(0);
+    for (int i = 0; i < nTxValidationThreads; i++)
+        if (!NewThread(ThreadTxValidation, NULL))
+            printf("Error: NewThread(ThreadTxValidation) failed\n");
+}
 
+void StopTxValidationThreads()
+{
+    if (!semTxAdmission)
+        return;
 
-// The message start string is designed to be unlikely to occur in normal data.
-// The characters are rarely used upper ASCII, not valid as UTF-8, and produce
-// a large 4-byte int at any alignment.
-unsigned char pchMessageStart[4] = { 0xdb, 0xad, 0xbd, 0xda };
+    // Wake every worker so it notices fShutdown
+    for (int i = 0; i < nTxValidationThreads; i++)
+        semTxAdmission->post();
+
+    // Drop whatever is still queued and give the nodes back
+    LOCK2(cs_txAdmission, cs_vNodes);
+    BOOST_FOREACH(CTxAdmissionJob& job, vTxAdmissionQueue)
+    {
+        setTxAdmissionQueued.erase(job.tx.GetHash());
+        job.pfrom->Release();
+    }
+    vTxAdmissionQueue.clear();
+}
 
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
 {
@@ -3170,7 +4268,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
                 {
                     LOCK(cs_vNodes);
                     // Use deterministic randomness to send to the same nodes for 24 hours
-                    // at a time so the setAddrKnowns of the chosen nodes prevent repeats
+                    // at a time so the addrKnown filters of the chosen nodes prevent repeats
                     static uint256 hashSalt;
                     if (hashSalt == 0)
                         hashSalt = GetRandHash();
@@ -3268,68 +4366,14 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         if (fDebugNet || (vInv.size() != 1))
             printf("received getdata (%"PRIszu" invsz)\n", vInv.size());
 
-        BOOST_FOREACH(const CInv& inv, vInv)
+        if (fDebugNet || (vInv.size() == 1))
         {
-            if (fShutdown)
-                return true;
-            if (fDebugNet || (vInv.size() == 1))
+            BOOST_FOREACH(const CInv& inv, vInv)
                 printf("received getdata for: %s\n", inv.ToString().c_str());
-
-            if (inv.type == MSG_BLOCK)
-            {
-                // Send block from disk
-                map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(inv.hash);
-				pfrom->nBlocksRequested++;
-                if (mi != mapBlockIndex.end())
-                {
-                    CBlock block;
-                    block.ReadFromDisk((*mi).second);
-                    pfrom->PushMessage("block", block);
-
-                    // Trigger them to send a getblocks request for the next batch of inventory
-                    if (inv.hash == pfrom->hashContinue)
-                    {
-                        // Default behavior of PoS coins is to send last PoW block here which client receives as an orphan. 
-                        // To increase download speed, further block (index HIGH_BLOCK_INDEX) is sent.
-                        // If server does not have it yet, then proceeds with default behavior.
-                        vector<CInv> vInv;
-        			if (nBestHeight > HIGH_BLOCK_INDEX) { 
-		        	    vInv.push_back(CInv(MSG_BLOCK, hashHighBlock)); 
-			         } else { 
-                        vInv.push_back(CInv(MSG_BLOCK, GetLastBlockIndex(pindexBest, false)->GetBlockHash())); 
-			         } 
-                        pfrom->PushMessage("inv", vInv);
-                        pfrom->hashContinue = 0;
-                    }
-                }
-            }
-            else if (inv.IsKnownType())
-            {
-                // Send stream from relay memory
-                bool pushed = false;
-                {
-                    LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
-                    if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
-                        pushed = true;
-                    }
-                }
-                if (!pushed && inv.type == MSG_TX) {
-                    LOCK(mempool.cs);
-                    if (mempool.exists(inv.hash)) {
-                        CTransaction tx = mempool.lookup(inv.hash);
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << tx;
-                        pfrom->PushMessage("tx", ss);
-                    }
-                }
-            }
-
-            // Track requests for our stuff
-            Inventory(inv.hash);
         }
+
+        pfrom->vRecvGetData.insert(pfrom->vRecvGetData.end(), vInv.begin(), vInv.end());
+        ProcessGetData(pfrom);
     }
 
 
@@ -3422,75 +4466,21 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
 
     else if (strCommand == "tx")
     {
-        vector<uint256> vWorkQueue;
-        vector<uint256> vEraseQueue;
         CDataStream vMsg(vRecv);
-        CTxDB txdb("r");
         CTransaction tx;
         vRecv >> tx;
 
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
+        downloads.Received(pfrom->id, inv, vMsg.size(), GetTimeMicros());
 
-        bool fMissingInputs = false;
-        if (tx.AcceptToMemoryPool(txdb, true, &fMissingInputs))
-        {
-            SyncWithWallets(tx, NULL, true);
-            RelayMessage(inv, vMsg);
-            mapAlreadyAskedFor.erase(inv);
-            vWorkQueue.push_back(inv.hash);
-            vEraseQueue.push_back(inv.hash);
-
-            // Recursively process any orphan transactions that depended on this one
-            for (unsigned int i = 0; i < vWorkQueue.size(); i++)
-            {
-                uint256 hashPrev = vWorkQueue[i];
-                for (map<uint256, CDataStream*>::iterator mi = mapOrphanTransactionsByPrev[hashPrev].begin();
-                     mi != mapOrphanTransactionsByPrev[hashPrev].end();
-                     ++mi)
-                {
-                    const CDataStream& vMsg = *((*mi).second);
-                    CTransaction tx;
-                    CDataStream(vMsg) >> tx;
-                    CInv inv(MSG_TX, tx.GetHash());
-                    bool fMissingInputs2 = false;
-
-                    if (tx.AcceptToMemoryPool(txdb, true, &fMissingInputs2))
-                    {
-                        printf("   accepted orphan tx %s\n", inv.hash.ToString().substr(0,10).c_str());
-                        SyncWithWallets(tx, NULL, true);
-                        RelayMessage(inv, vMsg);
-                        mapAlreadyAskedFor.erase(inv);
-                        vWorkQueue.push_back(inv.hash);
-                        vEraseQueue.push_back(inv.hash);
-                    }
-                    else if (!fMissingInputs2)
-                    {
-                        // invalid orphan
-                        vEraseQueue.push_back(inv.hash);
-                        printf("   removed invalid orphan tx %s\n", inv.hash.ToString().substr(0,10).c_str());
-                    }
-                }
-            }
-
-            BOOST_FOREACH(uint256 hash, vEraseQueue)
-                EraseOrphanTx(hash);
-        }
-        else if (fMissingInputs)
-        {
-            AddOrphanTx(vMsg);
-
-            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-            unsigned int nEvicted = LimitOrphanTxSize(MAX_ORPHAN_TRANSACTIONS);
-            if (nEvicted > 0)
-                printf("mapOrphan overflow, removed %u tx\n", nEvicted);
-        }
-        if (tx.nDoS) pfrom->Misbehaving(tx.nDoS);
+        QueueTransactionForAdmission(pfrom, tx, vMsg);
     }
 
 
     else if (strCommand == "block")
     {
+        unsigned int nSize = vRecv.size();
         CBlock block;
         vRecv >> block;
 
@@ -3499,10 +4489,14 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
 
         CInv inv(MSG_BLOCK, block.GetHash());
         pfrom->AddInventoryKnown(inv);
+        downloads.Received(pfrom->id, inv, nSize, GetTimeMicros());
+
+        if (ProcessBlock(pfrom, &block))
+            downloads.Forget(inv);
+        else
+        {
+            downloads.Rejected(inv);
 
-        if (ProcessBlock(pfrom, &block)) { 
-            mapAlreadyAskedFor.erase(inv); 
-        } else { 
         // Be more aggressive with blockchain download. Send getblocks() message after 
         // an error related to new block download. 
             int64 TimeSinceBestBlock = GetTime() - nTimeBestReceived; 
@@ -3611,6 +4605,20 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
     }
 
 
+    else if (strCommand == "feefilter")
+    {
+        int64 nFeeFilter = 0;
+        vRecv >> nFeeFilter;
+        if (MoneyRange(nFeeFilter))
+        {
+            LOCK(pfrom->cs_inventory);
+            pfrom->nMinFeeFilter = nFeeFilter;
+            if (fDebug)
+                printf("received: feefilter of %s from peer=%d\n", FormatMoney(nFeeFilter).c_str(), pfrom->id);
+        }
+    }
+
+
     else if (strCommand == "alert")
     {
         CAlert alert;
@@ -3659,6 +4667,16 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
 
 bool ProcessMessages(CNode* pfrom)
 {
+    // Finish answering earlier getdata requests before reading anything new,
+    // so replies keep their order
+    if (!pfrom->vRecvGetData.empty())
+    {
+        LOCK(cs_main);
+        ProcessGetData(pfrom);
+        if (!pfrom->vRecvGetData.empty())
+            return true;
+    }
+
     CDataStream& vRecv = pfrom->vRecv;
     if (vRecv.empty())
         return true;
@@ -3677,7 +4695,7 @@ bool ProcessMessages(CNode* pfrom)
     while (true)
     {
         // Don't bother if send buffer is too full to respond anyway
-        if (pfrom->vSend.size() >= SendBufferSize())
+        if (pfrom->nSendSize >= SendBufferSize())
             break;
 
         // Scan for message start
@@ -3779,163 +4797,199 @@ bool ProcessMessages(CNode* pfrom)
 }
 
 
+// Everything here works on per-peer state, so a long ConnectBlock or rescan
+// holding cs_main does not stop pings, addr relay or inventory trickling.
+// Only the getdata scheduling, which has to consult the chain and the pool,
+// waits for cs_main.
 bool SendMessages(CNode* pto, bool fSendTrickle)
 {
-    TRY_LOCK(cs_main, lockMain);
-    if (lockMain) {
-        // Don't send anything until we get their version message
-        if (pto->nVersion == 0)
-            return true;
-
-        // Keep-alive ping. We send a nonce of zero because we don't use it anywhere
-        // right now.
-        if (pto->nLastSend && GetTime() - pto->nLastSend > 30 * 60 && pto->vSend.empty()) {
-            uint64 nonce = 0;
-            if (pto->nVersion > BIP0031_VERSION)
-                pto->PushMessage("ping", nonce);
-            else
-                pto->PushMessage("ping");
-        }
+    // Don't send anything until we get their version message
+    if (pto->nVersion == 0)
+        return true;
 
-        // Resend wallet transactions that haven't gotten in a block yet
-        ResendWalletTransactions();
+    // Keep-alive ping. We send a nonce of zero because we don't use it anywhere
+    // right now.
+    if (pto->nLastSend && GetTime() - pto->nLastSend > 30 * 60 && pto->vSendMsg.empty()) {
+        uint64 nonce = 0;
+        if (pto->nVersion > BIP0031_VERSION)
+            pto->PushMessage("ping", nonce);
+        else
+            pto->PushMessage("ping");
+    }
 
-        // Address refresh broadcast
-        static int64 nLastRebroadcast;
-        if (!IsInitialBlockDownload() && (GetTime() - nLastRebroadcast > 24 * 60 * 60))
+    // Address refresh broadcast
+    static int64 nLastRebroadcast;
+    if (!IsInitialBlockDownload() && (GetTime() - nLastRebroadcast > 24 * 60 * 60))
+    {
         {
+            LOCK(cs_vNodes);
+            BOOST_FOREACH(CNode* pnode, vNodes)
             {
-                LOCK(cs_vNodes);
-                BOOST_FOREACH(CNode* pnode, vNodes)
-                {
-                    // Periodically clear setAddrKnown to allow refresh broadcasts
-                    if (nLastRebroadcast)
-                        pnode->setAddrKnown.clear();
+                // Periodically clear addrKnown to allow refresh broadcasts
+                if (nLastRebroadcast)
+                    pnode->addrKnown.reset();
 
-                    // Rebroadcast our address
-                    if (!fNoListen)
-                    {
-                        CAddress addr = GetLocalAddress(&pnode->addr);
-                        if (addr.IsRoutable())
-                            pnode->PushAddress(addr);
-                    }
+                // Rebroadcast our address
+                if (!fNoListen)
+                {
+                    CAddress addr = GetLocalAddress(&pnode->addr);
+                    if (addr.IsRoutable())
+                        pnode->PushAddress(addr);
                 }
             }
-            nLastRebroadcast = GetTime();
         }
+        nLastRebroadcast = GetTime();
+    }
 
-        //
-        // Message: addr
-        //
-        if (fSendTrickle)
+    //
+    // Message: addr
+    //
+    if (fSendTrickle)
+    {
+        vector<CAddress> vAddr;
+        vAddr.reserve(pto->vAddrToSend.size());
+        BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
         {
-            vector<CAddress> vAddr;
-            vAddr.reserve(pto->vAddrToSend.size());
-            BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
+            if (!pto->addrKnown.contains(addr.GetKey()))
             {
-                // returns true if wasn't already contained in the set
-                if (pto->setAddrKnown.insert(addr).second)
+                pto->addrKnown.insert(addr.GetKey());
+                vAddr.push_back(addr);
+                // receiver rejects addr messages larger than 1000
+                if (vAddr.size() >= 1000)
                 {
-                    vAddr.push_back(addr);
-                    // receiver rejects addr messages larger than 1000
-                    if (vAddr.size() >= 1000)
-                    {
-                        pto->PushMessage("addr", vAddr);
-                        vAddr.clear();
-                    }
+                    pto->PushMessage("addr", vAddr);
+                    vAddr.clear();
                 }
             }
-            pto->vAddrToSend.clear();
-            if (!vAddr.empty())
-                pto->PushMessage("addr", vAddr);
         }
+        pto->vAddrToSend.clear();
+        if (!vAddr.empty())
+            pto->PushMessage("addr", vAddr);
+    }
 
 
-        //
-        // Message: inventory
-        //
-        vector<CInv> vInv;
-        vector<CInv> vInvWait;
+    //
+    // Message: feefilter
+    //
+    // Tell the peer the fee rate our pool currently admits, so it does not
+    // announce transactions we would only download and reject.  Resent on a
+    // randomised timer, and sooner when the rate moves by a third or more.
+    // The pool's rate is 0 until it fills up, but the relay fee applies even
+    // then.
+    if (pto->nVersion >= FEEFILTER_VERSION && GetBoolArg("-feefilter", true))
+    {
+        int64 nFeeFilter = max(mempool.GetMinFee(GetMaxMempoolSize()), MIN_RELAY_TX_FEE);
+        int64 nNow = GetTime();
+        if (nNow > pto->nNextSendTimeFeeFilter)
         {
-            LOCK(pto->cs_inventory);
-            vInv.reserve(pto->vInventoryToSend.size());
-            vInvWait.reserve(pto->vInventoryToSend.size());
-            BOOST_FOREACH(const CInv& inv, pto->vInventoryToSend)
+            if (nFeeFilter != pto->nLastSentFeeFilter)
             {
-                if (pto->setInventoryKnown.count(inv))
-                    continue;
+                pto->PushMessage("feefilter", nFeeFilter);
+                pto->nLastSentFeeFilter = nFeeFilter;
+            }
+            pto->nNextSendTimeFeeFilter = nNow + AVG_FEEFILTER_BROADCAST_INTERVAL / 2 + GetRand(AVG_FEEFILTER_BROADCAST_INTERVAL);
+        }
+        else if (pto->nNextSendTimeFeeFilter > nNow + MAX_FEEFILTER_CHANGE_DELAY &&
+                 (nFeeFilter < 3 * pto->nLastSentFeeFilter / 4 || nFeeFilter > 4 * pto->nLastSentFeeFilter / 3))
+        {
+            pto->nNextSendTimeFeeFilter = nNow + GetRand(MAX_FEEFILTER_CHANGE_DELAY);
+        }
+    }
 
-                // trickle out tx inv to protect privacy
-                if (inv.type == MSG_TX && !fSendTrickle)
-                {
-                    // 1/4 of tx invs blast to all immediately
-                    static uint256 hashSalt;
-                    if (hashSalt == 0)
-                        hashSalt = GetRandHash();
-                    uint256 hashRand = inv.hash ^ hashSalt;
-                    hashRand = Hash(BEGIN(hashRand), END(hashRand));
-                    bool fTrickleWait = ((hashRand & 3) != 0);
 
-                    // always trickle our own transactions
-                    if (!fTrickleWait)
-                    {
-                        CWalletTx wtx;
-                        if (GetTransaction(inv.hash, wtx))
-                            if (wtx.fFromMe)
-                                fTrickleWait = true;
-                    }
+    //
+    // Message: inventory
+    //
+    vector<CInv> vInv;
+    vector<CInv> vInvWait;
+    {
+        LOCK(pto->cs_inventory);
+        int64 nMinFeeFilter = pto->nMinFeeFilter;
+        vInv.reserve(pto->vInventoryToSend.size());
+        vInvWait.reserve(pto->vInventoryToSend.size());
+        BOOST_FOREACH(const CInv& inv, pto->vInventoryToSend)
+        {
+            if (pto->filterInventoryKnown.contains(inv.hash))
+                continue;
 
-                    if (fTrickleWait)
-                    {
-                        vInvWait.push_back(inv);
-                        continue;
-                    }
-                }
+            // Drop transactions the peer told us it would not accept anyway
+            if (inv.type == MSG_TX && nMinFeeFilter > 0)
+            {
+                LOCK(mempool.cs);
+                map<uint256, CTxMemPoolEntry>::const_iterator mi = mempool.mapInfo.find(inv.hash);
+                if (mi != mempool.mapInfo.end() &&
+                    (*mi).second.nFee * 1000 < nMinFeeFilter * (int64)(*mi).second.nTxSize)
+                    continue;
+            }
 
-                // returns true if wasn't already contained in the set
-                if (pto->setInventoryKnown.insert(inv).second)
+            // trickle out tx inv to protect privacy
+            if (inv.type == MSG_TX && !fSendTrickle)
+            {
+                // 1/4 of tx invs blast to all immediately
+                static uint256 hashSalt;
+                if (hashSalt == 0)
+                    hashSalt = GetRandHash();
+                uint256 hashRand = inv.hash ^ hashSalt;
+                hashRand = Hash(BEGIN(hashRand), END(hashRand));
+                bool fTrickleWait = ((hashRand & 3) != 0);
+
+                // always trickle our own transactions
+                if (!fTrickleWait && IsLocalTransaction(inv.hash))
+                    fTrickleWait = true;
+
+                if (fTrickleWait)
                 {
-                    vInv.push_back(inv);
-                    if (vInv.size() >= 1000)
-                    {
-                        pto->PushMessage("inv", vInv);
-                        vInv.clear();
-                    }
+                    vInvWait.push_back(inv);
+                    continue;
                 }
             }
-            pto->vInventoryToSend = vInvWait;
-        }
-        if (!vInv.empty())
-            pto->PushMessage("inv", vInv);
-
 
-        //
-        // Message: getdata
-        //
-        vector<CInv> vGetData;
-        int64 nNow = GetTime() * 1000000;
-        CTxDB txdb("r");
-        while (!pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow)
-        {
-            const CInv& inv = (*pto->mapAskFor.begin()).second;
-            if (!AlreadyHave(txdb, inv))
+            if (!pto->filterInventoryKnown.contains(inv.hash))
             {
-                if (fDebugNet)
-                    printf("sending getdata: %s\n", inv.ToString().c_str());
-                vGetData.push_back(inv);
-                if (vGetData.size() >= 1000)
+                pto->filterInventoryKnown.insert(inv.hash);
+                vInv.push_back(inv);
+                if (vInv.size() >= 1000)
                 {
-                    pto->PushMessage("getdata", vGetData);
-                    vGetData.clear();
+                    pto->PushMessage("inv", vInv);
+                    vInv.clear();
                 }
-                mapAlreadyAskedFor[inv] = nNow;
             }
-            pto->mapAskFor.erase(pto->mapAskFor.begin());
         }
-        if (!vGetData.empty())
-            pto->PushMessage("getdata", vGetData);
+        pto->vInventoryToSend = vInvWait;
+    }
+    if (!vInv.empty())
+        pto->PushMessage("inv", vInv);
 
+
+    //
+    // Message: getdata
+    //
+    TRY_LOCK(cs_main, lockMain);
+    if (!lockMain)
+        return true;
+    vector<CInv> vGetData;
+    vector<CInv> vRequest;
+    downloads.GetRequests(pto->id, GetTimeMicros(), vRequest);
+    CTxDB txdb("r");
+    BOOST_FOREACH(const CInv& inv, vRequest)
+    {
+        if (AlreadyHave(txdb, inv))
+        {
+            downloads.Forget(inv);
+            continue;
+        }
+        if (fDebugNet)
+            printf("sending getdata: %s\n", inv.ToString().c_str());
+        vGetData.push_back(inv);
+        if (vGetData.size() >= 1000)
+        {
+            pto->PushMessage("getdata", vGetData);
+            vGetData.clear();
+        }
     }
+    if (!vGetData.empty())
+        pto->PushMessage("getdata", vGetData);
+
     return true;
 }
 
@@ -4181,8 +5235,11 @@ CBlock* CreateNewBlock(CWallet* pwallet, bool fProofOfStake)
 
             // This is a more accurate fee-per-kilobyte than is used by the client code, because the
             // client code rounds up the size to the nearest 1K. That's good, because it gives an
-            // incentive to create smaller transactions.
-            double dFeePerKb =  double(nTotalIn-tx.GetValueOut()) / (double(nTxSize)/1000.0);
+            // incentive to create smaller transactions.  A prioritisetransaction delta only
+            // moves the transaction in this ordering, it is not part of the block's fees.
+            int64 nFeeDelta = 0;
+            mempool.ApplyDeltas((*mi).first, nFeeDelta);
+            double dFeePerKb =  double(nTotalIn-tx.GetValueOut()+nFeeDelta) / (double(nTxSize)/1000.0);
 
             if (porphan)
             {
@@ -4253,7 +5310,9 @@ CBlock* CreateNewBlock(CWallet* pwallet, bool fProofOfStake)
                 continue;
 
             int64 nTxFees = tx.GetValueIn(mapInputs)-tx.GetValueOut();
-            if (nTxFees < nMinFee)
+            int64 nFeeDelta = 0;
+            mempool.ApplyDeltas(tx.GetHash(), nFeeDelta);
+            if (nTxFees + nFeeDelta < nMinFee)
                 continue;
 
             nTxSigOps += tx.GetP2SHSigOpCount(mapInputs);
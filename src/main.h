@@ -33,9 +33,27 @@ static const unsigned int MAX_BLOCK_SIZE = 1000000;
 static const unsigned int MAX_BLOCK_SIZE_GEN = MAX_BLOCK_SIZE/2;
 static const unsigned int MAX_BLOCK_SIGOPS = MAX_BLOCK_SIZE/50;
 static const unsigned int MAX_ORPHAN_TRANSACTIONS = MAX_BLOCK_SIZE/100;
+/** Most orphan transactions kept on behalf of a single peer */
+static const unsigned int MAX_ORPHAN_TRANSACTIONS_PER_PEER = MAX_ORPHAN_TRANSACTIONS/10;
+/** Seconds an orphan transaction waits for its parents before it is dropped */
+static const int64 ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+/** Minimum seconds between two sweeps for expired orphan transactions */
+static const int64 ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
 static const unsigned int MAX_INV_SZ = 30000;
+/** Default for -maxmempool, maximum megabytes of mempool memory usage */
+static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
+/** Half-life of the rolling minimum relay fee once the mempool has stopped evicting */
+static const unsigned int ROLLING_FEE_HALFLIFE = 60 * 60 * 12;
+/** Version of the mempool.dat format written by DumpMempool */
+static const int MEMPOOL_DUMP_VERSION = 1;
+/** Transactions that sat in the pool longer than this are not reloaded from mempool.dat */
+static const int64 MEMPOOL_DUMP_MAX_AGE = 60 * 60 * 72;
 static const int64 MIN_TX_FEE = .1 * COIN;
 static const int64 MIN_RELAY_TX_FEE = MIN_TX_FEE;
+/** Average seconds between feefilter announcements to a peer */
+static const int64 AVG_FEEFILTER_BROADCAST_INTERVAL = 10 * 60;
+/** Longest delay before announcing a significant change of our fee filter */
+static const int64 MAX_FEEFILTER_CHANGE_DELAY = 5 * 60;
 static const int64 MAX_MONEY = 75000000000 * COIN;
 static const int64 MAX_MONEY2 = 75000000000 * COIN;	// 75 Million DeOxyRibose
 static const int64 DEF_SPLIT_AMOUNT = 100 * COIN; 
@@ -106,6 +124,10 @@ class CTxIndex;
 
 void RegisterWallet(CWallet* pwalletIn);
 void UnregisterWallet(CWallet* pwalletIn);
+/** Let SyncWithWallets find a registered wallet by a new lookup hash (see ExtractLookupHashes) or transaction */
+void AddWalletLookup(CWallet* pwallet, const uint160& hash);
+void AddWalletTxLookup(CWallet* pwallet, const uint256& hashTx);
+void EraseWalletTxLookup(CWallet* pwallet, const uint256& hashTx);
 void SyncWithWallets(const CTransaction& tx, const CBlock* pblock = NULL, bool fUpdate = false, bool fConnect = true);
 bool ProcessBlock(CNode* pfrom, CBlock* pblock);
 bool CheckDiskSpace(uint64 nAdditionalBytes=0);
@@ -114,6 +136,9 @@ FILE* AppendBlockFile(unsigned int& nFileRet);
 bool LoadBlockIndex(bool fAllowNew=true);
 void PrintBlockTree();
 CBlockIndex* FindBlockByHeight(int nHeight);
+/** Block until the best chain moves off hashWatched or nMilliseconds pass;
+ * returns true if it moved.  Call without holding cs_main. */
+bool WaitForBlockChange(const uint256& hashWatched, int64 nMilliseconds);
 bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 bool LoadExternalBlockFile(FILE* fileIn);
@@ -137,6 +162,7 @@ uint256 WantedByOrphan(const CBlock* pblockOrphan);
 const CBlockIndex* GetLastBlockIndex(const CBlockIndex* pindex, bool fProofOfStake);
 void BitcoinMiner(CWallet *pwallet, bool fProofOfStake);
 void ResendWalletTransactions();
+void ThreadResendWalletTransactions(void* parg);
 
 
 
@@ -700,10 +726,11 @@ public:
      @param[in] fMiner	True if being called by CreateNewBlock
      @param[out] inputsRet	Pointers to this transaction's inputs
      @param[out] fInvalid	returns true if transaction is invalid
+     @param[in] fQuiet	True to fail without logging, for callers expecting missing inputs
      @return	Returns true if all inputs are in txdb or mapTestPool
      */
     bool FetchInputs(CTxDB& txdb, const std::map<uint256, CTxIndex>& mapTestPool,
-                     bool fBlock, bool fMiner, MapPrevTx& inputsRet, bool& fInvalid);
+                     bool fBlock, bool fMiner, MapPrevTx& inputsRet, bool& fInvalid, bool fQuiet=false);
 
     /** Sanity check previous transactions, then, if all checks succeed,
         mark them as spent by this transaction.
@@ -715,11 +742,13 @@ public:
         @param[in] fBlock	true if called from ConnectBlock
         @param[in] fMiner	true if called from CreateNewBlock
         @param[in] fStrictPayToScriptHash	true if fully validating p2sh transactions
+        @param[in] fScriptChecks	false if the signatures were already verified against these inputs
         @return Returns true if all checks succeed
      */
     bool ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
                        std::map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-                       const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, bool fStrictPayToScriptHash=true);
+                       const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, bool fStrictPayToScriptHash=true,
+                       bool fScriptChecks=true);
     bool ClientConnectInputs();
     bool CheckTransaction() const;
     bool AcceptToMemoryPool(CTxDB& txdb, bool fCheckInputs=true, bool* pfMissingInputs=NULL);
@@ -1579,20 +1608,130 @@ public:
 
 
 
+/** Bookkeeping kept alongside each memory pool transaction: what it pays,
+ * how much memory it costs and the aggregate of it plus all its in-pool
+ * descendants, which is the unit the pool evicts when it is full.
+ */
+class CTxMemPoolEntry
+{
+public:
+    int64 nFee;                     // fee paid, 0 if inputs were not checked
+    unsigned int nTxSize;           // serialized size
+    unsigned int nUsageSize;        // estimated dynamic memory usage
+    int64 nTime;                    // local time when entering the pool
+    int64 nFeesWithDescendants;     // fee of this tx and all in-pool descendants
+    uint64 nSizeWithDescendants;    // size of this tx and all in-pool descendants
+
+    CTxMemPoolEntry()
+    {
+        nFee = 0;
+        nTxSize = 0;
+        nUsageSize = 0;
+        nTime = 0;
+        nFeesWithDescendants = 0;
+        nSizeWithDescendants = 0;
+    }
+
+    CTxMemPoolEntry(int64 nFeeIn, unsigned int nTxSizeIn, unsigned int nUsageSizeIn, int64 nTimeIn)
+    {
+        nFee = nFeeIn;
+        nTxSize = nTxSizeIn;
+        nUsageSize = nUsageSizeIn;
+        nTime = nTimeIn;
+        nFeesWithDescendants = nFee;
+        nSizeWithDescendants = nTxSize;
+    }
+
+    /** Fee per 1000 bytes used to order eviction: the better of the
+     * transaction alone and its package with descendants, so a high-fee
+     * parent is not evicted because of a cheap child (and vice versa).
+     */
+    double GetEvictionScore() const
+    {
+        double dFeeRate = (double)nFee * 1000 / std::max(nTxSize, 1U);
+        double dPackageRate = (double)nFeesWithDescendants * 1000 / std::max(nSizeWithDescendants, (uint64)1);
+        return std::max(dFeeRate, dPackageRate);
+    }
+};
+
 class CTxMemPool
 {
 public:
     mutable CCriticalSection cs;
     std::map<uint256, CTransaction> mapTx;
     std::map<COutPoint, CInPoint> mapNextTx;
+    std::map<uint256, CTxMemPoolEntry> mapInfo;
+    // Fee adjustments set by prioritisetransaction, also kept for
+    // transactions not (yet) in the pool
+    std::map<uint256, int64> mapDeltas;
+
+private:
+    // Entries ordered by eviction score, lowest first
+    std::set<std::pair<double, uint256> > setEvictionOrder;
+    // Sum of the dynamic usage of all entries
+    uint64 nTotalUsage;
+    // Sum of the serialized size of all entries
+    uint64 nTotalTxSize;
+    // Minimum fee per 1000 bytes required to enter the pool, raised on
+    // eviction and decaying back to zero over time
+    mutable double dRollingMinimumFeeRate;
+    mutable int64 nLastRollingFeeUpdate;
+    mutable bool fBlockSinceLastRollingFeeBump;
+
+    void UpdateDescendantState(const uint256& hash, int64 nFeeDelta, int64 nSizeDelta);
+    void TrackPackageRemoved(double dFeeRate);
+
+public:
+    CTxMemPool()
+    {
+        nTotalUsage = 0;
+        nTotalTxSize = 0;
+        dRollingMinimumFeeRate = 0;
+        nLastRollingFeeUpdate = GetTime();
+        fBlockSinceLastRollingFeeBump = false;
+    }
 
     bool accept(CTxDB& txdb, CTransaction &tx,
-                bool fCheckInputs, bool* pfMissingInputs);
-    bool addUnchecked(const uint256& hash, CTransaction &tx);
+                bool fCheckInputs, bool* pfMissingInputs, bool fScriptChecks=true);
+    bool addUnchecked(const uint256& hash, CTransaction &tx, int64 nFee = 0);
     bool remove(CTransaction &tx);
+    bool remove(const CTransaction &tx, std::list<CTransaction>& removed, bool fRecursive);
+    void removeForBlock(const std::vector<CTransaction>& vtx);
     void clear();
     void queryHashes(std::vector<uint256>& vtxid);
 
+    /** Add nFeeDelta to the fee the pool credits a transaction with when
+     * admitting and evicting it, and when CreateNewBlock orders and
+     * fee-checks it for a mined or staked block.  Deltas accumulate. */
+    void PrioritiseTransaction(const uint256& hash, int64 nFeeDelta);
+    void ApplyDeltas(const uint256& hash, int64& nFee) const;
+
+    /** Collect the in-pool ancestors / descendants of a transaction.  The
+     * descendant set includes the transaction itself. */
+    void CalculateAncestors(const CTransaction& tx, std::set<uint256>& setAncestors) const;
+    void CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const;
+
+    /** Evict the lowest scoring packages until usage is below nSizeLimit bytes.
+     * Returns the number of transactions removed. */
+    unsigned int TrimToSize(uint64 nSizeLimit);
+
+    /** Minimum fee per 1000 bytes a new transaction must pay to be accepted,
+     * given a pool limit of nSizeLimit bytes. */
+    int64 GetMinFee(uint64 nSizeLimit) const;
+
+    /** Estimated heap memory used by the pool, in bytes */
+    uint64 DynamicMemoryUsage() const
+    {
+        LOCK(cs);
+        return nTotalUsage;
+    }
+
+    uint64 GetTotalTxSize() const
+    {
+        LOCK(cs);
+        return nTotalTxSize;
+    }
+
     unsigned long size()
     {
         LOCK(cs);
@@ -1610,6 +1749,30 @@ public:
     }
 };
 
+/** Size limit for the memory pool in bytes, from -maxmempool */
+uint64 GetMaxMempoolSize();
+
 extern CTxMemPool mempool;
 
+/** A transaction whose inputs are missing, kept in mapOrphanTransactions
+ * until its parents arrive or it expires */
+struct COrphanTx
+{
+    CTransaction tx;
+    NodeId fromPeer;
+    int64 nTimeExpire;
+    unsigned int nListPos;
+};
+
+/** Hand a transaction received from pfrom to the validation threads.  Falls
+ * back to validating in place under cs_main when -txvalidationthreads=0. */
+void QueueTransactionForAdmission(CNode* pfrom, const CTransaction& tx, const CDataStream& vMsg);
+void StartTxValidationThreads();
+void StopTxValidationThreads();
+
+/** Write the memory pool to mempool.dat so it survives a restart */
+bool DumpMempool();
+/** Background thread that re-accepts the transactions saved in mempool.dat */
+void ThreadLoadMempool(void* parg);
+
 #endif
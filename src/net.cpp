@@ -11,6 +11,8 @@
 #include "addrman.h"
 #include "ui_interface.h"
 
+#include <boost/algorithm/string.hpp>
+
 #ifdef WIN32
 #include <string.h>
 #endif
@@ -63,10 +65,12 @@ CAddrMan addrman;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
+map<CInv, CMessageRef> mapRelay;
 deque<pair<int64, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
-map<CInv, int64> mapAlreadyAskedFor;
+static mruset<uint256> setLocalTransactions(10000);
+static CCriticalSection cs_setLocalTransactions;
+CDownloadScheduler downloads;
 
 static deque<string> vOneShots;
 CCriticalSection cs_vOneShots;
@@ -432,6 +436,13 @@ uint64 CNode::nTotalBytesRecv = 0;
 uint64 CNode::nTotalBytesSent = 0; 
 CCriticalSection CNode::cs_totalBytesRecv; 
 CCriticalSection CNode::cs_totalBytesSent; 
+uint64 CNode::nMaxOutboundLimit = 0;
+uint64 CNode::nMaxOutboundTotalBytesSentInCycle = 0;
+int64 CNode::nMaxOutboundCycleStartTime = 0;
+vector<CNetAddr> CNode::vWhitelisted;
+CCriticalSection CNode::cs_vWhitelisted;
+NodeId CNode::nLastNodeId = 0;
+CCriticalSection CNode::cs_nLastNodeId;
 
 CNode* FindNode(const CNetAddr& ip)
 {
@@ -630,9 +641,13 @@ void CNode::copyStats(CNodeStats &stats)
     X(nReleaseTime);
     X(nStartingHeight);
     X(nMisbehavior);
+    X(nMinFeeFilter);
 	X(nSendBytes); 
     X(nRecvBytes); 
     X(nBlocksRequested); 
+    stats.nDownloadInFlight = 0;
+    stats.nDownloadResponse = 0;
+    downloads.GetPeerStats(id, stats.nDownloadInFlight, stats.nDownloadResponse);
 }
 #undef X
 
@@ -645,6 +660,71 @@ void CNode::copyStats(CNodeStats &stats)
 
 
 
+void MarkLocalTransaction(const uint256& hash)
+{
+    LOCK(cs_setLocalTransactions);
+    setLocalTransactions.insert(hash);
+}
+
+bool IsLocalTransaction(const uint256& hash)
+{
+    LOCK(cs_setLocalTransactions);
+    return setLocalTransactions.count(hash) != 0;
+}
+
+CMessageRef MakeMessage(const char* pszCommand, const CDataStream& ssPayload)
+{
+    CMessageHeader hdr(pszCommand, ssPayload.size());
+    uint256 hash = Hash(ssPayload.begin(), ssPayload.end());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+
+    CDataStream ssMsg(SER_NETWORK, PROTOCOL_VERSION);
+    ssMsg.reserve(sizeof(hdr) + ssPayload.size());
+    ssMsg << hdr;
+    ssMsg += ssPayload;
+    return CMessageRef(new vector<char>(ssMsg.begin(), ssMsg.end()));
+}
+
+// Write as much of the send queue to the socket as it will take.
+// Requires cs_vSend.
+void static SocketSendData(CNode* pnode)
+{
+    deque<CMessageRef>::iterator it = pnode->vSendMsg.begin();
+    while (it != pnode->vSendMsg.end())
+    {
+        const vector<char>& data = **it;
+        assert(data.size() > pnode->nSendOffset);
+        int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (nBytes > 0)
+        {
+            pnode->nLastSend = GetTime();
+            pnode->RecordBytesSent(nBytes);
+            pnode->nSendBytes += nBytes;
+            pnode->nSendOffset += nBytes;
+            pnode->nSendSize -= nBytes;
+            if (pnode->nSendOffset != data.size())
+                break; // could not send the whole message, socket is full
+            pnode->nSendOffset = 0;
+            ++it;
+        }
+        else
+        {
+            if (nBytes < 0)
+            {
+                // error
+                int nErr = WSAGetLastError();
+                if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+                {
+                    printf("socket send error %d\n", nErr);
+                    pnode->CloseSocketDisconnect();
+                }
+            }
+            break;
+        }
+    }
+    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+}
+
 void ThreadSocketHandler(void* parg)
 {
     // Make this thread recognisable as the networking thread
@@ -684,11 +764,14 @@ void ThreadSocketHandler2(void* parg)
             BOOST_FOREACH(CNode* pnode, vNodesCopy)
             {
                 if (pnode->fDisconnect ||
-                    (pnode->GetRefCount() <= 0 && pnode->vRecv.empty() && pnode->vSend.empty()))
+                    (pnode->GetRefCount() <= 0 && pnode->vRecv.empty() && pnode->vSendMsg.empty()))
                 {
                     // remove from vNodes
                     vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
 
+                    // let other peers fetch what it still owed us
+                    downloads.PeerDisconnected(pnode->id);
+
                     // release outbound grant (if any)
                     pnode->grantOutbound.Release();
 
@@ -777,7 +860,7 @@ void ThreadSocketHandler2(void* parg)
                 have_fds = true;
                 {
                     TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSend.empty())
+                    if (lockSend && !pnode->vSendMsg.empty())
                         FD_SET(pnode->hSocket, &fdsetSend);
                 }
             }
@@ -940,35 +1023,14 @@ void ThreadSocketHandler2(void* parg)
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
                 {
-                    CDataStream& vSend = pnode->vSend;
-                    if (!vSend.empty())
-                    {
-                        int nBytes = send(pnode->hSocket, &vSend[0], vSend.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
-                        if (nBytes > 0)
-                        {
-                            vSend.erase(vSend.begin(), vSend.begin() + nBytes);
-                            pnode->nLastSend = GetTime();
-							pnode->RecordBytesSent(nBytes);
-							pnode->nSendBytes += nBytes;
-                        }
-                        else if (nBytes < 0)
-                        {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                            {
-                                printf("socket send error %d\n", nErr);
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-                    }
+                    SocketSendData(pnode);
                 }
             }
 
             //
             // Inactivity checking
             //
-            if (pnode->vSend.empty())
+            if (pnode->vSendMsg.empty())
                 pnode->nLastSendEmpty = GetTime();
             if (GetTime() - pnode->nTimeConnected > 60)
             {
@@ -1785,6 +1847,112 @@ bool BindListenPort(const CService &addrBind, string& strError)
     return true;
 }
 
+bool ListenLineServer(const CService& addrBind, SOCKET& hListenSocket, const char* pszName)
+{
+    int nOne = 1;
+
+#ifdef USE_IPV6
+    struct sockaddr_storage sockaddr;
+#else
+    struct sockaddr sockaddr;
+#endif
+    socklen_t len = sizeof(sockaddr);
+    if (!addrBind.GetSockAddr((struct sockaddr*)&sockaddr, &len))
+        return error("%s: bind address family for %s not supported", pszName, addrBind.ToString().c_str());
+
+    hListenSocket = socket(((struct sockaddr*)&sockaddr)->sa_family, SOCK_STREAM, IPPROTO_TCP);
+    if (hListenSocket == INVALID_SOCKET)
+        return error("%s: couldn't open socket (socket returned error %d)", pszName, WSAGetLastError());
+
+#ifdef SO_NOSIGPIPE
+    setsockopt(hListenSocket, SOL_SOCKET, SO_NOSIGPIPE, (void*)&nOne, sizeof(int));
+#endif
+#ifndef WIN32
+    setsockopt(hListenSocket, SOL_SOCKET, SO_REUSEADDR, (void*)&nOne, sizeof(int));
+#endif
+
+#ifdef WIN32
+    if (ioctlsocket(hListenSocket, FIONBIO, (u_long*)&nOne) == SOCKET_ERROR)
+#else
+    if (fcntl(hListenSocket, F_SETFL, O_NONBLOCK) == SOCKET_ERROR)
+#endif
+        return error("%s: couldn't set properties on socket (error %d)", pszName, WSAGetLastError());
+
+    if (::bind(hListenSocket, (struct sockaddr*)&sockaddr, len) == SOCKET_ERROR)
+        return error("%s: unable to bind to %s (bind returned error %d)", pszName, addrBind.ToString().c_str(), WSAGetLastError());
+    if (listen(hListenSocket, SOMAXCONN) == SOCKET_ERROR)
+        return error("%s: listening failed (listen returned error %d)", pszName, WSAGetLastError());
+
+    printf("%s listening on %s\n", pszName, addrBind.ToString().c_str());
+    return true;
+}
+
+SOCKET AcceptLineClient(SOCKET hListenSocket, CAddress& addr, const char* pszName)
+{
+#ifdef USE_IPV6
+    struct sockaddr_storage sockaddr;
+#else
+    struct sockaddr sockaddr;
+#endif
+    socklen_t len = sizeof(sockaddr);
+    SOCKET hSocket = accept(hListenSocket, (struct sockaddr*)&sockaddr, &len);
+    if (hSocket == INVALID_SOCKET)
+    {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK)
+            printf("%s: accept failed: %d\n", pszName, nErr);
+        return INVALID_SOCKET;
+    }
+
+    if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
+    {
+        printf("%s: connection from unknown address family refused\n", pszName);
+        closesocket(hSocket);
+        return INVALID_SOCKET;
+    }
+    return hSocket;
+}
+
+bool RecvLines(SOCKET hSocket, string& strRecv, vector<string>& vLines, unsigned int nMaxLine)
+{
+    char pchBuf[0x10000];
+    int nBytes = recv(hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    if (nBytes > 0)
+        strRecv.append(pchBuf, nBytes);
+    else if (nBytes == 0)
+        return false;
+    else
+    {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+            return false;
+    }
+
+    size_t nEnd;
+    while ((nEnd = strRecv.find('\n')) != string::npos)
+    {
+        string strLine = strRecv.substr(0, nEnd);
+        strRecv.erase(0, nEnd + 1);
+        boost::trim(strLine);
+        if (!strLine.empty())
+            vLines.push_back(strLine);
+    }
+    return strRecv.size() <= nMaxLine;
+}
+
+bool SendNonBlocking(SOCKET hSocket, const char* pch, size_t nSize, size_t& nSent)
+{
+    nSent = 0;
+    int nBytes = send(hSocket, pch, nSize, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (nBytes > 0)
+    {
+        nSent = nBytes;
+        return true;
+    }
+    int nErr = WSAGetLastError();
+    return (nErr == WSAEWOULDBLOCK || nErr == WSAEMSGSIZE || nErr == WSAEINTR || nErr == WSAEINPROGRESS);
+}
+
 void static Discover()
 {
     if (!fDiscover)
@@ -1895,6 +2063,18 @@ void StartNode(void* parg)
     if (!NewThread(ThreadDumpAddress, NULL))
         printf("Error; NewThread(ThreadDumpAddress) failed\n");
 
+    // Validate incoming transactions outside cs_main
+    StartTxValidationThreads();
+
+    // Rebroadcast wallet transactions that have not been confirmed
+    if (!NewThread(ThreadResendWalletTransactions, NULL))
+        printf("Error: NewThread(ThreadResendWalletTransactions) failed\n");
+
+    // Reload the transactions saved at the last shutdown
+    if (GetBoolArg("-persistmempool", true))
+        if (!NewThread(ThreadLoadMempool, NULL))
+            printf("Error: NewThread(ThreadLoadMempool) failed\n");
+
     // mint proof-of-stake blocks in the background
     if (!GetBoolArg("-staking", true))
         printf("Staking disabled\n");
@@ -1915,6 +2095,7 @@ bool StopNode()
     if (semOutbound)
         for (int i=0; i<MAX_OUTBOUND_CONNECTIONS; i++)
             semOutbound->post();
+    StopTxValidationThreads();
     do
     {
         int nThreadsRunning = 0;
@@ -1939,10 +2120,17 @@ bool StopNode()
     if (vnThreadsRunning[THREAD_ADDEDCONNECTIONS] > 0) printf("ThreadOpenAddedConnections still running\n");
     if (vnThreadsRunning[THREAD_DUMPADDRESS] > 0) printf("ThreadDumpAddresses still running\n");
     if (vnThreadsRunning[THREAD_MINTER] > 0) printf("ThreadStakeMinter still running\n");
+    if (vnThreadsRunning[THREAD_LOADMEMPOOL] > 0) printf("ThreadLoadMempool still running\n");
+    if (vnThreadsRunning[THREAD_TXVALIDATION] > 0) printf("ThreadTxValidation still running\n");
+    if (vnThreadsRunning[THREAD_RESENDWALLET] > 0) printf("ThreadResendWalletTransactions still running\n");
+    if (vnThreadsRunning[THREAD_STRATUM] > 0) printf("ThreadStratumServer still running\n");
+    if (vnThreadsRunning[THREAD_EVENTSERVER] > 0) printf("ThreadEventServer still running\n");
     while (vnThreadsRunning[THREAD_MESSAGEHANDLER] > 0 || vnThreadsRunning[THREAD_RPCHANDLER] > 0)
         Sleep(20);
     Sleep(50);
     DumpAddresses();
+    if (GetBoolArg("-persistmempool", true))
+        DumpMempool();
     return true;
 }
 
@@ -1981,6 +2169,15 @@ void CNode::RecordBytesSent(uint64 bytes)
 { 
     LOCK(cs_totalBytesSent); 
     nTotalBytesSent += bytes; 
+
+    int64 nNow = GetTime();
+    if (nMaxOutboundCycleStartTime + MAX_UPLOAD_TIMEFRAME < nNow)
+    {
+        // timeframe expired, reset cycle
+        nMaxOutboundCycleStartTime = nNow;
+        nMaxOutboundTotalBytesSentInCycle = 0;
+    }
+    nMaxOutboundTotalBytesSentInCycle += bytes;
 } 
  
 uint64 CNode::GetTotalBytesRecv() 
@@ -1993,4 +2190,68 @@ uint64 CNode::GetTotalBytesSent()
 { 
     LOCK(cs_totalBytesSent); 
     return nTotalBytesSent; 
+}
+
+void CNode::SetMaxOutboundTarget(uint64 nLimit)
+{
+    LOCK(cs_totalBytesSent);
+    nMaxOutboundLimit = nLimit;
+}
+
+uint64 CNode::GetMaxOutboundTarget()
+{
+    LOCK(cs_totalBytesSent);
+    return nMaxOutboundLimit;
+}
+
+int64 CNode::GetMaxOutboundTimeLeftInCycle()
+{
+    LOCK(cs_totalBytesSent);
+    if (nMaxOutboundLimit == 0)
+        return 0;
+    if (nMaxOutboundCycleStartTime == 0)
+        return MAX_UPLOAD_TIMEFRAME;
+    return std::max((int64)0, nMaxOutboundCycleStartTime + MAX_UPLOAD_TIMEFRAME - GetTime());
+}
+
+uint64 CNode::GetOutboundTargetBytesLeft()
+{
+    LOCK(cs_totalBytesSent);
+    if (nMaxOutboundLimit == 0)
+        return 0;
+    if (nMaxOutboundTotalBytesSentInCycle >= nMaxOutboundLimit)
+        return 0;
+    return nMaxOutboundLimit - nMaxOutboundTotalBytesSentInCycle;
+}
+
+bool CNode::OutboundTargetReached(bool fHistoricalBlockServingLimit)
+{
+    int64 nTimeLeft = GetMaxOutboundTimeLeftInCycle();
+    LOCK(cs_totalBytesSent);
+    if (nMaxOutboundLimit == 0)
+        return false;
+
+    if (fHistoricalBlockServingLimit)
+    {
+        // Keep back a reserve for relaying new blocks and transactions until
+        // the cycle ends: half the budget at the start, shrinking to nothing
+        uint64 nReserve = (uint64)((double)nMaxOutboundLimit / 2 * nTimeLeft / MAX_UPLOAD_TIMEFRAME);
+        return nMaxOutboundTotalBytesSentInCycle + nReserve >= nMaxOutboundLimit;
+    }
+    return nMaxOutboundTotalBytesSentInCycle >= nMaxOutboundLimit;
+}
+
+void CNode::AddWhitelisted(const CNetAddr& addr)
+{
+    LOCK(cs_vWhitelisted);
+    vWhitelisted.push_back(addr);
+}
+
+bool CNode::IsWhitelisted(const CNetAddr& addr)
+{
+    LOCK(cs_vWhitelisted);
+    BOOST_FOREACH(const CNetAddr& addrWhitelisted, vWhitelisted)
+        if (addrWhitelisted == addr)
+            return true;
+    return false;
 } 
\ No newline at end of file
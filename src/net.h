@@ -8,6 +8,7 @@
 #include <deque>
 #include <boost/array.hpp>
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 #include <openssl/rand.h>
 
 #ifndef WIN32
@@ -15,20 +16,44 @@
 #endif
 
 #include "mruset.h"
+#include "bloom.h"
 #include "netbase.h"
 #include "protocol.h"
 #include "addrman.h"
+#include "download.h"
 
 class CRequestTracker;
 class CNode;
 class CBlockIndex;
 extern int nBestHeight;
 
+/** A complete network message, header and payload, exactly as it goes on the
+ * wire.  Never modified once built, so one copy can be shared between the
+ * relay memory and the send queue of every peer it is sent to. */
+typedef boost::shared_ptr<const std::vector<char> > CMessageRef;
+
+CMessageRef MakeMessage(const char* pszCommand, const CDataStream& ssPayload);
+
 
 
 inline unsigned int ReceiveBufferSize() { return 1000*GetArg("-maxreceivebuffer", 5*1000); }
 inline unsigned int SendBufferSize() { return 1000*GetArg("-maxsendbuffer", 1*1000); }
 
+/** Length of the -maxuploadtarget accounting window in seconds */
+static const int64 MAX_UPLOAD_TIMEFRAME = 60 * 60 * 24;
+/** Size and false-positive rate of the per-peer filters remembering which
+ * addresses and inventory the peer already knows about.  A rolling filter
+ * keeps two CBloomFilters for twice the elements each, so these come to
+ * about 18KB and 14KB per peer.  Inventory matches the 1000 entries of the
+ * mruset it replaces, addresses a full getaddr reply (ADDRMAN_GETADDR_MAX). */
+static const unsigned int ADDR_KNOWN_ELEMENTS = 2500;
+static const double ADDR_KNOWN_FPRATE = 0.001;
+static const unsigned int INVENTORY_KNOWN_ELEMENTS = 1000;
+static const double INVENTORY_KNOWN_FPRATE = 0.000001;
+/** Blocks older than this are historical and the first to be refused once
+ * the upload budget runs low */
+static const int64 HISTORICAL_BLOCK_AGE = 60 * 60 * 24 * 7;
+
 void AddOneShot(std::string strDest);
 bool RecvLine(SOCKET hSocket, std::string& strLine);
 bool GetMyExternalIP(CNetAddr& ipRet);
@@ -39,6 +64,20 @@ CNode* ConnectNode(CAddress addrConnect, const char *strDest = NULL, int64 nTime
 void MapPort();
 unsigned short GetListenPort();
 bool BindListenPort(const CService &bindAddr, std::string& strError=REF(std::string()));
+
+/** Helpers of the line-based local servers (stratum, event server), which
+ * poll their own non-blocking sockets rather than going through CNode.
+ * pszName prefixes the log messages. */
+bool ListenLineServer(const CService& addrBind, SOCKET& hListenSocket, const char* pszName);
+/** Accept a waiting connection, INVALID_SOCKET if there is none */
+SOCKET AcceptLineClient(SOCKET hListenSocket, CAddress& addr, const char* pszName);
+/** Read what arrived on hSocket into strRecv and move the complete, trimmed,
+ * non-empty lines to vLines.  Returns false when the connection should be
+ * closed: it was closed or failed, or a line grew past nMaxLine. */
+bool RecvLines(SOCKET hSocket, std::string& strRecv, std::vector<std::string>& vLines, unsigned int nMaxLine);
+/** Send as much of pch as the socket takes without blocking, nSent bytes.
+ * Returns false when the connection failed. */
+bool SendNonBlocking(SOCKET hSocket, const char* pch, size_t nSize, size_t& nSent);
 void StartNode(void* parg);
 bool StopNode();
 
@@ -107,6 +146,11 @@ enum threadId
     THREAD_DUMPADDRESS,
     THREAD_RPCHANDLER,
     THREAD_MINTER,
+    THREAD_LOADMEMPOOL,
+    THREAD_TXVALIDATION,
+    THREAD_RESENDWALLET,
+    THREAD_STRATUM,
+    THREAD_EVENTSERVER,
 
     THREAD_MAX
 };
@@ -122,10 +166,15 @@ extern CAddrMan addrman;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
+extern std::map<CInv, CMessageRef> mapRelay;
 extern std::deque<std::pair<int64, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
-extern std::map<CInv, int64> mapAlreadyAskedFor;
+extern CDownloadScheduler downloads;
+
+/** Remember that a transaction was created by this node, so its inventory is
+ * always trickled rather than blasted to every peer at once */
+void MarkLocalTransaction(const uint256& hash);
+bool IsLocalTransaction(const uint256& hash);
 
 
 
@@ -144,9 +193,12 @@ public:
     int64 nReleaseTime;
     int nStartingHeight;
     int nMisbehavior;
+    int64 nMinFeeFilter;
 	uint64 nSendBytes; 
     uint64 nRecvBytes; 
     uint64 nBlocksRequested; 
+    int nDownloadInFlight;
+    int64 nDownloadResponse;
 };
 
 
@@ -160,7 +212,10 @@ public:
     // socket
     uint64 nServices;
     SOCKET hSocket;
-    CDataStream vSend;
+    CDataStream vSend;                  // message being built by BeginMessage/EndMessage
+    std::deque<CMessageRef> vSendMsg;   // finished messages waiting for the socket
+    size_t nSendOffset;                 // bytes of vSendMsg.front() already sent
+    uint64 nSendSize;                   // bytes waiting in vSendMsg
     CDataStream vRecv;
     CCriticalSection cs_vSend;
     CCriticalSection cs_vRecv;
@@ -173,6 +228,7 @@ public:
     uint64 nSendBytes; 
     int nHeaderStart;
     unsigned int nMessageStart;
+    NodeId id;
     CAddress addr;
     std::string addrName;
     CService addrLocal;
@@ -184,6 +240,7 @@ public:
     bool fNetworkNode;
     bool fSuccessfullyConnected;
     bool fDisconnect;
+    bool fWhitelisted;
     CSemaphoreGrant grantOutbound;
 protected:
     int nRefCount;
@@ -194,6 +251,9 @@ protected:
     static CCriticalSection cs_setBanned;
     int nMisbehavior;
 
+    static NodeId nLastNodeId;
+    static CCriticalSection cs_nLastNodeId;
+
 public:
     int64 nReleaseTime;
     std::map<uint256, CRequestTracker> mapRequests;
@@ -205,21 +265,34 @@ public:
 
     // flood relay
     std::vector<CAddress> vAddrToSend;
-    std::set<CAddress> setAddrKnown;
+    CRollingBloomFilter addrKnown;
     bool fGetAddr;
     std::set<uint256> setKnown;
     uint256 hashCheckpointKnown; // known sent sync-checkpoint
 
     // inventory based relay
-    mruset<CInv> setInventoryKnown;
+    CRollingBloomFilter filterInventoryKnown;
     std::vector<CInv> vInventoryToSend;
     CCriticalSection cs_inventory;
-    std::multimap<int64, CInv> mapAskFor;
 
-    CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "", bool fInboundIn=false) : vSend(SER_NETWORK, INIT_PROTO_VERSION), vRecv(SER_NETWORK, INIT_PROTO_VERSION)
+    // getdata requests not answered yet; served as the send queue drains,
+    // so one peer downloading blocks cannot starve the others
+    std::deque<CInv> vRecvGetData;
+
+    // fee filtering: the fee per 1000 bytes below which the peer does not
+    // want transactions announced, and what we last told it about ours
+    int64 nMinFeeFilter;
+    int64 nLastSentFeeFilter;
+    int64 nNextSendTimeFeeFilter;
+
+    CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "", bool fInboundIn=false) : vSend(SER_NETWORK, INIT_PROTO_VERSION), vRecv(SER_NETWORK, INIT_PROTO_VERSION),
+        addrKnown(ADDR_KNOWN_ELEMENTS, ADDR_KNOWN_FPRATE),
+        filterInventoryKnown(INVENTORY_KNOWN_ELEMENTS, INVENTORY_KNOWN_FPRATE)
     {
         nServices = 0;
         hSocket = hSocketIn;
+        nSendOffset = 0;
+        nSendSize = 0;
         nLastSend = 0;
         nLastRecv = 0;
         nLastSendEmpty = GetTime();
@@ -239,6 +312,7 @@ public:
         fNetworkNode = false;
         fSuccessfullyConnected = false;
         fDisconnect = false;
+        fWhitelisted = IsWhitelisted(addr);
         nRefCount = 0;
         nReleaseTime = 0;
         hashContinue = 0;
@@ -248,7 +322,14 @@ public:
         fGetAddr = false;
         nMisbehavior = 0;
         hashCheckpointKnown = 0;
-        setInventoryKnown.max_size(SendBufferSize() / 1000);
+        nMinFeeFilter = 0;
+        nLastSentFeeFilter = 0;
+        nNextSendTimeFeeFilter = 0;
+
+        {
+            LOCK(cs_nLastNodeId);
+            id = nLastNodeId++;
+        }
 
         // Be shy and don't send version until we hear
 		// Don't announce non-peer CNodes
@@ -272,6 +353,15 @@ private:
     static uint64 nTotalBytesRecv; 
     static uint64 nTotalBytesSent; 
 
+    // Upload budget (-maxuploadtarget), guarded by cs_totalBytesSent
+    static uint64 nMaxOutboundLimit;
+    static uint64 nMaxOutboundTotalBytesSentInCycle;
+    static int64 nMaxOutboundCycleStartTime;
+
+    // Peers exempt from serving limits (-whitelist)
+    static std::vector<CNetAddr> vWhitelisted;
+    static CCriticalSection cs_vWhitelisted;
+
     CNode(const CNode&);
     void operator=(const CNode&);
 
@@ -300,7 +390,7 @@ public:
 
     void AddAddressKnown(const CAddress& addr)
     {
-        setAddrKnown.insert(addr);
+        addrKnown.insert(addr.GetKey());
     }
 
     void PushAddress(const CAddress& addr)
@@ -308,7 +398,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
-        if (addr.IsValid() && !setAddrKnown.count(addr))
+        if (addr.IsValid() && !addrKnown.contains(addr.GetKey()))
             vAddrToSend.push_back(addr);
     }
 
@@ -317,7 +407,7 @@ public:
     {
         {
             LOCK(cs_inventory);
-            setInventoryKnown.insert(inv);
+            filterInventoryKnown.insert(inv.hash);
         }
     }
 
@@ -325,29 +415,14 @@ public:
     {
         {
             LOCK(cs_inventory);
-            if (!setInventoryKnown.count(inv))
+            if (!filterInventoryKnown.contains(inv.hash))
                 vInventoryToSend.push_back(inv);
         }
     }
 
     void AskFor(const CInv& inv)
     {
-        // We're using mapAskFor as a priority queue,
-        // the key is the earliest time the request can be sent
-        int64& nRequestTime = mapAlreadyAskedFor[inv];
-        if (fDebugNet)
-            printf("askfor %s   %"PRI64d" (%s)\n", inv.ToString().c_str(), nRequestTime, DateTimeStrFormat("%H:%M:%S", nRequestTime/1000000).c_str());
-
-        // Make sure not to reuse time indexes to keep things in the same order
-        int64 nNow = (GetTime() - 1) * 1000000;
-        static int64 nLastTime;
-        ++nLastTime;
-        nNow = std::max(nNow, nLastTime);
-        nLastTime = nNow;
-
-        // Each retry is 2 minutes after the last
-        nRequestTime = std::max(nRequestTime + 2 * 60 * 1000000, nNow);
-        mapAskFor.insert(std::make_pair(nRequestTime, inv));
+        downloads.Announce(id, inv, GetTimeMicros());
     }
 
 
@@ -404,6 +479,12 @@ public:
             printf("(%d bytes)\n", nSize);
         }
 
+        // Hand the finished message to the send queue
+        CMessageRef msg(new std::vector<char>(vSend.begin() + nHeaderStart, vSend.end()));
+        vSend.resize(nHeaderStart);
+        vSendMsg.push_back(msg);
+        nSendSize += msg->size();
+
         nHeaderStart = -1;
         nMessageStart = -1;
         LEAVE_CRITICAL_SECTION(cs_vSend);
@@ -424,6 +505,16 @@ public:
 
     void PushVersion();
 
+    // Queue a prebuilt message; the buffer is shared, not copied
+    void PushMessage(const CMessageRef& msg)
+    {
+        LOCK(cs_vSend);
+        if (fDebug)
+            printf("sending: shared message (%"PRIszu" bytes)\n", msg->size());
+        vSendMsg.push_back(msg);
+        nSendSize += msg->size();
+    }
+
 
     void PushMessage(const char* pszCommand)
     {
@@ -663,6 +754,18 @@ public:
  
     static uint64 GetTotalBytesRecv(); 
     static uint64 GetTotalBytesSent(); 
+
+    // Upload budget over a rolling MAX_UPLOAD_TIMEFRAME window
+    static void SetMaxOutboundTarget(uint64 nLimit);
+    static uint64 GetMaxOutboundTarget();
+    static int64 GetMaxOutboundTimeLeftInCycle();
+    static uint64 GetOutboundTargetBytesLeft();
+    /** True when the budget is spent; with fHistoricalBlockServingLimit, true
+     * as soon as only the reserve kept for relaying new data remains */
+    static bool OutboundTargetReached(bool fHistoricalBlockServingLimit);
+
+    static void AddWhitelisted(const CNetAddr& addr);
+    static bool IsWhitelisted(const CNetAddr& addr);
 };
 
 
@@ -705,8 +808,9 @@ inline void RelayMessage<>(const CInv& inv, const CDataStream& ss)
             vRelayExpiration.pop_front();
         }
 
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
+        // Save original serialized message so newer versions are preserved;
+        // it is framed once here and shared by every peer that asks for it
+        mapRelay.insert(std::make_pair(inv, MakeMessage(inv.GetCommand(), ss)));
         vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
     }
 
@@ -1,5 +1,6 @@
 #include "addresstablemodel.h"
 #include "guiutil.h"
+#include "guiconstants.h"
 #include "walletmodel.h"
 
 #include "wallet.h"
@@ -7,6 +8,11 @@
 
 #include <QFont>
 #include <QColor>
+#include <QTimer>
+
+#include <algorithm>
+#include <map>
+#include <vector>
 
 const QString AddressTableModel::Send = "S";
 const QString AddressTableModel::Receive = "R";
@@ -43,12 +49,24 @@ struct AddressTableEntryLessThan
     }
 };
 
+/* State an address book entry ends up in after the notifications received for it */
+struct AddressTableUpdate
+{
+    QString label;
+    bool isMine;
+    bool fDeleted;
+};
+
+/* Batches with more changes than this reset the model instead of updating rows one by one */
+static const unsigned int MAX_ROW_UPDATES = 64;
+
 // Private implementation
 class AddressTablePriv
 {
 public:
     CWallet *wallet;
-    QList<AddressTableEntry> cachedAddressTable;
+    std::vector<AddressTableEntry> cachedAddressTable;  // sorted by address
+    std::map<QString, AddressTableUpdate> pendingUpdates;
     AddressTableModel *parent;
 
     AddressTablePriv(CWallet *wallet, AddressTableModel *parent):
@@ -59,65 +77,132 @@ public:
         cachedAddressTable.clear();
         {
             LOCK(wallet->cs_wallet);
+            cachedAddressTable.reserve(wallet->mapAddressBook.size());
             BOOST_FOREACH(const PAIRTYPE(CTxDestination, std::string)& item, wallet->mapAddressBook)
             {
                 const CBitcoinAddress& address = item.first;
                 const std::string& strName = item.second;
                 bool fMine = IsMine(*wallet, address.Get());
-                cachedAddressTable.append(AddressTableEntry(fMine ? AddressTableEntry::Receiving : AddressTableEntry::Sending,
+                cachedAddressTable.push_back(AddressTableEntry(fMine ? AddressTableEntry::Receiving : AddressTableEntry::Sending,
                                   QString::fromStdString(strName),
                                   QString::fromStdString(address.ToString())));
             }
         }
+        // mapAddressBook is ordered by destination, not by address string
+        std::sort(cachedAddressTable.begin(), cachedAddressTable.end(), AddressTableEntryLessThan());
     }
 
-    void updateEntry(const QString &address, const QString &label, bool isMine, int status)
+    /* Remember a change from the core, returns true if it is the first of a new batch */
+    bool queueEntry(const QString &address, const QString &label, bool isMine, int status)
     {
-        // Find address / label in model
-        QList<AddressTableEntry>::iterator lower = qLowerBound(
-            cachedAddressTable.begin(), cachedAddressTable.end(), address, AddressTableEntryLessThan());
-        QList<AddressTableEntry>::iterator upper = qUpperBound(
-            cachedAddressTable.begin(), cachedAddressTable.end(), address, AddressTableEntryLessThan());
-        int lowerIndex = (lower - cachedAddressTable.begin());
-        int upperIndex = (upper - cachedAddressTable.begin());
-        bool inModel = (lower != upper);
-        AddressTableEntry::Type newEntryType = isMine ? AddressTableEntry::Receiving : AddressTableEntry::Sending;
+        bool fFirst = pendingUpdates.empty();
+
+        // Only the last state of an address matters, earlier notifications for it are superseded
+        AddressTableUpdate &update = pendingUpdates[address];
+        update.label = label;
+        update.isMine = isMine;
+        update.fDeleted = (status == CT_DELETED);
+        return fFirst;
+    }
 
-        switch(status)
+    /* Apply the queued changes to the table */
+    void applyUpdates()
+    {
+        if(pendingUpdates.size() > MAX_ROW_UPDATES)
+            applyUpdatesReset();
+        else
+            applyUpdatesByRow();
+        pendingUpdates.clear();
+    }
+
+    void applyUpdatesByRow()
+    {
+        for(std::map<QString, AddressTableUpdate>::const_iterator it = pendingUpdates.begin(); it != pendingUpdates.end(); ++it)
         {
-        case CT_NEW:
-            if(inModel)
+            const QString &address = (*it).first;
+            const AddressTableUpdate &update = (*it).second;
+            AddressTableEntry::Type newEntryType = update.isMine ? AddressTableEntry::Receiving : AddressTableEntry::Sending;
+
+            // Find address in model
+            std::vector<AddressTableEntry>::iterator lower = std::lower_bound(
+                cachedAddressTable.begin(), cachedAddressTable.end(), address, AddressTableEntryLessThan());
+            int lowerIndex = (lower - cachedAddressTable.begin());
+            bool inModel = (lower != cachedAddressTable.end() && lower->address == address);
+
+            if(update.fDeleted)
             {
-                OutputDebugStringF("Warning: AddressTablePriv::updateEntry: Got CT_NOW, but entry is already in model\n");
-                break;
+                if(!inModel)
+                    continue;
+                parent->beginRemoveRows(QModelIndex(), lowerIndex, lowerIndex);
+                cachedAddressTable.erase(lower);
+                parent->endRemoveRows();
             }
-            parent->beginInsertRows(QModelIndex(), lowerIndex, lowerIndex);
-            cachedAddressTable.insert(lowerIndex, AddressTableEntry(newEntryType, label, address));
-            parent->endInsertRows();
-            break;
-        case CT_UPDATED:
-            if(!inModel)
+            else if(inModel)
             {
-                OutputDebugStringF("Warning: AddressTablePriv::updateEntry: Got CT_UPDATED, but entry is not in model\n");
-                break;
+                lower->type = newEntryType;
+                lower->label = update.label;
+                parent->emitDataChanged(lowerIndex);
             }
-            lower->type = newEntryType;
-            lower->label = label;
-            parent->emitDataChanged(lowerIndex);
-            break;
-        case CT_DELETED:
-            if(!inModel)
+            else
             {
-                OutputDebugStringF("Warning: AddressTablePriv::updateEntry: Got CT_DELETED, but entry is not in model\n");
-                break;
+                parent->beginInsertRows(QModelIndex(), lowerIndex, lowerIndex);
+                cachedAddressTable.insert(lower, AddressTableEntry(newEntryType, update.label, address));
+                parent->endInsertRows();
             }
-            parent->beginRemoveRows(QModelIndex(), lowerIndex, upperIndex-1);
-            cachedAddressTable.erase(lower, upper);
-            parent->endRemoveRows();
-            break;
         }
     }
 
+    void applyUpdatesReset()
+    {
+        parent->beginResetModel();
+
+        // Update and delete in place, collect new entries to sort in once at the end
+        std::vector<bool> vDeleted(cachedAddressTable.size(), false);
+        std::vector<AddressTableEntry> vNew;
+        for(std::map<QString, AddressTableUpdate>::const_iterator it = pendingUpdates.begin(); it != pendingUpdates.end(); ++it)
+        {
+            const QString &address = (*it).first;
+            const AddressTableUpdate &update = (*it).second;
+            AddressTableEntry::Type newEntryType = update.isMine ? AddressTableEntry::Receiving : AddressTableEntry::Sending;
+
+            std::vector<AddressTableEntry>::iterator lower = std::lower_bound(
+                cachedAddressTable.begin(), cachedAddressTable.end(), address, AddressTableEntryLessThan());
+            bool inModel = (lower != cachedAddressTable.end() && lower->address == address);
+
+            if(update.fDeleted)
+            {
+                if(inModel)
+                    vDeleted[lower - cachedAddressTable.begin()] = true;
+            }
+            else if(inModel)
+            {
+                lower->type = newEntryType;
+                lower->label = update.label;
+            }
+            else
+            {
+                // The map hands out addresses in order, so vNew is sorted already
+                vNew.push_back(AddressTableEntry(newEntryType, update.label, address));
+            }
+        }
+
+        size_t nKept = 0;
+        for(size_t i = 0; i < cachedAddressTable.size(); i++)
+        {
+            if(vDeleted[i])
+                continue;
+            if(nKept != i)
+                cachedAddressTable[nKept] = cachedAddressTable[i];
+            nKept++;
+        }
+        cachedAddressTable.resize(nKept);
+
+        cachedAddressTable.insert(cachedAddressTable.end(), vNew.begin(), vNew.end());
+        std::inplace_merge(cachedAddressTable.begin(), cachedAddressTable.begin() + nKept, cachedAddressTable.end(), AddressTableEntryLessThan());
+
+        parent->endResetModel();
+    }
+
     int size()
     {
         return cachedAddressTable.size();
@@ -125,7 +210,7 @@ public:
 
     AddressTableEntry *index(int idx)
     {
-        if(idx >= 0 && idx < cachedAddressTable.size())
+        if(idx >= 0 && idx < (int)cachedAddressTable.size())
         {
             return &cachedAddressTable[idx];
         }
@@ -134,6 +219,16 @@ public:
             return 0;
         }
     }
+
+    /* Row of an address, or -1 if it is not in the table */
+    int lookupAddress(const QString &address)
+    {
+        std::vector<AddressTableEntry>::iterator lower = std::lower_bound(
+            cachedAddressTable.begin(), cachedAddressTable.end(), address, AddressTableEntryLessThan());
+        if(lower == cachedAddressTable.end() || lower->address != address)
+            return -1;
+        return lower - cachedAddressTable.begin();
+    }
 };
 
 AddressTableModel::AddressTableModel(CWallet *wallet, WalletModel *parent) :
@@ -163,11 +258,10 @@ int AddressTableModel::columnCount(const QModelIndex &parent) const
 
 QVariant AddressTableModel::data(const QModelIndex &index, int role) const
 {
-    if(!index.isValid())
+    AddressTableEntry *rec = priv->index(index.row());
+    if(!index.isValid() || !rec)
         return QVariant();
 
-    AddressTableEntry *rec = static_cast<AddressTableEntry*>(index.internalPointer());
-
     if(role == Qt::DisplayRole || role == Qt::EditRole)
     {
         switch(index.column())
@@ -210,9 +304,9 @@ QVariant AddressTableModel::data(const QModelIndex &index, int role) const
 
 bool AddressTableModel::setData(const QModelIndex & index, const QVariant & value, int role)
 {
-    if(!index.isValid())
+    AddressTableEntry *rec = priv->index(index.row());
+    if(!index.isValid() || !rec)
         return false;
-    AddressTableEntry *rec = static_cast<AddressTableEntry*>(index.internalPointer());
 
     editStatus = OK;
 
@@ -264,9 +358,9 @@ QVariant AddressTableModel::headerData(int section, Qt::Orientation orientation,
 
 Qt::ItemFlags AddressTableModel::flags(const QModelIndex & index) const
 {
-    if(!index.isValid())
+    AddressTableEntry *rec = priv->index(index.row());
+    if(!index.isValid() || !rec)
         return 0;
-    AddressTableEntry *rec = static_cast<AddressTableEntry*>(index.internalPointer());
 
     Qt::ItemFlags retval = Qt::ItemIsSelectable | Qt::ItemIsEnabled;
     // Can edit address and label for sending addresses,
@@ -285,7 +379,8 @@ QModelIndex AddressTableModel::index(int row, int column, const QModelIndex & pa
     AddressTableEntry *data = priv->index(row);
     if(data)
     {
-        return createIndex(row, column, priv->index(row));
+        // Rows move in the table as entries come and go, so indexes only carry the row
+        return createIndex(row, column);
     }
     else
     {
@@ -295,8 +390,15 @@ QModelIndex AddressTableModel::index(int row, int column, const QModelIndex & pa
 
 void AddressTableModel::updateEntry(const QString &address, const QString &label, bool isMine, int status)
 {
-    // Update address book model from Bitcoin core
-    priv->updateEntry(address, label, isMine, status);
+    // Update address book model from Bitcoin core. Bulk operations like importing a wallet
+    // send a notification per address, so collect them and update the table once.
+    if(priv->queueEntry(address, label, isMine, status))
+        QTimer::singleShot(ADDRESS_BATCH_DELAY, this, SLOT(applyPendingUpdates()));
+}
+
+void AddressTableModel::applyPendingUpdates()
+{
+    priv->applyUpdates();
 }
 
 QString AddressTableModel::addRow(const QString &type, const QString &label, const QString &address)
@@ -388,16 +490,7 @@ QString AddressTableModel::labelForAddress(const QString &address) const
 
 int AddressTableModel::lookupAddress(const QString &address) const
 {
-    QModelIndexList lst = match(index(0, Address, QModelIndex()),
-                                Qt::EditRole, address, 1, Qt::MatchExactly);
-    if(lst.isEmpty())
-    {
-        return -1;
-    }
-    else
-    {
-        return lst.at(0).row();
-    }
+    return priv->lookupAddress(address);
 }
 
 void AddressTableModel::emitDataChanged(int idx)
@@ -86,6 +86,11 @@ public slots:
     void updateEntry(const QString &address, const QString &label, bool isMine, int status);
 
     friend class AddressTablePriv;
+
+private slots:
+    /* Apply the address book changes collected by updateEntry.
+     */
+    void applyPendingUpdates();
 };
 
 #endif // ADDRESSTABLEMODEL_H
@@ -175,7 +175,7 @@ BitcoinGUI::BitcoinGUI(QWidget *parent):
     timerMintingWeights->start(30 * 1000);
     connect(timerMintingWeights, SIGNAL(timeout()), this, SLOT(updateMintingWeights()));
     // Set initial values for user and network weights
-    nWeight, nNetworkWeight = 0;
+    nWeight = nNetworkWeight = 0;
 
     // Progress bar and label for blocks download
     progressBarLabel = new QLabel();
@@ -488,6 +488,10 @@ void BitcoinGUI::setWalletModel(WalletModel *walletModel)
 
         // Ask for passphrase if needed
         connect(walletModel, SIGNAL(requireUnlock()), this, SLOT(unlockWallet()));
+
+        // Minting weights are computed off the GUI thread
+        connect(walletModel, SIGNAL(stakeWeightChanged(quint64,quint64)), this, SLOT(setMintingWeights(quint64,quint64)));
+        updateMintingWeights();
 	
 	// Show IRC / Web button option
 	chatAction->setVisible(walletModel->getOptionsModel()->getShowIrcButton());
@@ -1252,7 +1256,7 @@ void BitcoinGUI::updateMintingIcon()
         labelMintingIcon->setToolTip(tr("Not minting because staking is disabled."));
         labelMintingIcon->setEnabled(false);
     }
-    else if (IsInitialBlockDownload() || clientModel->getNumBlocks() < clientModel->getNumBlocksOfPeers())
+    else if (!clientModel || clientModel->inInitialBlockDownload() || clientModel->getNumBlocks() < clientModel->getNumBlocksOfPeers())
     {
         labelMintingIcon->setToolTip(tr("Not minting because wallet is syncing."));
         labelMintingIcon->setEnabled(false);
@@ -1306,13 +1310,15 @@ void BitcoinGUI::updateMintingIcon()
 void BitcoinGUI::updateMintingWeights()
 {
     // Only update if we have the network's current number of blocks, or weight(s) are zero (fixes lagging GUI)
-    if ((clientModel && clientModel->getNumBlocks() == clientModel->getNumBlocksOfPeers()) || !nWeight || !nNetworkWeight)
-    {
-        if (pwalletMain)
-            pwalletMain->GetStakeWeight(*pwalletMain, nMinMax, nMinMax, nWeight);
+    if (walletModel && ((clientModel && clientModel->getNumBlocks() == clientModel->getNumBlocksOfPeers()) || !nWeight || !nNetworkWeight))
+        walletModel->pollStakeWeight();
+}
 
-        nNetworkWeight = GetPoSKernelPS();
-    }
+void BitcoinGUI::setMintingWeights(quint64 weight, quint64 networkWeight)
+{
+    nWeight = weight;
+    nNetworkWeight = networkWeight;
+    updateMintingIcon();
 }
 
 WId BitcoinGUI::getMainWinId() const 
@@ -116,7 +116,6 @@ private:
 
     QMovie *syncIconMovie;
 
-    uint64 nMinMax;
     uint64 nWeight;
     uint64 nNetworkWeight;
     unsigned int nStakeSpacing;
@@ -229,6 +228,8 @@ private slots:
     void updateMintingIcon();
     /** Update minting weight info */
     void updateMintingWeights();
+    /** Take the minting weights the wallet model computed */
+    void setMintingWeights(quint64 weight, quint64 networkWeight);
 };
 
 #endif
@@ -6,293 +6,240 @@
 #include "db.h"
 #include "wallet.h"
 
+#include <QThread>
+
 double GetPoSKernelPS(const CBlockIndex* blockindex);
 double GetDifficulty(const CBlockIndex* blockindex);
 double GetPoWMHashPS(const CBlockIndex* blockindex);
 
 using namespace std;
 
-const CBlockIndex* getBlockIndex(int64_t height)
-{
-    std::string hex = getBlockHash(height);
-    uint256 hash(hex);
-    return mapBlockIndex[hash];
-}
-
-std::string getBlockHash(int64_t Height)
+double convertCoins(int64_t amount)
 {
-    if(Height > pindexBest->nHeight) { return ""; }
-    if(Height < 0) { return ""; }
-    int64_t desiredheight;
-    desiredheight = Height;
-    if (desiredheight < 0 || desiredheight > nBestHeight)
-        return 0;
-
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hashBestChain];
-    while (pblockindex->nHeight > desiredheight)
-        pblockindex = pblockindex->pprev;
-    return  pblockindex->GetBlockHash().GetHex(); // pblockindex->phashBlock->GetHex();
+    return (double)amount / (double)COIN;
 }
 
-int64_t getBlockTime(int64_t Height)
+static QString formatTxOut(const CTxOut& txout)
 {
-    std::string strHash = getBlockHash(Height);
-    uint256 hash(strHash);
-
-    if (mapBlockIndex.count(hash) == 0)
-        return 0;
+    CTxDestination address;
+    if (!ExtractDestination(txout.scriptPubKey, address))
+        address = CNoDestination();
 
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-    return pblockindex->nTime;
+    return QString::fromStdString(CBitcoinAddress(address).ToString() + ": " + FormatMoney(txout.nValue) + " XNA\n");
 }
 
-std::string getBlockMerkle(int64_t Height)
+/* Object for looking up blocks and transactions in a separate thread, so
+   browsing deep into the chain or waiting for cs_main doesn't freeze the GUI.
+*/
+class BlockBrowserExecutor: public QObject
 {
-    std::string strHash = getBlockHash(Height);
-    uint256 hash(strHash);
-
-    if (mapBlockIndex.count(hash) == 0)
-        return 0;
-
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-    return pblockindex->hashMerkleRoot.ToString();//.substr(0,10).c_str();
-}
-
-int64_t getBlocknBits(int64_t Height)
+    Q_OBJECT
+public slots:
+    void lookupBlock(int height);
+    void lookupTransaction(const QString &txid);
+signals:
+    void blockReady(const BlockBrowserBlock &block);
+    void txReady(const BlockBrowserTx &tx);
+};
+
+#include "blockbrowser.moc"
+
+void BlockBrowserExecutor::lookupBlock(int height)
 {
-    std::string strHash = getBlockHash(Height);
-    uint256 hash(strHash);
-
-    if (mapBlockIndex.count(hash) == 0)
-        return 0;
-
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-    return pblockindex->nBits;
+    BlockBrowserBlock result;
+    {
+        LOCK(cs_main);
+        if (!pindexBest)
+            return;
+        if (height > nBestHeight)
+            height = nBestHeight;
+        if (height < 0)
+            height = 0;
+
+        // Everything shown comes from the one index entry
+        const CBlockIndex* pindex = FindBlockByHeight(height);
+        result.nHeight = pindex->nHeight;
+        result.hash = QString::fromStdString(pindex->GetBlockHash().GetHex());
+        result.merkle = QString::fromStdString(pindex->hashMerkleRoot.ToString());
+        result.nBits = pindex->nBits;
+        result.nNonce = pindex->nNonce;
+        result.nTime = pindex->GetBlockTime();
+        result.dDifficulty = GetDifficulty(pindex);
+        result.fProofOfStake = pindex->IsProofOfStake();
+        result.dRate = result.fProofOfStake ? GetPoSKernelPS(pindex) : GetPoWMHashPS(pindex);
+    }
+    emit blockReady(result);
 }
 
-int64_t getBlockNonce(int64_t Height)
+void BlockBrowserExecutor::lookupTransaction(const QString &txid)
 {
-    std::string strHash = getBlockHash(Height);
-    uint256 hash(strHash);
-
-    if (mapBlockIndex.count(hash) == 0)
-        return 0;
-
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-    return pblockindex->nNonce;
-}
+    BlockBrowserTx result;
+    result.txid = txid;
 
-double getTxTotalValue(std::string txid)
-{
     uint256 hash;
-    hash.SetHex(txid);
-
-    CTransaction tx;
-    uint256 hashBlock = 0;
-    if (!GetTransaction(hash, tx, hashBlock))
-        return 0;
-
-    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
-    ssTx << tx;
-
-    double value = 0;
-    double buffer = 0;
-    for (unsigned int i = 0; i < tx.vout.size(); i++)
+    hash.SetHex(txid.toStdString());
     {
-        const CTxOut& txout = tx.vout[i];
+        LOCK(cs_main);
+        CTxDB txdb("r");
+
+        // Fetch the transaction once, from the memory pool or the block it is in
+        CTransaction tx;
+        {
+            LOCK(mempool.cs);
+            if (mempool.exists(hash))
+            {
+                tx = mempool.lookup(hash);
+                result.fFound = true;
+            }
+        }
+        if (!result.fFound)
+        {
+            CTxIndex txindex;
+            if (tx.ReadFromDisk(txdb, COutPoint(hash, 0), txindex))
+            {
+                result.fFound = true;
+                CBlock block;
+                if (block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
+                {
+                    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(block.GetHash());
+                    if (mi != mapBlockIndex.end())
+                        result.nHeight = (*mi).second->nHeight;
+                }
+            }
+        }
 
-        buffer = value + convertCoins(txout.nValue);
-        value = buffer;
+        if (result.fFound)
+        {
+            result.nValueOut = tx.GetValueOut();
+            for (unsigned int i = (tx.IsCoinStake() ? 1 : 0); i < tx.vout.size(); i++)
+                result.outputs.append(formatTxOut(tx.vout[i]));
+
+            // Resolve all previous outputs in one pass over the same database handle
+            MapPrevTx mapInputs;
+            map<uint256, CTxIndex> mapUnused;
+            bool fInvalid;
+            result.fReward = tx.IsCoinBase() || tx.IsCoinStake();
+            if (!tx.IsCoinBase() && tx.FetchInputs(txdb, mapUnused, false, false, mapInputs, fInvalid))
+            {
+                result.fHaveInputs = true;
+                BOOST_FOREACH(const CTxIn& txin, tx.vin)
+                    result.inputs.append(formatTxOut(mapInputs[txin.prevout.hash].second.vout[txin.prevout.n]));
+                result.nFee = tx.GetValueIn(mapInputs) - result.nValueOut;
+            }
+            else if (tx.IsCoinBase())
+            {
+                result.fHaveInputs = true;
+                result.nFee = -result.nValueOut;
+            }
+            if (result.fReward)
+                result.nFee *= -1;
+        }
     }
-
-    return value;
+    emit txReady(result);
 }
 
-double convertCoins(int64_t amount)
-{
-    return (double)amount / (double)COIN;
-}
-
-std::string getOutputs(std::string txid)
+BlockBrowser::BlockBrowser(QWidget *parent) :
+    QDialog(parent, (Qt::WindowMinMaxButtonsHint|Qt::WindowCloseButtonHint)),
+    ui(new Ui::BlockBrowser),
+    model(0),
+    fShowTxBlock(false)
 {
-    uint256 hash;
-    hash.SetHex(txid);
+    ui->setupUi(this);
 
-    CTransaction tx;
-    uint256 hashBlock = 0;
-    if (!GetTransaction(hash, tx, hashBlock))
-        return "N/A";
+    setBaseSize(850, 524);
 
-    std::string str = "";
-    for (unsigned int i = (tx.IsCoinStake() ? 1 : 0); i < tx.vout.size(); i++)
-    {
-        const CTxOut& txout = tx.vout[i];
-		
-        CTxDestination address;
-        if (!ExtractDestination(txout.scriptPubKey, address) )
-            address = CNoDestination();
-			
-        double buffer = convertCoins(txout.nValue);
-        std::string amount = boost::to_string(buffer);
-		str.append(CBitcoinAddress(address).ToString());
-        str.append(": ");
-        str.append(amount);
-        str.append(" XNA");
-        str.append("\n");
-    }
+    connect(ui->blockButton, SIGNAL(pressed()), this, SLOT(blockClicked()));
+    connect(ui->txButton, SIGNAL(pressed()), this, SLOT(txClicked()));
+    connect(ui->closeButton, SIGNAL(pressed()), this, SLOT(close()));
 
-    return str;
+    startExecutor();
 }
 
-std::string getInputs(std::string txid)
+void BlockBrowser::startExecutor()
 {
-    uint256 hash;
-    hash.SetHex(txid);
-
-    CTransaction tx;
-    uint256 hashBlock = 0;
-    if (!GetTransaction(hash, tx, hashBlock))
-        return "N/A";
-
-    std::string str = "";
-    for (unsigned int i = 0; i < tx.vin.size(); i++)
-    {
-        uint256 hash;
-        const CTxIn& vin = tx.vin[i];
-		
-        hash.SetHex(vin.prevout.hash.ToString());
-        CTransaction wtxPrev;
-        uint256 hashBlock = 0;
-        if (!GetTransaction(hash, wtxPrev, hashBlock))
-             return "N/A";
-
-        CTxDestination address;
-        if (!ExtractDestination(wtxPrev.vout[vin.prevout.n].scriptPubKey, address) )
-            address = CNoDestination();
-
-        double buffer = convertCoins(wtxPrev.vout[vin.prevout.n].nValue);
-        std::string amount = boost::to_string(buffer);
-        str.append(CBitcoinAddress(address).ToString());
-        str.append(": ");
-        str.append(amount);
-        str.append("XNA");
-        str.append("\n");
-    }
-
-    return str;
+    qRegisterMetaType<BlockBrowserBlock>("BlockBrowserBlock");
+    qRegisterMetaType<BlockBrowserTx>("BlockBrowserTx");
+
+    QThread* thread = new QThread;
+    BlockBrowserExecutor *executor = new BlockBrowserExecutor();
+    executor->moveToThread(thread);
+
+    // Lookups from this object go to the executor, results come back here
+    connect(this, SIGNAL(blockRequest(int)), executor, SLOT(lookupBlock(int)));
+    connect(this, SIGNAL(txRequest(QString)), executor, SLOT(lookupTransaction(QString)));
+    connect(executor, SIGNAL(blockReady(BlockBrowserBlock)), this, SLOT(showBlock(BlockBrowserBlock)));
+    connect(executor, SIGNAL(txReady(BlockBrowserTx)), this, SLOT(showTransaction(BlockBrowserTx)));
+    // On stopExecutor signal
+    // - queue executor for deletion (in execution thread)
+    // - quit the Qt event loop in the execution thread
+    connect(this, SIGNAL(stopExecutor()), executor, SLOT(deleteLater()));
+    connect(this, SIGNAL(stopExecutor()), thread, SLOT(quit()));
+    // Queue the thread for deletion (in this thread) when it is finished
+    connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
+
+    thread->start();
 }
 
-double BlockBrowser::getTxFees(std::string txid)
+void BlockBrowser::updateExplorer(bool block)
 {
-    uint256 hash;
-    hash.SetHex(txid);
-
-    CTransaction tx;
-    uint256 hashBlock = 0;
-	CTxDB txdb("r");
-	
-    if (!GetTransaction(hash, tx, hashBlock))
-        return convertCoins(MIN_TX_FEE);
-
-    MapPrevTx mapInputs;
-    map<uint256, CTxIndex> mapUnused;
-	bool fInvalid;
-
-    if (!tx.FetchInputs(txdb, mapUnused, false, false, mapInputs, fInvalid))
-	      return convertCoins(MIN_TX_FEE);
-		  
-    int64_t nTxFees = tx.GetValueIn(mapInputs)-tx.GetValueOut();
-
-    if(tx.IsCoinStake() || tx.IsCoinBase()) {
-        ui->feesLabel->setText(QString("Reward:"));
-        nTxFees *= -1;
-    }
+    if(block)
+        emit blockRequest(ui->heightBox->value());
     else
-        ui->feesLabel->setText(QString("Fees:"));
-		
-    return convertCoins(nTxFees);
+        emit txRequest(ui->txBox->text().trimmed());
 }
 
-BlockBrowser::BlockBrowser(QWidget *parent) :
-    QDialog(parent, (Qt::WindowMinMaxButtonsHint|Qt::WindowCloseButtonHint)),
-    ui(new Ui::BlockBrowser)
+void BlockBrowser::showBlock(const BlockBrowserBlock &block)
 {
-    ui->setupUi(this);
-
-    setBaseSize(850, 524);
-        
-    connect(ui->blockButton, SIGNAL(pressed()), this, SLOT(blockClicked()));
-    connect(ui->txButton, SIGNAL(pressed()), this, SLOT(txClicked()));
-    connect(ui->closeButton, SIGNAL(pressed()), this, SLOT(close()));
+    if (block.nHeight != ui->heightBox->value())
+        ui->heightBox->setValue(block.nHeight);
+
+    ui->heightLabelBE1->setText(QString::number(block.nHeight));
+    ui->hashBox->setText(block.hash);
+    ui->merkleBox->setText(block.merkle);
+    ui->bitsBox->setText(QString::number(block.nBits));
+    ui->nonceBox->setText(QString::number(block.nNonce));
+    ui->timeBox->setText(QString::fromUtf8(DateTimeStrFormat(block.nTime).c_str()));
+    ui->diffBox->setText(QString::number(block.dDifficulty, 'f', 6));
+    if (block.fProofOfStake) {
+        ui->hashRateLabel->setText("Block Network Stake Weight:");
+        ui->diffLabel->setText("PoS Block Difficulty:");
+        ui->hashRateBox->setText(QString::number(block.dRate, 'f', 3) + " ");
+    }
+    else {
+        ui->hashRateLabel->setText("Block Hash Rate:");
+        ui->diffLabel->setText("PoW Block Difficulty:");
+        ui->hashRateBox->setText(QString::number(block.dRate, 'f', 3) + " MH/s");
+    }
 }
 
-void BlockBrowser::updateExplorer(bool block)
-{    
-    if(block)
-	{
-	    int64_t height = ui->heightBox->value(); 
-        if (height > pindexBest->nHeight) 
-        { 
-            ui->heightBox->setValue(pindexBest->nHeight); 
-            height = pindexBest->nHeight; 
-        } 
- 
-        const CBlockIndex* pindex = getBlockIndex(height);
-	
-        ui->heightLabelBE1->setText(QString::number(height)); 
-        ui->hashBox->setText(QString::fromUtf8(getBlockHash(height).c_str())); 
-        ui->merkleBox->setText(QString::fromUtf8(getBlockMerkle(height).c_str())); 
-        ui->bitsBox->setText(QString::number(getBlocknBits(height))); 
-        ui->nonceBox->setText(QString::number(getBlockNonce(height))); 
-        ui->timeBox->setText(QString::fromUtf8(DateTimeStrFormat(getBlockTime(height)).c_str())); 
-        ui->diffBox->setText(QString::number(GetDifficulty(pindex), 'f', 6));
-        if (pindex->IsProofOfStake()) { 
-            ui->hashRateLabel->setText("Block Network Stake Weight:");
-            ui->diffLabel->setText("PoS Block Difficulty:");			
-            ui->hashRateBox->setText(QString::number(GetPoSKernelPS(pindex), 'f', 3) + " ");
-        } 
-        else { 
-            ui->hashRateLabel->setText("Block Hash Rate:");
-            ui->diffLabel->setText("PoW Block Difficulty:");
-            ui->hashRateBox->setText(QString::number(GetPoWMHashPS(pindex), 'f', 3) + " MH/s");
+void BlockBrowser::showTransaction(const BlockBrowserTx &tx)
+{
+    ui->txID->setText(tx.txid);
+    ui->valueBox->setText(QString::number(convertCoins(tx.nValueOut), 'f', 6) + " XNA");
+    ui->outputBox->setText(tx.fFound ? tx.outputs : QString("N/A"));
+    ui->inputBox->setText(tx.fHaveInputs && !tx.inputs.isEmpty() ? tx.inputs : QString("N/A"));
+    ui->feesLabel->setText(tx.fReward ? QString("Reward:") : QString("Fees:"));
+    ui->feesBox->setText(tx.fHaveInputs ? QString::number(convertCoins(tx.nFee), 'f', 6) + " XNA" : QString("N/A"));
+
+    // Coming from the transaction list, also show the block the transaction is in
+    if (fShowTxBlock)
+    {
+        fShowTxBlock = false;
+        if (tx.fFound)
+        {
+            ui->heightBox->setValue(tx.nHeight >= 0 ? tx.nHeight : nBestHeight);
+            updateExplorer(true);
         }
-    } 
-    
-    else {
-        std::string txid = ui->txBox->text().toUtf8().constData();
-        ui->valueBox->setText(QString::number(getTxTotalValue(txid), 'f', 6) + " XNA"); 
-        ui->txID->setText(QString::fromUtf8(txid.c_str())); 
-        ui->outputBox->setText(QString::fromUtf8(getOutputs(txid).c_str())); 
-        ui->inputBox->setText(QString::fromUtf8(getInputs(txid).c_str())); 
-        ui->feesBox->setText(QString::number(getTxFees(txid), 'f', 6) + " XNA"); 
     }
 }
 
- void BlockBrowser::setTransactionId(const QString &transactionId) 
- { 
-     ui->txBox->setText(transactionId); 
-     ui->txBox->setFocus(); 
-     updateExplorer(false); 
-  
-     uint256 hash; 
-     hash.SetHex(transactionId.toStdString()); 
-  
-     CTransaction tx; 
-     uint256 hashBlock = 0; 
-     if (GetTransaction(hash, tx, hashBlock)) 
-     { 
-         CBlockIndex* pblockindex = mapBlockIndex[hashBlock]; 
-         if (!pblockindex) 
-             ui->heightBox->setValue(nBestHeight); 
-         else 
-             ui->heightBox->setValue(pblockindex->nHeight); 
-         updateExplorer(true); 
-     } 
- } 
+void BlockBrowser::setTransactionId(const QString &transactionId)
+{
+    ui->txBox->setText(transactionId);
+    ui->txBox->setFocus();
+    fShowTxBlock = true;
+    updateExplorer(false);
+}
 
 void BlockBrowser::txClicked()
 {
@@ -311,5 +258,6 @@ void BlockBrowser::setModel(ClientModel *model)
 
 BlockBrowser::~BlockBrowser()
 {
+    emit stopExecutor();
     delete ui;
 }
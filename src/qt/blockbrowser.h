@@ -4,12 +4,48 @@
 #include "clientmodel.h"
 #include "main.h"
 #include <QDialog>
+#include <QMetaType>
 
 namespace Ui {
 class BlockBrowser;
 }
 class ClientModel;
 
+/** What the block view shows, gathered from a single index entry */
+struct BlockBrowserBlock
+{
+    int nHeight;
+    QString hash;
+    QString merkle;
+    unsigned int nBits;
+    unsigned int nNonce;
+    qint64 nTime;
+    double dDifficulty;
+    bool fProofOfStake;
+    double dRate;           // stake weight or MH/s around the block
+
+    BlockBrowserBlock() : nHeight(-1), nBits(0), nNonce(0), nTime(0), dDifficulty(0), fProofOfStake(false), dRate(0) {}
+};
+
+/** What the transaction view shows, gathered from a single fetch of the transaction and its inputs */
+struct BlockBrowserTx
+{
+    QString txid;
+    bool fFound;
+    int nHeight;            // -1 while in the memory pool
+    qint64 nValueOut;
+    QString inputs;
+    QString outputs;
+    bool fHaveInputs;
+    bool fReward;           // coinbase or coinstake, nFee is then what was created
+    qint64 nFee;
+
+    BlockBrowserTx() : fFound(false), nHeight(-1), nValueOut(0), fHaveInputs(false), fReward(false), nFee(0) {}
+};
+
+Q_DECLARE_METATYPE(BlockBrowserBlock)
+Q_DECLARE_METATYPE(BlockBrowserTx)
+
 class BlockBrowser : public QDialog
 {
     Q_OBJECT
@@ -17,36 +53,33 @@ class BlockBrowser : public QDialog
 public:
     explicit BlockBrowser(QWidget *parent = 0);
     ~BlockBrowser();
-    
+
     void setTransactionId(const QString &transactionId);
     void setModel(ClientModel *model);
-    
+
 public slots:
-    
+
     void blockClicked();
     void txClicked();
     void updateExplorer(bool);
-    double getTxFees(std::string);
 
 private slots:
+    void showBlock(const BlockBrowserBlock &block);
+    void showTransaction(const BlockBrowserTx &tx);
+
+signals:
+    void blockRequest(int height);
+    void txRequest(const QString &txid);
+    void stopExecutor();
 
 private:
     Ui::BlockBrowser *ui;
     ClientModel *model;
-    
+    bool fShowTxBlock;
+
+    void startExecutor();
 };
 
-double getTxTotalValue(std::string); 
-double convertCoins(int64_t); 
-int64_t getBlockTime(int64_t); 
-int64_t getBlocknBits(int64_t); 
-int64_t getBlockNonce(int64_t); 
-int64_t getBlockHashrate(int64_t); 
-std::string getInputs(std::string); 
-std::string getOutputs(std::string); 
-std::string getBlockHash(int64_t); 
-std::string getBlockMerkle(int64_t); 
-bool addnode(std::string); 
-const CBlockIndex* getBlockIndex(int64_t);
+double convertCoins(int64_t);
 
 #endif // BLOCKBROWSER_H
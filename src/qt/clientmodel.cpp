@@ -3,6 +3,7 @@
 #include "optionsmodel.h"
 #include "addresstablemodel.h"
 #include "transactiontablemodel.h"
+#include "modelworker.h"
 
 #include "alert.h"
 #include "main.h"
@@ -12,12 +13,18 @@
 #include <QTimer>
 
 static const int64_t nClientStartupTime = GetTime();
-double GetPoSKernelPS(const CBlockIndex* blockindex = NULL);
 
 ClientModel::ClientModel(OptionsModel *optionsModel, QObject *parent) :
     QObject(parent), optionsModel(optionsModel),
-    cachedNumBlocks(0), cachedNumBlocksOfPeers(0), numBlocksAtStartup(-1), pollTimer(0)
+    cachedNumBlocks(0), cachedNumBlocksOfPeers(0), cachedLastBlockTime(0),
+    cachedInitialDownload(true), cachedBits(0), numBlocksAtStartup(-1), pollTimer(0)
 {
+    // Chain state is queried on the worker thread, which takes cs_main;
+    // the first answer replaces the defaults above
+    worker = new ClientModelWorker();
+    connect(worker, SIGNAL(chainStatusReady(int,int,qint64,bool,unsigned int)), this, SLOT(updateChainStatus(int,int,qint64,bool,unsigned int)));
+    worker->start();
+    worker->post(ClientModelWorker::ChainStatus);
 
     pollTimer = new QTimer(this);
     pollTimer->setInterval(MODEL_UPDATE_DELAY);
@@ -30,6 +37,8 @@ ClientModel::ClientModel(OptionsModel *optionsModel, QObject *parent) :
 ClientModel::~ClientModel()
 {
     unsubscribeFromCoreSignals();
+    worker->stop();
+    delete worker;
 }
 
 int ClientModel::getNumConnections() const
@@ -39,7 +48,7 @@ int ClientModel::getNumConnections() const
 
 int ClientModel::getNumBlocks() const
 {
-    return nBestHeight;
+    return cachedNumBlocks;
 }
 
 int ClientModel::getNumBlocksAtStartup()
@@ -60,15 +69,23 @@ quint64 ClientModel::getTotalBytesSent() const
 
 QDateTime ClientModel::getLastBlockDate() const
 {
-    return QDateTime::fromTime_t(pindexBest->GetBlockTime());
+    return QDateTime::fromTime_t(cachedLastBlockTime);
 }
 
 void ClientModel::updateTimer()
 {
     // Some quantities (such as number of blocks) change so fast that we don't want to be notified for each change.
     // Periodically check and update with a timer.
-    int newNumBlocks = getNumBlocks();
-    int newNumBlocksOfPeers = getNumBlocksOfPeers();
+    worker->post(ClientModelWorker::ChainStatus);
+
+    emit bytesChanged(getTotalBytesRecv(), getTotalBytesSent());
+}
+
+void ClientModel::updateChainStatus(int newNumBlocks, int newNumBlocksOfPeers, qint64 lastBlockTime, bool initialDownload, unsigned int bits)
+{
+    cachedLastBlockTime = lastBlockTime;
+    cachedInitialDownload = initialDownload;
+    cachedBits = bits;
 
     if(cachedNumBlocks != newNumBlocks || cachedNumBlocksOfPeers != newNumBlocksOfPeers)
     {
@@ -78,8 +95,6 @@ void ClientModel::updateTimer()
         // ensure we return the maximum of newNumBlocksOfPeers and newNumBlocks to not create weird displays in the GUI 
         emit numBlocksChanged(newNumBlocks, std::max(newNumBlocksOfPeers, newNumBlocks)); 
     }
-	
-	    emit bytesChanged(getTotalBytesRecv(), getTotalBytesSent());
 }
 
 void ClientModel::updateNumConnections(int numConnections)
@@ -112,12 +127,12 @@ double ClientModel::GetDifficulty() const
     // Floating point number that is a multiple of the minimum difficulty,
     // minimum difficulty = 1.0.
 
-    if (pindexBest == NULL)
+    if (cachedBits == 0)
         return 1.0;
-    int nShift = (pindexBest->nBits >> 24) & 0xff;
+    int nShift = (cachedBits >> 24) & 0xff;
 
     double dDiff =
-        (double)0x0000ffff / (double)(pindexBest->nBits & 0x00ffffff);
+        (double)0x0000ffff / (double)(cachedBits & 0x00ffffff);
 
     while (nShift < 29)
     {
@@ -141,12 +156,12 @@ bool ClientModel::isTestNet() const
 
 bool ClientModel::inInitialBlockDownload() const
 {
-    return IsInitialBlockDownload();
+    return cachedInitialDownload;
 }
 
 int ClientModel::getNumBlocksOfPeers() const
 {
-    return GetNumBlocksOfPeers();
+    return cachedNumBlocksOfPeers;
 }
 
 QString ClientModel::getStatusBarWarnings() const
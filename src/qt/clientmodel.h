@@ -7,6 +7,7 @@ class OptionsModel;
 class AddressTableModel;
 class TransactionTableModel;
 class CWallet;
+class ClientModelWorker;
 
 QT_BEGIN_NAMESPACE
 class QDateTime;
@@ -52,10 +53,14 @@ private:
 
     int cachedNumBlocks;
     int cachedNumBlocksOfPeers;
+    qint64 cachedLastBlockTime;
+    bool cachedInitialDownload;
+    unsigned int cachedBits;
 
     int numBlocksAtStartup;
 
     QTimer *pollTimer;
+    ClientModelWorker *worker;
 
     void subscribeToCoreSignals();
     void unsubscribeFromCoreSignals();
@@ -71,6 +76,10 @@ public slots:
     void updateTimer();
     void updateNumConnections(int numConnections);
     void updateAlert(const QString &hash, int status);
+
+private slots:
+    /* Chain status as queried by the worker */
+    void updateChainStatus(int numBlocks, int numBlocksOfPeers, qint64 lastBlockTime, bool initialDownload, unsigned int bits);
 };
 
 #endif // CLIENTMODEL_H
@@ -12,19 +12,15 @@
 #include <QApplication>
 #include <QCheckBox>
 #include <QClipboard>
-#include <QColor>
 #include <QCursor>
-#include <QDateTime>
 #include <QDialogButtonBox>
-#include <QFlags>
-#include <QIcon>
+#include <QHeaderView>
 #include <QString>
-#include <QTreeWidget>
-#include <QTreeWidgetItem>
 
 using namespace std;
 QList<int64_t> CoinControlDialog::payAmounts;
 CCoinControl* CoinControlDialog::coinControl = new CCoinControl();
+CoinControlInputs CoinControlDialog::selectedInputs;
 
 CoinControlDialog::CoinControlDialog(QWidget *parent) :
     QDialog(parent),
@@ -33,6 +29,11 @@ CoinControlDialog::CoinControlDialog(QWidget *parent) :
 {
     ui->setupUi(this);
 
+    coinModel = new CoinControlModel(coinControl, &selectedInputs, this);
+    coinModel->setTreeMode(ui->radioTreeMode->isChecked());
+    ui->treeWidget->setModel(coinModel);
+    ui->treeWidget->setAlternatingRowColors(!ui->radioTreeMode->isChecked());
+
     // context menu actions
     QAction *copyAddressAction = new QAction(tr("Copy address"), this);
     QAction *copyLabelAction = new QAction(tr("Copy label"), this);
@@ -93,7 +94,7 @@ CoinControlDialog::CoinControlDialog(QWidget *parent) :
     connect(ui->radioListMode, SIGNAL(toggled(bool)), this, SLOT(radioListMode(bool)));
 
     // click on checkbox
-    connect(ui->treeWidget, SIGNAL(itemChanged( QTreeWidgetItem*, int)), this, SLOT(viewItemChanged( QTreeWidgetItem*, int)));
+    connect(coinModel, SIGNAL(checkedChanged()), this, SLOT(checkedChanged()));
 
     // click on header
 #if QT_VERSION < 0x050000
@@ -122,14 +123,9 @@ CoinControlDialog::CoinControlDialog(QWidget *parent) :
 	ui->treeWidget->setColumnWidth(COLUMN_PRIORITY, 100);
     ui->treeWidget->setColumnWidth(COLUMN_LABEL, 85);
     ui->treeWidget->setColumnWidth(COLUMN_ADDRESS, 150);
-	ui->treeWidget->setColumnHidden(COLUMN_AGE_INT64, true);
-    ui->treeWidget->setColumnHidden(COLUMN_TXHASH, true);         // store transacton hash in this column, but dont show it
-    ui->treeWidget->setColumnHidden(COLUMN_VOUT_INDEX, true);     // store vout index in this column, but dont show it
-    ui->treeWidget->setColumnHidden(COLUMN_AMOUNT_INT64, true);   // store amount int64_t in this column, but dont show it
-    ui->treeWidget->setColumnHidden(COLUMN_PRIORITY_INT64, true); // store priority int64_t in this column, but dont show it
 
     // default view is sorted by amount desc
-    sortView(COLUMN_AMOUNT_INT64, Qt::DescendingOrder);
+    sortView(COLUMN_AMOUNT, Qt::DescendingOrder);
 
 	// combo box to select coin filter 
 	ui->QComboBoxFilterCoins->addItem("Amount <"); 
@@ -151,21 +147,15 @@ void CoinControlDialog::setModel(WalletModel *model)
 
     if(model && model->getOptionsModel() && model->getAddressTableModel())
     {
-        updateView();
+        // The coins are listed on the wallet model's worker thread, setCoins() shows them
+        connect(model, SIGNAL(coinsChanged(WalletCoins)), this, SLOT(setCoins(WalletCoins)));
+        model->pollCoins();
+        coinModel->setDisplayUnit(model->getOptionsModel()->getDisplayUnit());
         //updateLabelLocked();
         CoinControlDialog::updateLabels(model, this);
     }
 }
 
-// helper function str_pad
-QString CoinControlDialog::strPad(QString s, int nPadLength, QString sPadding)
-{
-    while (s.length() < nPadLength)
-        s = sPadding + s;
-
-    return s;
-}
-
 // ok button
 void CoinControlDialog::buttonBoxClicked(QAbstractButton* button)
 {
@@ -176,21 +166,8 @@ void CoinControlDialog::buttonBoxClicked(QAbstractButton* button)
 // (un)select all
 void CoinControlDialog::buttonSelectAllClicked()
 {
-    Qt::CheckState state = Qt::Checked;
-    for (int i = 0; i < ui->treeWidget->topLevelItemCount(); i++)
-    {
-        if (ui->treeWidget->topLevelItem(i)->checkState(COLUMN_CHECKBOX) != Qt::Unchecked)
-        {
-            state = Qt::Unchecked;
-            break;
-        }
-    }
-    ui->treeWidget->setEnabled(false);
-    for (int i = 0; i < ui->treeWidget->topLevelItemCount(); i++)
-            if (ui->treeWidget->topLevelItem(i)->checkState(COLUMN_CHECKBOX) != state)
-                ui->treeWidget->topLevelItem(i)->setCheckState(COLUMN_CHECKBOX, state);
-    ui->treeWidget->setEnabled(true);
-    CoinControlDialog::updateLabels(model, this);
+    // unselect all if anything is selected, select all otherwise
+    coinModel->setAllChecked(!coinModel->hasChecked());
 }
 
 void CoinControlDialog::customSelectCoins() 
@@ -198,110 +175,51 @@ void CoinControlDialog::customSelectCoins()
 	QString strUserAmount = ui->lineEditCustomCC->text(); 
 	QString strComboText = ui->QComboBoxFilterCoins->currentText();
 	double dUserAmount = QString(strUserAmount).toDouble(); 
-	 
-	bool treeMode = ui->radioTreeMode->isChecked(); 
-	 
-	QFlags<Qt::ItemFlag> flgCheckbox=Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable; 
-         
-    map<QString, vector<COutput> > mapCoins; 
-    model->listCoins(mapCoins); 
- 
-    BOOST_FOREACH(PAIRTYPE(QString, vector<COutput>) coins, mapCoins) 
-    { 
-        QTreeWidgetItem *itemWalletAddress = new QTreeWidgetItem(); 
-		 
-		QTreeWidgetItem *itemOutput; 
-        if (treeMode)    itemOutput = new QTreeWidgetItem(itemWalletAddress); 
-        else             itemOutput = new QTreeWidgetItem(ui->treeWidget); 
-        itemOutput->setFlags(flgCheckbox); 
-        itemOutput->setCheckState(COLUMN_CHECKBOX,Qt::Unchecked); 
-		 
-    BOOST_FOREACH(const COutput& out, coins.second) 
-    { 
-    // transaction hash 
-        uint256 txhash = out.tx->GetHash(); 
-
-    //Getting the coin amount 
-    double dCoinAmount = out.tx->vout[out.i].nValue; 
-			
-    //Coin Weight 
-	uint64_t nTxWeight = 0; 
-	model->getStakeWeightFromValue(out.tx->GetTxTime(), out.tx->vout[out.i].nValue, nTxWeight); 
-			 
-	//Age 
-	double dAge = (GetTime() - out.tx->GetTxTime()) / (double)(1440 * 60); 
-			 
-	//selecting the coins 
-		if (strComboText == "Amount <") 
-		{ 
-			if (dCoinAmount < dUserAmount * COIN) 
-			{			 
-				COutPoint outpt(txhash, out.i); 
-				coinControl->Select(outpt); 
-				itemOutput->setCheckState(COLUMN_CHECKBOX,Qt::Checked); 
-			}
-		} 
-		else if (strComboText == "Amount >") 
-		{ 
-			if (dCoinAmount > dUserAmount * COIN) 
-			{			 
-				COutPoint outpt(txhash, out.i); 
-				coinControl->Select(outpt); 
-				itemOutput->setCheckState(COLUMN_CHECKBOX,Qt::Checked); 
-			}
-		} 
-		else if (strComboText == "Weight <") 
-		{ 
-			if (nTxWeight < dUserAmount) 
-			{			 
-				COutPoint outpt(txhash, out.i); 
-				coinControl->Select(outpt); 
-				itemOutput->setCheckState(COLUMN_CHECKBOX,Qt::Checked); 
-			}
-		} 
-		else if (strComboText == "Weight >") 
-		{ 
-			if (nTxWeight > dUserAmount) 
-			{			 
-				COutPoint outpt(txhash, out.i); 
-				coinControl->Select(outpt); 
-				itemOutput->setCheckState(COLUMN_CHECKBOX,Qt::Checked); 
-			}
-		} 
-		else if (strComboText == "Age <") 
-		{ 
-			if (dAge < dUserAmount) 
-			{			 
-				COutPoint outpt(txhash, out.i); 
-				coinControl->Select(outpt); 
-				itemOutput->setCheckState(COLUMN_CHECKBOX,Qt::Checked); 
-			}
-		} 
-		else if (strComboText == "Age >") 
-		{ 
-			if (dAge > dUserAmount) 
-			{			 
-				COutPoint outpt(txhash, out.i); 
-				coinControl->Select(outpt); 
-				itemOutput->setCheckState(COLUMN_CHECKBOX,Qt::Checked); 
-			}
-		} 
-	} 
-    } 
-    CoinControlDialog::updateLabels(model, this);
-	updateView(); 
+
+    BOOST_FOREACH(const WalletCoinGroup& coinGroup, coinModel->getCoins())
+    {
+        BOOST_FOREACH(const WalletCoin& coin, coinGroup.coins)
+        {
+            //Age 
+            double dAge = (GetTime() - coin.nTxTime) / (double)(1440 * 60); 
+
+            //selecting the coins 
+            bool fSelect = false;
+            if (strComboText == "Amount <")
+                fSelect = coin.nValue < dUserAmount * COIN;
+            else if (strComboText == "Amount >")
+                fSelect = coin.nValue > dUserAmount * COIN;
+            else if (strComboText == "Weight <")
+                fSelect = coin.nWeight < dUserAmount;
+            else if (strComboText == "Weight >")
+                fSelect = coin.nWeight > dUserAmount;
+            else if (strComboText == "Age <")
+                fSelect = dAge < dUserAmount;
+            else if (strComboText == "Age >")
+                fSelect = dAge > dUserAmount;
+
+            if (fSelect)
+            {
+                COutPoint outpt(coin.hash, coin.n);
+                coinControl->Select(outpt);
+            }
+        }
+    }
+    // the model unselects immature coins again and updates the labels
+    coinModel->updateCheckStates();
+    expandPartiallyChecked();
 } 
 
 // context menu
 void CoinControlDialog::showMenu(const QPoint &point)
 {
-    QTreeWidgetItem *item = ui->treeWidget->itemAt(point);
-    if(item)
+    QModelIndex index = ui->treeWidget->indexAt(point);
+    if(index.isValid())
     {
-        contextMenuItem = item;
+        contextMenuItem = index;
 
         // disable some items (like Copy Transaction ID, lock, unlock) for tree roots in context menu
-        if (item->text(COLUMN_TXHASH).length() == 64) // transaction hash is 64 characters (this means its a child node, so its not a parent node in tree mode)
+        if (!index.data(CoinControlModel::TxHashRole).toString().isEmpty()) // only coins have a transaction hash, addresses in tree mode don't
         {
             copyTransactionHashAction->setEnabled(true);
             //if (model->isLockedCoin(uint256(item->text(COLUMN_TXHASH).toStdString()), item->text(COLUMN_VOUT_INDEX).toUInt()))
@@ -327,34 +245,38 @@ void CoinControlDialog::showMenu(const QPoint &point)
     }
 }
 
+// text of a column of the row the context menu is for, in tree mode optionally from its address if empty
+QString CoinControlDialog::contextMenuText(int column, bool fFromParent)
+{
+    QModelIndex index = contextMenuItem.sibling(contextMenuItem.row(), column);
+    QString text = index.data().toString();
+    if (fFromParent && ui->radioTreeMode->isChecked() && text.length() == 0 && index.parent().isValid())
+        text = index.parent().sibling(index.parent().row(), column).data().toString();
+    return text;
+}
+
 // context menu action: copy amount
 void CoinControlDialog::copyAmount()
 {
-    QApplication::clipboard()->setText(contextMenuItem->text(COLUMN_AMOUNT));
+    QApplication::clipboard()->setText(contextMenuText(COLUMN_AMOUNT, false));
 }
 
 // context menu action: copy label
 void CoinControlDialog::copyLabel()
 {
-    if (ui->radioTreeMode->isChecked() && contextMenuItem->text(COLUMN_LABEL).length() == 0 && contextMenuItem->parent())
-        QApplication::clipboard()->setText(contextMenuItem->parent()->text(COLUMN_LABEL));
-    else
-        QApplication::clipboard()->setText(contextMenuItem->text(COLUMN_LABEL));
+    QApplication::clipboard()->setText(contextMenuText(COLUMN_LABEL, true));
 }
 
 // context menu action: copy address
 void CoinControlDialog::copyAddress()
 {
-    if (ui->radioTreeMode->isChecked() && contextMenuItem->text(COLUMN_ADDRESS).length() == 0 && contextMenuItem->parent())
-        QApplication::clipboard()->setText(contextMenuItem->parent()->text(COLUMN_ADDRESS));
-    else
-        QApplication::clipboard()->setText(contextMenuItem->text(COLUMN_ADDRESS));
+    QApplication::clipboard()->setText(contextMenuText(COLUMN_ADDRESS, true));
 }
 
 // context menu action: copy transaction id
 void CoinControlDialog::copyTransactionHash()
 {
-    QApplication::clipboard()->setText(contextMenuItem->text(COLUMN_TXHASH));
+    QApplication::clipboard()->setText(contextMenuItem.data(CoinControlModel::TxHashRole).toString());
 }
 
 // context menu action: lock coin
@@ -433,8 +355,8 @@ void CoinControlDialog::sortView(int column, Qt::SortOrder order)
 {
     sortColumn = column;
     sortOrder = order;
-    ui->treeWidget->sortItems(column, order);
-    ui->treeWidget->header()->setSortIndicator((sortColumn == COLUMN_AMOUNT_INT64 ? COLUMN_AMOUNT : (sortColumn == COLUMN_PRIORITY_INT64 ? COLUMN_PRIORITY : (sortColumn == COLUMN_AGE_INT64 ? COLUMN_AGE : sortColumn))), sortOrder); 
+    coinModel->sort(column, order);
+    ui->treeWidget->header()->setSortIndicator(sortColumn, sortOrder);
 }
 
 // treeview: clicked on header
@@ -442,25 +364,16 @@ void CoinControlDialog::headerSectionClicked(int logicalIndex)
 {
     if (logicalIndex == COLUMN_CHECKBOX) // click on most left column -> do nothing
     {
-        ui->treeWidget->header()->setSortIndicator((sortColumn == COLUMN_AMOUNT_INT64 ? COLUMN_AMOUNT : (sortColumn == COLUMN_PRIORITY_INT64 ? COLUMN_PRIORITY : sortColumn)), sortOrder);
+        ui->treeWidget->header()->setSortIndicator(sortColumn, sortOrder);
     }
     else
     {
-        if (logicalIndex == COLUMN_AMOUNT) // sort by amount
-            logicalIndex = COLUMN_AMOUNT_INT64;
-			
-		if (logicalIndex == COLUMN_AGE) // sort by age 
-            logicalIndex = COLUMN_AGE_INT64;	 
- 
-        if (logicalIndex == COLUMN_PRIORITY) // sort by priority
-            logicalIndex = COLUMN_PRIORITY_INT64;
-
         if (sortColumn == logicalIndex)
             sortOrder = ((sortOrder == Qt::AscendingOrder) ? Qt::DescendingOrder : Qt::AscendingOrder);
         else
         {
             sortColumn = logicalIndex;
-            sortOrder = ((sortColumn == COLUMN_AMOUNT_INT64 || sortColumn == COLUMN_PRIORITY_INT64 || sortColumn == COLUMN_DATE || sortColumn == COLUMN_CONFIRMATIONS || sortColumn == COLUMN_AGE_INT64) ? Qt::DescendingOrder : Qt::AscendingOrder); // if amount,date,conf,priority then default => desc, else default => asc  
+            sortOrder = ((sortColumn == COLUMN_AMOUNT || sortColumn == COLUMN_PRIORITY || sortColumn == COLUMN_DATE || sortColumn == COLUMN_CONFIRMATIONS || sortColumn == COLUMN_AGE) ? Qt::DescendingOrder : Qt::AscendingOrder); // if amount,date,conf,priority,age then default => desc, else default => asc  
         }
 
         sortView(sortColumn, sortOrder);
@@ -470,35 +383,28 @@ void CoinControlDialog::headerSectionClicked(int logicalIndex)
 // toggle tree mode
 void CoinControlDialog::radioTreeMode(bool checked)
 {
-    if (checked && model)
-        updateView();
+    if (checked)
+    {
+        ui->treeWidget->setAlternatingRowColors(false);
+        coinModel->setTreeMode(true);
+        expandPartiallyChecked();
+    }
 }
 
 // toggle list mode
 void CoinControlDialog::radioListMode(bool checked)
 {
-    if (checked && model)
-        updateView();
+    if (checked)
+    {
+        ui->treeWidget->setAlternatingRowColors(true);
+        coinModel->setTreeMode(false);
+    }
 }
 
-// checkbox clicked by user
-void CoinControlDialog::viewItemChanged(QTreeWidgetItem* item, int column)
+// checkbox clicked by user, or selection changed otherwise
+void CoinControlDialog::checkedChanged()
 {
-    if (column == COLUMN_CHECKBOX && item->text(COLUMN_TXHASH).length() == 64) // transaction hash is 64 characters (this means its a child node, so its not a parent node in tree mode)
-    {
-        COutPoint outpt(uint256(item->text(COLUMN_TXHASH).toStdString()), item->text(COLUMN_VOUT_INDEX).toUInt());
-
-        if (item->checkState(COLUMN_CHECKBOX) == Qt::Unchecked)
-            coinControl->UnSelect(outpt);
-        else if (item->isDisabled()) // locked (this happens if "check all" through parent node)
-            item->setCheckState(COLUMN_CHECKBOX, Qt::Unchecked);
-        else
-            coinControl->Select(outpt);
-
-        // selection changed -> update labels
-        if (ui->treeWidget->isEnabled()) // do not update on every click for (un)select all
-            CoinControlDialog::updateLabels(model, this);
-    }
+    CoinControlDialog::updateLabels(model, this);
 }
 
 // helper function, return human readable label for priority number
@@ -556,45 +462,54 @@ void CoinControlDialog::updateLabels(WalletModel *model, QDialog* dialog)
     }
 
     QString sPriorityLabel      = "";
-    int64_t nAmount               = 0;
     int64_t nPayFee               = 0;
     int64_t nAfterFee             = 0;
     int64_t nChange               = 0;
     unsigned int nBytes         = 0;
-    unsigned int nBytesInputs   = 0;
     double dPriority            = 0;
-    double dPriorityInputs      = 0;
-    unsigned int nQuantity      = 0;
-    
-    vector<COutPoint> vCoinControl;
-    vector<COutput>   vOutputs;
-    coinControl->ListSelected(vCoinControl);
-    model->getOutputs(vCoinControl, vOutputs);
 
-    BOOST_FOREACH(const COutput& out, vOutputs)
+    // The coin control model keeps the totals up to date as coins are (un)checked.
+    // Only if the selection was changed behind its back, add up the selected outputs again.
+    if (selectedInputs.nGeneration != coinControl->GetGeneration())
     {
-        // Quantity
-        nQuantity++;
-            
-        // Amount
-        nAmount += out.tx->vout[out.i].nValue;
-        
-        // Priority
-        dPriorityInputs += (double)out.tx->vout[out.i].nValue * (out.nDepth+1);
-        
-        // Bytes
-        CTxDestination address;
-        if(ExtractDestination(out.tx->vout[out.i].scriptPubKey, address))
+        selectedInputs.SetNull();
+
+        vector<COutPoint> vCoinControl;
+        vector<COutput>   vOutputs;
+        coinControl->ListSelected(vCoinControl);
+        model->getOutputs(vCoinControl, vOutputs);
+        selectedInputs.nGeneration = coinControl->GetGeneration();
+
+        BOOST_FOREACH(const COutput& out, vOutputs)
         {
-            CPubKey pubkey;
-            CKeyID *keyid = boost::get< CKeyID >(&address);
-            if (keyid && model->getPubKey(*keyid, pubkey))
-                nBytesInputs += (pubkey.IsCompressed() ? 148 : 180);
-            else
-                nBytesInputs += 148; // in all error cases, simply assume 148 here
+            // Quantity
+            selectedInputs.nQuantity++;
+
+            // Amount
+            selectedInputs.nAmount += out.tx->vout[out.i].nValue;
+
+            // Priority
+            selectedInputs.dPriorityInputs += (double)out.tx->vout[out.i].nValue * (out.nDepth+1);
+
+            // Bytes
+            CTxDestination address;
+            if(ExtractDestination(out.tx->vout[out.i].scriptPubKey, address))
+            {
+                CPubKey pubkey;
+                CKeyID *keyid = boost::get< CKeyID >(&address);
+                if (keyid && model->getPubKey(*keyid, pubkey))
+                    selectedInputs.nBytesInputs += (pubkey.IsCompressed() ? 148 : 180);
+                else
+                    selectedInputs.nBytesInputs += 148; // in all error cases, simply assume 148 here
+            }
+            else selectedInputs.nBytesInputs += 148;
         }
-        else nBytesInputs += 148;
     }
+
+    unsigned int nQuantity      = selectedInputs.nQuantity;
+    int64_t nAmount               = selectedInputs.nAmount;
+    unsigned int nBytesInputs   = selectedInputs.nBytesInputs;
+    double dPriorityInputs      = selectedInputs.dPriorityInputs;
     
     // calculation
     if (nQuantity > 0)
@@ -695,186 +610,23 @@ void CoinControlDialog::updateLabels(WalletModel *model, QDialog* dialog)
         label->setVisible(nChange < 0);
 }
 
-void CoinControlDialog::updateView()
+void CoinControlDialog::setCoins(const WalletCoins &coins)
 {
-    bool treeMode = ui->radioTreeMode->isChecked();
-
-    ui->treeWidget->clear();
-    ui->treeWidget->setEnabled(false); // performance, otherwise updateLabels would be called for every checked checkbox
-    ui->treeWidget->setAlternatingRowColors(!treeMode);
-    QFlags<Qt::ItemFlag> flgCheckbox=Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable;
-    QFlags<Qt::ItemFlag> flgTristate=Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable | Qt::ItemIsTristate;    
-    
-    int nDisplayUnit = BitcoinUnits::BTC;
-    if (model && model->getOptionsModel())
-        nDisplayUnit = model->getOptionsModel()->getDisplayUnit();
-        
-    map<QString, vector<COutput> > mapCoins;
-    model->listCoins(mapCoins);
-
-    BOOST_FOREACH(PAIRTYPE(QString, vector<COutput>) coins, mapCoins)
-    {
-        QTreeWidgetItem *itemWalletAddress = new QTreeWidgetItem();
-        QString sWalletAddress = coins.first;
-        QString sWalletLabel = "";
-        if (model->getAddressTableModel())
-            sWalletLabel = model->getAddressTableModel()->labelForAddress(sWalletAddress);
-        if (sWalletLabel.length() == 0)
-            sWalletLabel = tr("(no label)");
-        
-        if (treeMode)
-        {
-            // wallet address
-            ui->treeWidget->addTopLevelItem(itemWalletAddress);
-
-            itemWalletAddress->setFlags(flgTristate);
-            itemWalletAddress->setCheckState(COLUMN_CHECKBOX,Qt::Unchecked);
-            
-            for (int i = 0; i < ui->treeWidget->columnCount(); i++)
-                itemWalletAddress->setBackground(i, QColor(248, 247, 246));
-            
-            // label
-            itemWalletAddress->setText(COLUMN_LABEL, sWalletLabel);
-
-            // address
-            itemWalletAddress->setText(COLUMN_ADDRESS, sWalletAddress);
-        }
-
-        int64_t nSum = 0;
-        double dPrioritySum = 0;
-        int nChildren = 0;
-        int nInputSum = 0;
-		uint64_t nTxWeight = 0, nTxWeightSum = 0;
-		GetLastBlockIndex(pindexBest, false);
-        int64_t nBestHeight = pindexBest->nHeight;
-		
-        BOOST_FOREACH(const COutput& out, coins.second)
-        {
-            int nInputSize = 148; // 180 if uncompressed public key
-            nSum += out.tx->vout[out.i].nValue;
-            nChildren++;
-			
-			model->getStakeWeightFromValue(out.tx->GetTxTime(), out.tx->vout[out.i].nValue, nTxWeight); 
-			nTxWeightSum += nTxWeight; 
-            
-            QTreeWidgetItem *itemOutput;
-            if (treeMode)    itemOutput = new QTreeWidgetItem(itemWalletAddress);
-            else             itemOutput = new QTreeWidgetItem(ui->treeWidget);
-            itemOutput->setFlags(flgCheckbox);
-            itemOutput->setCheckState(COLUMN_CHECKBOX,Qt::Unchecked);
-                
-            // address
-            CTxDestination outputAddress;
-            QString sAddress = "";
-            if(ExtractDestination(out.tx->vout[out.i].scriptPubKey, outputAddress))
-            {
-                sAddress = CBitcoinAddress(outputAddress).ToString().c_str();
-                
-                // if listMode or change => show bitcoin address. In tree mode, address is not shown again for direct wallet address outputs
-                if (!treeMode || (!(sAddress == sWalletAddress)))
-                    itemOutput->setText(COLUMN_ADDRESS, sAddress);
-                    
-                CPubKey pubkey;
-                CKeyID *keyid = boost::get< CKeyID >(&outputAddress);
-                if (keyid && model->getPubKey(*keyid, pubkey) && !pubkey.IsCompressed())
-                    nInputSize = 180;
-            }
-
-            // label
-            if (!(sAddress == sWalletAddress)) // change
-            {
-                // tooltip from where the change comes from
-                itemOutput->setToolTip(COLUMN_LABEL, tr("change from %1 (%2)").arg(sWalletLabel).arg(sWalletAddress));
-                itemOutput->setText(COLUMN_LABEL, tr("(change)"));
-            }
-            else if (!treeMode)
-            {
-                QString sLabel = "";
-                if (model->getAddressTableModel())
-                    sLabel = model->getAddressTableModel()->labelForAddress(sAddress);
-                if (sLabel.length() == 0)
-                    sLabel = tr("(no label)");
-                itemOutput->setText(COLUMN_LABEL, sLabel); 
-            }
-
-            // amount
-            itemOutput->setText(COLUMN_AMOUNT, BitcoinUnits::format(nDisplayUnit, out.tx->vout[out.i].nValue));
-            itemOutput->setText(COLUMN_AMOUNT_INT64, strPad(QString::number(out.tx->vout[out.i].nValue), 15, " ")); // padding so that sorting works correctly
-
-            // date
-            int64_t nHeight = nBestHeight - out.nDepth;
-			CBlockIndex* pindex = FindBlockByHeight(nHeight);
-			int64_t nTime = pindex->nTime;
-            itemOutput->setText(COLUMN_DATE, QDateTime::fromTime_t(nTime).toString("yy-MM-dd hh:mm"));;
-            
-            // immature PoS reward
-            if (out.tx->IsCoinStake() && out.tx->GetBlocksToMaturity() > 0 && out.tx->GetDepthInMainChain() > 0) {
-              itemOutput->setBackground(COLUMN_CONFIRMATIONS, Qt::red);
-              itemOutput->setDisabled(true);
-            }
+    coinModel->setCoins(coins);
+    expandPartiallyChecked();
+    CoinControlDialog::updateLabels(model, this);
+}
 
-            // confirmations
-            itemOutput->setText(COLUMN_CONFIRMATIONS, strPad(QString::number(out.nDepth), 8, " "));
-            
-            // priority
-            double dPriority = ((double)out.tx->vout[out.i].nValue  / (nInputSize + 78)) * (out.nDepth+1); // 78 = 2 * 34 + 10
-            itemOutput->setText(COLUMN_PRIORITY, CoinControlDialog::getPriorityLabel(dPriority));
-            itemOutput->setText(COLUMN_PRIORITY_INT64, strPad(QString::number((int64_t)dPriority), 20, " "));
-            dPrioritySum += (double)out.tx->vout[out.i].nValue  * (out.nDepth+1);
-            nInputSum    += nInputSize;
-			
-			// List Mode Weight 
-			itemOutput->setText(COLUMN_WEIGHT, strPad(QString::number(nTxWeight), 8, " ")); 
-			
-			// Age 
-			int64_t age = COIN * (GetTime() - nTime) / (1440 * 60); 
-			itemOutput->setText(COLUMN_AGE, strPad(BitcoinUnits::formatAge(nDisplayUnit, age), 2, " ")); 
-			itemOutput->setText(COLUMN_AGE_INT64, strPad(QString::number(age), 15, " ")); 
-           
-            // transaction hash
-            uint256 txhash = out.tx->GetHash();
-            itemOutput->setText(COLUMN_TXHASH, txhash.GetHex().c_str());
-    
-            // vout index
-            itemOutput->setText(COLUMN_VOUT_INDEX, QString::number(out.i));
-            
-            // disable locked coins     
-            /*if (model->isLockedCoin(txhash, out.i))
-            {
-                COutPoint outpt(txhash, out.i);
-                coinControl->UnSelect(outpt); // just to be sure
-                itemOutput->setDisabled(true);
-                itemOutput->setIcon(COLUMN_CHECKBOX, QIcon(":/icons/lock_closed"));
-            }*/
-              
-            // set checkbox
-            if (coinControl->IsSelected(txhash, out.i))
-                itemOutput->setCheckState(COLUMN_CHECKBOX,Qt::Checked);
-        }
+// expand all partially selected
+void CoinControlDialog::expandPartiallyChecked()
+{
+    if (!coinModel->isTreeMode())
+        return;
 
-        // amount
-        if (treeMode)
-        {
-            dPrioritySum = dPrioritySum / (nInputSum + 78);
-            itemWalletAddress->setText(COLUMN_CHECKBOX, "(" + QString::number(nChildren) + ")");
-            itemWalletAddress->setText(COLUMN_AMOUNT, BitcoinUnits::format(nDisplayUnit, nSum));
-            itemWalletAddress->setText(COLUMN_AMOUNT_INT64, strPad(QString::number(nSum), 15, " "));
-            itemWalletAddress->setText(COLUMN_PRIORITY, CoinControlDialog::getPriorityLabel(dPrioritySum));
-            itemWalletAddress->setText(COLUMN_PRIORITY_INT64, strPad(QString::number((int64_t)dPrioritySum), 20, " "));
-			//Tree Mode Weight 
-			itemWalletAddress->setText(COLUMN_WEIGHT, strPad(QString::number((uint64_t)nTxWeightSum),8," ")); 
-        }
-    }
-    
-    // expand all partially selected
-    if (treeMode)
+    for (int i = 0; i < coinModel->rowCount(); i++)
     {
-        for (int i = 0; i < ui->treeWidget->topLevelItemCount(); i++)
-            if (ui->treeWidget->topLevelItem(i)->checkState(COLUMN_CHECKBOX) == Qt::PartiallyChecked)
-                ui->treeWidget->topLevelItem(i)->setExpanded(true);
+        QModelIndex index = coinModel->index(i, COLUMN_CHECKBOX);
+        if (index.data(Qt::CheckStateRole).toInt() == Qt::PartiallyChecked)
+            ui->treeWidget->setExpanded(index, true);
     }
-    
-    // sort view
-    sortView(sortColumn, sortOrder);
-    ui->treeWidget->setEnabled(true);
 }
@@ -6,9 +6,11 @@
 #include <QDialog>
 #include <QList>
 #include <QMenu>
+#include <QPersistentModelIndex>
 #include <QPoint>
 #include <QString>
-#include <QTreeWidgetItem>
+
+#include "coincontrolmodel.h"
 
 namespace Ui {
     class CoinControlDialog;
@@ -32,42 +34,40 @@ public:
 
     static QList<int64_t> payAmounts;
     static CCoinControl *coinControl;
+    static CoinControlInputs selectedInputs;
 
 private:
     Ui::CoinControlDialog *ui;
     WalletModel *model;
+    CoinControlModel *coinModel;
     int sortColumn;
     Qt::SortOrder sortOrder;
 
     QMenu *contextMenu;
-    QTreeWidgetItem *contextMenuItem;
+    QPersistentModelIndex contextMenuItem;
     QAction *copyTransactionHashAction;
     //QAction *lockAction;
     //QAction *unlockAction;
 
-    QString strPad(QString, int, QString);
     void sortView(int, Qt::SortOrder);
-    void updateView();
+    void expandPartiallyChecked();
+    QString contextMenuText(int column, bool fFromParent);
 
     enum
     {
-        COLUMN_CHECKBOX,
-        COLUMN_AMOUNT,
-        COLUMN_CONFIRMATIONS,
-		COLUMN_WEIGHT,
-		COLUMN_AGE,
-		COLUMN_DATE,
-		COLUMN_PRIORITY,
-        COLUMN_LABEL,
-		COLUMN_ADDRESS,
-		COLUMN_AGE_INT64, 
-        COLUMN_TXHASH,
-        COLUMN_VOUT_INDEX,
-        COLUMN_AMOUNT_INT64,
-        COLUMN_PRIORITY_INT64
+        COLUMN_CHECKBOX = CoinControlModel::Checkbox,
+        COLUMN_AMOUNT = CoinControlModel::Amount,
+        COLUMN_CONFIRMATIONS = CoinControlModel::Confirmations,
+        COLUMN_WEIGHT = CoinControlModel::Weight,
+        COLUMN_AGE = CoinControlModel::Age,
+        COLUMN_DATE = CoinControlModel::Date,
+        COLUMN_PRIORITY = CoinControlModel::Priority,
+        COLUMN_LABEL = CoinControlModel::Label,
+        COLUMN_ADDRESS = CoinControlModel::Address
     };
 
 private slots:
+    void setCoins(const WalletCoins &);
     void showMenu(const QPoint &);
     void copyAmount();
     void copyLabel();
@@ -85,7 +85,7 @@ private slots:
     void clipboardChange();
     void radioTreeMode(bool);
     void radioListMode(bool);
-    void viewItemChanged(QTreeWidgetItem*, int);
+    void checkedChanged();
     void headerSectionClicked(int);
     void buttonBoxClicked(QAbstractButton*);
     void buttonSelectAllClicked();
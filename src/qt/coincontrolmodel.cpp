@@ -0,0 +1,581 @@
+#include "coincontrolmodel.h"
+#include "coincontroldialog.h"
+#include "bitcoinunits.h"
+
+#include "wallet.h"
+#include "coincontrol.h"
+
+#include <QColor>
+#include <QDateTime>
+
+#include <algorithm>
+
+/* Rows handed to the view at a time when it scrolls or expands an address */
+static const int COIN_CONTROL_FETCH_BATCH = 500;
+
+static double CoinPriority(const WalletCoin &coin)
+{
+    return ((double)coin.nValue / ((coin.fCompressed ? 148 : 180) + 78)) * (coin.nDepth + 1); // 78 = 2 * 34 + 10
+}
+
+/* Orders coins by a column, ascending */
+struct CoinLessThan
+{
+    const WalletCoins *coins;
+    int column;
+
+    CoinLessThan(const WalletCoins *coins, int column) : coins(coins), column(column) {}
+
+    bool operator()(const std::pair<int, int> &a, const std::pair<int, int> &b) const
+    {
+        const WalletCoin &x = (*coins)[a.first].coins[a.second];
+        const WalletCoin &y = (*coins)[b.first].coins[b.second];
+        switch (column)
+        {
+        case CoinControlModel::Amount: return x.nValue < y.nValue;
+        case CoinControlModel::Confirmations: return x.nDepth < y.nDepth;
+        case CoinControlModel::Weight: return x.nWeight < y.nWeight;
+        case CoinControlModel::Age: return x.nTime > y.nTime;
+        case CoinControlModel::Date: return x.nTime < y.nTime;
+        case CoinControlModel::Priority: return CoinPriority(x) < CoinPriority(y);
+        case CoinControlModel::Label: return x.label < y.label;
+        case CoinControlModel::Address: return x.address < y.address;
+        }
+        return false;
+    }
+};
+
+/* Orders the coins of one group */
+struct GroupCoinLessThan
+{
+    CoinLessThan lessThan;
+    int nGroup;
+    bool fDescending;
+
+    GroupCoinLessThan(const CoinLessThan &lessThan, int nGroup, bool fDescending) : lessThan(lessThan), nGroup(nGroup), fDescending(fDescending) {}
+
+    bool operator()(int a, int b) const
+    {
+        if (fDescending)
+            std::swap(a, b);
+        return lessThan(std::make_pair(nGroup, a), std::make_pair(nGroup, b));
+    }
+};
+
+/* Orders list mode rows */
+struct ListLessThan
+{
+    CoinLessThan lessThan;
+    bool fDescending;
+
+    ListLessThan(const CoinLessThan &lessThan, bool fDescending) : lessThan(lessThan), fDescending(fDescending) {}
+
+    bool operator()(const std::pair<int, int> &a, const std::pair<int, int> &b) const
+    {
+        return fDescending ? lessThan(b, a) : lessThan(a, b);
+    }
+};
+
+CoinControlModel::CoinControlModel(CCoinControl *coinControl, CoinControlInputs *inputs, QObject *parent) :
+    QAbstractItemModel(parent), coinControl(coinControl), inputs(inputs), nListFetched(0), nChecked(0),
+    fTreeMode(true), nDisplayUnit(BitcoinUnits::BTC), sortColumn(Amount), sortOrder(Qt::DescendingOrder)
+{
+    columns << tr("Select") << tr("Amount") << tr("Confirmations") << tr("Weight") << tr("Age")
+            << tr("Date") << tr("Priority") << tr("Label") << tr("Address");
+}
+
+QModelIndex CoinControlModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (!hasIndex(row, column, parent))
+        return QModelIndex();
+
+    // Coins in tree mode carry the row of their address, plus one
+    quint32 id = 0;
+    if (parent.isValid())
+        id = parent.row() + 1;
+    return createIndex(row, column, id);
+}
+
+QModelIndex CoinControlModel::parent(const QModelIndex &index) const
+{
+    if (!index.isValid() || index.internalId() == 0)
+        return QModelIndex();
+    return createIndex(index.internalId() - 1, 0, (quint32)0);
+}
+
+int CoinControlModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+        return 0;
+    if (!parent.isValid())
+        return fTreeMode ? groupOrder.size() : nListFetched;
+    if (fTreeMode && parent.internalId() == 0)
+        return groups[groupOrder[parent.row()]].nFetched;
+    return 0;
+}
+
+int CoinControlModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+    return columns.length();
+}
+
+bool CoinControlModel::hasChildren(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+        return false;
+    if (!parent.isValid())
+        return !coins.empty();
+    return fTreeMode && parent.internalId() == 0 && !coins[groupOrder[parent.row()]].coins.empty();
+}
+
+bool CoinControlModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (!parent.isValid())
+        return !fTreeMode && nListFetched < (int)listOrder.size();
+    if (fTreeMode && parent.internalId() == 0 && parent.column() == 0)
+    {
+        int nGroup = groupOrder[parent.row()];
+        return groups[nGroup].nFetched < (int)coins[nGroup].coins.size();
+    }
+    return false;
+}
+
+void CoinControlModel::fetchMore(const QModelIndex &parent)
+{
+    if (!canFetchMore(parent))
+        return;
+
+    int &nFetched = parent.isValid() ? groups[groupOrder[parent.row()]].nFetched : nListFetched;
+    int nTotal = parent.isValid() ? coins[groupOrder[parent.row()]].coins.size() : listOrder.size();
+    int nCount = std::min(COIN_CONTROL_FETCH_BATCH, nTotal - nFetched);
+
+    beginInsertRows(parent, nFetched, nFetched + nCount - 1);
+    nFetched += nCount;
+    endInsertRows();
+}
+
+bool CoinControlModel::lookup(const QModelIndex &index, int &nGroup, int &nCoin) const
+{
+    if (!index.isValid())
+        return false;
+
+    if (!fTreeMode)
+    {
+        if (index.row() >= (int)listOrder.size())
+            return false;
+        nGroup = listOrder[index.row()].first;
+        nCoin = listOrder[index.row()].second;
+        return true;
+    }
+
+    if (index.internalId() == 0)
+    {
+        if (index.row() >= (int)groupOrder.size())
+            return false;
+        nGroup = groupOrder[index.row()];
+        nCoin = -1;
+        return true;
+    }
+
+    int nParentRow = index.internalId() - 1;
+    if (nParentRow >= (int)groupOrder.size())
+        return false;
+    nGroup = groupOrder[nParentRow];
+    if (index.row() >= (int)groups[nGroup].order.size())
+        return false;
+    nCoin = groups[nGroup].order[index.row()];
+    return true;
+}
+
+QVariant CoinControlModel::data(const QModelIndex &index, int role) const
+{
+    int nGroup, nCoin;
+    if (!lookup(index, nGroup, nCoin))
+        return QVariant();
+
+    if (nCoin < 0)
+        return groupData(nGroup, index.column(), role);
+    return coinData(nGroup, nCoin, index.column(), role);
+}
+
+QVariant CoinControlModel::groupData(int nGroup, int column, int role) const
+{
+    const WalletCoinGroup &group = coins[nGroup];
+    const GroupState &state = groups[nGroup];
+
+    if (role == Qt::DisplayRole)
+    {
+        switch (column)
+        {
+        case Checkbox:
+            return "(" + QString::number(group.coins.size()) + ")";
+        case Amount:
+            return BitcoinUnits::format(nDisplayUnit, state.nSum);
+        case Weight:
+            return QString::number(state.nWeightSum);
+        case Priority:
+            return CoinControlDialog::getPriorityLabel(state.dPriorityInputs / (state.nInputSum + 78));
+        case Label:
+            return group.label.isEmpty() ? tr("(no label)") : group.label;
+        case Address:
+            return group.address;
+        }
+    }
+    else if (role == Qt::CheckStateRole && column == Checkbox)
+    {
+        if (state.nChecked == 0)
+            return Qt::Unchecked;
+        return state.nChecked == state.nMature ? Qt::Checked : Qt::PartiallyChecked;
+    }
+    else if (role == Qt::BackgroundRole)
+    {
+        return QColor(248, 247, 246);
+    }
+    return QVariant();
+}
+
+QVariant CoinControlModel::coinData(int nGroup, int nCoin, int column, int role) const
+{
+    const WalletCoinGroup &group = coins[nGroup];
+    const WalletCoin &coin = group.coins[nCoin];
+    bool fChange = coin.address != group.address;
+
+    switch (role)
+    {
+    case Qt::DisplayRole:
+        switch (column)
+        {
+        case Amount:
+            return BitcoinUnits::format(nDisplayUnit, coin.nValue);
+        case Confirmations:
+            return QString::number(coin.nDepth);
+        case Weight:
+            return QString::number(coin.nWeight);
+        case Age:
+            return BitcoinUnits::formatAge(nDisplayUnit, COIN * (GetTime() - coin.nTime) / (1440 * 60));
+        case Date:
+            return QDateTime::fromTime_t(coin.nTime).toString("yy-MM-dd hh:mm");
+        case Priority:
+            return CoinControlDialog::getPriorityLabel(CoinPriority(coin));
+        case Label:
+            if (fChange)
+                return tr("(change)");
+            if (!fTreeMode)
+                return coin.label.isEmpty() ? tr("(no label)") : coin.label;
+            break;
+        case Address:
+            // In tree mode, the address is not shown again for direct wallet address outputs
+            if (!fTreeMode || fChange)
+                return coin.address;
+            break;
+        }
+        break;
+    case Qt::ToolTipRole:
+        if (column == Label && fChange)
+            return tr("change from %1 (%2)").arg(group.label.isEmpty() ? tr("(no label)") : group.label).arg(group.address);
+        break;
+    case Qt::CheckStateRole:
+        if (column == Checkbox)
+            return coinControl->IsSelected(coin.hash, coin.n) ? Qt::Checked : Qt::Unchecked;
+        break;
+    case Qt::BackgroundRole:
+        // immature PoS reward
+        if (column == Confirmations && coin.fImmature)
+            return QColor(Qt::red);
+        break;
+    case TxHashRole:
+        return QString::fromStdString(coin.hash.GetHex());
+    case VoutRole:
+        return coin.n;
+    }
+    return QVariant();
+}
+
+bool CoinControlModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    int nGroup, nCoin;
+    if (role != Qt::CheckStateRole || index.column() != Checkbox || !lookup(index, nGroup, nCoin))
+        return false;
+
+    bool fChecked = (Qt::CheckState)value.toInt() != Qt::Unchecked;
+    if (nCoin >= 0)
+    {
+        setChecked(nGroup, nCoin, fChecked);
+        emit dataChanged(index, index);
+        if (fTreeMode)
+            emit dataChanged(index.parent(), index.parent());
+    }
+    else
+    {
+        for (unsigned int i = 0; i < coins[nGroup].coins.size(); i++)
+            setChecked(nGroup, i, fChecked);
+        emit dataChanged(index, index);
+        if (groups[nGroup].nFetched > 0)
+            emit dataChanged(this->index(0, Checkbox, index), this->index(groups[nGroup].nFetched - 1, Checkbox, index));
+    }
+    emit checkedChanged();
+    return true;
+}
+
+QVariant CoinControlModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal)
+    {
+        if (role == Qt::DisplayRole)
+            return columns[section];
+        if (role == Qt::ToolTipRole && section == Confirmations)
+            return tr("Confirmed");
+    }
+    return QVariant();
+}
+
+Qt::ItemFlags CoinControlModel::flags(const QModelIndex &index) const
+{
+    int nGroup, nCoin;
+    if (!lookup(index, nGroup, nCoin))
+        return 0;
+
+    // Immature coins can't be spent, so they can't be checked either
+    if (nCoin >= 0 && coins[nGroup].coins[nCoin].fImmature)
+        return Qt::ItemIsSelectable;
+    return Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable;
+}
+
+QModelIndex CoinControlModel::indexFor(int nGroup, int nCoin, int column) const
+{
+    if (!fTreeMode)
+    {
+        for (int row = 0; row < nListFetched; row++)
+            if (listOrder[row].first == nGroup && listOrder[row].second == nCoin)
+                return createIndex(row, column, (quint32)0);
+        return QModelIndex();
+    }
+
+    int nGroupRow = std::find(groupOrder.begin(), groupOrder.end(), nGroup) - groupOrder.begin();
+    if (nCoin < 0)
+        return createIndex(nGroupRow, column, (quint32)0);
+
+    const GroupState &state = groups[nGroup];
+    int row = std::find(state.order.begin(), state.order.begin() + state.nFetched, nCoin) - state.order.begin();
+    if (row >= state.nFetched)
+        return QModelIndex();
+    return createIndex(row, column, (quint32)(nGroupRow + 1));
+}
+
+void CoinControlModel::sortRows()
+{
+    bool fDescending = sortOrder == Qt::DescendingOrder;
+    CoinLessThan lessThan(&coins, sortColumn);
+
+    std::stable_sort(listOrder.begin(), listOrder.end(), ListLessThan(lessThan, fDescending));
+    for (unsigned int i = 0; i < groups.size(); i++)
+        std::stable_sort(groups[i].order.begin(), groups[i].order.end(), GroupCoinLessThan(lessThan, i, fDescending));
+
+    // Addresses only have an amount, weight, priority, label and address to sort by
+    std::vector<std::pair<double, int> > vKeys;
+    std::vector<std::pair<QString, int> > vTextKeys;
+    for (unsigned int i = 0; i < groupOrder.size(); i++)
+    {
+        int nGroup = groupOrder[i];
+        const GroupState &state = groups[nGroup];
+        switch (sortColumn)
+        {
+        case Amount: vKeys.push_back(std::make_pair((double)state.nSum, nGroup)); break;
+        case Weight: vKeys.push_back(std::make_pair((double)state.nWeightSum, nGroup)); break;
+        case Priority: vKeys.push_back(std::make_pair(state.dPriorityInputs / (state.nInputSum + 78), nGroup)); break;
+        case Label: vTextKeys.push_back(std::make_pair(coins[nGroup].label, nGroup)); break;
+        case Address: vTextKeys.push_back(std::make_pair(coins[nGroup].address, nGroup)); break;
+        default: return;
+        }
+    }
+    std::stable_sort(vKeys.begin(), vKeys.end());
+    std::stable_sort(vTextKeys.begin(), vTextKeys.end());
+    for (unsigned int i = 0; i < groupOrder.size(); i++)
+    {
+        unsigned int j = fDescending ? groupOrder.size() - 1 - i : i;
+        groupOrder[i] = vKeys.empty() ? vTextKeys[j].second : vKeys[j].second;
+    }
+}
+
+void CoinControlModel::sort(int column, Qt::SortOrder order)
+{
+    if (column == Checkbox)
+        return;
+
+    emit layoutAboutToBeChanged();
+
+    // Remember what the persistent indexes (expanded addresses, current row) point at
+    QModelIndexList oldIndexes = persistentIndexList();
+    std::vector<std::pair<int, int> > vPointsAt;
+    foreach(const QModelIndex &index, oldIndexes)
+    {
+        int nGroup = -1, nCoin = -1;
+        lookup(index, nGroup, nCoin);
+        vPointsAt.push_back(std::make_pair(nGroup, nCoin));
+    }
+
+    sortColumn = column;
+    sortOrder = order;
+    sortRows();
+
+    QModelIndexList newIndexes;
+    for (int i = 0; i < oldIndexes.size(); i++)
+    {
+        if (vPointsAt[i].first < 0)
+            newIndexes.append(QModelIndex());
+        else
+            newIndexes.append(indexFor(vPointsAt[i].first, vPointsAt[i].second, oldIndexes[i].column()));
+    }
+    changePersistentIndexList(oldIndexes, newIndexes);
+
+    emit layoutChanged();
+}
+
+void CoinControlModel::setCoins(const WalletCoins &coins)
+{
+    beginResetModel();
+
+    this->coins = coins;
+    groups.assign(coins.size(), GroupState());
+    groupOrder.clear();
+    listOrder.clear();
+    nListFetched = 0;
+    for (unsigned int i = 0; i < coins.size(); i++)
+    {
+        GroupState &state = groups[i];
+        state.nSum = 0;
+        state.nWeightSum = 0;
+        state.dPriorityInputs = 0;
+        state.nInputSum = 0;
+        state.nChecked = 0;
+        state.nMature = 0;
+        state.nFetched = 0;
+        for (unsigned int j = 0; j < coins[i].coins.size(); j++)
+        {
+            const WalletCoin &coin = coins[i].coins[j];
+            state.nSum += coin.nValue;
+            state.nWeightSum += coin.nWeight;
+            state.dPriorityInputs += (double)coin.nValue * (coin.nDepth + 1);
+            state.nInputSum += coin.fCompressed ? 148 : 180;
+            if (!coin.fImmature)
+                state.nMature++;
+            state.order.push_back(j);
+            listOrder.push_back(std::make_pair((int)i, (int)j));
+        }
+        groupOrder.push_back(i);
+    }
+    recount();
+    sortRows();
+
+    endResetModel();
+}
+
+void CoinControlModel::setTreeMode(bool fTreeMode)
+{
+    if (this->fTreeMode == fTreeMode)
+        return;
+
+    beginResetModel();
+    this->fTreeMode = fTreeMode;
+    nListFetched = 0;
+    for (unsigned int i = 0; i < groups.size(); i++)
+        groups[i].nFetched = 0;
+    endResetModel();
+}
+
+void CoinControlModel::setDisplayUnit(int unit)
+{
+    nDisplayUnit = unit;
+}
+
+void CoinControlModel::setChecked(int nGroup, int nCoin, bool fChecked)
+{
+    const WalletCoin &coin = coins[nGroup].coins[nCoin];
+    if ((fChecked && coin.fImmature) || coinControl->IsSelected(coin.hash, coin.n) == fChecked)
+        return;
+
+    // The totals stay current only if they were before this change
+    bool fCurrent = (inputs->nGeneration == coinControl->GetGeneration());
+    COutPoint outpt(coin.hash, coin.n);
+    if (fChecked)
+    {
+        coinControl->Select(outpt);
+        inputs->Add(coin);
+        groups[nGroup].nChecked++;
+        nChecked++;
+    }
+    else
+    {
+        coinControl->UnSelect(outpt);
+        inputs->Remove(coin);
+        groups[nGroup].nChecked--;
+        nChecked--;
+    }
+    if (fCurrent)
+        inputs->nGeneration = coinControl->GetGeneration();
+}
+
+void CoinControlModel::setAllChecked(bool fChecked)
+{
+    for (unsigned int i = 0; i < coins.size(); i++)
+        for (unsigned int j = 0; j < coins[i].coins.size(); j++)
+            setChecked(i, j, fChecked);
+
+    emitCheckStatesChanged();
+    emit checkedChanged();
+}
+
+void CoinControlModel::updateCheckStates()
+{
+    recount();
+    emitCheckStatesChanged();
+    emit checkedChanged();
+}
+
+void CoinControlModel::recount()
+{
+    // Totals are only complete if every selected outpoint is one of our coins,
+    // otherwise CoinControlDialog::updateLabels adds them up itself
+    inputs->SetNull();
+    nChecked = 0;
+    for (unsigned int i = 0; i < coins.size(); i++)
+    {
+        groups[i].nChecked = 0;
+        for (unsigned int j = 0; j < coins[i].coins.size(); j++)
+        {
+            const WalletCoin &coin = coins[i].coins[j];
+            if (!coinControl->IsSelected(coin.hash, coin.n))
+                continue;
+            if (coin.fImmature)
+            {
+                COutPoint outpt(coin.hash, coin.n);
+                coinControl->UnSelect(outpt);
+                continue;
+            }
+            inputs->Add(coin);
+            groups[i].nChecked++;
+            nChecked++;
+        }
+    }
+    if ((unsigned int)nChecked == coinControl->CountSelected())
+        inputs->nGeneration = coinControl->GetGeneration();
+}
+
+void CoinControlModel::emitCheckStatesChanged()
+{
+    int nRows = rowCount();
+    if (nRows > 0)
+        emit dataChanged(index(0, Checkbox), index(nRows - 1, Checkbox));
+    if (!fTreeMode)
+        return;
+    for (int row = 0; row < nRows; row++)
+    {
+        int nFetched = groups[groupOrder[row]].nFetched;
+        if (nFetched > 0)
+        {
+            QModelIndex parent = index(row, 0);
+            emit dataChanged(index(0, Checkbox, parent), index(nFetched - 1, Checkbox, parent));
+        }
+    }
+}
@@ -0,0 +1,159 @@
+#ifndef COINCONTROLMODEL_H
+#define COINCONTROLMODEL_H
+
+#include <QAbstractItemModel>
+#include <QStringList>
+
+#include <utility>
+#include <vector>
+
+#include "modelworker.h" /* for WalletCoins */
+
+class CCoinControl;
+
+/** Running totals over the selected inputs, kept up to date as coins are
+   (un)checked so the coin control labels don't need a pass over the selection.
+ */
+class CoinControlInputs
+{
+public:
+    unsigned int nGeneration;   // CCoinControl::GetGeneration() of the selection these totals are for, 0 for none
+    unsigned int nQuantity;
+    int64_t nAmount;
+    double dPriorityInputs;
+    unsigned int nBytesInputs;
+
+    CoinControlInputs() { SetNull(); }
+
+    void SetNull()
+    {
+        nGeneration = 0;
+        nQuantity = 0;
+        nAmount = 0;
+        dPriorityInputs = 0;
+        nBytesInputs = 0;
+    }
+
+    void Add(const WalletCoin& coin)
+    {
+        nQuantity++;
+        nAmount += coin.nValue;
+        dPriorityInputs += (double)coin.nValue * (coin.nDepth + 1);
+        nBytesInputs += coin.fCompressed ? 148 : 180;
+    }
+
+    void Remove(const WalletCoin& coin)
+    {
+        nQuantity--;
+        nAmount -= coin.nValue;
+        dPriorityInputs -= (double)coin.nValue * (coin.nDepth + 1);
+        nBytesInputs -= coin.fCompressed ? 148 : 180;
+    }
+};
+
+/** Qt model of the coins coin control can choose from, over a snapshot
+   listed by the wallet model's worker.
+
+   In tree mode the coins are children of the address they were paid to,
+   otherwise they are listed flat. Rows are handed to the view in batches as
+   it scrolls or expands an address, so huge wallets don't create an item per
+   coin up front. Check states live in the CCoinControl selection.
+ */
+class CoinControlModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    explicit CoinControlModel(CCoinControl *coinControl, CoinControlInputs *inputs, QObject *parent = 0);
+
+    enum ColumnIndex {
+        Checkbox = 0,
+        Amount = 1,
+        Confirmations = 2,
+        Weight = 3,
+        Age = 4,
+        Date = 5,
+        Priority = 6,
+        Label = 7,
+        Address = 8
+    };
+
+    enum RoleIndex {
+        TxHashRole = Qt::UserRole,  /**< Transaction of a coin, empty for addresses */
+        VoutRole                    /**< Output index of a coin */
+    };
+
+    /** @name Methods overridden from QAbstractItemModel
+        @{*/
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+    QModelIndex parent(const QModelIndex &index) const;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const;
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+    QVariant data(const QModelIndex &index, int role) const;
+    bool setData(const QModelIndex &index, const QVariant &value, int role);
+    QVariant headerData(int section, Qt::Orientation orientation, int role) const;
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
+    /*@}*/
+
+    /** Show a new snapshot of the wallet's coins */
+    void setCoins(const WalletCoins &coins);
+    const WalletCoins &getCoins() const { return coins; }
+
+    void setTreeMode(bool fTreeMode);
+    bool isTreeMode() const { return fTreeMode; }
+    void setDisplayUnit(int unit);
+
+    /** Check every spendable coin, or uncheck all of them */
+    void setAllChecked(bool fChecked);
+    /** Whether any coin is checked */
+    bool hasChecked() const { return nChecked > 0; }
+    /** Take over selection changes made directly on the CCoinControl */
+    void updateCheckStates();
+
+private:
+    struct GroupState
+    {
+        int64_t nSum;
+        uint64_t nWeightSum;
+        double dPriorityInputs;
+        int nInputSum;
+        int nChecked;
+        int nMature;                // coins that can be checked
+        int nFetched;
+        std::vector<int> order;     // coins in view order
+    };
+
+    CCoinControl *coinControl;
+    CoinControlInputs *inputs;
+    WalletCoins coins;
+    std::vector<GroupState> groups;
+    std::vector<int> groupOrder;                    // groups in view order, tree mode
+    std::vector<std::pair<int, int> > listOrder;    // (group, coin) in view order, list mode
+    int nListFetched;
+    int nChecked;
+    bool fTreeMode;
+    int nDisplayUnit;
+    int sortColumn;
+    Qt::SortOrder sortOrder;
+    QStringList columns;
+
+    /** Resolve an index to its group, and coin or -1 for an address row */
+    bool lookup(const QModelIndex &index, int &nGroup, int &nCoin) const;
+    QVariant coinData(int nGroup, int nCoin, int column, int role) const;
+    QVariant groupData(int nGroup, int column, int role) const;
+    QModelIndex indexFor(int nGroup, int nCoin, int column) const;
+    void sortRows();
+    void setChecked(int nGroup, int nCoin, bool fChecked);
+    void recount();
+    void emitCheckStatesChanged();
+
+signals:
+    /** The set of checked coins changed */
+    void checkedChanged();
+};
+
+#endif // COINCONTROLMODEL_H
@@ -2,7 +2,7 @@
 #include "coincontroldialog.h"
 
 CoinControlTreeWidget::CoinControlTreeWidget(QWidget *parent) :
-    QTreeWidget(parent)
+    QTreeView(parent)
 {
 
 }
@@ -13,7 +13,9 @@ void CoinControlTreeWidget::keyPressEvent(QKeyEvent *event)
     {
         event->ignore();
         int COLUMN_CHECKBOX = 0;
-        this->currentItem()->setCheckState(COLUMN_CHECKBOX, ((this->currentItem()->checkState(COLUMN_CHECKBOX) == Qt::Checked) ? Qt::Unchecked : Qt::Checked));
+        QModelIndex index = this->currentIndex().sibling(this->currentIndex().row(), COLUMN_CHECKBOX);
+        if (index.isValid() && (index.flags() & Qt::ItemIsUserCheckable))
+            this->model()->setData(index, ((index.data(Qt::CheckStateRole).toInt() == Qt::Checked) ? Qt::Unchecked : Qt::Checked), Qt::CheckStateRole);
     }
     else if (event->key() == Qt::Key_Escape) // press esc -> close dialog
     {
@@ -23,6 +25,6 @@ void CoinControlTreeWidget::keyPressEvent(QKeyEvent *event)
     }
     else
     {
-        this->QTreeWidget::keyPressEvent(event);
+        this->QTreeView::keyPressEvent(event);
     }
 }
@@ -2,9 +2,9 @@
 #define COINCONTROLTREEWIDGET_H
 
 #include <QKeyEvent>
-#include <QTreeWidget>
+#include <QTreeView>
 
-class CoinControlTreeWidget : public QTreeWidget {
+class CoinControlTreeWidget : public QTreeView {
 Q_OBJECT
 
 public:
@@ -14,4 +14,4 @@ protected:
   virtual void  keyPressEvent(QKeyEvent *event);
 };
 
-#endif // COINCONTROLTREEWIDGET_H
\ No newline at end of file
+#endif // COINCONTROLTREEWIDGET_H
@@ -3,6 +3,10 @@
 
 /* Milliseconds between model updates */
 static const int MODEL_UPDATE_DELAY = 500;
+/* Milliseconds before a model query that found the core busy is retried */
+static const int MODEL_RETRY_DELAY = 100;
+/* Milliseconds address book notifications are collected before the address table is updated */
+static const int ADDRESS_BATCH_DELAY = 100;
 
 /* AskPassphraseDialog -- Maximum passphrase length */
 static const int MAX_PASSPHRASE_SIZE = 1024;
@@ -0,0 +1,210 @@
+#include "modelworker.h"
+#include "guiconstants.h"
+
+#include "base58.h"
+#include "main.h"
+#include "wallet.h"
+
+#include <QMutexLocker>
+#include <QThread>
+#include <QTimer>
+
+#include <map>
+
+double GetPoSKernelPS(const CBlockIndex* blockindex = NULL);
+
+ModelWorker::ModelWorker() :
+    thread(0), nPending(0), fScheduled(false)
+{
+}
+
+ModelWorker::~ModelWorker()
+{
+    stop();
+}
+
+void ModelWorker::start()
+{
+    thread = new QThread;
+    moveToThread(thread);
+    thread->start();
+}
+
+void ModelWorker::stop()
+{
+    if (!thread)
+        return;
+    thread->quit();
+    thread->wait();
+    delete thread;
+    thread = 0;
+}
+
+void ModelWorker::post(int requests)
+{
+    schedule(requests, false);
+}
+
+void ModelWorker::schedule(int requests, bool fRetry)
+{
+    bool fWake;
+    {
+        QMutexLocker lock(&mutex);
+        nPending |= requests;
+        fWake = !fScheduled;
+        fScheduled = true;
+    }
+    if (!fWake)
+        return;
+
+    // Retries are only scheduled from the worker thread itself
+    if (fRetry)
+        QTimer::singleShot(MODEL_RETRY_DELAY, this, SLOT(process()));
+    else
+        QMetaObject::invokeMethod(this, "process", Qt::QueuedConnection);
+}
+
+void ModelWorker::process()
+{
+    int requests;
+    {
+        QMutexLocker lock(&mutex);
+        requests = nPending;
+        nPending = 0;
+        fScheduled = false;
+    }
+
+    int busy = 0;
+    for (int request = 1; request > 0 && request <= requests; request <<= 1)
+        if ((requests & request) && !run(request))
+            busy |= request;
+
+    if (busy)
+        schedule(busy, true);
+}
+
+bool ClientModelWorker::run(int request)
+{
+    TRY_LOCK(cs_main, lockMain);
+    if (!lockMain || !pindexBest)
+        return false;
+
+    switch (request)
+    {
+    case ChainStatus:
+        emit chainStatusReady(nBestHeight, GetNumBlocksOfPeers(), pindexBest->GetBlockTime(), IsInitialBlockDownload(), pindexBest->nBits);
+        break;
+    }
+    return true;
+}
+
+WalletModelWorker::WalletModelWorker(CWallet *wallet) :
+    wallet(wallet)
+{
+}
+
+bool WalletModelWorker::run(int request)
+{
+    TRY_LOCK(cs_main, lockMain);
+    if (!lockMain)
+        return false;
+    TRY_LOCK(wallet->cs_wallet, lockWallet);
+    if (!lockWallet)
+        return false;
+
+    switch (request)
+    {
+    case Balance:
+        emit balanceReady(wallet->GetBalance(), wallet->GetStake(), wallet->GetUnconfirmedBalance(), wallet->GetImmatureBalance(), wallet->mapWallet.size());
+        break;
+    case StakeWeight:
+    {
+        uint64 nMinMax = 0, nWeight = 0;
+        wallet->GetStakeWeight(*wallet, nMinMax, nMinMax, nWeight);
+        emit stakeWeightReady(nWeight, (quint64)GetPoSKernelPS());
+        break;
+    }
+    case Coins:
+    {
+        WalletCoins coins;
+        listCoins(coins);
+        emit coinsReady(coins);
+        break;
+    }
+    }
+    return true;
+}
+
+static QString AddressBookLabel(const CWallet *wallet, const CTxDestination& address)
+{
+    std::map<CTxDestination, std::string>::const_iterator mi = wallet->mapAddressBook.find(address);
+    if (mi == wallet->mapAddressBook.end())
+        return QString();
+    return QString::fromStdString((*mi).second);
+}
+
+void WalletModelWorker::listCoins(WalletCoins& coins)
+{
+    std::map<QString, WalletCoinGroup> mapCoins;
+    std::vector<COutput> vCoins;
+    wallet->AvailableCoins(vCoins);
+
+    BOOST_FOREACH(const COutput& out, vCoins)
+    {
+        // Change is listed under the address whose coins it came from
+        COutput cout = out;
+        while (wallet->IsChange(cout.tx->vout[cout.i]) && cout.tx->vin.size() > 0 && wallet->IsMine(cout.tx->vin[0]))
+        {
+            if (!wallet->mapWallet.count(cout.tx->vin[0].prevout.hash)) break;
+            cout = COutput(&wallet->mapWallet[cout.tx->vin[0].prevout.hash], cout.tx->vin[0].prevout.n, 0);
+        }
+
+        CTxDestination walletAddress;
+        if (!ExtractDestination(cout.tx->vout[cout.i].scriptPubKey, walletAddress))
+            continue;
+
+        const CTxOut& txout = out.tx->vout[out.i];
+        WalletCoin coin;
+        coin.hash = out.tx->GetHash();
+        coin.n = out.i;
+        coin.nValue = txout.nValue;
+        coin.nDepth = out.nDepth;
+        coin.nTxTime = out.tx->GetTxTime();
+        coin.nTime = coin.nTxTime;
+        std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(out.tx->hashBlock);
+        if (mi != mapBlockIndex.end())
+            coin.nTime = (*mi).second->GetBlockTime();
+
+        int64 nTxTime = coin.nTxTime, nValue = coin.nValue;
+        uint64 nWeight = 0;
+        wallet->GetStakeWeightFromValue(nTxTime, nValue, nWeight);
+        coin.nWeight = nWeight;
+
+        CTxDestination address;
+        if (ExtractDestination(txout.scriptPubKey, address))
+        {
+            coin.address = QString::fromStdString(CBitcoinAddress(address).ToString());
+            coin.label = AddressBookLabel(wallet, address);
+
+            CPubKey pubkey;
+            CKeyID *keyid = boost::get< CKeyID >(&address);
+            if (keyid && wallet->GetPubKey(*keyid, pubkey) && !pubkey.IsCompressed())
+                coin.fCompressed = false;
+        }
+
+        coin.fImmature = out.tx->IsCoinStake() && out.tx->GetBlocksToMaturity() > 0 && out.tx->GetDepthInMainChain() > 0;
+
+        QString strWalletAddress = QString::fromStdString(CBitcoinAddress(walletAddress).ToString());
+        WalletCoinGroup& group = mapCoins[strWalletAddress];
+        if (group.coins.empty())
+        {
+            group.address = strWalletAddress;
+            group.label = AddressBookLabel(wallet, walletAddress);
+        }
+        group.coins.push_back(coin);
+    }
+
+    coins.reserve(mapCoins.size());
+    for (std::map<QString, WalletCoinGroup>::iterator it = mapCoins.begin(); it != mapCoins.end(); ++it)
+        coins.push_back((*it).second);
+}
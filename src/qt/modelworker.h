@@ -0,0 +1,137 @@
+#ifndef MODELWORKER_H
+#define MODELWORKER_H
+
+#include <QObject>
+#include <QMetaType>
+#include <QMutex>
+#include <QString>
+
+#include <vector>
+
+#include "uint256.h"
+
+class CWallet;
+
+QT_BEGIN_NAMESPACE
+class QThread;
+QT_END_NAMESPACE
+
+/** Runs the queries of a model against the wallet and the chain on a thread
+   of its own, so that block processing holding cs_main or cs_wallet never
+   stalls the GUI thread.
+
+   Requests are bits: everything posted before the worker gets to it is run
+   once, and results come back to the model as queued signals. Queries only
+   try the core locks; a query that finds them busy is retried a little later
+   instead of waiting.
+ */
+class ModelWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    ModelWorker();
+    ~ModelWorker();
+
+    /** Start the worker thread */
+    void start();
+    /** Stop the worker thread, waiting for a running query to finish */
+    void stop();
+    /** Ask for the queries in requests to be run (thread safe) */
+    void post(int requests);
+
+protected:
+    /** Run the query of a single request bit, returning false if a lock it needs was busy */
+    virtual bool run(int request) = 0;
+
+private:
+    QThread *thread;
+    QMutex mutex;
+    int nPending;
+    bool fScheduled;
+
+    void schedule(int requests, bool fRetry);
+
+private slots:
+    void process();
+};
+
+/** Chain status the client model shows */
+class ClientModelWorker : public ModelWorker
+{
+    Q_OBJECT
+
+public:
+    enum Request
+    {
+        ChainStatus = 1
+    };
+
+protected:
+    bool run(int request);
+
+signals:
+    void chainStatusReady(int numBlocks, int numBlocksOfPeers, qint64 lastBlockTime, bool initialDownload, unsigned int bits);
+};
+
+/** An unspent output as coin control shows it */
+struct WalletCoin
+{
+    uint256 hash;
+    unsigned int n;
+    qint64 nValue;
+    int nDepth;
+    qint64 nTime;           // time of the block it is in, or of the transaction while unconfirmed
+    qint64 nTxTime;
+    quint64 nWeight;        // stake weight right now
+    QString address;        // empty if it pays to no address
+    QString label;          // address book label of address
+    bool fCompressed;       // spent with a compressed public key
+    bool fImmature;         // coinstake output that can't be spent yet
+
+    WalletCoin() : n(0), nValue(0), nDepth(0), nTime(0), nTxTime(0), nWeight(0), fCompressed(true), fImmature(false) {}
+};
+
+/** Spendable outputs paid to a wallet address, or to change coming from it */
+struct WalletCoinGroup
+{
+    QString address;
+    QString label;
+    std::vector<WalletCoin> coins;
+};
+
+/** Coin groups sorted by address */
+typedef std::vector<WalletCoinGroup> WalletCoins;
+
+Q_DECLARE_METATYPE(WalletCoins)
+
+/** Balances, stake weight and coins the wallet model shows */
+class WalletModelWorker : public ModelWorker
+{
+    Q_OBJECT
+
+public:
+    enum Request
+    {
+        Balance = 1,
+        StakeWeight = 2,
+        Coins = 4
+    };
+
+    explicit WalletModelWorker(CWallet *wallet);
+
+protected:
+    bool run(int request);
+
+private:
+    CWallet *wallet;
+
+    void listCoins(WalletCoins& coins);
+
+signals:
+    void balanceReady(qint64 balance, qint64 stake, qint64 unconfirmedBalance, qint64 immatureBalance, int numTransactions);
+    void stakeWeightReady(quint64 weight, quint64 networkWeight);
+    void coinsReady(const WalletCoins &coins);
+};
+
+#endif // MODELWORKER_H
@@ -185,7 +185,7 @@ void OverviewPage::updateDisplayUnit()
     if(model && model->getOptionsModel())
     {
         if(currentBalance != -1)
-            setBalance(model->getBalance(), model->getStake(), model->getImmatureBalance(),model->getUnconfirmedBalance());
+            setBalance(currentBalance, currentStake, currentUnconfirmedBalance, currentImmatureBalance);
 
         // Update txdelegate->unit with the current unit
         txdelegate->unit = model->getOptionsModel()->getDisplayUnit();
@@ -3,6 +3,7 @@
 #include "optionsmodel.h"
 #include "addresstablemodel.h"
 #include "transactiontablemodel.h"
+#include "modelworker.h"
 
 #include "ui_interface.h"
 #include "wallet.h"
@@ -23,6 +24,15 @@ WalletModel::WalletModel(CWallet *wallet, OptionsModel *optionsModel, QObject *p
     addressTableModel = new AddressTableModel(wallet, this);
     transactionTableModel = new TransactionTableModel(wallet, this);
 
+    // Balances, stake weight and coins are queried on the worker thread
+    qRegisterMetaType<WalletCoins>("WalletCoins");
+    worker = new WalletModelWorker(wallet);
+    connect(worker, SIGNAL(balanceReady(qint64,qint64,qint64,qint64,int)), this, SLOT(updateBalance(qint64,qint64,qint64,qint64,int)));
+    connect(worker, SIGNAL(stakeWeightReady(quint64,quint64)), this, SIGNAL(stakeWeightChanged(quint64,quint64)));
+    connect(worker, SIGNAL(coinsReady(WalletCoins)), this, SIGNAL(coinsChanged(WalletCoins)));
+    worker->start();
+    worker->post(WalletModelWorker::Balance);
+
     // This timer will be fired repeatedly to update the balance
     pollTimer = new QTimer(this);
     connect(pollTimer, SIGNAL(timeout()), this, SLOT(pollBalanceChanged()));
@@ -34,36 +44,33 @@ WalletModel::WalletModel(CWallet *wallet, OptionsModel *optionsModel, QObject *p
 WalletModel::~WalletModel()
 {
     unsubscribeFromCoreSignals();
+    worker->stop();
+    delete worker;
 }
 
 int64_t WalletModel::getBalance() const
 {
-    return wallet->GetBalance();
+    return cachedBalance;
 }
 
 int64_t WalletModel::getUnconfirmedBalance() const
 {
-    return wallet->GetUnconfirmedBalance();
+    return cachedUnconfirmedBalance;
 }
 
 int64_t WalletModel::getStake() const
 {
-    return wallet->GetStake();
+    return cachedStake;
 }
 
 int64_t WalletModel::getImmatureBalance() const
 {
-    return wallet->GetImmatureBalance();
+    return cachedImmatureBalance;
 }
 
 int WalletModel::getNumTransactions() const
 {
-    int numTransactions = 0;
-    {
-        LOCK(wallet->cs_wallet);
-        numTransactions = wallet->mapWallet.size();
-    }
-    return numTransactions;
+    return cachedNumTransactions;
 }
 
 void WalletModel::updateStatus()
@@ -80,17 +87,22 @@ void WalletModel::pollBalanceChanged()
     {
         // Balance and number of transactions might have changed
         cachedNumBlocks = nBestHeight;
-        checkBalanceChanged();
+        worker->post(WalletModelWorker::Balance);
     }
 }
 
-void WalletModel::checkBalanceChanged()
+void WalletModel::pollStakeWeight()
 {
-    int64_t newBalance = getBalance();
-    int64_t newStake = getStake();
-    int64_t newUnconfirmedBalance = getUnconfirmedBalance();
-    int64_t newImmatureBalance = getImmatureBalance();
+    worker->post(WalletModelWorker::StakeWeight);
+}
 
+void WalletModel::pollCoins()
+{
+    worker->post(WalletModelWorker::Coins);
+}
+
+void WalletModel::updateBalance(qint64 newBalance, qint64 newStake, qint64 newUnconfirmedBalance, qint64 newImmatureBalance, int newNumTransactions)
+{
     if(cachedBalance != newBalance || cachedStake != newStake || cachedUnconfirmedBalance != newUnconfirmedBalance || cachedImmatureBalance != newImmatureBalance)
     {
         cachedBalance = newBalance;
@@ -99,6 +111,12 @@ void WalletModel::checkBalanceChanged()
         cachedImmatureBalance = newImmatureBalance;
         emit balanceChanged(newBalance, newStake, newUnconfirmedBalance, newImmatureBalance);
     }
+
+    if(cachedNumTransactions != newNumTransactions)
+    {
+        cachedNumTransactions = newNumTransactions;
+        emit numTransactionsChanged(newNumTransactions);
+    }
 }
 
 void WalletModel::updateTransaction(const QString &hash, int status)
@@ -107,14 +125,7 @@ void WalletModel::updateTransaction(const QString &hash, int status)
         transactionTableModel->updateTransaction(hash, status);
 
     // Balance and number of transactions might have changed
-    checkBalanceChanged();
-
-    int newNumTransactions = getNumTransactions();
-    if(cachedNumTransactions != newNumTransactions)
-    {
-        cachedNumTransactions = newNumTransactions;
-        emit numTransactionsChanged(newNumTransactions);
-    }
+    worker->post(WalletModelWorker::Balance);
 }
 
 void WalletModel::updateAddressBook(const QString &address, const QString &label, bool isMine, int status)
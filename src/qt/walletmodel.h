@@ -6,6 +6,7 @@
 #include <map>
 
 #include "allocators.h" /* for SecureString */
+#include "modelworker.h" /* for WalletCoins */
 
 class OptionsModel;
 class AddressTableModel;
@@ -153,10 +154,10 @@ private:
     int cachedNumBlocks;
 
     QTimer *pollTimer;
+    WalletModelWorker *worker;
 
     void subscribeToCoreSignals();
     void unsubscribeFromCoreSignals();
-    void checkBalanceChanged();
 
 
 public slots:
@@ -168,6 +169,14 @@ public slots:
     void updateAddressBook(const QString &address, const QString &label, bool isMine, int status);
     /* Current, immature or unconfirmed balance might have changed - emit 'balanceChanged' if so */
     void pollBalanceChanged();
+    /* Recompute the stake weights - 'stakeWeightChanged' is emitted when done */
+    void pollStakeWeight();
+    /* List the spendable coins - 'coinsChanged' is emitted when done */
+    void pollCoins();
+
+private slots:
+    /* Balances and number of transactions as queried by the worker */
+    void updateBalance(qint64 balance, qint64 stake, qint64 unconfirmedBalance, qint64 immatureBalance, int numTransactions);
 
 signals:
     // Signal that balance in wallet changed
@@ -176,6 +185,12 @@ signals:
     // Number of transactions in wallet changed
     void numTransactionsChanged(int count);
 
+    // Stake weight of the wallet and of the network
+    void stakeWeightChanged(quint64 weight, quint64 networkWeight);
+
+    // Spendable coins of the wallet
+    void coinsChanged(const WalletCoins &coins);
+
     // Encryption status of wallet changed
     void encryptionStatusChanged(int status);
 
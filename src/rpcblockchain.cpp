@@ -4,7 +4,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "main.h"
+#include "addrindex.h"
+#include "base58.h"
 #include "bitcoinrpc.h"
+#include "db.h"
 
 using namespace json_spirit;
 using namespace std;
@@ -103,57 +106,71 @@ double GetPoWMHashPS(const CBlockIndex* blockindex)
     int nPoWInterval = 72;
     int64 nTargetSpacingWorkMin = 1, nTargetSpacingWork = 1;
 
-    CBlockIndex* pindex = pindexGenesisBlock;
-    CBlockIndex* pindexPrevWork = pindexGenesisBlock;
     const CBlockIndex* pindexStop = pindexBest;
 
     if (blockindex != NULL)
         pindexStop = blockindex;
 
-    while (pindex && pindex->nHeight < pindexStop->nHeight)
-    {
+    // Each proof-of-work block shrinks the weight of earlier spacings by
+    // (nPoWInterval - 1) / (nPoWInterval + 1), so the average is settled by the
+    // last few hundred of them; walk back to those instead of forward from genesis
+    vector<const CBlockIndex*> vWork;
+    for (const CBlockIndex* pindex = pindexStop->pprev; pindex && (int)vWork.size() < 10 * nPoWInterval; pindex = pindex->pprev)
         if (pindex->IsProofOfWork())
-        {
-            int64 nActualSpacingWork = pindex->GetBlockTime() - pindexPrevWork->GetBlockTime();
-            nTargetSpacingWork = ((nPoWInterval - 1) * nTargetSpacingWork + nActualSpacingWork + nActualSpacingWork) / (nPoWInterval + 1);
-            nTargetSpacingWork = max(nTargetSpacingWork, nTargetSpacingWorkMin);
-            pindexPrevWork = pindex;
-        }
+            vWork.push_back(pindex);
 
-        pindex = pindex->pnext;
+    const CBlockIndex* pindexPrevWork = vWork.empty() ? pindexGenesisBlock : vWork.back();
+    BOOST_REVERSE_FOREACH(const CBlockIndex* pindex, vWork)
+    {
+        int64 nActualSpacingWork = pindex->GetBlockTime() - pindexPrevWork->GetBlockTime();
+        nTargetSpacingWork = ((nPoWInterval - 1) * nTargetSpacingWork + nActualSpacingWork + nActualSpacingWork) / (nPoWInterval + 1);
+        nTargetSpacingWork = max(nTargetSpacingWork, nTargetSpacingWorkMin);
+        pindexPrevWork = pindex;
     }
 
     return GetDifficulty(pindexPrevWork) * 4294.967296 / nTargetSpacingWork;
 }
 
-Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool fPrintTransactionDetail)
+void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool fPrintTransactionDetail, CJSONWriter& writer)
 {
-    Object result;
-    result.push_back(Pair("hash", block.GetHash().GetHex()));
-    CMerkleTx txGen(block.vtx[0]);
-    txGen.SetMerkleBranch(&block);
-    result.push_back(Pair("confirmations", (int)txGen.GetDepthInMainChain()));
-    result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
-    result.push_back(Pair("height", blockindex->nHeight));
-    result.push_back(Pair("version", block.nVersion));
-    result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
-    result.push_back(Pair("mint", ValueFromAmount(blockindex->nMint)));
-    result.push_back(Pair("time", (boost::int64_t)block.GetBlockTime()));
-    result.push_back(Pair("nonce", (boost::uint64_t)block.nNonce));
-    result.push_back(Pair("bits", HexBits(block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
+    // Only the position in the chain can change under us
+    int nConfirmations;
+    const CBlockIndex* pindexNext;
+    {
+        LOCK(cs_main);
+        CMerkleTx txGen(block.vtx[0]);
+        txGen.SetMerkleBranch(&block);
+        nConfirmations = txGen.GetDepthInMainChain();
+        pindexNext = blockindex->pnext;
+    }
+
+    writer.BeginObject();
+    writer.Pair("hash", block.GetHash().GetHex());
+    writer.Pair("confirmations", nConfirmations);
+    writer.Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    writer.Pair("height", blockindex->nHeight);
+    writer.Pair("version", block.nVersion);
+    writer.Pair("merkleroot", block.hashMerkleRoot.GetHex());
+    writer.Pair("mint", ValueFromAmount(blockindex->nMint));
+    writer.Pair("time", (int64)block.GetBlockTime());
+    writer.Pair("nonce", (uint64)block.nNonce);
+    writer.Pair("bits", HexBits(block.nBits));
+    writer.Pair("difficulty", GetDifficulty(blockindex));
 
     if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    if (blockindex->pnext)
-        result.push_back(Pair("nextblockhash", blockindex->pnext->GetBlockHash().GetHex()));
-
-    result.push_back(Pair("flags", strprintf("%s%s", blockindex->IsProofOfStake()? "proof-of-stake" : "proof-of-work", blockindex->GeneratedStakeModifier()? " stake-modifier": "")));
-    result.push_back(Pair("proofhash", blockindex->IsProofOfStake()? blockindex->hashProofOfStake.GetHex() : blockindex->GetBlockHash().GetHex()));
-    result.push_back(Pair("entropybit", (int)blockindex->GetStakeEntropyBit()));
-    result.push_back(Pair("modifier", strprintf("%016"PRI64x, blockindex->nStakeModifier)));
-    result.push_back(Pair("modifierchecksum", strprintf("%08x", blockindex->nStakeModifierChecksum)));
-    Array txinfo;
+        writer.Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
+    if (pindexNext)
+        writer.Pair("nextblockhash", pindexNext->GetBlockHash().GetHex());
+
+    writer.Pair("flags", strprintf("%s%s", blockindex->IsProofOfStake()? "proof-of-stake" : "proof-of-work", blockindex->GeneratedStakeModifier()? " stake-modifier": ""));
+    writer.Pair("proofhash", blockindex->IsProofOfStake()? blockindex->hashProofOfStake.GetHex() : blockindex->GetBlockHash().GetHex());
+    writer.Pair("entropybit", (int)blockindex->GetStakeEntropyBit());
+    writer.Pair("modifier", strprintf("%016"PRI64x, blockindex->nStakeModifier));
+    writer.Pair("modifierchecksum", strprintf("%08x", blockindex->nStakeModifierChecksum));
+
+    // One transaction at a time, so a big block is never held as a whole
+    writer.Key("tx");
+    writer.BeginArray();
     BOOST_FOREACH (const CTransaction& tx, block.vtx)
     {
         if (fPrintTransactionDetail)
@@ -163,16 +180,15 @@ Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool fPri
             entry.push_back(Pair("txid", tx.GetHash().GetHex()));
             TxToJSON(tx, 0, entry);
 
-            txinfo.push_back(entry);
+            writer.Write(entry);
         }
         else
-            txinfo.push_back(tx.GetHash().GetHex());
+            writer.Write(tx.GetHash().GetHex());
     }
+    writer.EndArray();
 
-    result.push_back(Pair("tx", txinfo));
-    result.push_back(Pair("signature", HexStr(block.vchBlockSig.begin(), block.vchBlockSig.end())));
-
-    return result;
+    writer.Pair("signature", HexStr(block.vchBlockSig.begin(), block.vchBlockSig.end()));
+    writer.EndObject();
 }
 
 
@@ -215,7 +231,7 @@ Value settxfee(const Array& params, bool fHelp)
     return true;
 }
 
-Value getrawmempool(const Array& params, bool fHelp)
+void getrawmempool(const Array& params, bool fHelp, CJSONWriter& writer)
 {
     if (fHelp || params.size() != 0)
         throw runtime_error(
@@ -225,11 +241,47 @@ Value getrawmempool(const Array& params, bool fHelp)
     vector<uint256> vtxid;
     mempool.queryHashes(vtxid);
 
-    Array a;
+    writer.BeginArray();
     BOOST_FOREACH(const uint256& hash, vtxid)
-        a.push_back(hash.ToString());
+        writer.Write(hash.ToString());
+    writer.EndArray();
+}
 
-    return a;
+Value getmempoolinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getmempoolinfo\n"
+            "Returns details on the transaction memory pool.");
+
+    Object ret;
+    ret.push_back(Pair("size",       (boost::int64_t)mempool.size()));
+    ret.push_back(Pair("bytes",      (boost::int64_t)mempool.GetTotalTxSize()));
+    ret.push_back(Pair("usage",      (boost::int64_t)mempool.DynamicMemoryUsage()));
+    ret.push_back(Pair("maxmempool", (boost::int64_t)GetMaxMempoolSize()));
+    ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(GetMaxMempoolSize()))));
+    return ret;
+}
+
+Value prioritisetransaction(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 2)
+        throw runtime_error(
+            "prioritisetransaction <txid> <feedelta>\n"
+            "Treats <txid> as paying <feedelta> more (or less, if negative) in fees\n"
+            "when accepting it to the memory pool, evicting it and selecting it for a\n"
+            "mined or staked block. The delta is not paid to the block creator.\n"
+            "Deltas accumulate and are kept across restarts.");
+
+    uint256 hash;
+    hash.SetHex(params[0].get_str());
+    double dDelta = params[1].get_real();
+    if (dDelta < -MAX_MONEY || dDelta > MAX_MONEY)
+        throw JSONRPCError(RPC_TYPE_ERROR, "Invalid amount");
+    int64 nFeeDelta = roundint64(dDelta * COIN);
+
+    mempool.PrioritiseTransaction(hash, nFeeDelta);
+    return true;
 }
 
 Value getblockhash(const Array& params, bool fHelp)
@@ -240,6 +292,8 @@ Value getblockhash(const Array& params, bool fHelp)
             "Returns hash of block in best-block-chain at <index>.");
 
     int nHeight = params[0].get_int();
+
+    LOCK(cs_main);
     if (nHeight < 0 || nHeight > nBestHeight)
         throw runtime_error("Block number out of range.");
 
@@ -247,7 +301,7 @@ Value getblockhash(const Array& params, bool fHelp)
     return pblockindex->phashBlock->GetHex();
 }
 
-Value getblock(const Array& params, bool fHelp)
+void getblock(const Array& params, bool fHelp, CJSONWriter& writer)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
@@ -258,17 +312,23 @@ Value getblock(const Array& params, bool fHelp)
     std::string strHash = params[0].get_str();
     uint256 hash(strHash);
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.count(hash) == 0)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = mapBlockIndex[hash];
+    }
 
+    // Index entries are never freed and block files only grow, so the read
+    // needs no lock
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
     block.ReadFromDisk(pblockindex, true);
 
-    return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
+    blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false, writer);
 }
 
-Value getblockbynumber(const Array& params, bool fHelp)
+void getblockbynumber(const Array& params, bool fHelp, CJSONWriter& writer)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
@@ -277,20 +337,22 @@ Value getblockbynumber(const Array& params, bool fHelp)
             "Returns details of a block with given block-number.");
 
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > nBestHeight)
-        throw runtime_error("Block number out of range.");
 
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hashBestChain];
-    while (pblockindex->nHeight > nHeight)
-        pblockindex = pblockindex->pprev;
+    CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        if (nHeight < 0 || nHeight > nBestHeight)
+            throw runtime_error("Block number out of range.");
 
-    uint256 hash = *pblockindex->phashBlock;
+        pblockindex = mapBlockIndex[hashBestChain];
+        while (pblockindex->nHeight > nHeight)
+            pblockindex = pblockindex->pprev;
+    }
 
-    pblockindex = mapBlockIndex[hash];
+    CBlock block;
     block.ReadFromDisk(pblockindex, true);
 
-    return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
+    blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false, writer);
 }
 
 // get information of sync-checkpoint
@@ -323,3 +385,128 @@ Value getcheckpoint(const Array& params, bool fHelp)
 
     return result;
 }
+
+// Addresses given as one address or an array of them
+static vector<pair<string, CAddrIndexKey> > ParseAddrIndexAddresses(const Value& value)
+{
+    if (!fAddrIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled, restart with -addrindex");
+
+    Array addresses;
+    if (value.type() == array_type)
+        addresses = value.get_array();
+    else
+        addresses.push_back(value);
+
+    vector<pair<string, CAddrIndexKey> > vAddr;
+    BOOST_FOREACH(const Value& address, addresses)
+    {
+        CBitcoinAddress addr(address.get_str());
+        CAddrIndexKey key;
+        if (!addr.IsValid() || !key.Set(addr.Get()))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, string("Invalid DeOxyRibose address: ") + address.get_str());
+        vAddr.push_back(make_pair(address.get_str(), key));
+    }
+    return vAddr;
+}
+
+Value getaddressbalance(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance <address or [\"address\",...]>\n"
+            "Returns the confirmed balance of the addresses and the total they ever received.\n"
+            "Requires -addrindex.");
+
+    vector<pair<string, CAddrIndexKey> > vAddr = ParseAddrIndexAddresses(params[0]);
+
+    int64 nBalance = 0;
+    int64 nReceived = 0;
+    CTxDB txdb("r");
+    for (unsigned int i = 0; i < vAddr.size(); i++)
+    {
+        vector<CAddrIndexDelta> vDelta;
+        if (!txdb.ReadAddrIndexDeltas(vAddr[i].second, 0, -1, vDelta))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+        BOOST_FOREACH(const CAddrIndexDelta& delta, vDelta)
+        {
+            nBalance += delta.nValue;
+            if (!delta.fSpend)
+                nReceived += delta.nValue;
+        }
+    }
+
+    Object result;
+    result.push_back(Pair("balance", ValueFromAmount(nBalance)));
+    result.push_back(Pair("received", ValueFromAmount(nReceived)));
+    return result;
+}
+
+Value getaddresstxids(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw runtime_error(
+            "getaddresstxids <address or [\"address\",...]> [start] [end]\n"
+            "Returns the ids of the transactions paying or spending from the addresses,\n"
+            "ordered by height and by txid within a block, optionally only those of\n"
+            "blocks <start> to <end>.\n"
+            "Requires -addrindex.");
+
+    vector<pair<string, CAddrIndexKey> > vAddr = ParseAddrIndexAddresses(params[0]);
+    int nStart = 0;
+    int nEnd = -1;
+    if (params.size() > 1)
+        nStart = params[1].get_int();
+    if (params.size() > 2)
+        nEnd = params[2].get_int();
+    if (nStart < 0 || (params.size() > 2 && nEnd < nStart))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block range");
+
+    set<pair<int, uint256> > setTx;
+    CTxDB txdb("r");
+    for (unsigned int i = 0; i < vAddr.size(); i++)
+    {
+        vector<CAddrIndexDelta> vDelta;
+        if (!txdb.ReadAddrIndexDeltas(vAddr[i].second, nStart, nEnd, vDelta))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+        BOOST_FOREACH(const CAddrIndexDelta& delta, vDelta)
+            setTx.insert(make_pair(delta.nHeight, delta.txid));
+    }
+
+    Array result;
+    for (set<pair<int, uint256> >::iterator it = setTx.begin(); it != setTx.end(); ++it)
+        result.push_back((*it).second.GetHex());
+    return result;
+}
+
+Value getaddressutxos(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos <address or [\"address\",...]>\n"
+            "Returns the confirmed unspent outputs paying the addresses.\n"
+            "Requires -addrindex.");
+
+    vector<pair<string, CAddrIndexKey> > vAddr = ParseAddrIndexAddresses(params[0]);
+
+    Array result;
+    CTxDB txdb("r");
+    for (unsigned int i = 0; i < vAddr.size(); i++)
+    {
+        vector<CAddrIndexUnspent> vUnspent;
+        if (!txdb.ReadAddrIndexUnspent(vAddr[i].second, vUnspent))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+        BOOST_FOREACH(const CAddrIndexUnspent& unspent, vUnspent)
+        {
+            Object entry;
+            entry.push_back(Pair("address", vAddr[i].first));
+            entry.push_back(Pair("txid", unspent.txid.GetHex()));
+            entry.push_back(Pair("vout", (int)unspent.n));
+            entry.push_back(Pair("amount", ValueFromAmount(unspent.nValue)));
+            entry.push_back(Pair("height", unspent.nHeight));
+            entry.push_back(Pair("confirmations", nBestHeight - unspent.nHeight + 1));
+            result.push_back(entry);
+        }
+    }
+    return result;
+}
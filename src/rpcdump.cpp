@@ -71,6 +71,64 @@ Value importprivkey(const Array& params, bool fHelp)
     return Value::null;
 }
 
+Value importaddress(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 2 || params.size() > 4)
+        throw runtime_error(
+            "importaddress <filename> <DeOxyRiboseaddress or script hex> [label] [rescan=true]\n"
+            "Adds an address or output script to the wallet <filename> loaded with loadwallet, which treats\n"
+            "payments to it as its own without being able to spend them.");
+
+    string strFile = params[0].get_str();
+    string strLabel = "";
+    if (params.size() > 2)
+        strLabel = params[2].get_str();
+    bool fRescan = true;
+    if (params.size() > 3)
+        fRescan = params[3].get_bool();
+
+    CScript script;
+    CBitcoinAddress address(params[1].get_str());
+    if (address.IsValid())
+        script.SetDestination(address.Get());
+    else if (IsHex(params[1].get_str()))
+    {
+        std::vector<unsigned char> data(ParseHex(params[1].get_str()));
+        script = CScript(data.begin(), data.end());
+    }
+    else
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid DeOxyRibose address or script");
+    if (script.empty())
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Empty script");
+
+    // wallet.dat stakes and spends whatever it considers its own, so only
+    // loaded wallets can watch scripts
+    LOCK(cs_mapLoadedWallets);
+    map<string, CWallet*>::iterator mi = mapLoadedWallets.find(strFile);
+    if (mi == mapLoadedWallets.end())
+        throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is not loaded");
+    CWallet* pwallet = (*mi).second;
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+        if (IsMine(*pwallet, script))
+            return Value::null;
+
+        pwallet->MarkDirty();
+        if (address.IsValid())
+            pwallet->SetAddressBookName(address.Get(), strLabel);
+        if (!pwallet->AddWatchOnly(script))
+            throw JSONRPCError(RPC_WALLET_ERROR, "Error adding address to wallet");
+
+        if (fRescan)
+        {
+            pwallet->ScanForWalletTransactions(pindexGenesisBlock, true);
+            pwallet->ReacceptWalletTransactions();
+        }
+    }
+
+    return Value::null;
+}
+
 Value importwallet(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
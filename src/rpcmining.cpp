@@ -8,6 +8,8 @@
 #include "init.h"
 #include "bitcoinrpc.h"
 
+#include <boost/shared_ptr.hpp>
+
 using namespace json_spirit;
 using namespace std;
 
@@ -366,7 +368,155 @@ Value getwork(const Array& params, bool fHelp)
 }
 
 
-Value getblocktemplate(const Array& params, bool fHelp)
+// How long a long poll waits on a changed memory pool before answering
+static const int64 LONGPOLL_MEMPOOL_WAIT = 60;
+
+// Per-transaction part of a template entry; unchanged for a given txid, so
+// kept across template refreshes
+struct CTemplateTx
+{
+    string strData;
+    int64 nFee;
+    int64 nSigOps;
+    vector<uint256> vPrevHashes;
+};
+
+// Everything getblocktemplate returns except the current time.  Shared by
+// all callers and replaced, never modified, when the template changes, so
+// it can be written out without holding any lock.
+struct CBlockTemplateReply
+{
+    int nVersion;
+    uint256 hashPrevBlock;
+    Array transactions;
+    int64 nCoinbaseValue;
+    uint256 hashTarget;
+    int64 nMinTime;
+    unsigned int nBits;
+    int nHeight;
+    string strLongPollId;
+};
+
+// Guarded by cs_main
+static CBlock* pblockTemplate = NULL;
+static CBlockIndex* pindexTemplatePrev = NULL;
+static unsigned int nTemplateTxUpdated = 0;
+static int64 nTemplateStart = 0;
+static boost::shared_ptr<const CBlockTemplateReply> pTemplateReply;
+static map<uint256, CTemplateTx> mapTemplateTx;
+
+// Look txHash up in the entries kept from the previous template, or work
+// it out; either way it ends up in mapNew.  False if its inputs are missing.
+static bool GetTemplateTx(CTxDB& txdb, CTransaction& tx, const uint256& txHash, map<uint256, CTemplateTx>& mapNew)
+{
+    map<uint256, CTemplateTx>::iterator mi = mapTemplateTx.find(txHash);
+    if (mi != mapTemplateTx.end())
+    {
+        mapNew[txHash] = (*mi).second;
+        return true;
+    }
+
+    MapPrevTx mapInputs;
+    map<uint256, CTxIndex> mapUnused;
+    bool fInvalid = false;
+    if (!tx.FetchInputs(txdb, mapUnused, false, false, mapInputs, fInvalid))
+        return false;
+
+    CTemplateTx& entry = mapNew[txHash];
+    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+    ssTx << tx;
+    entry.strData = HexStr(ssTx.begin(), ssTx.end());
+    entry.nFee = tx.GetValueIn(mapInputs) - tx.GetValueOut();
+    entry.nSigOps = tx.GetLegacySigOpCount() + tx.GetP2SHSigOpCount(mapInputs);
+    BOOST_FOREACH (MapPrevTx::value_type& inp, mapInputs)
+        entry.vPrevHashes.push_back(inp.first);
+    return true;
+}
+
+// Rebuild the template if the tip moved, or the memory pool changed and the
+// current one is more than 5 seconds old.  Only transactions new to the
+// template are serialized and have their inputs looked up.
+static void UpdateBlockTemplate()
+{
+    if (pblockTemplate && pindexTemplatePrev == pindexBest &&
+        (nTransactionsUpdated == nTemplateTxUpdated || GetTime() - nTemplateStart <= 5))
+        return;
+
+    // Clear pindexTemplatePrev so future calls make a new block, despite any failures from here on
+    pindexTemplatePrev = NULL;
+
+    // Store the pindexBest used before CreateNewBlock, to avoid races
+    nTemplateTxUpdated = nTransactionsUpdated;
+    CBlockIndex* pindexPrevNew = pindexBest;
+    nTemplateStart = GetTime();
+
+    // Create new block
+    if (pblockTemplate)
+    {
+        delete pblockTemplate;
+        pblockTemplate = NULL;
+    }
+    pblockTemplate = CreateNewBlock(pwalletMain);
+    if (!pblockTemplate)
+        throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
+
+    // Need to update only after we know CreateNewBlock succeeded
+    pindexTemplatePrev = pindexPrevNew;
+
+    boost::shared_ptr<CBlockTemplateReply> preply(new CBlockTemplateReply());
+    map<uint256, CTemplateTx> mapNew;
+    map<uint256, int64_t> setTxIndex;
+    int i = 0;
+    CTxDB txdb("r");
+    BOOST_FOREACH (CTransaction& tx, pblockTemplate->vtx)
+    {
+        uint256 txHash = tx.GetHash();
+        setTxIndex[txHash] = i++;
+
+        if (tx.IsCoinBase() || tx.IsCoinStake())
+            continue;
+
+        Object entry;
+        if (GetTemplateTx(txdb, tx, txHash, mapNew))
+        {
+            const CTemplateTx& txEntry = mapNew[txHash];
+            entry.push_back(Pair("data", txEntry.strData));
+            entry.push_back(Pair("hash", txHash.GetHex()));
+            entry.push_back(Pair("fee", (int64_t)txEntry.nFee));
+
+            Array deps;
+            BOOST_FOREACH (const uint256& hashPrev, txEntry.vPrevHashes)
+            {
+                if (setTxIndex.count(hashPrev))
+                    deps.push_back(setTxIndex[hashPrev]);
+            }
+            entry.push_back(Pair("depends", deps));
+            entry.push_back(Pair("sigops", (int64_t)txEntry.nSigOps));
+        }
+        else
+        {
+            CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+            ssTx << tx;
+            entry.push_back(Pair("data", HexStr(ssTx.begin(), ssTx.end())));
+            entry.push_back(Pair("hash", txHash.GetHex()));
+        }
+
+        preply->transactions.push_back(entry);
+    }
+    mapTemplateTx.swap(mapNew);
+
+    preply->nVersion = pblockTemplate->nVersion;
+    preply->hashPrevBlock = pblockTemplate->hashPrevBlock;
+    preply->nCoinbaseValue = pblockTemplate->vtx[0].vout[0].nValue;
+    preply->hashTarget = CBigNum().SetCompact(pblockTemplate->nBits).getuint256();
+    preply->nMinTime = pindexTemplatePrev->GetMedianTimePast()+1;
+    preply->nBits = pblockTemplate->nBits;
+    preply->nHeight = pindexTemplatePrev->nHeight+1;
+    preply->strLongPollId = pindexTemplatePrev->GetBlockHash().GetHex() + strprintf("%u", nTemplateTxUpdated);
+    pTemplateReply = preply;
+}
+
+void getblocktemplate(const Array& params, bool fHelp, CJSONWriter& writer)
 {
     if (fHelp || params.size() > 1)
         throw runtime_error(
@@ -386,9 +536,11 @@ Value getblocktemplate(const Array& params, bool fHelp)
             "  \"sizelimit\" : limit of block size\n"
             "  \"bits\" : compressed target of next block\n"
             "  \"height\" : height of the next block\n"
+            "  \"longpollid\" : pass as \"longpollid\" in [params] to wait until this template is outdated\n"
             "See https://en.bitcoin.it/wiki/BIP_0022 for full specification.");
 
     std::string strMode = "template";
+    string strLongPollId;
     if (params.size() > 0)
     {
         const Object& oparam = params[0].get_obj();
@@ -401,6 +553,12 @@ Value getblocktemplate(const Array& params, bool fHelp)
         }
         else
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
+
+        const Value& lpval = find_value(oparam, "longpollid");
+        if (lpval.type() == str_type)
+            strLongPollId = lpval.get_str();
+        else if (lpval.type() != null_type)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid longpollid");
     }
 
     if (strMode != "template")
@@ -412,115 +570,73 @@ Value getblocktemplate(const Array& params, bool fHelp)
     if (IsInitialBlockDownload())
         throw JSONRPCError(RPC_CLIENT_IN_INITIAL_DOWNLOAD, "DeOxyRibose is downloading blocks...");
 
-    static CReserveKey reservekey(pwalletMain);
-
-    // Update block
-    static unsigned int nTransactionsUpdatedLast;
-    static CBlockIndex* pindexPrev;
-    static int64 nStart;
-    static CBlock* pblock;
-    if (pindexPrev != pindexBest ||
-        (nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 5))
+    // Long poll: hold the reply until the tip moves, or until the memory
+    // pool has changed and the caller waited a while
+    if (strLongPollId.size() > 64)
     {
-        // Clear pindexPrev so future calls make a new block, despite any failures from here on
-        pindexPrev = NULL;
+        uint256 hashWatched;
+        hashWatched.SetHex(strLongPollId.substr(0, 64));
+        unsigned int nTxUpdatedWatched = (unsigned int)atoi64(strLongPollId.substr(64));
 
-        // Store the pindexBest used before CreateNewBlock, to avoid races
-        nTransactionsUpdatedLast = nTransactionsUpdated;
-        CBlockIndex* pindexPrevNew = pindexBest;
-        nStart = GetTime();
-
-        // Create new block
-        if(pblock)
+        bool fWait;
         {
-            delete pblock;
-            pblock = NULL;
+            LOCK(cs_main);
+            fWait = (hashBestChain == hashWatched);
         }
-        pblock = CreateNewBlock(pwalletMain);
-        if (!pblock)
-            throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
-
-        // Need to update only after we know CreateNewBlock succeeded
-        pindexPrev = pindexPrevNew;
-    }
-
-    // Update nTime
-    pblock->UpdateTime(pindexPrev);
-    pblock->nNonce = 0;
-
-    Array transactions;
-    map<uint256, int64_t> setTxIndex;
-    int i = 0;
-    CTxDB txdb("r");
-    BOOST_FOREACH (CTransaction& tx, pblock->vtx)
-    {
-        uint256 txHash = tx.GetHash();
-        setTxIndex[txHash] = i++;
-
-        if (tx.IsCoinBase() || tx.IsCoinStake())
-            continue;
-
-        Object entry;
-
-        CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
-        ssTx << tx;
-        entry.push_back(Pair("data", HexStr(ssTx.begin(), ssTx.end())));
-
-        entry.push_back(Pair("hash", txHash.GetHex()));
-
-        MapPrevTx mapInputs;
-        map<uint256, CTxIndex> mapUnused;
-        bool fInvalid = false;
-        if (tx.FetchInputs(txdb, mapUnused, false, false, mapInputs, fInvalid))
+        int64 nMempoolCheck = GetTime() + LONGPOLL_MEMPOOL_WAIT;
+        while (fWait)
         {
-            entry.push_back(Pair("fee", (int64_t)(tx.GetValueIn(mapInputs) - tx.GetValueOut())));
-
-            Array deps;
-            BOOST_FOREACH (MapPrevTx::value_type& inp, mapInputs)
+            if (WaitForBlockChange(hashWatched, 1000))
+                break;
+            if (fShutdown)
+                throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Shutting down");
+            if (GetTime() >= nMempoolCheck)
             {
-                if (setTxIndex.count(inp.first))
-                    deps.push_back(setTxIndex[inp.first]);
+                if (nTransactionsUpdated != nTxUpdatedWatched)
+                    break;
+                nMempoolCheck = GetTime() + 10;
             }
-            entry.push_back(Pair("depends", deps));
-
-            int64_t nSigOps = tx.GetLegacySigOpCount();
-            nSigOps += tx.GetP2SHSigOpCount(mapInputs);
-            entry.push_back(Pair("sigops", nSigOps));
         }
-
-        transactions.push_back(entry);
     }
 
-    Object aux;
-    aux.push_back(Pair("flags", HexStr(COINBASE_FLAGS.begin(), COINBASE_FLAGS.end())));
-
-    uint256 hashTarget = CBigNum().SetCompact(pblock->nBits).getuint256();
-
-    static Array aMutable;
-    if (aMutable.empty())
+    boost::shared_ptr<const CBlockTemplateReply> preply;
+    int64 nCurTime;
     {
-        aMutable.push_back("time");
-        aMutable.push_back("transactions");
-        aMutable.push_back("prevblock");
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        UpdateBlockTemplate();
+
+        // Update nTime
+        pblockTemplate->UpdateTime(pindexTemplatePrev);
+        pblockTemplate->nNonce = 0;
+        nCurTime = pblockTemplate->nTime;
+        preply = pTemplateReply;
     }
 
-    Object result;
-    result.push_back(Pair("version", pblock->nVersion));
-    result.push_back(Pair("previousblockhash", pblock->hashPrevBlock.GetHex()));
-    result.push_back(Pair("transactions", transactions));
-    result.push_back(Pair("coinbaseaux", aux));
-    result.push_back(Pair("coinbasevalue", (int64_t)pblock->vtx[0].vout[0].nValue));
-    result.push_back(Pair("target", hashTarget.GetHex()));
-    result.push_back(Pair("mintime", (int64_t)pindexPrev->GetMedianTimePast()+1));
-    result.push_back(Pair("mutable", aMutable));
-    result.push_back(Pair("noncerange", "00000000ffffffff"));
-    result.push_back(Pair("sigoplimit", (int64_t)MAX_BLOCK_SIGOPS));
-    result.push_back(Pair("sizelimit", (int64_t)MAX_BLOCK_SIZE));
-    result.push_back(Pair("curtime", (int64_t)pblock->nTime));
-    result.push_back(Pair("bits", HexBits(pblock->nBits)));
-    result.push_back(Pair("height", (int64_t)(pindexPrev->nHeight+1)));
-
-    return result;
+    writer.BeginObject();
+    writer.Pair("version", preply->nVersion);
+    writer.Pair("previousblockhash", preply->hashPrevBlock.GetHex());
+    writer.Pair("transactions", preply->transactions);
+    writer.Key("coinbaseaux");
+    writer.BeginObject();
+    writer.Pair("flags", HexStr(COINBASE_FLAGS.begin(), COINBASE_FLAGS.end()));
+    writer.EndObject();
+    writer.Pair("coinbasevalue", preply->nCoinbaseValue);
+    writer.Pair("target", preply->hashTarget.GetHex());
+    writer.Pair("mintime", preply->nMinTime);
+    writer.Key("mutable");
+    writer.BeginArray();
+    writer.Write("time");
+    writer.Write("transactions");
+    writer.Write("prevblock");
+    writer.EndArray();
+    writer.Pair("noncerange", "00000000ffffffff");
+    writer.Pair("sigoplimit", (int64)MAX_BLOCK_SIGOPS);
+    writer.Pair("sizelimit", (int64)MAX_BLOCK_SIZE);
+    writer.Pair("curtime", nCurTime);
+    writer.Pair("bits", HexBits(preply->nBits));
+    writer.Pair("height", (int64)preply->nHeight);
+    writer.Pair("longpollid", preply->strLongPollId);
+    writer.EndObject();
 }
 
 Value submitblock(const Array& params, bool fHelp)
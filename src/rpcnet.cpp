@@ -65,6 +65,9 @@ Value getpeerinfo(const Array& params, bool fHelp)
         obj.push_back(Pair("releasetime", (boost::int64_t)stats.nReleaseTime));
         obj.push_back(Pair("startingheight", stats.nStartingHeight));
         obj.push_back(Pair("banscore", stats.nMisbehavior));
+        obj.push_back(Pair("minfeefilter", ValueFromAmount(stats.nMinFeeFilter)));
+        obj.push_back(Pair("inflight", stats.nDownloadInFlight));
+        obj.push_back(Pair("responsetime", (boost::int64_t)(stats.nDownloadResponse / 1000)));
 
         ret.push_back(obj);
     }
@@ -144,11 +147,20 @@ Value getnettotals(const Array& params, bool fHelp)
         throw runtime_error( 
             "getnettotals\n" 
             "Returns information about network traffic, including bytes in, bytes out,\n" 
-            "and current time."); 
+            "and current time, and the state of the -maxuploadtarget budget."); 
  
     Object obj; 
     obj.push_back(Pair("totalbytesrecv", static_cast< boost::uint64_t>(CNode::GetTotalBytesRecv()))); 
     obj.push_back(Pair("totalbytessent", static_cast<boost::uint64_t>(CNode::GetTotalBytesSent()))); 
     obj.push_back(Pair("timemillis", static_cast<boost::int64_t>(GetTimeMillis()))); 
+
+    Object outboundLimit;
+    outboundLimit.push_back(Pair("timeframe", (boost::int64_t)MAX_UPLOAD_TIMEFRAME));
+    outboundLimit.push_back(Pair("target", (boost::uint64_t)CNode::GetMaxOutboundTarget()));
+    outboundLimit.push_back(Pair("target_reached", CNode::OutboundTargetReached(false)));
+    outboundLimit.push_back(Pair("serve_historical_blocks", !CNode::OutboundTargetReached(true)));
+    outboundLimit.push_back(Pair("bytes_left_in_cycle", (boost::uint64_t)CNode::GetOutboundTargetBytesLeft()));
+    outboundLimit.push_back(Pair("time_left_in_cycle", (boost::int64_t)CNode::GetMaxOutboundTimeLeftInCycle()));
+    obj.push_back(Pair("uploadtarget", outboundLimit));
     return obj; 
 } 
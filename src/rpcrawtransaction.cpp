@@ -11,6 +11,7 @@
 #include "init.h"
 #include "main.h"
 #include "net.h"
+#include "spentindex.h"
 #include "wallet.h"
 
 using namespace std;
@@ -42,9 +43,41 @@ void ScriptPubKeyToJSON(const CScript& scriptPubKey, Object& out)
     out.push_back(Pair("addresses", a));
 }
 
-void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry)
+// Value and address of the output prevout points to, without asking the
+// caller to look up the previous transaction
+static bool GetPrevOutInfo(CTxDB& txdb, const COutPoint& prevout, int64& nValue, CTxDestination& address)
+{
+    CSpentIndexValue spent;
+    if (fSpentIndex && txdb.ReadSpentIndex(prevout, spent))
+    {
+        nValue = spent.nValue;
+        address = spent.addr.Get();
+        return true;
+    }
+
+    CTransaction txPrev;
+    {
+        LOCK(mempool.cs);
+        if (mempool.mapTx.count(prevout.hash))
+            txPrev = mempool.mapTx[prevout.hash];
+    }
+    if (txPrev.IsNull() && !txdb.ReadDiskTx(prevout.hash, txPrev))
+        return false;
+    if (prevout.n >= txPrev.vout.size())
+        return false;
+    nValue = txPrev.vout[prevout.n].nValue;
+    if (!ExtractDestination(txPrev.vout[prevout.n].scriptPubKey, address))
+        address = CNoDestination();
+    return true;
+}
+
+void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry, bool fSpentInfo)
 {
-    entry.push_back(Pair("txid", tx.GetHash().GetHex()));
+    uint256 hashTx = tx.GetHash();
+    // One database handle for all the inputs and outputs
+    auto_ptr<CTxDB> ptxdb(fSpentInfo ? new CTxDB("r") : NULL);
+
+    entry.push_back(Pair("txid", hashTx.GetHex()));
     entry.push_back(Pair("version", tx.nVersion));
     entry.push_back(Pair("time", (boost::int64_t)tx.nTime));
     entry.push_back(Pair("locktime", (boost::int64_t)tx.nLockTime));
@@ -62,6 +95,15 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry)
             o.push_back(Pair("asm", txin.scriptSig.ToString()));
             o.push_back(Pair("hex", HexStr(txin.scriptSig.begin(), txin.scriptSig.end())));
             in.push_back(Pair("scriptSig", o));
+
+            int64 nValue;
+            CTxDestination address;
+            if (fSpentInfo && GetPrevOutInfo(*ptxdb, txin.prevout, nValue, address))
+            {
+                in.push_back(Pair("value", ValueFromAmount(nValue)));
+                if (address.which() != 0)
+                    in.push_back(Pair("address", CBitcoinAddress(address).ToString()));
+            }
         }
         in.push_back(Pair("sequence", (boost::int64_t)txin.nSequence));
         vin.push_back(in);
@@ -77,6 +119,28 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry)
         Object o;
         ScriptPubKeyToJSON(txout.scriptPubKey, o);
         out.push_back(Pair("scriptPubKey", o));
+
+        if (fSpentInfo)
+        {
+            COutPoint outpoint(hashTx, i);
+            CSpentIndexValue spent;
+            if (fSpentIndex && ptxdb->ReadSpentIndex(outpoint, spent))
+            {
+                out.push_back(Pair("spentTxId", spent.txid.GetHex()));
+                out.push_back(Pair("spentIndex", (boost::int64_t)spent.nIn));
+                out.push_back(Pair("spentHeight", spent.nHeight));
+            }
+            else
+            {
+                LOCK(mempool.cs);
+                map<COutPoint, CInPoint>::iterator mi = mempool.mapNextTx.find(outpoint);
+                if (mi != mempool.mapNextTx.end())
+                {
+                    out.push_back(Pair("spentTxId", (*mi).second.ptx->GetHash().GetHex()));
+                    out.push_back(Pair("spentIndex", (boost::int64_t)(*mi).second.n));
+                }
+            }
+        }
         vout.push_back(out);
     }
     entry.push_back(Pair("vout", vout));
@@ -100,6 +164,11 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry)
     }
 }
 
+void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry)
+{
+    TxToJSON(tx, hashBlock, entry, false);
+}
+
 Value getrawtransaction(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -108,14 +177,17 @@ Value getrawtransaction(const Array& params, bool fHelp)
             "If verbose=0, returns a string that is\n"
             "serialized, hex-encoded data for <txid>.\n"
             "If verbose is non-zero, returns an Object\n"
-            "with information about <txid>.");
+            "with information about <txid>.\n"
+            "If verbose=2, inputs also show the value and address they spend\n"
+            "and outputs where they were spent (with -spentindex).");
 
     uint256 hash;
     hash.SetHex(params[0].get_str());
 
-    bool fVerbose = false;
+    int nVerbose = 0;
     if (params.size() > 1)
-        fVerbose = (params[1].get_int() != 0);
+        nVerbose = params[1].get_int();
+    bool fVerbose = (nVerbose != 0);
 
     CTransaction tx;
     uint256 hashBlock = 0;
@@ -131,11 +203,14 @@ Value getrawtransaction(const Array& params, bool fHelp)
 
     Object result;
     result.push_back(Pair("hex", strHex));
-    TxToJSON(tx, hashBlock, result);
+    {
+        LOCK(cs_main);
+        TxToJSON(tx, hashBlock, result, nVerbose == 2);
+    }
     return result;
 }
 
-Value listunspent(const Array& params, bool fHelp)
+void listunspent(const Array& params, bool fHelp, CJSONWriter& writer)
 {
     if (fHelp || params.size() > 3)
         throw runtime_error(
@@ -171,9 +246,9 @@ Value listunspent(const Array& params, bool fHelp)
         }
     }
 
-    Array results;
     vector<COutput> vecOutputs;
     pwalletMain->AvailableCoins(vecOutputs, false);
+    writer.BeginArray();
     BOOST_FOREACH(const COutput& out, vecOutputs)
     {
         if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
@@ -191,16 +266,15 @@ Value listunspent(const Array& params, bool fHelp)
 
         int64 nValue = out.tx->vout[out.i].nValue;
         const CScript& pk = out.tx->vout[out.i].scriptPubKey;
-        Object entry;
-        entry.push_back(Pair("txid", out.tx->GetHash().GetHex()));
-        entry.push_back(Pair("vout", out.i));
-        entry.push_back(Pair("scriptPubKey", HexStr(pk.begin(), pk.end())));
-        entry.push_back(Pair("amount",ValueFromAmount(nValue)));
-        entry.push_back(Pair("confirmations",out.nDepth));
-        results.push_back(entry);
+        writer.BeginObject();
+        writer.Pair("txid", out.tx->GetHash().GetHex());
+        writer.Pair("vout", out.i);
+        writer.Pair("scriptPubKey", HexStr(pk.begin(), pk.end()));
+        writer.Pair("amount", ValueFromAmount(nValue));
+        writer.Pair("confirmations", out.nDepth);
+        writer.EndObject();
     }
-
-    return results;
+    writer.EndArray();
 }
 
 Value createrawtransaction(const Array& params, bool fHelp)
@@ -270,12 +344,14 @@ Value createrawtransaction(const Array& params, bool fHelp)
 
 Value decoderawtransaction(const Array& params, bool fHelp)
 {
-    if (fHelp || params.size() != 1)
+    if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
-            "decoderawtransaction <hex string>\n"
-            "Return a JSON object representing the serialized, hex-encoded transaction.");
+            "decoderawtransaction <hex string> [verbose=false]\n"
+            "Return a JSON object representing the serialized, hex-encoded transaction.\n"
+            "If verbose is true, inputs also show the value and address they spend\n"
+            "and outputs where they were spent (with -spentindex).");
 
-    RPCTypeCheck(params, list_of(str_type));
+    RPCTypeCheck(params, list_of(str_type)(bool_type));
 
     vector<unsigned char> txData(ParseHex(params[0].get_str()));
     CDataStream ssData(txData, SER_NETWORK, PROTOCOL_VERSION);
@@ -288,7 +364,13 @@ Value decoderawtransaction(const Array& params, bool fHelp)
     }
 
     Object result;
-    TxToJSON(tx, 0, result);
+    if (params.size() > 1 && params[1].get_bool())
+    {
+        LOCK(cs_main);
+        TxToJSON(tx, 0, result, true);
+    }
+    else
+        TxToJSON(tx, 0, result);
 
     return result;
 }
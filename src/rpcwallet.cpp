@@ -1068,7 +1068,17 @@ void AcentryToJSON(const CAccountingEntry& acentry, const string& strAccount, Ar
     }
 }
 
-Value listtransactions(const Array& params, bool fHelp)
+static void ListTxItem(const CWallet::TxPair& item, const string& strAccount, Array& ret)
+{
+    CWalletTx *const pwtx = item.first;
+    if (pwtx != 0)
+        ListTransactions(*pwtx, strAccount, 0, true, ret);
+    CAccountingEntry *const pacentry = item.second;
+    if (pacentry != 0)
+        AcentryToJSON(*pacentry, strAccount, ret);
+}
+
+void listtransactions(const Array& params, bool fHelp, CJSONWriter& writer)
 {
     if (fHelp || params.size() > 3)
         throw runtime_error(
@@ -1090,40 +1100,32 @@ Value listtransactions(const Array& params, bool fHelp)
     if (nFrom < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
 
-    Array ret;
-
     std::list<CAccountingEntry> acentries;
     CWallet::TxItems txOrdered = pwalletMain->OrderedTxItems(acentries, strAccount);
 
-    // iterate backwards until we have nCount items to return:
+    // Walk back from the newest item until nFrom+nCount entries are covered,
+    // keeping only the entries that are asked for
+    vector<Value> vSelected;
+    int nEntries = 0;
     for (CWallet::TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
     {
-        CWalletTx *const pwtx = (*it).second.first;
-        if (pwtx != 0)
-            ListTransactions(*pwtx, strAccount, 0, true, ret);
-        CAccountingEntry *const pacentry = (*it).second.second;
-        if (pacentry != 0)
-            AcentryToJSON(*pacentry, strAccount, ret);
-
-        if ((int)ret.size() >= (nCount+nFrom)) break;
-    }
-    // ret is newest to oldest
+        if (nEntries >= (nCount+nFrom)) break;
 
-    if (nFrom > (int)ret.size())
-        nFrom = ret.size();
-    if ((nFrom + nCount) > (int)ret.size())
-        nCount = ret.size() - nFrom;
-    Array::iterator first = ret.begin();
-    std::advance(first, nFrom);
-    Array::iterator last = ret.begin();
-    std::advance(last, nFrom+nCount);
-
-    if (last != ret.end()) ret.erase(last, ret.end());
-    if (first != ret.begin()) ret.erase(ret.begin(), first);
-
-    std::reverse(ret.begin(), ret.end()); // Return oldest to newest
+        Array entries;
+        ListTxItem((*it).second, strAccount, entries);
+        BOOST_FOREACH(const Value& entry, entries)
+        {
+            if (nEntries >= nFrom && nEntries < nFrom + nCount)
+                vSelected.push_back(entry);
+            nEntries++;
+        }
+    }
 
-    return ret;
+    // Oldest to newest
+    writer.BeginArray();
+    BOOST_REVERSE_FOREACH(const Value& entry, vSelected)
+        writer.Write(entry);
+    writer.EndArray();
 }
 
 Value listaccounts(const Array& params, bool fHelp)
@@ -1412,13 +1414,6 @@ Value keypoolrefill(const Array& params, bool fHelp)
 }
 
 
-void ThreadTopUpKeyPool(void* parg)
-{
-    // Make this thread recognisable as the key-topping-up thread
-    RenameThread("bitcoin-key-top");
-
-    pwalletMain->TopUpKeyPool();
-}
 
 void ThreadCleanWalletPassphrase(void* parg)
 {
@@ -1495,7 +1490,7 @@ Value walletpassphrase(const Array& params, bool fHelp)
             "walletpassphrase <passphrase> <timeout>\n"
             "Stores the wallet decryption key in memory for <timeout> seconds.");
 
-    NewThread(ThreadTopUpKeyPool, NULL);
+    NewThread(ThreadTopUpKeyPool, pwalletMain);
     int64* pnSleepTime = new int64(params[1].get_int64_t());
     NewThread(ThreadCleanWalletPassphrase, pnSleepTime);
 
@@ -1649,6 +1644,7 @@ Value validateaddress(const Array& params, bool fHelp)
         CTxDestination dest = address.Get();
         string currentAddress = address.ToString();
         ret.push_back(Pair("address", currentAddress));
+        LOCK(pwalletMain->cs_wallet);
         bool fMine = IsMine(*pwalletMain, dest);
         ret.push_back(Pair("ismine", fMine));
         if (fMine) {
@@ -1826,3 +1822,67 @@ Value makekeypair(const Array& params, bool fHelp)
     result.push_back(Pair("PublicKey", HexStr(key.GetPubKey().Raw())));
     return result;
 }
+
+static Object WalletToJSON(const string& strName, const CWallet* pwallet)
+{
+    Object entry;
+    entry.push_back(Pair("name", strName));
+    {
+        LOCK(pwallet->cs_wallet);
+        set<CKeyID> setKeys;
+        pwallet->GetKeys(setKeys);
+        entry.push_back(Pair("keys", (int)setKeys.size()));
+        entry.push_back(Pair("transactions", (int)pwallet->mapWallet.size()));
+        entry.push_back(Pair("balance", ValueFromAmount(pwallet->GetBalance())));
+        entry.push_back(Pair("unconfirmed", ValueFromAmount(pwallet->GetUnconfirmedBalance())));
+    }
+    return entry;
+}
+
+Value loadwallet(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "loadwallet <filename> [watchonly=false]\n"
+            "Loads the wallet <filename> from the data directory next to wallet.dat, creating it if needed.\n"
+            "Only blocks since it was last loaded are scanned. A new wallet created with [watchonly] true\n"
+            "gets no keys, only the scripts given to importaddress.");
+
+    string strFile = params[0].get_str();
+    bool fWatchOnly = false;
+    if (params.size() > 1)
+        fWatchOnly = params[1].get_bool();
+
+    string strError;
+    CWallet* pwallet = LoadAdditionalWallet(strFile, fWatchOnly, strError);
+    if (!pwallet)
+        throw JSONRPCError(RPC_WALLET_ERROR, strError);
+    return WalletToJSON(strFile, pwallet);
+}
+
+Value unloadwallet(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "unloadwallet <filename>\n"
+            "Unloads a wallet loaded with loadwallet.");
+
+    if (!UnloadAdditionalWallet(params[0].get_str()))
+        throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is not loaded");
+    return Value::null;
+}
+
+Value listwallets(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "listwallets\n"
+            "Lists wallet.dat and the wallets loaded with loadwallet.");
+
+    Array ret;
+    ret.push_back(WalletToJSON(pwalletMain->strWalletFile, pwalletMain));
+    LOCK(cs_mapLoadedWallets);
+    BOOST_FOREACH(const PAIRTYPE(string, CWallet*)& item, mapLoadedWallets)
+        ret.push_back(WalletToJSON(item.first, item.second));
+    return ret;
+}
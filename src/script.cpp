@@ -1476,6 +1476,9 @@ bool IsMine(const CKeyStore &keystore, const CTxDestination &dest)
 
 bool IsMine(const CKeyStore &keystore, const CScript& scriptPubKey)
 {
+    if (keystore.HaveWatchOnly(scriptPubKey))
+        return true;
+
     vector<valtype> vSolutions;
     txnouttype whichType;
     if (!Solver(scriptPubKey, whichType, vSolutions))
@@ -1550,6 +1553,39 @@ class CAffectedKeysVisitor : public boost::static_visitor<void> {
       CAffectedKeysVisitor(keystore, vKeys).Process(scriptPubKey);
   }
 
+void ExtractLookupHashes(const CScript& scriptPubKey, std::vector<uint160>& vHashes)
+{
+    if (scriptPubKey.empty())
+        return;
+
+    vector<valtype> vSolutions;
+    txnouttype whichType;
+    if (!Solver(scriptPubKey, whichType, vSolutions))
+    {
+        // Only a watch-only script can make this ours
+        vHashes.push_back(Hash160(scriptPubKey));
+        return;
+    }
+
+    switch (whichType)
+    {
+    case TX_NONSTANDARD:
+        vHashes.push_back(Hash160(scriptPubKey));
+        break;
+    case TX_PUBKEY:
+        vHashes.push_back(CPubKey(vSolutions[0]).GetID());
+        break;
+    case TX_PUBKEYHASH:
+    case TX_SCRIPTHASH:
+        vHashes.push_back(uint160(vSolutions[0]));
+        break;
+    case TX_MULTISIG:
+        for (unsigned int i = 1; i < vSolutions.size() - 1; i++)
+            vHashes.push_back(CPubKey(vSolutions[i]).GetID());
+        break;
+    }
+}
+
 bool ExtractDestination(const CScript& scriptPubKey, CTxDestination& addressRet)
 {
     vector<valtype> vSolutions;
@@ -0,0 +1,105 @@
+// Copyright (c) 2013 The DeOxyRibose developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/foreach.hpp>
+
+#include "spentindex.h"
+#include "db.h"
+#include "main.h"
+#include "ui_interface.h"
+
+using namespace std;
+
+bool fSpentIndex = false;
+
+bool SpentIndexConnectInputs(CTxDB& txdb, const CTransaction& tx, const MapPrevTx& mapInputs, int nHeight)
+{
+    if (tx.IsCoinBase())
+        return true;
+
+    uint256 hashTx = tx.GetHash();
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+    {
+        const COutPoint& prevout = tx.vin[i].prevout;
+        MapPrevTx::const_iterator mi = mapInputs.find(prevout.hash);
+        if (mi == mapInputs.end() || prevout.n >= (*mi).second.second.vout.size())
+            return error("SpentIndexConnectInputs() : %s input %u not fetched", hashTx.ToString().c_str(), i);
+        const CTxOut& txout = (*mi).second.second.vout[prevout.n];
+
+        CSpentIndexValue spent;
+        spent.txid = hashTx;
+        spent.nIn = i;
+        spent.nHeight = nHeight;
+        spent.nValue = txout.nValue;
+        spent.addr.Set(txout.scriptPubKey);
+        if (!txdb.WriteSpentIndex(prevout, spent))
+            return error("SpentIndexConnectInputs() : WriteSpentIndex failed");
+    }
+    return true;
+}
+
+bool SpentIndexConnectBlock(CTxDB& txdb, const CBlockIndex* pindex)
+{
+    return txdb.WriteSpentIndexHeight(pindex->nHeight);
+}
+
+bool SpentIndexDisconnectBlock(CTxDB& txdb, const CBlock& block, const CBlockIndex* pindex)
+{
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+    {
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            if (!txdb.EraseSpentIndex(txin.prevout))
+                return error("SpentIndexDisconnectBlock() : EraseSpentIndex failed");
+    }
+    return txdb.WriteSpentIndexHeight(pindex->nHeight - 1);
+}
+
+// Index what block spends while the index is built, for BuildChainIndex
+static bool SpentIndexBuildBlock(CTxDB& txdb, const CBlock& block, const CBlockIndex* pindex)
+{
+    map<uint256, CTxIndex> mapUnused;
+    BOOST_FOREACH(const CTransaction& txBlock, block.vtx)
+    {
+        if (txBlock.IsCoinBase())
+            continue;
+        CTransaction tx(txBlock);       // FetchInputs isn't const
+        MapPrevTx mapInputs;
+        bool fInvalid;
+        if (!tx.FetchInputs(txdb, mapUnused, true, false, mapInputs, fInvalid) ||
+            !SpentIndexConnectInputs(txdb, tx, mapInputs, pindex->nHeight))
+            return false;
+    }
+    return SpentIndexConnectBlock(txdb, pindex);
+}
+
+bool InitSpentIndex()
+{
+    fSpentIndex = GetBoolArg("-spentindex");
+
+    CTxDB txdb;
+    int nHeight = -1;
+    bool fHaveIndex = txdb.ReadSpentIndexHeight(nHeight);
+    if (!fSpentIndex)
+    {
+        // Blocks connected from now on aren't indexed, so what is there goes stale
+        if (fHaveIndex && !txdb.EraseSpentIndexHeight())
+            return error("InitSpentIndex() : failed to disable the spent index");
+        return true;
+    }
+
+    if (!fHaveIndex || nHeight > nBestHeight)
+    {
+        printf("Wiping spent index...\n");
+        if (!txdb.WipeSpentIndex())
+            return error("InitSpentIndex() : failed to wipe the spent index");
+        nHeight = 0;        // the genesis block spends nothing
+    }
+    if (nHeight >= nBestHeight)
+        return true;
+
+    uiInterface.InitMessage(_("Building spent index..."));
+    return BuildChainIndex(txdb, nHeight, SpentIndexBuildBlock, SPENTINDEX_BUILD_BATCH, "spent index");
+}
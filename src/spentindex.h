@@ -0,0 +1,60 @@
+// Copyright (c) 2013 The DeOxyRibose developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_SPENTINDEX_H
+#define BITCOIN_SPENTINDEX_H
+
+#include <map>
+
+#include "addrindex.h"
+#include "serialize.h"
+#include "uint256.h"
+
+class CBlock;
+class CBlockIndex;
+class CTransaction;
+class CTxDB;
+class CTxIndex;
+
+/** Blocks are indexed in database transactions of about this many transactions while the index is built */
+static const unsigned int SPENTINDEX_BUILD_BATCH = 500;
+
+/** Whether the spent index (-spentindex) is maintained */
+extern bool fSpentIndex;
+
+/** Where an output was spent, and what it was worth to whom */
+class CSpentIndexValue
+{
+public:
+    uint256 txid;           // spending transaction
+    unsigned int nIn;       // its input spending the output
+    int nHeight;            // height of the block it was spent in
+    int64 nValue;           // value of the spent output
+    CAddrIndexKey addr;     // address it paid, nType 0 if none
+
+    CSpentIndexValue() : txid(0), nIn(0), nHeight(0), nValue(0) {}
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(txid);
+        READWRITE(nIn);
+        READWRITE(nHeight);
+        READWRITE(nValue);
+        READWRITE(addr);
+    )
+};
+
+/** Record the outputs tx spends, given the previous transactions ConnectBlock fetched */
+bool SpentIndexConnectInputs(CTxDB& txdb, const CTransaction& tx,
+                             const std::map<uint256, std::pair<CTxIndex, CTransaction> >& mapInputs, int nHeight);
+
+/** Mark block's spends as recorded, after SpentIndexConnectInputs was called for all its transactions */
+bool SpentIndexConnectBlock(CTxDB& txdb, const CBlockIndex* pindex);
+
+/** Forget the outputs block spent while it is disconnected */
+bool SpentIndexDisconnectBlock(CTxDB& txdb, const CBlock& block, const CBlockIndex* pindex);
+
+/** Build, resume or disable the spent index at startup, like InitAddrIndex */
+bool InitSpentIndex();
+
+#endif
@@ -0,0 +1,610 @@
+// Copyright (c) 2013 The DeOxyRibose developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include "stratum.h"
+#include "init.h"
+#include "main.h"
+#include "net.h"
+#include "bitcoinrpc.h"
+
+using namespace std;
+using namespace json_spirit;
+
+/** Longest request line a miner may send */
+static const unsigned int MAX_STRATUM_LINE = 16 * 1024;
+/** Miner connections served at once */
+static const unsigned int MAX_STRATUM_CONNECTIONS = 256;
+/** Seconds before a changed memory pool is handed out as a new job */
+static const int64 STRATUM_JOB_REFRESH = 60;
+/** Jobs of the current tip a share may still be submitted against */
+static const unsigned int MAX_STRATUM_JOBS = 8;
+/** Seconds a miner may roll ntime past the job's */
+static const unsigned int STRATUM_MAX_NTIME_ROLL = 600;
+/** Seconds a connection gets to subscribe */
+static const int64 STRATUM_SUBSCRIBE_TIMEOUT = 60;
+
+// Error codes of the stratum protocol
+enum StratumErrorCode
+{
+    STRATUM_OTHER           = 20,
+    STRATUM_JOB_NOT_FOUND   = 21,
+    STRATUM_DUPLICATE_SHARE = 22,
+    STRATUM_LOW_DIFFICULTY  = 23,
+    STRATUM_UNAUTHORIZED    = 24,
+    STRATUM_NOT_SUBSCRIBED  = 25,
+};
+
+void StratumCoinbaseSplit(CBlock* pblock, int nHeight, vector<unsigned char>& vchCoinb1, vector<unsigned char>& vchCoinb2)
+{
+    const unsigned int nSize = STRATUM_EXTRANONCE1_SIZE + STRATUM_EXTRANONCE2_SIZE;
+    CTransaction& txCoinbase = pblock->vtx[0];
+
+    // The extra nonce is where the coinbase with all ones differs from the one with all zeros
+    txCoinbase.vin[0].scriptSig = (CScript() << nHeight << vector<unsigned char>(nSize, 0xff)) + COINBASE_FLAGS;
+    CDataStream ssOnes(SER_NETWORK, PROTOCOL_VERSION);
+    ssOnes << txCoinbase;
+    txCoinbase.vin[0].scriptSig = (CScript() << nHeight << vector<unsigned char>(nSize, 0)) + COINBASE_FLAGS;
+    CDataStream ssZeros(SER_NETWORK, PROTOCOL_VERSION);
+    ssZeros << txCoinbase;
+
+    unsigned int nPos = 0;
+    while (ssZeros[nPos] == ssOnes[nPos])
+        nPos++;
+    vchCoinb1.assign(ssZeros.begin(), ssZeros.begin() + nPos);
+    vchCoinb2.assign(ssZeros.begin() + nPos + nSize, ssZeros.end());
+
+    pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+}
+
+uint256 StratumShareTarget(double dDifficulty)
+{
+    dDifficulty = max(STRATUM_MIN_DIFFICULTY, min(STRATUM_MAX_DIFFICULTY, dDifficulty));
+
+    // Fixed point with 16 fractional bits, so difficulties below 1 work too
+    CBigNum bnTarget = CBigNum().SetCompact(0x1d00ffff) * 65536;
+    bnTarget /= CBigNum((uint64)(dDifficulty * 65536 + 0.5));
+    return bnTarget.getuint256();
+}
+
+struct CStratumJob
+{
+    string strId;
+    CBlock block;                   // coinbase holds a zero extra nonce
+    CBlockIndex* pindexPrev;
+    vector<unsigned char> vchCoinb1;
+    vector<unsigned char> vchCoinb2;
+    vector<uint256> vMerkleBranch;
+    set<string> setSubmitted;
+};
+
+class CStratumClient
+{
+public:
+    SOCKET hSocket;
+    CAddress addr;
+    string strRecv;
+    string strSend;
+    vector<unsigned char> vchExtraNonce1;
+    bool fSubscribed;
+    bool fAuthorized;
+    bool fDisconnect;
+    double dDifficulty;
+    int64 nTimeConnected;
+    int nAccepted;
+    int nRejected;
+
+    CStratumClient(SOCKET hSocketIn, const CAddress& addrIn, unsigned int nExtraNonce1, double dDifficultyIn)
+        : hSocket(hSocketIn), addr(addrIn), fSubscribed(false), fAuthorized(false), fDisconnect(false),
+          dDifficulty(dDifficultyIn), nTimeConnected(GetTime()), nAccepted(0), nRejected(0)
+    {
+        vchExtraNonce1.assign((unsigned char*)&nExtraNonce1, (unsigned char*)&nExtraNonce1 + STRATUM_EXTRANONCE1_SIZE);
+    }
+
+    void Send(const Object& obj)
+    {
+        strSend += write_string(Value(obj), false) + "\n";
+    }
+
+    void Notify(const string& strMethod, const Array& params)
+    {
+        Object notification;
+        notification.push_back(Pair("id", Value::null));
+        notification.push_back(Pair("method", strMethod));
+        notification.push_back(Pair("params", params));
+        Send(notification);
+    }
+};
+
+class CStratumServer
+{
+private:
+    SOCKET hListenSocket;
+    list<CStratumClient*> lClients;
+    map<unsigned int, boost::shared_ptr<CStratumJob> > mapJobs;
+    unsigned int nJobId;
+    unsigned int nExtraNonce1;
+    CBlockIndex* pindexJobPrev;
+    unsigned int nJobTxUpdated;
+    int64 nJobStart;
+    int64 nRetryAfter;
+    double dDefaultDifficulty;
+    CReserveKey reservekey;
+
+    bool Listen();
+    bool ClientAllowed(const CNetAddr& addr) const;
+    void AcceptConnection();
+    bool UpdateJob(bool& fClean);
+    void SendJob(CStratumClient* pclient, bool fClean);
+    void SetDifficulty(CStratumClient* pclient, double dDifficulty);
+    void ProcessLine(CStratumClient* pclient, const string& strLine);
+    bool Submit(CStratumClient* pclient, const Array& params, string& strError, int& nError);
+
+public:
+    CStratumServer() : hListenSocket(INVALID_SOCKET), nJobId(0), nExtraNonce1(GetRand(0xffffffff)),
+                       pindexJobPrev(NULL), nJobTxUpdated(0), nJobStart(0), nRetryAfter(0),
+                       dDefaultDifficulty(1.0), reservekey(pwalletMain) {}
+    ~CStratumServer();
+
+    void Run();
+};
+
+CStratumServer::~CStratumServer()
+{
+    BOOST_FOREACH(CStratumClient* pclient, lClients)
+    {
+        closesocket(pclient->hSocket);
+        delete pclient;
+    }
+    if (hListenSocket != INVALID_SOCKET)
+        closesocket(hListenSocket);
+}
+
+bool CStratumServer::Listen()
+{
+    // Only loopback unless other miners are allowed in
+    struct in_addr inaddr;
+    inaddr.s_addr = mapArgs.count("-stratumallowip") ? INADDR_ANY : htonl(INADDR_LOOPBACK);
+    CService addrBind(inaddr, GetArg("-stratumport", DEFAULT_STRATUM_PORT));
+    return ListenLineServer(addrBind, hListenSocket, "Stratum");
+}
+
+bool CStratumServer::ClientAllowed(const CNetAddr& addr) const
+{
+    if (addr.IsLocal())
+        return true;
+    const string strAddress = addr.ToStringIP();
+    BOOST_FOREACH(const string& strAllow, mapMultiArgs["-stratumallowip"])
+        if (WildcardMatch(strAddress, strAllow))
+            return true;
+    return false;
+}
+
+void CStratumServer::AcceptConnection()
+{
+    CAddress addr;
+    SOCKET hSocket = AcceptLineClient(hListenSocket, addr, "Stratum");
+    if (hSocket == INVALID_SOCKET)
+        return;
+    if (!ClientAllowed(addr) || lClients.size() >= MAX_STRATUM_CONNECTIONS)
+    {
+        printf("Stratum: connection from %s refused\n", addr.ToString().c_str());
+        closesocket(hSocket);
+        return;
+    }
+
+    if (fDebug)
+        printf("Stratum: miner connected from %s\n", addr.ToString().c_str());
+    lClients.push_back(new CStratumClient(hSocket, addr, nExtraNonce1++, dDefaultDifficulty));
+}
+
+bool CStratumServer::UpdateJob(bool& fClean)
+{
+    if (vNodes.empty() || IsInitialBlockDownload() || GetTime() < nRetryAfter)
+        return false;
+
+    // New job when the tip moved, or every minute while the memory pool changes
+    fClean = (pindexJobPrev != pindexBest);
+    if (!fClean && (nTransactionsUpdated == nJobTxUpdated || GetTime() - nJobStart < STRATUM_JOB_REFRESH))
+        return false;
+
+    boost::shared_ptr<CStratumJob> job(new CStratumJob());
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        unsigned int nTxUpdated = nTransactionsUpdated;
+        CBlockIndex* pindexPrev = pindexBest;
+
+        auto_ptr<CBlock> pblock(CreateNewBlock(pwalletMain));
+        if (!pblock.get())
+        {
+            nRetryAfter = GetTime() + 5;
+            return error("Stratum: CreateNewBlock failed");
+        }
+        pblock->UpdateTime(pindexPrev);
+        pblock->nNonce = 0;
+        StratumCoinbaseSplit(pblock.get(), pindexPrev->nHeight + 1, job->vchCoinb1, job->vchCoinb2);
+
+        job->block = *pblock;
+        job->pindexPrev = pindexPrev;
+        job->vMerkleBranch = job->block.GetMerkleBranch(0);
+        job->strId = strprintf("%x", ++nJobId);
+
+        pindexJobPrev = pindexPrev;
+        nJobTxUpdated = nTxUpdated;
+        nJobStart = GetTime();
+    }
+
+    // Shares for the old tip are worthless
+    if (fClean)
+        mapJobs.clear();
+    mapJobs[nJobId] = job;
+    while (mapJobs.size() > MAX_STRATUM_JOBS)
+        mapJobs.erase(mapJobs.begin());
+    return true;
+}
+
+void CStratumServer::SendJob(CStratumClient* pclient, bool fClean)
+{
+    if (mapJobs.empty())
+        return;
+    const CStratumJob& job = *(*mapJobs.rbegin()).second;
+
+    // Miners expect the previous hash with every 32-bit word byte swapped
+    uint256 hashPrev = job.block.hashPrevBlock;
+    for (unsigned int i = 0; i < 8; i++)
+        ((unsigned int*)hashPrev.begin())[i] = ByteReverse(((unsigned int*)hashPrev.begin())[i]);
+
+    Array branch;
+    BOOST_FOREACH(const uint256& hash, job.vMerkleBranch)
+        branch.push_back(HexStr(hash.begin(), hash.end()));
+
+    Array params;
+    params.push_back(job.strId);
+    params.push_back(HexStr(hashPrev.begin(), hashPrev.end()));
+    params.push_back(HexStr(job.vchCoinb1));
+    params.push_back(HexStr(job.vchCoinb2));
+    params.push_back(branch);
+    params.push_back(strprintf("%08x", job.block.nVersion));
+    params.push_back(strprintf("%08x", job.block.nBits));
+    params.push_back(strprintf("%08x", job.block.nTime));
+    params.push_back(fClean);
+    pclient->Notify("mining.notify", params);
+}
+
+void CStratumServer::SetDifficulty(CStratumClient* pclient, double dDifficulty)
+{
+    pclient->dDifficulty = max(STRATUM_MIN_DIFFICULTY, min(STRATUM_MAX_DIFFICULTY, dDifficulty));
+    Array params;
+    params.push_back(pclient->dDifficulty);
+    pclient->Notify("mining.set_difficulty", params);
+}
+
+static bool ParseHexUint(const Value& value, unsigned int& n)
+{
+    if (value.type() != str_type)
+        return false;
+    const string& str = value.get_str();
+    if (str.size() != 8 || !IsHex(str))
+        return false;
+    n = strtoul(str.c_str(), NULL, 16);
+    return true;
+}
+
+bool CStratumServer::Submit(CStratumClient* pclient, const Array& params, string& strError, int& nError)
+{
+    nError = STRATUM_OTHER;
+    if (!pclient->fSubscribed)
+    {
+        nError = STRATUM_NOT_SUBSCRIBED;
+        strError = "Not subscribed";
+        return false;
+    }
+    if (!pclient->fAuthorized)
+    {
+        nError = STRATUM_UNAUTHORIZED;
+        strError = "Unauthorized worker";
+        return false;
+    }
+
+    // params: worker, job id, extranonce2, ntime, nonce
+    unsigned int nTime, nNonce;
+    if (params.size() < 5 || params[1].type() != str_type || params[2].type() != str_type ||
+        !ParseHexUint(params[3], nTime) || !ParseHexUint(params[4], nNonce))
+    {
+        strError = "Invalid parameters";
+        return false;
+    }
+    vector<unsigned char> vchExtraNonce2 = ParseHex(params[2].get_str());
+    if (vchExtraNonce2.size() != STRATUM_EXTRANONCE2_SIZE || !IsHex(params[2].get_str()))
+    {
+        strError = "Invalid extranonce2 size";
+        return false;
+    }
+
+    map<unsigned int, boost::shared_ptr<CStratumJob> >::iterator mi = mapJobs.find(strtoul(params[1].get_str().c_str(), NULL, 16));
+    if (mi == mapJobs.end() || (*mi).second->strId != params[1].get_str())
+    {
+        nError = STRATUM_JOB_NOT_FOUND;
+        strError = "Job not found";
+        return false;
+    }
+    CStratumJob& job = *(*mi).second;
+
+    if (nTime < job.block.nTime || nTime > job.block.nTime + STRATUM_MAX_NTIME_ROLL)
+    {
+        strError = "Time out of range";
+        return false;
+    }
+
+    string strShare = HexStr(pclient->vchExtraNonce1) + params[2].get_str() + params[3].get_str() + params[4].get_str();
+    if (job.setSubmitted.count(strShare))
+    {
+        nError = STRATUM_DUPLICATE_SHARE;
+        strError = "Duplicate share";
+        return false;
+    }
+
+    // Rebuild the header the miner hashed
+    vector<unsigned char> vchCoinbase(job.vchCoinb1);
+    vchCoinbase.insert(vchCoinbase.end(), pclient->vchExtraNonce1.begin(), pclient->vchExtraNonce1.end());
+    vchCoinbase.insert(vchCoinbase.end(), vchExtraNonce2.begin(), vchExtraNonce2.end());
+    vchCoinbase.insert(vchCoinbase.end(), job.vchCoinb2.begin(), job.vchCoinb2.end());
+
+    CBlock header;
+    header.nVersion = job.block.nVersion;
+    header.hashPrevBlock = job.block.hashPrevBlock;
+    header.hashMerkleRoot = CBlock::CheckMerkleBranch(Hash(vchCoinbase.begin(), vchCoinbase.end()), job.vMerkleBranch, 0);
+    header.nTime = nTime;
+    header.nBits = job.block.nBits;
+    header.nNonce = nNonce;
+    uint256 hash = header.GetHash();
+
+    if (hash > StratumShareTarget(pclient->dDifficulty))
+    {
+        nError = STRATUM_LOW_DIFFICULTY;
+        strError = "Low difficulty share";
+        return false;
+    }
+    job.setSubmitted.insert(strShare);
+
+    if (hash <= CBigNum().SetCompact(job.block.nBits).getuint256())
+    {
+        CBlock block(job.block);
+        CDataStream ssCoinbase(vchCoinbase, SER_NETWORK, PROTOCOL_VERSION);
+        ssCoinbase >> block.vtx[0];
+        block.vMerkleTree.clear();
+        block.hashMerkleRoot = header.hashMerkleRoot;
+        block.nTime = nTime;
+        block.nNonce = nNonce;
+
+        printf("Stratum: block found by %s\n", pclient->addr.ToString().c_str());
+        if (!block.SignBlock(*pwalletMain))
+            printf("Stratum: unable to sign block, wallet locked?\n");
+        else
+            CheckWork(&block, *pwalletMain, reservekey);
+    }
+    return true;
+}
+
+void CStratumServer::ProcessLine(CStratumClient* pclient, const string& strLine)
+{
+    Value valRequest;
+    if (!read_string(strLine, valRequest) || valRequest.type() != obj_type)
+    {
+        printf("Stratum: garbage from %s\n", pclient->addr.ToString().c_str());
+        pclient->fDisconnect = true;
+        return;
+    }
+    const Object& request = valRequest.get_obj();
+    const Value& valMethod = find_value(request, "method");
+    if (valMethod.type() != str_type)
+        return;
+    const string& strMethod = valMethod.get_str();
+    const Value& valParams = find_value(request, "params");
+    Array params;
+    if (valParams.type() == array_type)
+        params = valParams.get_array();
+
+    Value result = Value::null;
+    int nError = 0;
+    string strError;
+    bool fSendJob = false;
+
+    if (strMethod == "mining.subscribe")
+    {
+        Array subscription;
+        subscription.push_back("mining.notify");
+        subscription.push_back(HexStr(pclient->vchExtraNonce1));
+        Array subscriptions;
+        subscriptions.push_back(subscription);
+
+        Array res;
+        res.push_back(subscriptions);
+        res.push_back(HexStr(pclient->vchExtraNonce1));
+        res.push_back((int)STRATUM_EXTRANONCE2_SIZE);
+        result = res;
+        pclient->fSubscribed = true;
+        fSendJob = true;
+    }
+    else if (strMethod == "mining.authorize")
+    {
+        // Access is by address; the password may carry d=<difficulty>
+        if (params.size() >= 2 && params[1].type() == str_type)
+        {
+            vector<string> vOptions;
+            boost::split(vOptions, params[1].get_str(), boost::is_any_of(",;"));
+            BOOST_FOREACH(const string& strOption, vOptions)
+                if (boost::starts_with(strOption, "d="))
+                    pclient->dDifficulty = atof(strOption.substr(2).c_str());
+        }
+        pclient->fAuthorized = true;
+        result = true;
+        fSendJob = pclient->fSubscribed;
+    }
+    else if (strMethod == "mining.suggest_difficulty")
+    {
+        if (params.size() >= 1 && (params[0].type() == real_type || params[0].type() == int_type))
+        {
+            pclient->dDifficulty = params[0].get_real();
+            fSendJob = pclient->fSubscribed && pclient->fAuthorized;
+        }
+        result = true;
+    }
+    else if (strMethod == "mining.submit")
+    {
+        if (Submit(pclient, params, strError, nError))
+        {
+            pclient->nAccepted++;
+            result = true;
+        }
+        else
+        {
+            pclient->nRejected++;
+            if (fDebug)
+                printf("Stratum: share from %s rejected: %s\n", pclient->addr.ToString().c_str(), strError.c_str());
+        }
+    }
+    else if (strMethod == "mining.extranonce.subscribe")
+        result = false;
+    else
+    {
+        nError = STRATUM_OTHER;
+        strError = "Method not found";
+    }
+
+    Object reply;
+    reply.push_back(Pair("id", find_value(request, "id")));
+    reply.push_back(Pair("result", result));
+    if (nError)
+    {
+        Array error;
+        error.push_back(nError);
+        error.push_back(strError);
+        error.push_back(Value::null);
+        reply.push_back(Pair("error", error));
+    }
+    else
+        reply.push_back(Pair("error", Value::null));
+    pclient->Send(reply);
+
+    // New difficulty applies from the job sent along with it
+    if (fSendJob && pclient->fAuthorized)
+    {
+        SetDifficulty(pclient, pclient->dDifficulty);
+        SendJob(pclient, true);
+    }
+}
+
+void CStratumServer::Run()
+{
+    dDefaultDifficulty = atof(GetArg("-stratumdifficulty", "1").c_str());
+    if (!Listen())
+        return;
+
+    while (!fShutdown)
+    {
+        bool fClean = false;
+        if (UpdateJob(fClean))
+        {
+            BOOST_FOREACH(CStratumClient* pclient, lClients)
+                if (pclient->fSubscribed && pclient->fAuthorized)
+                    SendJob(pclient, fClean);
+        }
+
+        struct timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 100000;
+
+        fd_set fdsetRecv;
+        fd_set fdsetSend;
+        FD_ZERO(&fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        SOCKET hSocketMax = hListenSocket;
+        FD_SET(hListenSocket, &fdsetRecv);
+        BOOST_FOREACH(CStratumClient* pclient, lClients)
+        {
+            FD_SET(pclient->hSocket, &fdsetRecv);
+            if (!pclient->strSend.empty())
+                FD_SET(pclient->hSocket, &fdsetSend);
+            hSocketMax = max(hSocketMax, pclient->hSocket);
+        }
+
+        if (select(hSocketMax + 1, &fdsetRecv, &fdsetSend, NULL, &timeout) == SOCKET_ERROR)
+        {
+            printf("Stratum: select failed: %d\n", WSAGetLastError());
+            Sleep(100);
+            continue;
+        }
+
+        if (FD_ISSET(hListenSocket, &fdsetRecv))
+            AcceptConnection();
+
+        BOOST_FOREACH(CStratumClient* pclient, lClients)
+        {
+            if (FD_ISSET(pclient->hSocket, &fdsetRecv))
+            {
+                vector<string> vLines;
+                bool fOpen = RecvLines(pclient->hSocket, pclient->strRecv, vLines, MAX_STRATUM_LINE);
+                BOOST_FOREACH(const string& strLine, vLines)
+                {
+                    if (pclient->fDisconnect)
+                        break;
+                    ProcessLine(pclient, strLine);
+                }
+                if (!fOpen)
+                    pclient->fDisconnect = true;
+            }
+
+            if (!pclient->fDisconnect && !pclient->strSend.empty() && FD_ISSET(pclient->hSocket, &fdsetSend))
+            {
+                size_t nSent;
+                if (!SendNonBlocking(pclient->hSocket, pclient->strSend.data(), pclient->strSend.size(), nSent))
+                    pclient->fDisconnect = true;
+                pclient->strSend.erase(0, nSent);
+            }
+
+            if (!pclient->fSubscribed && GetTime() - pclient->nTimeConnected > STRATUM_SUBSCRIBE_TIMEOUT)
+                pclient->fDisconnect = true;
+        }
+
+        for (list<CStratumClient*>::iterator it = lClients.begin(); it != lClients.end(); )
+        {
+            CStratumClient* pclient = *it;
+            if (!pclient->fDisconnect)
+            {
+                ++it;
+                continue;
+            }
+            if (fDebug)
+                printf("Stratum: miner %s disconnected, %d shares accepted, %d rejected\n",
+                       pclient->addr.ToString().c_str(), pclient->nAccepted, pclient->nRejected);
+            closesocket(pclient->hSocket);
+            delete pclient;
+            it = lClients.erase(it);
+        }
+    }
+}
+
+void ThreadStratumServer(void* parg)
+{
+    // Make this thread recognisable as the stratum server thread
+    RenameThread("bitcoin-stratum");
+
+    vnThreadsRunning[THREAD_STRATUM]++;
+    try
+    {
+        CStratumServer server;
+        server.Run();
+    }
+    catch (std::exception& e) {
+        PrintException(&e, "ThreadStratumServer()");
+    } catch (...) {
+        PrintException(NULL, "ThreadStratumServer()");
+    }
+    vnThreadsRunning[THREAD_STRATUM]--;
+    printf("ThreadStratumServer exited\n");
+}
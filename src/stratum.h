@@ -0,0 +1,36 @@
+// Copyright (c) 2013 The DeOxyRibose developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_STRATUM_H
+#define BITCOIN_STRATUM_H
+
+#include <vector>
+
+#include "uint256.h"
+
+class CBlock;
+
+/** Port the stratum server listens on unless -stratumport says otherwise */
+static const unsigned short DEFAULT_STRATUM_PORT = 3333;
+/** Extra nonce bytes fixed by the server per connection, and rolled by the miner */
+static const unsigned int STRATUM_EXTRANONCE1_SIZE = 4;
+static const unsigned int STRATUM_EXTRANONCE2_SIZE = 4;
+/** Bounds on the share difficulty a connection may ask for */
+static const double STRATUM_MIN_DIFFICULTY = 1.0 / 65536;
+static const double STRATUM_MAX_DIFFICULTY = 1000000000.0;
+
+/**
+ * Lay out the coinbase of pblock the way IncrementExtraNonce does, with a
+ * fixed-size extra nonce of STRATUM_EXTRANONCE1_SIZE + STRATUM_EXTRANONCE2_SIZE
+ * bytes after the height.  Returns the serialized coinbase before and after
+ * the extra nonce (stratum's coinb1 and coinb2).
+ */
+void StratumCoinbaseSplit(CBlock* pblock, int nHeight, std::vector<unsigned char>& vchCoinb1, std::vector<unsigned char>& vchCoinb2);
+
+/** Hash target of a share of the given difficulty, difficulty 1 being 0x1d00ffff */
+uint256 StratumShareTarget(double dDifficulty);
+
+/** Serve stratum miners on -stratumport until shutdown */
+void ThreadStratumServer(void* parg);
+
+#endif
@@ -0,0 +1,44 @@
+#include <boost/test/unit_test.hpp>
+
+#include "addrindex.h"
+#include "key.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(addrindex_tests)
+
+BOOST_AUTO_TEST_CASE(addrindex_key)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CKeyID keyID = key.GetPubKey().GetID();
+
+    // Pay-to-pubkey and pay-to-pubkey-hash outputs index under the same address
+    CScript scriptPubKey;
+    scriptPubKey << key.GetPubKey() << OP_CHECKSIG;
+    CAddrIndexKey addrPubKey;
+    BOOST_CHECK(addrPubKey.Set(scriptPubKey));
+
+    scriptPubKey.SetDestination(keyID);
+    CAddrIndexKey addrKeyID;
+    BOOST_CHECK(addrKeyID.Set(scriptPubKey));
+    BOOST_CHECK_EQUAL(addrKeyID.nType, CAddrIndexKey::KEYID);
+    BOOST_CHECK(addrKeyID.hash == addrPubKey.hash);
+    BOOST_CHECK(addrKeyID.Get() == CTxDestination(keyID));
+
+    // P2SH is told apart from a key with the same hash
+    CScriptID scriptID(keyID);
+    scriptPubKey.SetDestination(scriptID);
+    CAddrIndexKey addrScriptID;
+    BOOST_CHECK(addrScriptID.Set(scriptPubKey));
+    BOOST_CHECK_EQUAL(addrScriptID.nType, CAddrIndexKey::SCRIPTID);
+    BOOST_CHECK(addrKeyID < addrScriptID);
+
+    // Nothing to index for bare data
+    scriptPubKey.clear();
+    scriptPubKey << OP_RETURN;
+    CAddrIndexKey addrNone;
+    BOOST_CHECK(!addrNone.Set(scriptPubKey));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,50 @@
+#include <boost/test/unit_test.hpp>
+
+#include "bloom.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(bloom_tests)
+
+BOOST_AUTO_TEST_CASE(murmurhash3)
+{
+    // Test vectors from the reference x86_32 implementation
+    BOOST_CHECK_EQUAL(MurmurHash3(0x00000000, vector<unsigned char>(1, 0x00)), 0x514E28B7U);
+    BOOST_CHECK_EQUAL(MurmurHash3(0xFBA4C795, vector<unsigned char>(1, 0x00)), 0xEA3F0B17U);
+    BOOST_CHECK_EQUAL(MurmurHash3(0x00000000, vector<unsigned char>(1, 0xff)), 0xFD6CF10DU);
+}
+
+BOOST_AUTO_TEST_CASE(rolling_bloom)
+{
+    // Last 100 entries, 1% false positive rate
+    CRollingBloomFilter rb(100, 0.01);
+
+    vector<uint256> vData;
+    for (int i = 0; i < 399; i++)
+        vData.push_back(GetRandHash());
+
+    for (int i = 0; i < 399; i++)
+    {
+        rb.insert(vData[i]);
+        // The most recent 100 entries must always be found
+        for (int j = max(0, i - 99); j <= i; j++)
+            BOOST_CHECK(rb.contains(vData[j]));
+    }
+
+    // Entries never inserted are only rarely found
+    int nHits = 0;
+    for (int i = 0; i < 10000; i++)
+        if (rb.contains(GetRandHash()))
+            ++nHits;
+    BOOST_CHECK(nHits < 300);
+
+    rb.reset();
+    nHits = 0;
+    for (int i = 0; i < 399; i++)
+        if (rb.contains(vData[i]))
+            ++nHits;
+    BOOST_CHECK(nHits < 12);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,133 @@
+#include <boost/test/unit_test.hpp>
+
+#include "net.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(download_tests)
+
+BOOST_AUTO_TEST_CASE(download_preferred_and_timeout)
+{
+    CDownloadScheduler sched;
+    CInv inv(MSG_TX, GetRandHash());
+    int64 nNow = 1000000000;
+    vector<CInv> vRequest;
+
+    sched.Announce(1, inv, nNow);
+    sched.Announce(2, inv, nNow);
+
+    // Both look alike, so the first announcer is preferred and the other waits
+    sched.GetRequests(2, nNow, vRequest);
+    BOOST_CHECK(vRequest.empty());
+    sched.GetRequests(1, nNow, vRequest);
+    BOOST_CHECK_EQUAL(vRequest.size(), 1U);
+
+    // Not asked twice while outstanding
+    vRequest.clear();
+    sched.GetRequests(1, nNow + 1, vRequest);
+    sched.GetRequests(2, nNow + DOWNLOAD_PREFERRED_WAIT, vRequest);
+    BOOST_CHECK(vRequest.empty());
+
+    int nInFlight;
+    int64 nAvgResponse;
+    BOOST_CHECK(sched.GetPeerStats(1, nInFlight, nAvgResponse));
+    BOOST_CHECK_EQUAL(nInFlight, 1);
+
+    // Peer 1 never answers; once the request expires peer 2 gets it
+    int64 nLater = nNow + DOWNLOAD_TX_TIMEOUT + 4 * DOWNLOAD_DEFAULT_RESPONSE + 1;
+    sched.GetRequests(2, nLater, vRequest);
+    BOOST_CHECK_EQUAL(vRequest.size(), 1U);
+    BOOST_CHECK(sched.GetPeerStats(1, nInFlight, nAvgResponse));
+    BOOST_CHECK_EQUAL(nInFlight, 0);
+    BOOST_CHECK(nAvgResponse > DOWNLOAD_DEFAULT_RESPONSE);
+
+    // Delivery frees the slot
+    sched.Received(2, inv, 250, nLater + 50000);
+    BOOST_CHECK(sched.GetPeerStats(2, nInFlight, nAvgResponse));
+    BOOST_CHECK_EQUAL(nInFlight, 0);
+    BOOST_CHECK(nAvgResponse < DOWNLOAD_DEFAULT_RESPONSE);
+}
+
+BOOST_AUTO_TEST_CASE(download_disconnect)
+{
+    CDownloadScheduler sched;
+    CInv inv(MSG_BLOCK, GetRandHash());
+    int64 nNow = 1000000000;
+    vector<CInv> vRequest;
+
+    sched.Announce(1, inv, nNow);
+    sched.Announce(2, inv, nNow);
+    sched.GetRequests(1, nNow, vRequest);
+    BOOST_CHECK_EQUAL(vRequest.size(), 1U);
+
+    // What peer 1 owed is handed to peer 2 straight away
+    sched.PeerDisconnected(1);
+    vRequest.clear();
+    sched.GetRequests(2, nNow + 1, vRequest);
+    BOOST_CHECK_EQUAL(vRequest.size(), 1U);
+
+    int nInFlight;
+    int64 nAvgResponse;
+    BOOST_CHECK(!sched.GetPeerStats(1, nInFlight, nAvgResponse));
+}
+
+BOOST_AUTO_TEST_CASE(download_rejected)
+{
+    CDownloadScheduler sched;
+    CInv inv(MSG_BLOCK, GetRandHash());
+    int64 nNow = 1000000000;
+    vector<CInv> vRequest;
+
+    sched.Announce(1, inv, nNow);
+    sched.Announce(2, inv, nNow);
+    sched.Announce(3, inv, nNow);
+    sched.GetRequests(1, nNow, vRequest);
+    BOOST_CHECK_EQUAL(vRequest.size(), 1U);
+
+    // Nobody else is asked while what peer 1 sent is being validated
+    sched.Received(1, inv, 1000, nNow + 100000);
+    vRequest.clear();
+    sched.GetRequests(2, nNow + 2 * DOWNLOAD_PREFERRED_WAIT, vRequest);
+    sched.GetRequests(3, nNow + 2 * DOWNLOAD_PREFERRED_WAIT, vRequest);
+    BOOST_CHECK(vRequest.empty());
+
+    // Rejected: the remaining announcers get it, peer 1 doesn't
+    int64 nLater = nNow + 3 * DOWNLOAD_PREFERRED_WAIT;
+    sched.Rejected(inv);
+    sched.GetRequests(1, nLater, vRequest);
+    BOOST_CHECK(vRequest.empty());
+    sched.GetRequests(2, nLater, vRequest);
+    BOOST_CHECK_EQUAL(vRequest.size(), 1U);
+
+    // Accepted: dropped for everyone
+    sched.Received(2, inv, 1000, nLater + 100000);
+    sched.Forget(inv);
+    vRequest.clear();
+    sched.Rejected(inv);
+    sched.GetRequests(3, nLater + 2 * DOWNLOAD_PREFERRED_WAIT, vRequest);
+    BOOST_CHECK(vRequest.empty());
+}
+
+BOOST_AUTO_TEST_CASE(download_in_flight_cap)
+{
+    CDownloadScheduler sched;
+    int64 nNow = 1000000000;
+    vector<CInv> vRequest;
+
+    for (int i = 0; i < DOWNLOAD_MIN_IN_FLIGHT * 2; i++)
+        sched.Announce(1, CInv(MSG_TX, GetRandHash()), nNow);
+
+    // Nothing measured yet, so the peer starts at the minimum
+    sched.GetRequests(1, nNow, vRequest);
+    BOOST_CHECK_EQUAL(vRequest.size(), (unsigned int)DOWNLOAD_MIN_IN_FLIGHT);
+
+    // Answers free up room for the rest
+    for (unsigned int i = 0; i < 4; i++)
+        sched.Received(1, vRequest[i], 250, nNow + 100000);
+    vRequest.clear();
+    sched.GetRequests(1, nNow + 100000, vRequest);
+    BOOST_CHECK_EQUAL(vRequest.size(), 4U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,51 @@
+#include <boost/test/unit_test.hpp>
+
+#include "eventserver.h"
+#include "main.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(eventserver_tests)
+
+BOOST_AUTO_TEST_CASE(event_frame_layout)
+{
+    uint256 hash = 0;
+    hash.SetHex("000000000000000000000000000000000000000000000000000000000000abcd");
+
+    vector<char> vchFrame;
+    MakeEventFrame("hashblock", 0x01020304, hash.begin(), hash.size(), vchFrame);
+
+    // size, "hashblock" with a one byte compact size, sequence, 32 byte hash
+    BOOST_CHECK_EQUAL(vchFrame.size(), 4U + 1 + 9 + 4 + 32);
+    const unsigned char* p = (const unsigned char*)&vchFrame[0];
+    BOOST_CHECK_EQUAL(p[0], 1 + 9 + 4 + 32);
+    BOOST_CHECK_EQUAL(p[1], 0);
+    BOOST_CHECK_EQUAL(p[2], 0);
+    BOOST_CHECK_EQUAL(p[3], 0);
+    BOOST_CHECK_EQUAL(p[4], 9);
+    BOOST_CHECK(string(&vchFrame[5], 9) == "hashblock");
+    BOOST_CHECK_EQUAL(p[14], 0x04);
+    BOOST_CHECK_EQUAL(p[15], 0x03);
+    BOOST_CHECK_EQUAL(p[16], 0x02);
+    BOOST_CHECK_EQUAL(p[17], 0x01);
+    BOOST_CHECK(memcmp(&p[18], hash.begin(), 32) == 0);
+    BOOST_CHECK_EQUAL(p[18], 0xcd);
+    BOOST_CHECK_EQUAL(p[19], 0xab);
+
+    // A serialized transaction goes in as is, after the same header
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+    ssTx << tx;
+    MakeEventFrame("rawtx", 7, &ssTx[0], ssTx.size(), vchFrame);
+    BOOST_CHECK_EQUAL(vchFrame.size(), 4 + 1 + 5 + 4 + ssTx.size());
+    unsigned int nFrameSize;
+    memcpy(&nFrameSize, &vchFrame[0], 4);
+    BOOST_CHECK_EQUAL(nFrameSize, vchFrame.size() - 4);
+    BOOST_CHECK(string(&vchFrame[5], 5) == "rawtx");
+    BOOST_CHECK_EQUAL(vchFrame[10], 7);
+    BOOST_CHECK(string(vchFrame.begin() + 14, vchFrame.end()) == ssTx.str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "key.h"
+#include "keystore.h"
 #include "base58.h"
 #include "uint256.h"
 #include "util.h"
@@ -144,4 +145,44 @@ BOOST_AUTO_TEST_CASE(key_test1)
     }
 }
 
+// Exposes what CWallet uses to encrypt and unlock its key store
+class CTestCryptoKeyStore : public CCryptoKeyStore
+{
+public:
+    using CCryptoKeyStore::EncryptKeys;
+    using CCryptoKeyStore::Unlock;
+};
+
+BOOST_AUTO_TEST_CASE(key_cache_test)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CKeyID keyID = key.GetPubKey().GetID();
+
+    CTestCryptoKeyStore keystore;
+    BOOST_CHECK(keystore.AddKey(key));
+    CKeyingMaterial vMasterKey(32, 0x42);
+    BOOST_CHECK(keystore.EncryptKeys(vMasterKey));
+    BOOST_CHECK(keystore.IsLocked());
+
+    CKey keyOut;
+    BOOST_CHECK(!keystore.GetKey(keyID, keyOut));
+    BOOST_CHECK_EQUAL(keystore.GetKeyCacheSize(), 0U);
+
+    // Decrypted once, then served from the cache
+    BOOST_CHECK(keystore.Unlock(vMasterKey));
+    BOOST_CHECK(keystore.GetKey(keyID, keyOut));
+    BOOST_CHECK(keyOut.GetPubKey() == key.GetPubKey());
+    BOOST_CHECK_EQUAL(keystore.GetKeyCacheSize(), 1U);
+    CKey keyCached;
+    BOOST_CHECK(keystore.GetKey(keyID, keyCached));
+    BOOST_CHECK(keyCached.GetPubKey() == key.GetPubKey());
+    BOOST_CHECK_EQUAL(keystore.GetKeyCacheSize(), 1U);
+
+    // Locking forgets the decrypted keys
+    BOOST_CHECK(keystore.Lock());
+    BOOST_CHECK_EQUAL(keystore.GetKeyCacheSize(), 0U);
+    BOOST_CHECK(!keystore.GetKey(keyID, keyOut));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,132 @@
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(mempool_tests)
+
+static CTransaction MakeTx(const uint256& hashPrev, unsigned int nOut, unsigned int nOutputs)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(hashPrev, nOut);
+    tx.vin[0].scriptSig << OP_1;
+    tx.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++)
+    {
+        tx.vout[i].nValue = 1*COIN;
+        tx.vout[i].scriptPubKey << OP_1;
+    }
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(mempool_descendant_accounting)
+{
+    CTxMemPool pool;
+
+    CTransaction txParent = MakeTx(GetRandHash(), 0, 2);
+    uint256 hashParent = txParent.GetHash();
+    pool.addUnchecked(hashParent, txParent, 1000);
+
+    CTransaction txChild = MakeTx(hashParent, 0, 1);
+    uint256 hashChild = txChild.GetHash();
+    pool.addUnchecked(hashChild, txChild, 50000);
+
+    CTransaction txGrandChild = MakeTx(hashChild, 0, 1);
+    uint256 hashGrandChild = txGrandChild.GetHash();
+    pool.addUnchecked(hashGrandChild, txGrandChild, 3000);
+
+    BOOST_CHECK_EQUAL(pool.mapInfo[hashParent].nFeesWithDescendants, 54000);
+    BOOST_CHECK_EQUAL(pool.mapInfo[hashChild].nFeesWithDescendants, 53000);
+    BOOST_CHECK_EQUAL(pool.mapInfo[hashGrandChild].nFeesWithDescendants, 3000);
+
+    set<uint256> setDescendants;
+    pool.CalculateDescendants(hashParent, setDescendants);
+    BOOST_CHECK_EQUAL(setDescendants.size(), 3U);
+
+    set<uint256> setAncestors;
+    pool.CalculateAncestors(txGrandChild, setAncestors);
+    BOOST_CHECK_EQUAL(setAncestors.size(), 2U);
+
+    // Removing the middle of the chain takes its spends with it
+    list<CTransaction> removed;
+    pool.remove(txChild, removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), 2U);
+    BOOST_CHECK_EQUAL(pool.size(), 1U);
+    BOOST_CHECK_EQUAL(pool.mapInfo[hashParent].nFeesWithDescendants, 1000);
+    BOOST_CHECK_EQUAL(pool.mapInfo[hashParent].nSizeWithDescendants, pool.mapInfo[hashParent].nTxSize);
+
+    pool.clear();
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_trim)
+{
+    CTxMemPool pool;
+
+    // A cheap standalone transaction and a cheap parent paid for by a rich child
+    CTransaction txCheap = MakeTx(GetRandHash(), 0, 1);
+    pool.addUnchecked(txCheap.GetHash(), txCheap, 100);
+
+    CTransaction txParent = MakeTx(GetRandHash(), 0, 1);
+    pool.addUnchecked(txParent.GetHash(), txParent, 100);
+    CTransaction txChild = MakeTx(txParent.GetHash(), 0, 1);
+    pool.addUnchecked(txChild.GetHash(), txChild, 12*COIN);
+
+    CTransaction txRich = MakeTx(GetRandHash(), 0, 1);
+    pool.addUnchecked(txRich.GetHash(), txRich, 5*COIN);
+
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1000000), 0);
+
+    // Trimming just below current usage evicts the cheapest package only
+    uint64 nUsage = pool.DynamicMemoryUsage();
+    BOOST_CHECK(nUsage > 0);
+    BOOST_CHECK_EQUAL(pool.TrimToSize(nUsage - 1), 1U);
+    BOOST_CHECK(!pool.exists(txCheap.GetHash()));
+    BOOST_CHECK(pool.exists(txParent.GetHash()));
+    BOOST_CHECK(pool.exists(txChild.GetHash()));
+    BOOST_CHECK(pool.GetMinFee(1000000) >= MIN_RELAY_TX_FEE);
+
+    // The parent's package outscores the standalone transaction, so it survives longer
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(!pool.exists(txRich.GetHash()));
+    BOOST_CHECK(pool.exists(txParent.GetHash()));
+
+    // Evicting a parent removes its spends too
+    pool.TrimToSize(0);
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_prioritise)
+{
+    CTxMemPool pool;
+
+    CTransaction txParent = MakeTx(GetRandHash(), 0, 1);
+    uint256 hashParent = txParent.GetHash();
+    pool.addUnchecked(hashParent, txParent, 1000);
+    CTransaction txChild = MakeTx(hashParent, 0, 1);
+    uint256 hashChild = txChild.GetHash();
+    pool.addUnchecked(hashChild, txChild, 2000);
+
+    // A delta on an in-pool child is credited to the parent's package as well
+    pool.PrioritiseTransaction(hashChild, 5000);
+    BOOST_CHECK_EQUAL(pool.mapInfo[hashChild].nFee, 7000);
+    BOOST_CHECK_EQUAL(pool.mapInfo[hashParent].nFeesWithDescendants, 8000);
+
+    // Deltas for unknown transactions are remembered and accumulate
+    uint256 hashUnknown = GetRandHash();
+    pool.PrioritiseTransaction(hashUnknown, 300);
+    pool.PrioritiseTransaction(hashUnknown, 200);
+    int64 nFee = 0;
+    pool.ApplyDeltas(hashUnknown, nFee);
+    BOOST_CHECK_EQUAL(nFee, 500);
+
+    // Cancelling a delta out forgets it
+    pool.PrioritiseTransaction(hashUnknown, -500);
+    BOOST_CHECK_EQUAL(pool.mapDeltas.count(hashUnknown), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -250,6 +250,44 @@ BOOST_AUTO_TEST_CASE(multisig_Solver1)
     }
 }
 
+BOOST_AUTO_TEST_CASE(multisig_watchonly_lookup)
+{
+    // IsMine() of watch-only scripts, and ExtractLookupHashes() which
+    // finds the wallets to ask it
+    CBasicKeyStore keystore;
+    CKey key[2];
+    for (int i = 0; i < 2; i++)
+        key[i].MakeNewKey(true);
+
+    CScript p2pkh;
+    p2pkh.SetDestination(key[0].GetPubKey().GetID());
+    CScript multisig;
+    multisig << OP_1 << key[0].GetPubKey() << key[1].GetPubKey() << OP_2 << OP_CHECKMULTISIG;
+    CScript nonstandard;
+    nonstandard << OP_RETURN << OP_1;
+
+    BOOST_CHECK(!IsMine(keystore, p2pkh));
+    keystore.AddWatchOnly(p2pkh);
+    keystore.AddWatchOnly(nonstandard);
+    BOOST_CHECK(IsMine(keystore, p2pkh));
+    BOOST_CHECK(IsMine(keystore, nonstandard));
+    BOOST_CHECK(!IsMine(keystore, multisig));
+    BOOST_CHECK(!keystore.HaveKey(key[0].GetPubKey().GetID()));
+
+    vector<uint160> vHashes;
+    ExtractLookupHashes(p2pkh, vHashes);
+    BOOST_CHECK(vHashes.size() == 1 && vHashes[0] == key[0].GetPubKey().GetID());
+    vHashes.clear();
+    ExtractLookupHashes(multisig, vHashes);
+    BOOST_CHECK(vHashes.size() == 2 && vHashes[1] == key[1].GetPubKey().GetID());
+    vHashes.clear();
+    ExtractLookupHashes(nonstandard, vHashes);
+    BOOST_CHECK(vHashes.size() == 1 && vHashes[0] == Hash160(nonstandard));
+    vHashes.clear();
+    ExtractLookupHashes(CScript(), vHashes);
+    BOOST_CHECK(vHashes.empty());
+}
+
 BOOST_AUTO_TEST_CASE(multisig_Sign)
 {
     // Test SignSignature() (and therefore the version of Solver() that signs transactions)
@@ -59,4 +59,56 @@ BOOST_AUTO_TEST_CASE(rpc_addmultisig)
     BOOST_CHECK_THROW(addmultisig(createArgs(2, short2.c_str()), false), runtime_error);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_jsonwriter)
+{
+    // Must produce exactly what json_spirit does
+    Object inner;
+    inner.push_back(Pair("str", string("quote\" backslash\\ tab\t nl\n ctl\x01 high\xe9")));
+    inner.push_back(Pair("int", -42));
+    inner.push_back(Pair("int64", (boost::int64_t)-9000000000000000000LL));
+    inner.push_back(Pair("uint64", (boost::uint64_t)18000000000000000000ULL));
+    inner.push_back(Pair("real", 1.5));
+    inner.push_back(Pair("amount", ValueFromAmount(123456789)));
+    inner.push_back(Pair("bool", true));
+    inner.push_back(Pair("null", Value::null));
+    inner.push_back(Pair("empty", Array()));
+    Array arr;
+    arr.push_back(inner);
+    arr.push_back(Object());
+    arr.push_back("x");
+    Object outer;
+    outer.push_back(Pair("result", arr));
+    outer.push_back(Pair("id", 1));
+
+    ostringstream ss;
+    CJSONWriter writer(ss);
+    writer.Write(Value(outer));
+    BOOST_CHECK_EQUAL(ss.str(), write_string(Value(outer), false));
+
+    // Built piece by piece
+    ostringstream ss2;
+    CJSONWriter writer2(ss2);
+    writer2.BeginObject();
+    writer2.Key("result");
+    writer2.BeginArray();
+    writer2.Write(inner);
+    writer2.BeginObject();
+    writer2.EndObject();
+    writer2.Write("x");
+    writer2.EndArray();
+    writer2.Pair("id", 1);
+    writer2.EndObject();
+    BOOST_CHECK_EQUAL(ss2.str(), ss.str());
+
+    // With a result rendered beforehand, as locked streamed commands do
+    ostringstream ss3;
+    CJSONWriter writer3(ss3);
+    writer3.BeginObject();
+    writer3.Key("result");
+    writer3.WriteJSON(write_string(Value(arr), false));
+    writer3.Pair("id", 1);
+    writer3.EndObject();
+    BOOST_CHECK_EQUAL(ss3.str(), ss.str());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
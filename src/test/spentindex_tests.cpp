@@ -0,0 +1,123 @@
+#include <boost/test/unit_test.hpp>
+
+#include "base58.h"
+#include "bitcoinrpc.h"
+#include "db.h"
+#include "main.h"
+#include "spentindex.h"
+
+using namespace std;
+using namespace json_spirit;
+
+extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry, bool fSpentInfo);
+
+BOOST_AUTO_TEST_SUITE(spentindex_tests)
+
+BOOST_AUTO_TEST_CASE(spentindex_value_serialization)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CKeyID keyID = key.GetPubKey().GetID();
+
+    CSpentIndexValue spent;
+    spent.txid = GetRandHash();
+    spent.nIn = 3;
+    spent.nHeight = 12345;
+    spent.nValue = 42 * COIN;
+    BOOST_CHECK(spent.addr.Set(CTxDestination(keyID)));
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << spent;
+    BOOST_CHECK_EQUAL(ss.size(), 32U + 4 + 4 + 8 + 1 + 20);
+
+    CSpentIndexValue spent2;
+    ss >> spent2;
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK(spent2.txid == spent.txid);
+    BOOST_CHECK_EQUAL(spent2.nIn, 3U);
+    BOOST_CHECK_EQUAL(spent2.nHeight, 12345);
+    BOOST_CHECK_EQUAL(spent2.nValue, 42 * COIN);
+    BOOST_CHECK_EQUAL(spent2.addr.nType, CAddrIndexKey::KEYID);
+    BOOST_CHECK(spent2.addr.Get() == CTxDestination(keyID));
+}
+
+BOOST_AUTO_TEST_CASE(spentindex_txtojson)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CKeyID keyID = key.GetPubKey().GetID();
+
+    CTransaction txPrev;
+    txPrev.vin.resize(1);
+    txPrev.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txPrev.vout.resize(2);
+    txPrev.vout[0].nValue = 5 * COIN;
+    txPrev.vout[0].scriptPubKey.SetDestination(keyID);
+    txPrev.vout[1].nValue = 7 * COIN;
+    txPrev.vout[1].scriptPubKey.SetDestination(keyID);
+    uint256 hashPrev = txPrev.GetHash();
+
+    // Output 0 spent in a block, as recorded in the spent index
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(hashPrev, 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 4 * COIN;
+
+    CSpentIndexValue spent;
+    spent.txid = tx.GetHash();
+    spent.nIn = 0;
+    spent.nHeight = 100;
+    spent.nValue = 5 * COIN;
+    spent.addr.Set(CTxDestination(keyID));
+
+    bool fSpentIndexSave = fSpentIndex;
+    fSpentIndex = true;
+    {
+        CTxDB txdb("r+");
+        BOOST_CHECK(txdb.WriteSpentIndex(COutPoint(hashPrev, 0), spent));
+    }
+
+    // Output 1 spent by a memory pool transaction
+    CTransaction txPool;
+    txPool.vin.resize(1);
+    txPool.vin[0].prevout = COutPoint(hashPrev, 1);
+    txPool.vout.resize(1);
+    txPool.vout[0].nValue = 6 * COIN;
+    BOOST_CHECK(mempool.addUnchecked(txPool.GetHash(), txPool));
+
+    Object entry;
+    TxToJSON(txPrev, 0, entry, true);
+    const Array& vout = find_value(entry, "vout").get_array();
+    BOOST_CHECK_EQUAL(vout.size(), 2U);
+    const Object& out0 = vout[0].get_obj();
+    BOOST_CHECK_EQUAL(find_value(out0, "spentTxId").get_str(), tx.GetHash().GetHex());
+    BOOST_CHECK_EQUAL(find_value(out0, "spentIndex").get_int(), 0);
+    BOOST_CHECK_EQUAL(find_value(out0, "spentHeight").get_int(), 100);
+    const Object& out1 = vout[1].get_obj();
+    BOOST_CHECK_EQUAL(find_value(out1, "spentTxId").get_str(), txPool.GetHash().GetHex());
+    BOOST_CHECK_EQUAL(find_value(out1, "spentIndex").get_int(), 0);
+    BOOST_CHECK(find_value(out1, "spentHeight").type() == null_type);
+
+    // The spending transaction's input shows what it spent, from the same record
+    Object entrySpend;
+    TxToJSON(tx, 0, entrySpend, true);
+    const Object& in0 = find_value(entrySpend, "vin").get_array()[0].get_obj();
+    BOOST_CHECK_EQUAL(find_value(in0, "value").get_real(), 5.0);
+    BOOST_CHECK_EQUAL(find_value(in0, "address").get_str(), CBitcoinAddress(keyID).ToString());
+
+    // Nothing is looked up without spent info
+    Object entryPlain;
+    TxToJSON(txPrev, 0, entryPlain, false);
+    const Object& outPlain = find_value(entryPlain, "vout").get_array()[0].get_obj();
+    BOOST_CHECK(find_value(outPlain, "spentTxId").type() == null_type);
+
+    mempool.remove(txPool);
+    {
+        CTxDB txdb("r+");
+        BOOST_CHECK(txdb.EraseSpentIndex(COutPoint(hashPrev, 0)));
+    }
+    fSpentIndex = fSpentIndexSave;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
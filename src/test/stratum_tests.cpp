@@ -0,0 +1,57 @@
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "stratum.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(stratum_tests)
+
+BOOST_AUTO_TEST_CASE(stratum_coinbase_split)
+{
+    CBlock block;
+    CTransaction txCoinbase;
+    txCoinbase.vin.resize(1);
+    txCoinbase.vin[0].prevout.SetNull();
+    txCoinbase.vout.resize(1);
+    txCoinbase.vout[0].nValue = 50 * COIN;
+    block.vtx.push_back(txCoinbase);
+
+    vector<unsigned char> vchCoinb1, vchCoinb2;
+    StratumCoinbaseSplit(&block, 12345, vchCoinb1, vchCoinb2);
+
+    // Whatever the miner fills in lands in the scriptSig right after the height
+    vector<unsigned char> vchExtraNonce;
+    for (unsigned int i = 0; i < STRATUM_EXTRANONCE1_SIZE + STRATUM_EXTRANONCE2_SIZE; i++)
+        vchExtraNonce.push_back(i + 1);
+    vector<unsigned char> vchCoinbase(vchCoinb1);
+    vchCoinbase.insert(vchCoinbase.end(), vchExtraNonce.begin(), vchExtraNonce.end());
+    vchCoinbase.insert(vchCoinbase.end(), vchCoinb2.begin(), vchCoinb2.end());
+
+    CTransaction tx;
+    CDataStream ss(vchCoinbase, SER_NETWORK, PROTOCOL_VERSION);
+    ss >> tx;
+    BOOST_CHECK(tx.IsCoinBase());
+    BOOST_CHECK(tx.vin[0].scriptSig == (CScript() << 12345 << vchExtraNonce) + COINBASE_FLAGS);
+    BOOST_CHECK_EQUAL(tx.vout[0].nValue, 50 * COIN);
+
+    // The merkle branch of the template leads to the same root for the miner's coinbase
+    block.vtx[0] = tx;
+    uint256 hashRoot = block.BuildMerkleTree();
+    BOOST_CHECK(CBlock::CheckMerkleBranch(Hash(vchCoinbase.begin(), vchCoinbase.end()), block.GetMerkleBranch(0), 0) == hashRoot);
+}
+
+BOOST_AUTO_TEST_CASE(stratum_share_target)
+{
+    CBigNum bnDiff1 = CBigNum().SetCompact(0x1d00ffff);
+    BOOST_CHECK(StratumShareTarget(1.0) == bnDiff1.getuint256());
+    CBigNum bnHalf = bnDiff1 / 2;
+    BOOST_CHECK(StratumShareTarget(2.0) == bnHalf.getuint256());
+    CBigNum bnDouble = bnDiff1 * 2;
+    BOOST_CHECK(StratumShareTarget(0.5) == bnDouble.getuint256());
+
+    // Out of range requests are clamped
+    BOOST_CHECK(StratumShareTarget(0) == StratumShareTarget(STRATUM_MIN_DIFFICULTY));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,5 +1,8 @@
 #include <boost/test/unit_test.hpp>
 
+#include "base58.h"
+#include "db.h"
+#include "init.h"
 #include "main.h"
 #include "wallet.h"
 
@@ -292,4 +295,62 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     }
 }
 
+BOOST_AUTO_TEST_CASE(keypool_drain_tests)
+{
+    // A small pool is refilled in the background while it is drained;
+    // every key handed out must still be a new one
+    mapArgs["-keypool"] = "5";
+    CPubKey defaultKey;
+    BOOST_CHECK(pwalletMain->GetKeyFromPool(defaultKey, false));
+    BOOST_CHECK(pwalletMain->SetDefaultKey(defaultKey));
+
+    set<CKeyID> setKeys;
+    for (int i = 0; i < 100; i++)
+    {
+        CPubKey key;
+        BOOST_CHECK(pwalletMain->GetKeyFromPool(key, true));
+        BOOST_CHECK(key != defaultKey);
+        BOOST_CHECK(setKeys.insert(key.GetID()).second);
+    }
+    mapArgs.erase("-keypool");
+}
+
+BOOST_AUTO_TEST_CASE(parse_dump_line_tests)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    bool fCompressed;
+    CSecret secret = key.GetSecret(fCompressed);
+    string strSecret = CBitcoinSecret(secret, fCompressed).ToString();
+    string strTime = "2013-04-01T12:00:00Z";
+
+    CImportedKey imported;
+    BOOST_CHECK(ParseDumpLine(strSecret + " " + strTime + " label=" + EncodeDumpString("my label") + " # addr=x", imported));
+    BOOST_CHECK(imported.secret == secret);
+    BOOST_CHECK(imported.fCompressed);
+    BOOST_CHECK_EQUAL(imported.nCreateTime, 1364817600);
+    BOOST_CHECK(imported.fLabel);
+    BOOST_CHECK_EQUAL(imported.strLabel, "my label");
+
+    CImportedKey change;
+    BOOST_CHECK(ParseDumpLine(strSecret + " " + strTime + " change=1 # addr=x", change));
+    BOOST_CHECK(!change.fLabel);
+
+    CImportedKey reserve;
+    BOOST_CHECK(ParseDumpLine(strSecret + " " + strTime + " reserve=1 # label=ignored", reserve));
+    BOOST_CHECK(!reserve.fLabel);
+    BOOST_CHECK(reserve.strLabel.empty());
+
+    // Key without any flags gets an (empty) address book entry
+    CImportedKey plain;
+    BOOST_CHECK(ParseDumpLine(strSecret + " " + strTime, plain));
+    BOOST_CHECK(plain.fLabel);
+
+    CImportedKey none;
+    BOOST_CHECK(!ParseDumpLine("", none));
+    BOOST_CHECK(!ParseDumpLine("# Wallet dump created by DeOxyRibose", none));
+    BOOST_CHECK(!ParseDumpLine(strSecret, none));
+    BOOST_CHECK(!ParseDumpLine("notakey " + strTime + " change=1", none));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
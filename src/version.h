@@ -25,7 +25,7 @@ extern const std::string CLIENT_DATE;
 // network protocol versioning
 //
 
-static const int PROTOCOL_VERSION = 1002000;
+static const int PROTOCOL_VERSION = 1002001;
 
 // intial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 10;
@@ -47,4 +47,7 @@ static const int BIP0031_VERSION = 1000000;
 // "mempool" command, enhanced "getdata" behavior starts with this version:
 static const int MEMPOOL_GD_VERSION = 1000000;
 
+// "feefilter" command, telling peers which fee rate to bother announcing, starts with this version
+static const int FEEFILTER_VERSION = 1002001;
+
 #endif
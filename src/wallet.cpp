@@ -11,6 +11,7 @@
 #include "base58.h"
 #include "kernel.h"
 #include "coincontrol.h"
+#include "eventserver.h"
 
 #include <boost/algorithm/string.hpp>
 
@@ -86,6 +87,35 @@ bool CWallet::AddCryptedKey(const CPubKey &vchPubKey, const vector<unsigned char
     return false;
 }
 
+bool CWallet::AddWatchOnly(const CScript& script)
+{
+    if (!CCryptoKeyStore::AddWatchOnly(script))
+        return false;
+    if (!fFileBacked)
+        return true;
+    return CWalletDB(strWalletFile).WriteWatchOnly(script);
+}
+
+void CWallet::GetLookupHashes(set<uint160>& setHashes, vector<uint256>& vTxHashes) const
+{
+    LOCK(cs_wallet);
+    set<CKeyID> setKeys;
+    GetKeys(setKeys);
+    setHashes.insert(setKeys.begin(), setKeys.end());
+    {
+        LOCK(cs_KeyStore);
+        BOOST_FOREACH(const ScriptMap::value_type& item, mapScripts)
+            setHashes.insert(item.first);
+        vector<uint160> vHashes;
+        BOOST_FOREACH(const WatchOnlyMap::value_type& item, mapWatchOnly)
+            ExtractLookupHashes(item.second, vHashes);
+        setHashes.insert(vHashes.begin(), vHashes.end());
+    }
+    vTxHashes.reserve(mapWallet.size());
+    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        vTxHashes.push_back((*it).first);
+}
+
 bool CWallet::LoadKeyMetadata(const CPubKey &pubkey, const CKeyMetadata &meta)
 {
     if (meta.nCreateTime && (!nTimeFirstKey || meta.nCreateTime < nTimeFirstKey))
@@ -399,6 +429,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn)
         bool fInsertedNew = ret.second;
         if (fInsertedNew)
         {
+            AddWalletTxLookup(this, hash);
             wtx.nTimeReceived = GetAdjustedTime();
             wtx.nOrderPos = IncOrderPosNext();
 
@@ -501,6 +532,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn)
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
+        PublishWalletTransactionEvent(hash);
 
 		// notify an external script when a wallet transaction comes in or is updated
         std::string strCmd = GetArg("-walletnotify", "");
@@ -545,7 +577,10 @@ bool CWallet::EraseFromWallet(uint256 hash)
     {
         LOCK(cs_wallet);
         if (mapWallet.erase(hash))
+        {
+            EraseWalletTxLookup(this, hash);
             CWalletDB(strWalletFile).EraseTx(hash);
+        }
     }
     return true;
 }
@@ -914,6 +949,8 @@ void CWalletTx::RelayWalletTransaction(CTxDB& txdb)
         if (!txdb.ContainsTx(hash))
         {
             printf("Relaying wtx %s\n", hash.ToString().substr(0,10).c_str());
+            if (fFromMe)
+                MarkLocalTransaction(hash);
             RelayMessage(CInv(MSG_TX, hash), (CTransaction)*this);
         }
     }
@@ -1956,43 +1993,276 @@ bool CWallet::NewKeyPool()
             return false;
 
         int64 nKeys = max(GetArg("-keypool", 100), (int64)0);
-        for (int i = 0; i < nKeys; i++)
-        {
-            int64 nIndex = i+1;
-            walletdb.WritePool(nIndex, CKeyPool(GenerateNewKey()));
-            setKeyPool.insert(nIndex);
-        }
+        if (!AddKeysToPool(walletdb, nKeys, 1))
+            return false;
         printf("CWallet::NewKeyPool wrote %"PRI64d" new keys\n", nKeys);
     }
     return true;
 }
 
-bool CWallet::TopUpKeyPool()
+// Worker for AddNewKeys: makes keys [nBegin, nEnd), from the secrets of
+// *pvImport or new ones, and, if the wallet is encrypted, their encrypted secrets
+static void MakeKeyRange(const vector<CImportedKey>* pvImport, vector<CKey>* pvKeys,
+                         vector<vector<unsigned char> >* pvCrypted, const CKeyingMaterial* pMasterKey,
+                         bool fCompressed, unsigned int nBegin, unsigned int nEnd, char* pfOk)
 {
+    CKeyingMaterial vMasterKey;
+    if (pMasterKey)
+        vMasterKey = *pMasterKey;
+    for (unsigned int i = nBegin; i < nEnd; i++)
+    {
+        CKey& key = (*pvKeys)[i];
+        if (!pvImport)
+            key.MakeNewKey(fCompressed);
+        else if (!key.SetSecret((*pvImport)[i].secret, (*pvImport)[i].fCompressed))
+            return;
+        if (pMasterKey)
+        {
+            bool fKeyCompressed;
+            if (!EncryptSecret(vMasterKey, key.GetSecret(fKeyCompressed), key.GetPubKey().GetHash(), (*pvCrypted)[i]))
+                return;
+        }
+    }
+    *pfOk = true;
+}
+
+// Add nKeys new keys to the key pool at nFirstIndex onwards or, with pvImport
+// set, the keys of *pvImport the wallet doesn't have yet.  The expensive
+// part, making the keys and encrypting their secrets, runs on as many threads
+// as there are cores without cs_wallet held.  All keys are written in a
+// single database transaction that is committed before any of them reaches
+// the keystore, so a failed write or commit leaves no keys in memory that
+// are missing from wallet.dat.  The pool indexes are settled under cs_wallet
+// when the keys are written, so concurrent callers don't collide.  vAddedRet
+// gets the position and id of every key added.
+bool CWallet::AddNewKeys(CWalletDB& walletdb, const vector<CImportedKey>* pvImport, unsigned int nKeys,
+                         int64 nFirstIndex, vector<pair<unsigned int, CKeyID> >& vAddedRet)
+{
+    if (nKeys == 0)
+        return true;
+
+    bool fCompressed;
+    bool fCrypted;
+    CKeyingMaterial vMasterKey;
     {
         LOCK(cs_wallet);
-
         if (IsLocked())
             return false;
+        fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY); // default to compressed public keys if we want 0.6.0 wallets
+        fCrypted = IsCrypted();
+        if (fCrypted && !GetMasterKey(vMasterKey))
+            return false;
+    }
 
-        CWalletDB walletdb(strWalletFile);
+    if (!pvImport)
+        RandAddSeedPerfmon();
+    vector<CKey> vKeys(nKeys);
+    vector<vector<unsigned char> > vCrypted(fCrypted ? nKeys : 0);
+    unsigned int nThreads = max(1U, min(boost::thread::hardware_concurrency(), 8U));
+    if (nKeys < 16 * nThreads)
+        nThreads = 1;
+    vector<char> vOk(nThreads, false);
+    if (nThreads == 1)
+        MakeKeyRange(pvImport, &vKeys, &vCrypted, fCrypted ? &vMasterKey : NULL, fCompressed, 0, nKeys, &vOk[0]);
+    else
+    {
+        boost::thread_group threads;
+        for (unsigned int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&MakeKeyRange, pvImport, &vKeys, &vCrypted, fCrypted ? &vMasterKey : NULL, fCompressed,
+                                              nKeys * i / nThreads, nKeys * (i + 1) / nThreads, &vOk[i]));
+        threads.join_all();
+    }
+    BOOST_FOREACH(char fOk, vOk)
+        if (!fOk)
+            return error("CWallet::AddNewKeys() : making or encrypting key failed");
 
-        // Top up key pool
-        unsigned int nTargetSize = max(GetArg("-keypool", 100), 0LL);
-        while (setKeyPool.size() < (nTargetSize + 1))
+    LOCK(cs_wallet);
+    // Encrypted or decrypted meanwhile: the keys don't fit anymore
+    if (IsCrypted() != fCrypted)
+        return false;
+    if (!pvImport)
+    {
+        if (!setKeyPool.empty() && *(--setKeyPool.end()) >= nFirstIndex)
+            nFirstIndex = *(--setKeyPool.end()) + 1;
+        if (fCompressed)
+            SetMinVersion(FEATURE_COMPRPUBKEY);
+    }
+
+    bool fTxn = walletdb.TxnBegin();
+    int64 nCreationTime = GetTime();
+    set<CKeyID> setBatch;
+    vector<pair<unsigned int, CKeyID> > vAdded;
+    for (unsigned int i = 0; i < nKeys; i++)
+    {
+        const CKey& key = vKeys[i];
+        CPubKey pubkey = key.GetPubKey();
+        CKeyID keyid = pubkey.GetID();
+        if (pvImport && (HaveKey(keyid) || !setBatch.insert(keyid).second))
         {
-            int64 nEnd = 1;
+            printf("Skipping import of %s (key already present)\n", CBitcoinAddress(keyid).ToString().c_str());
+            continue;
+        }
+
+        CKeyMetadata meta(pvImport ? (*pvImport)[i].nCreateTime : nCreationTime);
+        bool fWritten;
+        if (fCrypted)
+            fWritten = walletdb.WriteCryptedKey(pubkey, vCrypted[i], meta);
+        else
+            fWritten = walletdb.WriteKey(pubkey, key.GetPrivKey(), meta);
+        if (!pvImport)
+            fWritten = fWritten && walletdb.WritePool(nFirstIndex + i, CKeyPool(pubkey));
+        else if (fWritten && (*pvImport)[i].fLabel)
+        {
+            // Through walletdb rather than SetAddressBookName, which
+            // would write outside of the transaction
+            fWritten = walletdb.WriteName(CBitcoinAddress(keyid).ToString(), (*pvImport)[i].strLabel);
+        }
+        if (!fWritten)
+        {
+            if (fTxn)
+                walletdb.TxnAbort();
+            return error("CWallet::AddNewKeys() : writing key failed");
+        }
+        vAdded.push_back(make_pair(i, keyid));
+    }
+    if (fTxn && !walletdb.TxnCommit())
+        return error("CWallet::AddNewKeys() : committing keys failed");
+
+    for (unsigned int j = 0; j < vAdded.size(); j++)
+    {
+        unsigned int i = vAdded[j].first;
+        CPubKey pubkey = vKeys[i].GetPubKey();
+        mapKeyMetadata[vAdded[j].second] = CKeyMetadata(pvImport ? (*pvImport)[i].nCreateTime : nCreationTime);
+        bool fAdded;
+        if (fCrypted)
+            fAdded = CCryptoKeyStore::AddCryptedKey(pubkey, vCrypted[i]);
+        else
+            fAdded = CCryptoKeyStore::AddKey(vKeys[i]);
+        if (!fAdded)
+            return error("CWallet::AddNewKeys() : adding key failed");
+        if (!pvImport)
+            setKeyPool.insert(nFirstIndex + i);
+    }
+    if (!pvImport && (!nTimeFirstKey || nCreationTime < nTimeFirstKey))
+        nTimeFirstKey = nCreationTime;
+    vAddedRet.insert(vAddedRet.end(), vAdded.begin(), vAdded.end());
+    return true;
+}
+
+// Generate nKeys new keys and add them to the key pool at nFirstIndex
+// onwards, see AddNewKeys.  Top-ups hold cs_KeyPoolTopUp only so that two
+// of them don't fill the same gap.  Call with cs_wallet not held, unless the
+// caller is fine with keeping the wallet locked meanwhile.
+bool CWallet::AddKeysToPool(CWalletDB& walletdb, unsigned int nKeys, int64 nFirstIndex)
+{
+    vector<pair<unsigned int, CKeyID> > vAdded;
+    return AddNewKeys(walletdb, NULL, nKeys, nFirstIndex, vAdded);
+}
+
+// Add the keys of vImport the wallet doesn't have yet, with their creation
+// times and labels, see AddNewKeys.  nImported is increased by the number of
+// keys added, and nTimeBegin lowered to the earliest creation time among them.
+bool CWallet::ImportKeys(CWalletDB& walletdb, const vector<CImportedKey>& vImport, unsigned int& nImported, int64& nTimeBegin)
+{
+    vector<pair<unsigned int, CKeyID> > vAdded;
+    if (!AddNewKeys(walletdb, &vImport, vImport.size(), 0, vAdded))
+        return false;
+
+    LOCK(cs_wallet);
+    nImported += vAdded.size();
+    for (unsigned int j = 0; j < vAdded.size(); j++)
+    {
+        const CImportedKey& imported = vImport[vAdded[j].first];
+        nTimeBegin = min(nTimeBegin, imported.nCreateTime);
+        if (!imported.fLabel)
+            continue;
+        CTxDestination address = vAdded[j].second;
+        std::map<CTxDestination, std::string>::iterator mi = mapAddressBook.find(address);
+        ChangeType status = (mi == mapAddressBook.end()) ? CT_NEW : CT_UPDATED;
+        mapAddressBook[address] = imported.strLabel;
+        NotifyAddressBookChanged(this, address, imported.strLabel, true, status);
+    }
+    return true;
+}
+
+bool CWallet::TopUpKeyPool()
+{
+    // A top-up is already running; never wait for it, the caller may hold
+    // cs_wallet which that top-up needs to finish.  That is fine while the
+    // pool still has keys, but an empty pool gets a key made right here, or
+    // the caller would fall back to reusing the default key.
+    TRY_LOCK(cs_KeyPoolTopUp, lockTopUp);
+    if (!lockTopUp)
+    {
+        {
+            LOCK(cs_wallet);
+            if (IsLocked())
+                return false;
             if (!setKeyPool.empty())
-                nEnd = *(--setKeyPool.end()) + 1;
-            if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey())))
-                throw runtime_error("TopUpKeyPool() : writing generated key failed");
-            setKeyPool.insert(nEnd);
-            printf("keypool added key %"PRI64d", size=%"PRIszu"\n", nEnd, setKeyPool.size());
+                return true;
         }
+        CWalletDB walletdb(strWalletFile);
+        return AddKeysToPool(walletdb, 1, 1);
+    }
+
+    unsigned int nMissing;
+    int64 nFirstIndex;
+    {
+        LOCK(cs_wallet);
+
+        if (IsLocked())
+            return false;
+
+        unsigned int nTargetSize = max(GetArg("-keypool", 100), 0LL);
+        if (setKeyPool.size() >= nTargetSize + 1)
+            return true;
+        nMissing = nTargetSize + 1 - setKeyPool.size();
+        nFirstIndex = setKeyPool.empty() ? 1 : *(--setKeyPool.end()) + 1;
     }
+
+    CWalletDB walletdb(strWalletFile);
+    if (!AddKeysToPool(walletdb, nMissing, nFirstIndex))
+        return false;
+    printf("keypool added %u keys from %"PRI64d", size=%"PRIszu"\n", nMissing, nFirstIndex, setKeyPool.size());
     return true;
 }
 
+// Refill the key pool on a separate thread, so whoever took the key that
+// crossed the low-water mark does not wait for a whole batch
+void CWallet::RequestKeyPoolRefill()
+{
+    {
+        LOCK(cs_wallet);
+        if (fKeyPoolRefillPending || IsLocked())
+            return;
+        fKeyPoolRefillPending = true;
+    }
+    if (!NewThread(ThreadTopUpKeyPool, this))
+    {
+        LOCK(cs_wallet);
+        fKeyPoolRefillPending = false;
+    }
+}
+
+void ThreadTopUpKeyPool(void* parg)
+{
+    // Make this thread recognisable as the key-topping-up thread
+    RenameThread("bitcoin-key-top");
+
+    CWallet* pwallet = (CWallet*)parg;
+    try
+    {
+        pwallet->TopUpKeyPool();
+    }
+    catch (std::exception& e) {
+        PrintExceptionContinue(&e, "ThreadTopUpKeyPool()");
+    }
+    {
+        LOCK(pwallet->cs_wallet);
+        pwallet->fKeyPoolRefillPending = false;
+    }
+}
+
 void CWallet::ReserveKeyFromKeyPool(int64& nIndex, CKeyPool& keypool)
 {
     nIndex = -1;
@@ -2000,8 +2270,15 @@ void CWallet::ReserveKeyFromKeyPool(int64& nIndex, CKeyPool& keypool)
     {
         LOCK(cs_wallet);
 
+        // Only an empty pool is filled on the spot; once it runs below half
+        // of -keypool it is refilled in the background
         if (!IsLocked())
-            TopUpKeyPool();
+        {
+            if (setKeyPool.empty())
+                TopUpKeyPool();
+            else if (setKeyPool.size() <= (unsigned int)max(GetArg("-keypool", 100), 0LL) / 2)
+                RequestKeyPoolRefill();
+        }
 
         // Get the oldest key
         if(setKeyPool.empty())
@@ -2420,3 +2697,137 @@ void CWallet::UpdatedTransaction(const uint256 &hashTx)
             NotifyTransactionChanged(this, hashTx, CT_UPDATED);
     }
 }
+
+CCriticalSection cs_mapLoadedWallets;
+map<string, CWallet*> mapLoadedWallets;
+
+CWallet* LoadAdditionalWallet(const string& strFile, bool fWatchOnly, string& strError)
+{
+    LOCK(cs_mapLoadedWallets);
+    if (strFile.empty() || strFile.find_first_of("/\\:") != string::npos ||
+        strFile == "wallet.dat" || strFile == "blkindex.dat" || strFile == "addr.dat")
+    {
+        strError = "Invalid wallet file name";
+        return NULL;
+    }
+    if (mapLoadedWallets.count(strFile))
+    {
+        strError = "Wallet is already loaded";
+        return NULL;
+    }
+
+    printf("Loading wallet %s...\n", strFile.c_str());
+    int64 nStart = GetTimeMillis();
+    bool fFirstRun = true;
+    CWallet* pwallet = new CWallet(strFile);
+    DBErrors nLoadWalletRet = pwallet->LoadWallet(fFirstRun);
+    if (nLoadWalletRet != DB_LOAD_OK && nLoadWalletRet != DB_NONCRITICAL_ERROR)
+    {
+        if (nLoadWalletRet == DB_CORRUPT)
+            strError = "Wallet corrupted";
+        else if (nLoadWalletRet == DB_TOO_NEW)
+            strError = "Wallet requires newer version of DeOxyRibose";
+        else
+            strError = "Error loading wallet";
+        delete pwallet;
+        return NULL;
+    }
+
+    if (fFirstRun)
+    {
+        pwallet->SetMinVersion(FEATURE_LATEST);
+
+        // A watch-only wallet gets no keys at all, only scripts imported later
+        if (!fWatchOnly)
+        {
+            RandAddSeedPerfmon();
+            CPubKey newDefaultKey;
+            if (!pwallet->GetKeyFromPool(newDefaultKey, false))
+            {
+                strError = "Cannot initialize keypool";
+                delete pwallet;
+                return NULL;
+            }
+            pwallet->SetDefaultKey(newDefaultKey);
+            pwallet->SetAddressBookName(pwallet->vchDefaultKey.GetID(), "");
+        }
+    }
+
+    {
+        // Only the blocks since the wallet was last synced are scanned, and
+        // nothing can be connected before it is registered
+        LOCK(cs_main);
+        CBlockIndex* pindexRescan = pindexBest;
+        CBlockLocator locator;
+        if (CWalletDB(strFile).ReadBestBlock(locator))
+            pindexRescan = locator.GetBlockIndex();
+        else if (!fFirstRun)
+            pindexRescan = pindexGenesisBlock;
+        if (pindexBest && pindexRescan && pindexBest->nHeight > pindexRescan->nHeight)
+        {
+            printf("Rescanning last %i blocks (from block %i) for %s...\n", pindexBest->nHeight - pindexRescan->nHeight,
+                   pindexRescan->nHeight, strFile.c_str());
+            pwallet->ScanForWalletTransactions(pindexRescan, true);
+        }
+        RegisterWallet(pwallet);
+        if (pindexBest)
+            pwallet->SetBestChain(CBlockLocator(pindexBest));
+        pwallet->ReacceptWalletTransactions();
+    }
+
+    mapLoadedWallets[strFile] = pwallet;
+    printf(" wallet %s %15"PRI64d"ms\n", strFile.c_str(), GetTimeMillis() - nStart);
+    return pwallet;
+}
+
+bool UnloadAdditionalWallet(const string& strFile)
+{
+    LOCK(cs_mapLoadedWallets);
+    map<string, CWallet*>::iterator mi = mapLoadedWallets.find(strFile);
+    if (mi == mapLoadedWallets.end())
+        return false;
+    CWallet* pwallet = (*mi).second;
+
+    {
+        LOCK(cs_main);
+        if (pindexBest)
+            pwallet->SetBestChain(CBlockLocator(pindexBest));
+        UnregisterWallet(pwallet);
+    }
+    // A key pool refill may still be running on its own thread
+    while (true)
+    {
+        {
+            LOCK(pwallet->cs_wallet);
+            if (!pwallet->fKeyPoolRefillPending)
+                break;
+        }
+        Sleep(50);
+    }
+    mapLoadedWallets.erase(mi);
+    delete pwallet;
+
+    // Flush the file so it is self contained and can be moved away
+    {
+        LOCK(bitdb.cs_db);
+        map<string, int>::iterator mic = bitdb.mapFileUseCount.find(strFile);
+        if (mic != bitdb.mapFileUseCount.end() && (*mic).second == 0)
+        {
+            bitdb.CloseDb(strFile);
+            bitdb.CheckpointLSN(strFile);
+            bitdb.mapFileUseCount.erase(mic);
+        }
+    }
+    printf("Unloaded wallet %s\n", strFile.c_str());
+    return true;
+}
+
+void UnloadAdditionalWallets()
+{
+    LOCK(cs_mapLoadedWallets);
+    while (!mapLoadedWallets.empty())
+    {
+        string strFile = (*mapLoadedWallets.begin()).first;
+        UnloadAdditionalWallet(strFile);
+    }
+}
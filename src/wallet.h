@@ -63,6 +63,19 @@ public:
     )
 };
 
+/** Key read from a wallet dump, added by CWallet::ImportKeys */
+class CImportedKey
+{
+public:
+    CSecret secret;
+    bool fCompressed;
+    int64 nCreateTime;
+    bool fLabel;            // set the address book entry to strLabel
+    std::string strLabel;
+
+    CImportedKey() : fCompressed(false), nCreateTime(0), fLabel(false) {}
+};
+
 /** A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
  */
@@ -73,12 +86,25 @@ private:
 
     CWalletDB *pwalletdbEncryption;
 
+    // serializes key pool top-ups, which generate keys without cs_wallet
+    CCriticalSection cs_KeyPoolTopUp;
+    bool fKeyPoolRefillPending;
+    bool AddNewKeys(CWalletDB& walletdb, const std::vector<CImportedKey>* pvImport, unsigned int nKeys,
+                    int64 nFirstIndex, std::vector<std::pair<unsigned int, CKeyID> >& vAddedRet);
+    bool AddKeysToPool(CWalletDB& walletdb, unsigned int nKeys, int64 nFirstIndex);
+    friend void ThreadTopUpKeyPool(void* parg);
+
     // the current wallet version: clients below this version are not able to load the wallet
     int nWalletVersion;
 
     // the maximum wallet format version: memory-only variable that specifies to what version this wallet may be upgraded
     int nWalletMaxVersion;
 
+    friend bool UnloadAdditionalWallet(const std::string& strFile);
+
+protected:
+    void AddedToKeyStore(const uint160& hash) { AddWalletLookup(this, hash); }
+
 public:
     mutable CCriticalSection cs_wallet;
 
@@ -101,6 +127,7 @@ public:
         fFileBacked = false;
         nMasterKeyMaxID = 0;
         pwalletdbEncryption = NULL;
+        fKeyPoolRefillPending = false;
         nOrderPosNext = 0;
 		fWalletUnlockMintOnly = false;
     }
@@ -112,6 +139,7 @@ public:
         fFileBacked = true;
         nMasterKeyMaxID = 0;
         pwalletdbEncryption = NULL;
+        fKeyPoolRefillPending = false;
         nOrderPosNext = 0;
 		fWalletUnlockMintOnly = false;
     }
@@ -137,6 +165,8 @@ public:
     bool AddKey(const CKey& key);
     // Adds a key to the store, without saving it to disk (used by LoadWallet)
     bool LoadKey(const CKey& key) { return CCryptoKeyStore::AddKey(key); }
+    // Adds a batch of keys from a wallet dump in a single database transaction
+    bool ImportKeys(CWalletDB& walletdb, const std::vector<CImportedKey>& vImport, unsigned int& nImported, int64& nTimeBegin);
     // Load metadata (used by LoadWallet)
     bool LoadKeyMetadata(const CPubKey &pubkey, const CKeyMetadata &metadata);
 
@@ -148,6 +178,12 @@ public:
     bool LoadCryptedKey(const CPubKey &vchPubKey, const std::vector<unsigned char> &vchCryptedSecret) { SetMinVersion(FEATURE_WALLETCRYPT); return CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret); }
     bool AddCScript(const CScript& redeemScript);
     bool LoadCScript(const CScript& redeemScript) { return CCryptoKeyStore::AddCScript(redeemScript); }
+    // Adds a watch-only script to the store, and saves it to disk.
+    bool AddWatchOnly(const CScript& script);
+    // Adds a watch-only script to the store, without saving it to disk (used by LoadWallet)
+    bool LoadWatchOnly(const CScript& script) { return CCryptoKeyStore::AddWatchOnly(script); }
+    // Everything SyncWithWallets looks this wallet up by, see RegisterWallet
+    void GetLookupHashes(std::set<uint160>& setHashes, std::vector<uint256>& vTxHashes) const;
 
     bool Unlock(const SecureString& strWalletPassphrase);
     bool ChangeWalletPassphrase(const SecureString& strOldWalletPassphrase, const SecureString& strNewWalletPassphrase);
@@ -195,6 +231,7 @@ public:
 
     bool NewKeyPool();
     bool TopUpKeyPool();
+    void RequestKeyPoolRefill();
     int64 AddReserveKey(const CKeyPool& keypool);
     void ReserveKeyFromKeyPool(int64& nIndex, CKeyPool& keypool);
     void KeepKey(int64 nIndex);
@@ -867,5 +904,16 @@ private:
 };
 
 bool GetWalletFile(CWallet* pwallet, std::string &strWalletFileOut);
+void ThreadTopUpKeyPool(void* parg);
+
+/** Wallets loaded at runtime besides pwalletMain, by file name */
+extern CCriticalSection cs_mapLoadedWallets;
+extern std::map<std::string, CWallet*> mapLoadedWallets;
+
+/** Load a wallet file from the data directory, catch it up from the block it was last synced to and register it */
+CWallet* LoadAdditionalWallet(const std::string& strFile, bool fWatchOnly, std::string& strError);
+/** Unregister and free a wallet loaded with LoadAdditionalWallet */
+bool UnloadAdditionalWallet(const std::string& strFile);
+void UnloadAdditionalWallets();
 
 #endif
@@ -414,6 +414,18 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
                 return false;
             }
         }
+        else if (strType == "watchs")
+        {
+            CScript script;
+            ssKey >> script;
+            char fYes;
+            ssValue >> fYes;
+            if (fYes == '1' && !pwallet->LoadWatchOnly(script))
+            {
+                strErr = "Error reading wallet database: LoadWatchOnly failed";
+                return false;
+            }
+        }
         else if (strType == "orderposnext")
         {
             ssValue >> pwallet->nOrderPosNext;
@@ -713,167 +725,190 @@ bool CWalletDB::Recover(CDBEnv& dbenv, std::string filename, bool fOnlyKeys)
     return fSuccess;
 }
 
+// Keys are dumped and imported in batches of this many, each under a single
+// hold of cs_wallet and, for imports, in a single database transaction
+static const unsigned int WALLET_DUMP_BATCH = 1000;
+
 bool DumpWallet(CWallet* pwallet, const string& strDest)
 {
+    if (!pwallet->fFileBacked)
+        return false;
+
+    // open outputfile as a stream
+    ofstream file;
+    file.open(strDest.c_str());
+    if (!file.is_open())
+        return false;
 
-  if (!pwallet->fFileBacked)
-      return false;
-  while (!fShutdown)
-  {
-      // Populate maps
-      std::map<CKeyID, int64> mapKeyBirth;
-      std::set<CKeyID> setKeyPool;
-      pwallet->GetKeyBirthTimes(mapKeyBirth);
-      pwallet->GetAllReserveKeys(setKeyPool);
-
-      // sort time/key pairs
-      std::vector<std::pair<int64, CKeyID> > vKeyBirth;
-      for (std::map<CKeyID, int64>::const_iterator it = mapKeyBirth.begin(); it != mapKeyBirth.end(); it++) {
-          vKeyBirth.push_back(std::make_pair(it->second, it->first));
-      }
-      mapKeyBirth.clear();
-      std::sort(vKeyBirth.begin(), vKeyBirth.end());
-
-      // open outputfile as a stream
-      ofstream file;
-      file.open(strDest.c_str());
-      if (!file.is_open())
-         return false;
-
-      // produce output
-      file << strprintf("# Wallet dump created by DeOxyRibose %s (%s)\n", CLIENT_BUILD.c_str(), CLIENT_DATE.c_str());
-      file << strprintf("# * Created on %s\n", EncodeDumpTime(GetTime()).c_str());
-      file << strprintf("# * Best block at time of backup was %i (%s),\n", nBestHeight, hashBestChain.ToString().c_str());
-      file << strprintf("# mined on %s\n", EncodeDumpTime(pindexBest->nTime).c_str());
-      file << "\n";
-      for (std::vector<std::pair<int64, CKeyID> >::const_iterator it = vKeyBirth.begin(); it != vKeyBirth.end(); it++) {
-          const CKeyID &keyid = it->second;
-          std::string strTime = EncodeDumpTime(it->first);
-          std::string strAddr = CBitcoinAddress(keyid).ToString();
-          bool IsCompressed;
-
-          CKey key;
-          if (pwallet->GetKey(keyid, key)) {
-              if (pwallet->mapAddressBook.count(keyid)) {
-                  CSecret secret = key.GetSecret(IsCompressed);
-                  file << strprintf("%s %s label=%s # addr=%s\n",
-                                    CBitcoinSecret(secret, IsCompressed).ToString().c_str(),
-                                    strTime.c_str(),
-                                    EncodeDumpString(pwallet->mapAddressBook[keyid]).c_str(),
-                                    strAddr.c_str());
-              } else if (setKeyPool.count(keyid)) {
-                  CSecret secret = key.GetSecret(IsCompressed);
-                  file << strprintf("%s %s reserve=1 # addr=%s\n",
-                                    CBitcoinSecret(secret, IsCompressed).ToString().c_str(),
-                                    strTime.c_str(),
-                                    strAddr.c_str());
-              } else {
-                  CSecret secret = key.GetSecret(IsCompressed);
-                  file << strprintf("%s %s change=1 # addr=%s\n",
-                                    CBitcoinSecret(secret, IsCompressed).ToString().c_str(),
-                                    strTime.c_str(),
-                                    strAddr.c_str());
-              }
-          }
-      }
-      file << "\n";
-      file << "# End of dump\n";
-      file.close();
-      return true;
-     }
-   return false;
+    // Only the key ids are collected up front; the secrets are looked up and
+    // written out a batch at a time
+    std::vector<std::pair<int64, CKeyID> > vKeyBirth;
+    std::set<CKeyID> setKeyPool;
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+        std::map<CKeyID, int64> mapKeyBirth;
+        pwallet->GetKeyBirthTimes(mapKeyBirth);
+        pwallet->GetAllReserveKeys(setKeyPool);
+
+        // sort time/key pairs
+        vKeyBirth.reserve(mapKeyBirth.size());
+        for (std::map<CKeyID, int64>::const_iterator it = mapKeyBirth.begin(); it != mapKeyBirth.end(); it++)
+            vKeyBirth.push_back(std::make_pair(it->second, it->first));
+
+        file << strprintf("# Wallet dump created by DeOxyRibose %s (%s)\n", CLIENT_BUILD.c_str(), CLIENT_DATE.c_str());
+        file << strprintf("# * Created on %s\n", EncodeDumpTime(GetTime()).c_str());
+        file << strprintf("# * Best block at time of backup was %i (%s),\n", nBestHeight, hashBestChain.ToString().c_str());
+        file << strprintf("# mined on %s\n", EncodeDumpTime(pindexBest->nTime).c_str());
+        file << "\n";
+    }
+    std::sort(vKeyBirth.begin(), vKeyBirth.end());
+
+    // produce output
+    for (unsigned int nBatch = 0; nBatch < vKeyBirth.size(); nBatch += WALLET_DUMP_BATCH)
+    {
+        if (fShutdown)
+            return false;
+
+        std::string strBatch;
+        {
+            LOCK(pwallet->cs_wallet);
+            // locked again since the dump started: the remaining keys can't be read
+            if (pwallet->IsLocked())
+                return false;
+
+            unsigned int nEnd = std::min(nBatch + WALLET_DUMP_BATCH, (unsigned int)vKeyBirth.size());
+            for (unsigned int i = nBatch; i < nEnd; i++) {
+                const CKeyID &keyid = vKeyBirth[i].second;
+                std::string strTime = EncodeDumpTime(vKeyBirth[i].first);
+                std::string strAddr = CBitcoinAddress(keyid).ToString();
+                bool IsCompressed;
+
+                CKey key;
+                if (!pwallet->GetKey(keyid, key))
+                    continue;
+                CSecret secret = key.GetSecret(IsCompressed);
+                std::map<CTxDestination, std::string>::const_iterator mi = pwallet->mapAddressBook.find(keyid);
+                if (mi != pwallet->mapAddressBook.end()) {
+                    strBatch += strprintf("%s %s label=%s # addr=%s\n",
+                                          CBitcoinSecret(secret, IsCompressed).ToString().c_str(),
+                                          strTime.c_str(),
+                                          EncodeDumpString(mi->second).c_str(),
+                                          strAddr.c_str());
+                } else if (setKeyPool.count(keyid)) {
+                    strBatch += strprintf("%s %s reserve=1 # addr=%s\n",
+                                          CBitcoinSecret(secret, IsCompressed).ToString().c_str(),
+                                          strTime.c_str(),
+                                          strAddr.c_str());
+                } else {
+                    strBatch += strprintf("%s %s change=1 # addr=%s\n",
+                                          CBitcoinSecret(secret, IsCompressed).ToString().c_str(),
+                                          strTime.c_str(),
+                                          strAddr.c_str());
+                }
+            }
+        }
+        file << strBatch;
+        if (!file.good())
+            return false;
+    }
+    file << "\n";
+    file << "# End of dump\n";
+    file.close();
+    return !file.fail();
 }
 
+// Parse one line of a wallet dump, returns false for lines without a key
+bool ParseDumpLine(const std::string& line, CImportedKey& imported)
+{
+    if (line.empty() || line[0] == '#')
+        return false;
+
+    std::vector<std::string> vstr;
+    boost::split(vstr, line, boost::is_any_of(" "));
+    if (vstr.size() < 2)
+        return false;
+    CBitcoinSecret vchSecret;
+    if (!vchSecret.SetString(vstr[0]))
+        return false;
+
+    imported.secret = vchSecret.GetSecret(imported.fCompressed);
+    imported.nCreateTime = DecodeDumpTime(vstr[1]);
+    imported.fLabel = true;
+    for (unsigned int nStr = 2; nStr < vstr.size(); nStr++) {
+        if (boost::algorithm::starts_with(vstr[nStr], "#"))
+            break;
+        if (vstr[nStr] == "change=1")
+            imported.fLabel = false;
+        if (vstr[nStr] == "reserve=1")
+            imported.fLabel = false;
+        if (boost::algorithm::starts_with(vstr[nStr], "label=")) {
+            imported.strLabel = DecodeDumpString(vstr[nStr].substr(6));
+            imported.fLabel = true;
+        }
+    }
+    return true;
+}
 
 bool ImportWallet(CWallet *pwallet, const string& strLocation)
 {
+    if (!pwallet->fFileBacked)
+        return false;
 
-   if (!pwallet->fFileBacked)
-       return false;
-   while (!fShutdown)
-   {
-      // open inputfile as stream
-      ifstream file;
-      file.open(strLocation.c_str());
-      if (!file.is_open())
-          return false;
-
-      int64 nTimeBegin = pindexBest->nTime;
-
-      bool fGood = true;
-
-      // read through input file checking and importing keys into wallet.
-      while (file.good()) {
-          std::string line;
-          std::getline(file, line);
-          if (line.empty() || line[0] == '#')
-              continue;
-
-          std::vector<std::string> vstr;
-          boost::split(vstr, line, boost::is_any_of(" "));
-          if (vstr.size() < 2)
-              continue;
-          CBitcoinSecret vchSecret;
-          if (!vchSecret.SetString(vstr[0]))
-              continue;
-
-          bool fCompressed;
-          CKey key;
-          CSecret secret = vchSecret.GetSecret(fCompressed);
-          key.SetSecret(secret, fCompressed);
-          CKeyID keyid = key.GetPubKey().GetID();
-
-          if (pwallet->HaveKey(keyid)) {
-              printf("Skipping import of %s (key already present)\n", CBitcoinAddress(keyid).ToString().c_str());
-             continue;
-          }
-          int64 nTime = DecodeDumpTime(vstr[1]);
-          std::string strLabel;
-          bool fLabel = true;
-          for (unsigned int nStr = 2; nStr < vstr.size(); nStr++) {
-              if (boost::algorithm::starts_with(vstr[nStr], "#"))
-                  break;
-              if (vstr[nStr] == "change=1")
-                  fLabel = false;
-              if (vstr[nStr] == "reserve=1")
-                  fLabel = false;
-              if (boost::algorithm::starts_with(vstr[nStr], "label=")) {
-                  strLabel = DecodeDumpString(vstr[nStr].substr(6));
-                  fLabel = true;
-              }
-          }
-          printf("Importing %s...\n", CBitcoinAddress(keyid).ToString().c_str());
-          if (!pwallet->AddKey(key)) {
-              fGood = false;
-              continue;
-          }
-          pwallet->mapKeyMetadata[keyid].nCreateTime = nTime;
-          if (fLabel)
-              pwallet->SetAddressBookName(keyid, strLabel);
-          nTimeBegin = std::min(nTimeBegin, nTime);
-      }
-      file.close();
-
-      // rescan block chain looking for coins from new keys
-      CBlockIndex *pindex = pindexBest;
-      while (pindex && pindex->pprev && pindex->nTime > nTimeBegin - 7200)
-          pindex = pindex->pprev;
-
-      if (!pwallet->nTimeFirstKey || nTimeBegin < pwallet->nTimeFirstKey)
-          pwallet->nTimeFirstKey = nTimeBegin;
-
-      printf("Rescanning last %i blocks\n", pindexBest->nHeight - pindex->nHeight + 1);
-      pwallet->ScanForWalletTransactions(pindex);
-      pwallet->ReacceptWalletTransactions();
-      pwallet->MarkDirty();
-
-      return fGood;
-
-  }
-
-  return false;
+    // open inputfile as stream
+    ifstream file;
+    file.open(strLocation.c_str());
+    if (!file.is_open())
+        return false;
 
+    int64 nTimeBegin;
+    {
+        LOCK(cs_main);
+        nTimeBegin = pindexBest->nTime;
+    }
+
+    // read through input file a batch of keys at a time, importing them into wallet
+    CWalletDB walletdb(pwallet->strWalletFile);
+    unsigned int nImported = 0;
+    bool fGood = true;
+    while (file.good() && !fShutdown) {
+        std::vector<CImportedKey> vImport;
+        vImport.reserve(WALLET_DUMP_BATCH);
+        while (vImport.size() < WALLET_DUMP_BATCH && file.good()) {
+            std::string line;
+            std::getline(file, line);
+            CImportedKey imported;
+            if (ParseDumpLine(line, imported))
+                vImport.push_back(imported);
+        }
+        if (!pwallet->ImportKeys(walletdb, vImport, nImported, nTimeBegin))
+            fGood = false;
+    }
+    file.close();
+    if (fShutdown)
+        return false;
+    printf("Imported %u keys from %s\n", nImported, strLocation.c_str());
+
+    // rescan block chain looking for coins from new keys, once for the whole file
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+        if (!pwallet->nTimeFirstKey || nTimeBegin < pwallet->nTimeFirstKey)
+            pwallet->nTimeFirstKey = nTimeBegin;
+        if (nImported == 0)
+            return fGood;
+
+        CBlockIndex *pindex = pindexBest;
+        while (pindex && pindex->pprev && pindex->nTime > nTimeBegin - 7200)
+            pindex = pindex->pprev;
+
+        printf("Rescanning last %i blocks\n", pindexBest->nHeight - pindex->nHeight + 1);
+        pwallet->ScanForWalletTransactions(pindex);
+        pwallet->ReacceptWalletTransactions();
+        pwallet->MarkDirty();
+    }
+
+    return fGood;
 }
+
 bool CWalletDB::Recover(CDBEnv& dbenv, std::string filename)
 {
     return CWalletDB::Recover(dbenv, filename, false);
@@ -120,6 +120,12 @@ public:
         return Write(std::make_pair(std::string("cscript"), hash), redeemScript, false);
     }
 
+    bool WriteWatchOnly(const CScript& script)
+    {
+        nWalletDBUpdated++;
+        return Write(std::make_pair(std::string("watchs"), script), '1');
+    }
+
     bool WriteBestBlock(const CBlockLocator& locator)
     {
         nWalletDBUpdated++;